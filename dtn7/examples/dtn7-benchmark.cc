@@ -0,0 +1,542 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/dtn7-helper.h"
+#include "ns3/dtn-node.h"
+#include "ns3/dtn-time.h"
+#include "ns3/bundle.h"
+#include "ns3/cbor.h"
+#include "ns3/crc.h"
+#include "ns3/memory-bundle-store.h"
+#include "ns3/fragmentation-manager.h"
+#include "ns3/epidemic-routing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace ns3;
+using namespace ns3::dtn7;
+
+// dtn7模块的基准测试
+//
+// 微基准: CBOR编解码、Bundle::ToCbor/FromCbor、CRC16/32、MemoryBundleStore、
+// FragmentationManager和RoutingAlgorithm::DispatchBundles
+// 宏基准: N个DtnNode在Ad-hoc WiFi上以RandomWaypoint移动, 统计事件速率和墙钟时间
+//
+// 输出为"benchmark,parameter,metric,value"格式的CSV, 每个测量重复多次取中位数,
+// 随机数据使用固定种子, 便于不同版本之间比较
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 测量结果的输出目标
+std::ostream* g_out = &std::cout;
+
+// 重复次数
+uint32_t g_repetitions = 5;
+
+// 端到端场景中交付的bundle数
+uint64_t g_delivered = 0;
+
+int64_t
+ElapsedNs (Clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds> (Clock::now () - start).count ();
+}
+
+void
+Report (const std::string& benchmark, const std::string& parameter, const std::string& metric, double value)
+{
+  *g_out << benchmark << "," << parameter << "," << metric << "," << value << "\n";
+}
+
+// 报告一组重复测量: 每次操作耗时的中位数和最小值, 以及中位数对应的吞吐量
+void
+ReportSamples (const std::string& benchmark, const std::string& parameter, std::vector<int64_t> samples,
+               uint64_t ops, uint64_t bytes)
+{
+  std::sort (samples.begin (), samples.end ());
+  double median = samples[samples.size () / 2];
+  Report (benchmark, parameter, "ns_per_op", median / ops);
+  Report (benchmark, parameter, "ns_per_op_min", static_cast<double> (samples.front ()) / ops);
+  Report (benchmark, parameter, "ops_per_s", ops * 1e9 / median);
+  if (bytes > 0)
+    {
+      Report (benchmark, parameter, "mb_per_s", bytes * 1e3 / median);
+    }
+}
+
+// 重复运行fn并报告, fn执行ops次操作, 共处理bytes字节
+template <typename F>
+void
+Measure (const std::string& benchmark, const std::string& parameter, uint64_t ops, uint64_t bytes, F fn)
+{
+  std::vector<int64_t> samples;
+  for (uint32_t i = 0; i < g_repetitions; i++)
+    {
+      Clock::time_point start = Clock::now ();
+      fn ();
+      samples.push_back (ElapsedNs (start));
+    }
+  ReportSamples (benchmark, parameter, samples, ops, bytes);
+}
+
+std::vector<uint8_t>
+RandomBytes (size_t size)
+{
+  std::mt19937 rng (42);
+  std::vector<uint8_t> bytes (size);
+  for (uint8_t& byte : bytes)
+    {
+      byte = static_cast<uint8_t> (rng ());
+    }
+  return bytes;
+}
+
+Ptr<Bundle>
+MakeBundle (uint64_t sequence, const std::vector<uint8_t>& payload, Time lifetime)
+{
+  // 不同的源端点使bundle ID互不相同
+  Bundle bundle = Bundle::MustNewBundle ("dtn://bench-" + std::to_string (sequence) + "/",
+                                         "dtn://sink/", GetDtnNow (), lifetime, payload);
+  return Create<Bundle> (bundle);
+}
+
+// 循环次数, 使每次测量处理约bytes字节
+uint64_t
+IterationsFor (size_t size, uint64_t bytes)
+{
+  return std::max<uint64_t> (1, bytes / std::max<size_t> (size, 1));
+}
+
+void
+BenchmarkCbor (const std::vector<size_t>& sizes)
+{
+  for (size_t size : sizes)
+    {
+      std::vector<uint8_t> data = RandomBytes (size);
+      Cbor::CborValue value (data);
+      Buffer encoded = Cbor::Encode (value);
+      uint64_t iterations = IterationsFor (size, 64 << 20);
+      std::string parameter = "bytes=" + std::to_string (size);
+
+      Measure ("cbor_encode", parameter, iterations, iterations * size, [&] () {
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            Buffer buffer = Cbor::Encode (value);
+            NS_ABORT_IF (buffer.GetSize () == 0);
+          }
+      });
+      Measure ("cbor_decode", parameter, iterations, iterations * size, [&] () {
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            NS_ABORT_IF (!Cbor::Decode (encoded));
+          }
+      });
+    }
+}
+
+void
+BenchmarkBundle (const std::vector<size_t>& sizes)
+{
+  for (size_t size : sizes)
+    {
+      std::vector<uint8_t> payload = RandomBytes (size);
+      uint64_t iterations = std::min<uint64_t> (IterationsFor (size, 16 << 20), 10000);
+      std::string parameter = "payload=" + std::to_string (size);
+
+      // 每个bundle只编码一次, 避免测到缓存的编码
+      std::vector<int64_t> samples;
+      for (uint32_t r = 0; r < g_repetitions; r++)
+        {
+          std::vector<Ptr<Bundle>> bundles;
+          for (uint64_t i = 0; i < iterations; i++)
+            {
+              bundles.push_back (MakeBundle (i, payload, Seconds (3600)));
+            }
+          Clock::time_point start = Clock::now ();
+          for (const Ptr<Bundle>& bundle : bundles)
+            {
+              NS_ABORT_IF (bundle->ToCbor ().GetSize () == 0);
+            }
+          samples.push_back (ElapsedNs (start));
+        }
+      ReportSamples ("bundle_to_cbor", parameter, samples, iterations, iterations * size);
+
+      Buffer encoded = MakeBundle (0, payload, Seconds (3600))->ToCbor ();
+      Measure ("bundle_from_cbor", parameter, iterations, iterations * size, [&] () {
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            NS_ABORT_IF (!Bundle::FromCbor (encoded));
+          }
+      });
+    }
+}
+
+void
+BenchmarkCrc (const std::vector<size_t>& sizes)
+{
+  for (size_t size : sizes)
+    {
+      std::vector<uint8_t> data = RandomBytes (size);
+      uint64_t iterations = IterationsFor (size, 256 << 20);
+      std::string parameter = "bytes=" + std::to_string (size);
+      volatile uint32_t sink = 0;
+
+      Measure ("crc16", parameter, iterations, iterations * size, [&] () {
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            sink = sink + CalculateCRC16 (data.data (), data.size ());
+          }
+      });
+      Measure ("crc32c", parameter, iterations, iterations * size, [&] () {
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            sink = sink + CalculateCRC32 (data.data (), data.size ());
+          }
+      });
+    }
+}
+
+void
+BenchmarkStore (uint64_t maxBundles)
+{
+  std::vector<uint8_t> payload = RandomBytes (64);
+  for (uint64_t count = 1000; count <= maxBundles; count *= 10)
+    {
+      std::string parameter = "bundles=" + std::to_string (count);
+      std::vector<int64_t> push;
+      std::vector<int64_t> get;
+      std::vector<int64_t> cleanup;
+
+      for (uint32_t r = 0; r < g_repetitions; r++)
+        {
+          std::vector<Ptr<Bundle>> bundles;
+          bundles.reserve (count);
+          for (uint64_t i = 0; i < count; i++)
+            {
+              bundles.push_back (MakeBundle (i, payload, Seconds (10)));
+            }
+
+          Ptr<MemoryBundleStore> store = CreateObject<MemoryBundleStore> ();
+          store->SetAttribute ("MaxBundles", UintegerValue (count));
+
+          Clock::time_point start = Clock::now ();
+          for (const Ptr<Bundle>& bundle : bundles)
+            {
+              store->Push (bundle);
+            }
+          push.push_back (ElapsedNs (start));
+
+          start = Clock::now ();
+          for (const Ptr<Bundle>& bundle : bundles)
+            {
+              NS_ABORT_IF (!store->Get (bundle->GetId ()));
+            }
+          get.push_back (ElapsedNs (start));
+
+          // 在所有bundle过期后清理
+          Simulator::Schedule (Seconds (20), [&cleanup, store, count] () {
+            Clock::time_point begin = Clock::now ();
+            NS_ABORT_IF (store->Cleanup () != count);
+            cleanup.push_back (ElapsedNs (begin));
+          });
+          Simulator::Run ();
+          Simulator::Destroy ();
+        }
+
+      ReportSamples ("store_push", parameter, push, count, 0);
+      ReportSamples ("store_get", parameter, get, count, 0);
+      ReportSamples ("store_cleanup", parameter, cleanup, count, 0);
+    }
+}
+
+void
+BenchmarkFragmentation (const std::vector<size_t>& sizes, size_t fragmentSize)
+{
+  for (size_t size : sizes)
+    {
+      if (size <= fragmentSize)
+        {
+          continue;
+        }
+      std::vector<uint8_t> payload = RandomBytes (size);
+      Ptr<Bundle> bundle = MakeBundle (0, payload, Seconds (3600));
+      std::string parameter = "payload=" + std::to_string (size) + ";fragment=" + std::to_string (fragmentSize);
+      uint64_t iterations = std::min<uint64_t> (IterationsFor (size, 16 << 20), 1000);
+
+      Measure ("fragment", parameter, iterations, iterations * size, [&] () {
+        Ptr<FragmentationManager> manager = Create<FragmentationManager> ();
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            NS_ABORT_IF (manager->FragmentBundle (bundle, fragmentSize).empty ());
+          }
+      });
+
+      std::vector<Ptr<Bundle>> fragments = Create<FragmentationManager> ()->FragmentBundle (bundle, fragmentSize);
+      Measure ("reassemble", parameter, iterations, iterations * size, [&] () {
+        Ptr<FragmentationManager> manager = Create<FragmentationManager> ();
+        for (uint64_t i = 0; i < iterations; i++)
+          {
+            Ptr<Bundle> whole;
+            for (const Ptr<Bundle>& fragment : fragments)
+              {
+                whole = manager->AddFragment (fragment);
+              }
+            NS_ABORT_IF (!whole);
+          }
+      });
+    }
+}
+
+// 只计数的发送端, 使测量只包含路由层的开销
+class BenchmarkSender : public ConvergenceSender
+{
+public:
+  bool Send (Ptr<Bundle> bundle, const std::string& endpoint) override
+  {
+    m_sent++;
+    return true;
+  }
+  bool IsEndpointReachable (const std::string& endpoint) const override
+  {
+    return true;
+  }
+  bool Start () override
+  {
+    return true;
+  }
+  bool Stop () override
+  {
+    return true;
+  }
+
+  uint64_t m_sent = 0; //!< Number of bundles sent
+};
+
+void
+BenchmarkDispatch (const std::vector<uint32_t>& storeSizes, const std::vector<uint32_t>& peerCounts)
+{
+  const uint32_t batch = 100;
+  std::vector<uint8_t> payload = RandomBytes (64);
+  for (uint32_t storeSize : storeSizes)
+    {
+      for (uint32_t peers : peerCounts)
+        {
+          std::string parameter = "store=" + std::to_string (storeSize) + ";peers=" + std::to_string (peers);
+          std::vector<int64_t> contact;
+          std::vector<int64_t> incremental;
+
+          for (uint32_t r = 0; r < g_repetitions; r++)
+            {
+              Ptr<MemoryBundleStore> store = CreateObject<MemoryBundleStore> ();
+              store->SetAttribute ("MaxBundles", UintegerValue (storeSize + batch));
+              Ptr<BenchmarkSender> sender = CreateObject<BenchmarkSender> ();
+              Ptr<EpidemicRouting> routing = CreateObject<EpidemicRouting> ();
+              routing->SetAttribute ("SummaryVector", BooleanValue (false));
+              NodeID local ("dtn://bench/");
+              routing->Initialize (store, {sender}, local);
+
+              for (uint32_t i = 0; i < storeSize; i++)
+                {
+                  routing->NotifyNewBundle (MakeBundle (i, payload, Seconds (3600)), local);
+                }
+
+              // 每个新对端出现时都会分发一次整个存储
+              Clock::time_point start = Clock::now ();
+              for (uint32_t p = 0; p < peers; p++)
+                {
+                  PeerInfo peer;
+                  peer.nodeID = NodeID ("dtn://peer-" + std::to_string (p) + "/");
+                  peer.lastSeen = Simulator::Now ();
+                  peer.receptionTime = Simulator::Now ();
+                  peer.reachable = true;
+                  peer.endpoint = "peer-" + std::to_string (p);
+                  routing->NotifyPeerAppeared (peer);
+                }
+              contact.push_back (ElapsedNs (start));
+
+              // 已有对端时新存入一批bundle后的分发
+              for (uint32_t i = 0; i < batch; i++)
+                {
+                  routing->NotifyNewBundle (MakeBundle (storeSize + i, payload, Seconds (3600)), local);
+                }
+              start = Clock::now ();
+              routing->DispatchBundles ();
+              incremental.push_back (ElapsedNs (start));
+
+              routing->Dispose ();
+              Simulator::Destroy ();
+            }
+
+          ReportSamples ("dispatch_contact", parameter, contact, peers, 0);
+          ReportSamples ("dispatch_incremental", parameter + ";batch=" + std::to_string (batch), incremental, 1, 0);
+        }
+    }
+}
+
+void
+CountDelivery (Ptr<Bundle> bundle)
+{
+  g_delivered++;
+}
+
+void
+SendRandomBundle (ApplicationContainer apps, Ptr<UniformRandomVariable> rng, uint32_t payloadSize, Time interval)
+{
+  uint32_t n = apps.GetN ();
+  uint32_t from = rng->GetInteger (0, n - 1);
+  uint32_t to = (from + rng->GetInteger (1, n - 1)) % n;
+  Ptr<DtnNode> node = DynamicCast<DtnNode> (apps.Get (from));
+  node->Send (node->GetNodeId ().ToString () + "app", "dtn://node-" + std::to_string (apps.Get (to)->GetNode ()->GetId ()) + "/inbox",
+              std::vector<uint8_t> (payloadSize, 0xab), Seconds (3600));
+  Simulator::Schedule (interval, &SendRandomBundle, apps, rng, payloadSize, interval);
+}
+
+void
+BenchmarkEndToEnd (uint32_t nNodes, Time simTime)
+{
+  std::string parameter = "nodes=" + std::to_string (nNodes) + ";simTime=" + std::to_string (simTime.GetSeconds ());
+  g_delivered = 0;
+
+  NodeContainer nodes;
+  nodes.Create (nNodes);
+
+  WifiHelper wifi;
+  wifi.SetStandard (WIFI_STANDARD_80211b);
+  YansWifiPhyHelper wifiPhy;
+  YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default ();
+  wifiPhy.SetChannel (wifiChannel.Create ());
+  WifiMacHelper wifiMac;
+  wifiMac.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
+
+  ObjectFactory positions;
+  positions.SetTypeId ("ns3::RandomRectanglePositionAllocator");
+  positions.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=500.0]"));
+  positions.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=500.0]"));
+  Ptr<PositionAllocator> allocator = positions.Create ()->GetObject<PositionAllocator> ();
+
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator (allocator);
+  mobility.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
+                             "Speed", StringValue ("ns3::UniformRandomVariable[Min=1.0|Max=5.0]"),
+                             "Pause", StringValue ("ns3::ConstantRandomVariable[Constant=2.0]"),
+                             "PositionAllocator", PointerValue (allocator));
+  mobility.Install (nodes);
+
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.0.0");
+  address.Assign (devices);
+
+  Dtn7Helper dtn;
+  ApplicationContainer apps = dtn.InstallBulk (nodes, Seconds (0.5), Seconds (1));
+  apps.Stop (simTime);
+  for (uint32_t i = 0; i < apps.GetN (); i++)
+    {
+      Ptr<DtnNode> node = DynamicCast<DtnNode> (apps.Get (i));
+      node->RegisterEndpoint ("dtn://node-" + std::to_string (nodes.Get (i)->GetId ()) + "/inbox",
+                              MakeCallback (&CountDelivery));
+    }
+
+  Ptr<UniformRandomVariable> rng = CreateObject<UniformRandomVariable> ();
+  Simulator::Schedule (Seconds (2), &SendRandomBundle, apps, rng, 1024u, Seconds (1));
+
+  Simulator::Stop (simTime);
+  uint64_t eventsBefore = Simulator::GetEventCount ();
+  Clock::time_point start = Clock::now ();
+  Simulator::Run ();
+  double wall = ElapsedNs (start) / 1e9;
+  uint64_t events = Simulator::GetEventCount () - eventsBefore;
+  Simulator::Destroy ();
+
+  Report ("e2e_wifi_rwp", parameter, "setup_s", dtn.GetLastSetupTime ());
+  Report ("e2e_wifi_rwp", parameter, "wall_s", wall);
+  Report ("e2e_wifi_rwp", parameter, "events", events);
+  Report ("e2e_wifi_rwp", parameter, "events_per_s", wall > 0 ? events / wall : 0.0);
+  Report ("e2e_wifi_rwp", parameter, "sim_s_per_wall_s", wall > 0 ? simTime.GetSeconds () / wall : 0.0);
+  Report ("e2e_wifi_rwp", parameter, "delivered", g_delivered);
+}
+
+} // anonymous namespace
+
+int
+main (int argc, char *argv[])
+{
+  std::string filter;
+  std::string output;
+  uint32_t maxBundles = 1000000;
+  uint32_t nNodes = 20;
+  Time simTime = Seconds (100);
+  uint32_t fragmentSize = 1024;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("filter", "Run only the benchmarks whose name contains this text", filter);
+  cmd.AddValue ("output", "CSV output file, standard output if empty", output);
+  cmd.AddValue ("repetitions", "Number of repetitions of each measurement", g_repetitions);
+  cmd.AddValue ("maxBundles", "Largest bundle store size, from 1000 in powers of ten", maxBundles);
+  cmd.AddValue ("fragmentSize", "Maximum fragment size in bytes", fragmentSize);
+  cmd.AddValue ("nNodes", "Number of nodes in the end-to-end scenario", nNodes);
+  cmd.AddValue ("simTime", "Simulation time of the end-to-end scenario", simTime);
+  cmd.Parse (argc, argv);
+
+  // 固定种子, 使运行之间可比
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+  g_repetitions = std::max (1u, g_repetitions);
+
+  std::ofstream file;
+  if (!output.empty ())
+    {
+      file.open (output);
+      g_out = &file;
+    }
+  *g_out << "benchmark,parameter,metric,value\n";
+
+  auto selected = [&filter] (const std::string& name) {
+    return filter.empty () || name.find (filter) != std::string::npos;
+  };
+
+  std::vector<size_t> sizes = {64, 1024, 16384, 262144, 1048576};
+  if (selected ("cbor"))
+    {
+      BenchmarkCbor (sizes);
+    }
+  if (selected ("bundle"))
+    {
+      BenchmarkBundle (sizes);
+    }
+  if (selected ("crc"))
+    {
+      BenchmarkCrc (sizes);
+    }
+  if (selected ("store"))
+    {
+      BenchmarkStore (maxBundles);
+    }
+  if (selected ("fragment") || selected ("reassemble"))
+    {
+      BenchmarkFragmentation (sizes, fragmentSize);
+    }
+  if (selected ("dispatch"))
+    {
+      BenchmarkDispatch ({100, 1000, 10000}, {1, 10, 50});
+    }
+  if (selected ("e2e"))
+    {
+      BenchmarkEndToEnd (nNodes, simTime);
+    }
+
+  return 0;
+}
@@ -9,6 +9,8 @@
 #include "ns3/netanim-module.h"
 #include "ns3/udp-client-server-helper.h"
 
+#include <memory>
+
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("SimpleDelayTolerantExample");
@@ -19,10 +21,12 @@ main (int argc, char *argv[])
   // 基本参数
   uint32_t nNodes = 5;
   Time simTime = Seconds(100);
+  bool animation = true;
 
   CommandLine cmd (__FILE__);
   cmd.AddValue ("nNodes", "Number of nodes", nNodes);
   cmd.AddValue ("simTime", "Simulation time", simTime);
+  cmd.AddValue ("animation", "Write NetAnim XML output", animation);
   cmd.Parse (argc, argv);
 
   // 创建节点
@@ -79,16 +83,20 @@ main (int argc, char *argv[])
   clientApps.Start(Seconds(2.0));
   clientApps.Stop(simTime - Seconds(1.0));
 
-  // 可视化
-  AnimationInterface anim("simple-dtn-animation.xml");
-  for (uint32_t i = 0; i < nNodes; i++)
+  // 可视化 (参数扫描等批量运行时关闭)
+  std::unique_ptr<AnimationInterface> anim;
+  if (animation)
     {
-      anim.UpdateNodeDescription(nodes.Get(i), "Node " + std::to_string(i));
-      anim.UpdateNodeColor(nodes.Get(i), 0, 0, 255); // Blue
+      anim = std::make_unique<AnimationInterface>("simple-dtn-animation.xml");
+      for (uint32_t i = 0; i < nNodes; i++)
+        {
+          anim->UpdateNodeDescription(nodes.Get(i), "Node " + std::to_string(i));
+          anim->UpdateNodeColor(nodes.Get(i), 0, 0, 255); // Blue
+        }
+      
+      anim->UpdateNodeColor(nodes.Get(0), 255, 0, 0); // 源节点为红色
+      anim->UpdateNodeColor(nodes.Get(nNodes-1), 0, 255, 0); // 目标节点为绿色
     }
-  
-  anim.UpdateNodeColor(nodes.Get(0), 255, 0, 0); // 源节点为红色
-  anim.UpdateNodeColor(nodes.Get(nNodes-1), 0, 255, 0); // 目标节点为绿色
 
   // 运行仿真
   Simulator::Stop (simTime);
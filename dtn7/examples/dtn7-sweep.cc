@@ -0,0 +1,434 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+// 参数扫描: 对速度、K值、路由算法和种子的每个组合启动一个独立的仿真进程,
+// 按CPU核数并行运行, 最后把各次运行的"Metric,Value"结果合并为带95%置信区间的CSV
+//
+// 示例:
+//   dtn7-sweep --program=./ndn-notify --speeds=2,2.4,2.8,3 --seeds=1:10 --output=sweep.csv
+
+namespace {
+
+// 一次仿真运行
+struct SweepRun
+{
+  std::string speed;   // 移动速度
+  std::string k;       // K值, 为空表示不传递
+  std::string routing; // 路由算法, 为空表示不传递
+  uint32_t seed;       // RngRun
+  std::filesystem::path dir; // 工作目录
+  int status = -1;     // 退出状态, -1表示未完成
+};
+
+// 按逗号拆分列表, 忽略空项
+std::vector<std::string>
+SplitList (const std::string& list)
+{
+  std::vector<std::string> items;
+  std::stringstream ss (list);
+  std::string item;
+  while (std::getline (ss, item, ','))
+    {
+      if (!item.empty ())
+        {
+          items.push_back (item);
+        }
+    }
+  return items;
+}
+
+// 解析种子列表, 支持"1,2,5"和"1:10"两种形式
+std::vector<uint32_t>
+ParseSeeds (const std::string& list)
+{
+  std::vector<uint32_t> seeds;
+  for (const std::string& item : SplitList (list))
+    {
+      size_t colon = item.find (':');
+      if (colon == std::string::npos)
+        {
+          seeds.push_back (std::stoul (item));
+          continue;
+        }
+      uint32_t first = std::stoul (item.substr (0, colon));
+      uint32_t last = std::stoul (item.substr (colon + 1));
+      for (uint32_t seed = first; seed <= last; seed++)
+        {
+          seeds.push_back (seed);
+        }
+    }
+  return seeds;
+}
+
+// 双侧95%置信区间的t分位数
+double
+StudentT95 (uint32_t df)
+{
+  static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (df == 0)
+    {
+      return 0.0;
+    }
+  if (df <= 30)
+    {
+      return table[df - 1];
+    }
+  if (df <= 40)
+    {
+      return 2.021;
+    }
+  if (df <= 60)
+    {
+      return 2.000;
+    }
+  if (df <= 120)
+    {
+      return 1.980;
+    }
+  return 1.960;
+}
+
+// 读取一个结果文件
+// 支持"Metric,Value"形式的CSV行, 以及"Name: value"形式的文本行 (顶格书写、值为数字)
+void
+ReadMetrics (const std::filesystem::path& file, std::map<std::string, double>& metrics)
+{
+  std::ifstream in (file);
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty () || line[0] == '#' || std::isspace (static_cast<unsigned char> (line[0])))
+        {
+          continue;
+        }
+
+      size_t sep = line.find (',');
+      if (sep == std::string::npos)
+        {
+          sep = line.find (':');
+        }
+      if (sep == std::string::npos)
+        {
+          continue;
+        }
+
+      std::string name = line.substr (0, sep);
+      std::string value = line.substr (sep + 1);
+      char* end = nullptr;
+      double number = std::strtod (value.c_str (), &end);
+      if (end == value.c_str ())
+        {
+          continue; // 表头或非数值行
+        }
+      metrics[name] = number;
+    }
+}
+
+// 读取一次运行的全部指标: 优先读取指定的结果文件, 否则读取工作目录下的所有csv/txt文件
+std::map<std::string, double>
+CollectMetrics (const SweepRun& run, const std::string& resultFile)
+{
+  std::map<std::string, double> metrics;
+  if (!resultFile.empty () && std::filesystem::exists (run.dir / resultFile))
+    {
+      ReadMetrics (run.dir / resultFile, metrics);
+      return metrics;
+    }
+
+  for (const auto& entry : std::filesystem::directory_iterator (run.dir))
+    {
+      std::string extension = entry.path ().extension ().string ();
+      if (entry.is_regular_file () && (extension == ".csv" || extension == ".txt"))
+        {
+          ReadMetrics (entry.path (), metrics);
+        }
+    }
+  return metrics;
+}
+
+// 在子进程中启动一次运行, 返回进程号, 失败时返回-1
+pid_t
+Launch (const std::string& program, const std::vector<std::string>& args, const std::filesystem::path& dir)
+{
+  pid_t pid = fork ();
+  if (pid != 0)
+    {
+      return pid;
+    }
+
+  // 子进程: 在自己的目录中运行, 输出写入run.log, 使固定文件名的输出互不覆盖
+  if (chdir (dir.c_str ()) != 0)
+    {
+      _exit (127);
+    }
+  int log = open ("run.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (log >= 0)
+    {
+      dup2 (log, STDOUT_FILENO);
+      dup2 (log, STDERR_FILENO);
+      close (log);
+    }
+
+  std::vector<char*> argv;
+  argv.push_back (const_cast<char*> (program.c_str ()));
+  for (const std::string& arg : args)
+    {
+      argv.push_back (const_cast<char*> (arg.c_str ()));
+    }
+  argv.push_back (nullptr);
+  execv (program.c_str (), argv.data ());
+  _exit (127);
+}
+
+} // anonymous namespace
+
+int
+main (int argc, char *argv[])
+{
+  std::string program;
+  std::string speeds = "2";
+  std::string ks;
+  std::string routings;
+  std::string seeds = "1:10";
+  std::string speedArg = "mobility";
+  std::string kArg = "K";
+  std::string routingArg = "routing";
+  std::string animationArg = "animation";
+  std::string resultArg = "resultFile";
+  std::string extraArgs;
+  std::string workDir = "dtn7-sweep";
+  std::string output = "dtn7-sweep.csv";
+  std::string rawOutput;
+  uint32_t jobs = std::max (1u, std::thread::hardware_concurrency ());
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("program", "Simulation executable to run", program);
+  cmd.AddValue ("speeds", "Comma-separated mobility speeds", speeds);
+  cmd.AddValue ("ks", "Comma-separated K values, none if empty", ks);
+  cmd.AddValue ("routings", "Comma-separated routing algorithms, none if empty", routings);
+  cmd.AddValue ("seeds", "RngRun values, e.g. 1,2,3 or 1:30", seeds);
+  cmd.AddValue ("speedArg", "Program argument taking the speed", speedArg);
+  cmd.AddValue ("kArg", "Program argument taking K", kArg);
+  cmd.AddValue ("routingArg", "Program argument taking the routing algorithm", routingArg);
+  cmd.AddValue ("animationArg", "Program argument set to false to disable animation, unused if empty", animationArg);
+  cmd.AddValue ("resultArg", "Program argument taking the result file name, unused if empty", resultArg);
+  cmd.AddValue ("extraArgs", "Further space-separated arguments passed to every run", extraArgs);
+  cmd.AddValue ("workDir", "Directory holding one subdirectory per run", workDir);
+  cmd.AddValue ("output", "Summary CSV with mean and 95% confidence interval per metric", output);
+  cmd.AddValue ("rawOutput", "CSV with one row per run and metric, not written if empty", rawOutput);
+  cmd.AddValue ("jobs", "Number of runs in parallel", jobs);
+  cmd.Parse (argc, argv);
+
+  if (program.empty ())
+    {
+      std::cerr << "No simulation given, use --program=<executable>" << std::endl;
+      return 1;
+    }
+  program = std::filesystem::absolute (program).string ();
+  jobs = std::max (1u, jobs);
+
+  // 空列表表示该维度不参与扫描, 也不向仿真传递对应参数
+  std::vector<std::string> speedList = SplitList (speeds);
+  std::vector<std::string> kList = SplitList (ks);
+  std::vector<std::string> routingList = SplitList (routings);
+  std::vector<uint32_t> seedList = ParseSeeds (seeds);
+  if (speedList.empty () || seedList.empty ())
+    {
+      std::cerr << "At least one speed and one seed are needed" << std::endl;
+      return 1;
+    }
+  if (kList.empty ())
+    {
+      kList.push_back ("");
+    }
+  if (routingList.empty ())
+    {
+      routingList.push_back ("");
+    }
+
+  std::vector<std::string> extra;
+  std::stringstream extraStream (extraArgs);
+  for (std::string arg; extraStream >> arg;)
+    {
+      extra.push_back (arg);
+    }
+
+  // 生成运行列表
+  std::vector<SweepRun> runs;
+  for (const std::string& speed : speedList)
+    {
+      for (const std::string& k : kList)
+        {
+          for (const std::string& routing : routingList)
+            {
+              for (uint32_t seed : seedList)
+                {
+                  SweepRun run;
+                  run.speed = speed;
+                  run.k = k;
+                  run.routing = routing;
+                  run.seed = seed;
+                  run.dir = std::filesystem::absolute (workDir) /
+                            ("speed_" + speed + (k.empty () ? "" : "_K_" + k) +
+                             (routing.empty () ? "" : "_" + routing) + "_run_" + std::to_string (seed));
+                  runs.push_back (run);
+                }
+            }
+        }
+    }
+
+  // 并行运行, 同时最多jobs个进程
+  std::cout << "Running " << runs.size () << " simulations with " << jobs << " jobs" << std::endl;
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+  size_t finished = 0;
+  while (next < runs.size () || !running.empty ())
+    {
+      while (next < runs.size () && running.size () < jobs)
+        {
+          SweepRun& run = runs[next];
+          std::filesystem::create_directories (run.dir);
+
+          std::vector<std::string> args;
+          args.push_back ("--" + speedArg + "=" + run.speed);
+          if (!run.k.empty ())
+            {
+              args.push_back ("--" + kArg + "=" + run.k);
+            }
+          if (!run.routing.empty ())
+            {
+              args.push_back ("--" + routingArg + "=" + run.routing);
+            }
+          args.push_back ("--RngRun=" + std::to_string (run.seed));
+          if (!animationArg.empty ())
+            {
+              args.push_back ("--" + animationArg + "=false");
+            }
+          if (!resultArg.empty ())
+            {
+              args.push_back ("--" + resultArg + "=result.csv");
+            }
+          args.insert (args.end (), extra.begin (), extra.end ());
+
+          pid_t pid = Launch (program, args, run.dir);
+          if (pid < 0)
+            {
+              std::cerr << "Cannot start " << program << ": " << std::strerror (errno) << std::endl;
+              run.status = 127;
+              finished++;
+            }
+          else
+            {
+              running[pid] = next;
+            }
+          next++;
+        }
+
+      if (running.empty ())
+        {
+          continue;
+        }
+
+      int status = 0;
+      pid_t pid = waitpid (-1, &status, 0);
+      auto it = running.find (pid);
+      if (it == running.end ())
+        {
+          continue;
+        }
+      SweepRun& run = runs[it->second];
+      run.status = WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+      running.erase (it);
+      finished++;
+      std::cout << "[" << finished << "/" << runs.size () << "] " << run.dir.filename ().string ()
+                << (run.status == 0 ? "" : " failed with status " + std::to_string (run.status)) << std::endl;
+    }
+
+  // 合并结果 <(速度, K, 路由), 指标> -> 各次运行的值
+  typedef std::tuple<std::string, std::string, std::string> Point;
+  std::map<std::pair<Point, std::string>, std::vector<double>> samples;
+  std::ofstream raw;
+  if (!rawOutput.empty ())
+    {
+      raw.open (rawOutput);
+      raw << "speed,k,routing,seed,metric,value\n";
+    }
+
+  uint32_t failures = 0;
+  for (const SweepRun& run : runs)
+    {
+      if (run.status != 0)
+        {
+          failures++;
+          continue;
+        }
+      Point point (run.speed, run.k, run.routing);
+      for (const auto& metric : CollectMetrics (run, resultArg.empty () ? "" : "result.csv"))
+        {
+          samples[std::make_pair (point, metric.first)].push_back (metric.second);
+          if (raw.is_open ())
+            {
+              raw << run.speed << "," << run.k << "," << run.routing << "," << run.seed << ","
+                  << metric.first << "," << metric.second << "\n";
+            }
+        }
+    }
+
+  std::ofstream summary (output);
+  summary << "speed,k,routing,metric,n,mean,stddev,ci95_low,ci95_high\n";
+  for (const auto& sample : samples)
+    {
+      const Point& point = sample.first.first;
+      const std::vector<double>& values = sample.second;
+      double n = values.size ();
+      double mean = 0;
+      for (double value : values)
+        {
+          mean += value;
+        }
+      mean /= n;
+
+      double variance = 0;
+      for (double value : values)
+        {
+          variance += (value - mean) * (value - mean);
+        }
+      double stddev = values.size () > 1 ? std::sqrt (variance / (n - 1)) : 0.0;
+      double half = StudentT95 (values.size () - 1) * stddev / std::sqrt (n);
+
+      summary << std::get<0> (point) << "," << std::get<1> (point) << "," << std::get<2> (point) << ","
+              << sample.first.second << "," << values.size () << "," << mean << "," << stddev << ","
+              << mean - half << "," << mean + half << "\n";
+    }
+
+  std::cout << "Results of " << runs.size () - failures << " runs written to " << output << std::endl;
+  if (failures > 0)
+    {
+      std::cerr << failures << " runs failed, see run.log in their directories under " << workDir << std::endl;
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,42 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/core-module.h"
+#include "ns3/trace-events.h"
+
+#include <fstream>
+#include <iostream>
+
+using namespace ns3;
+
+// 将TraceEventRing::Dump写出的二进制事件文件转换为CSV
+int 
+main (int argc, char *argv[])
+{
+  std::string input;
+  std::string output;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("input", "Binary trace file written by TraceEventRing::Dump", input);
+  cmd.AddValue ("output", "CSV output file, standard output if empty", output);
+  cmd.Parse (argc, argv);
+
+  if (input.empty ())
+    {
+      std::cerr << "No input file given, use --input=<file>" << std::endl;
+      return 1;
+    }
+
+  std::ofstream file;
+  if (!output.empty ())
+    {
+      file.open (output);
+    }
+  std::ostream& os = output.empty () ? std::cout : file;
+
+  if (!dtn7::TraceEventRing::Decode (input, os))
+    {
+      std::cerr << "Malformed trace file " << input << std::endl;
+      return 1;
+    }
+  return 0;
+}
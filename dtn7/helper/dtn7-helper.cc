@@ -3,7 +3,17 @@
 #include "ns3/string.h"
 #include "ns3/ipv4.h"
 #include "ns3/names.h"
+#include "ns3/boolean.h"
+#include "ns3/global-value.h"
+#include "ns3/simulator.h"
 #include "../model/tcp-convergence-layer.h" 
+#include "../model/discovery.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
 
 namespace ns3 {
 
@@ -11,6 +21,49 @@ NS_LOG_COMPONENT_DEFINE ("Dtn7Helper");
 
 namespace dtn7 {
 
+namespace {
+
+// 递归二分：沿较长边按节点数切分区域，直到每个区域对应一个rank
+void 
+Bisect (const std::vector<Vector>& positions, std::vector<size_t>::iterator first,
+        std::vector<size_t>::iterator last, uint32_t firstSystem, uint32_t systemCount,
+        std::vector<uint32_t>& systemIds)
+{
+  if (systemCount <= 1 || last - first <= 1)
+    {
+      for (auto it = first; it != last; ++it)
+        {
+          systemIds[*it] = firstSystem;
+        }
+      return;
+    }
+  
+  double minX = positions[*first].x;
+  double maxX = minX;
+  double minY = positions[*first].y;
+  double maxY = minY;
+  for (auto it = first; it != last; ++it)
+    {
+      minX = std::min (minX, positions[*it].x);
+      maxX = std::max (maxX, positions[*it].x);
+      minY = std::min (minY, positions[*it].y);
+      maxY = std::max (maxY, positions[*it].y);
+    }
+  bool alongX = maxX - minX >= maxY - minY;
+  
+  // 两侧节点数与rank数成比例
+  uint32_t lowCount = systemCount / 2;
+  auto middle = first + (last - first) * lowCount / systemCount;
+  std::nth_element (first, middle, last, [&positions, alongX] (size_t a, size_t b) {
+    return alongX ? positions[a].x < positions[b].x : positions[a].y < positions[b].y;
+  });
+  
+  Bisect (positions, first, middle, firstSystem, lowCount, systemIds);
+  Bisect (positions, middle, last, firstSystem + lowCount, systemCount - lowCount, systemIds);
+}
+
+} // anonymous namespace
+
 Dtn7Helper::Dtn7Helper ()
 {
   NS_LOG_FUNCTION (this);
@@ -19,6 +72,10 @@ Dtn7Helper::Dtn7Helper ()
   m_storeFactory.SetTypeId ("ns3::dtn7::MemoryBundleStore");
   m_routingFactory.SetTypeId ("ns3::dtn7::EpidemicRouting");
   m_claFactory.SetTypeId ("ns3::dtn7::TcpConvergenceLayer");
+  m_discoveryFactory.SetTypeId ("ns3::dtn7::IpDiscoveryAgent");
+  m_discoveryEnabled = false;
+  m_startJitter = CreateObject<UniformRandomVariable> ();
+  m_lastSetupTime = 0;
 }
 
 void 
@@ -168,6 +225,56 @@ Dtn7Helper::SetConvergenceLayer (std::string claType,
     }
 }
 
+void 
+Dtn7Helper::SetDiscoveryAgent (std::string discoveryType,
+                               std::string n0, const AttributeValue &v0,
+                               std::string n1, const AttributeValue &v1,
+                               std::string n2, const AttributeValue &v2,
+                               std::string n3, const AttributeValue &v3,
+                               std::string n4, const AttributeValue &v4,
+                               std::string n5, const AttributeValue &v5,
+                               std::string n6, const AttributeValue &v6,
+                               std::string n7, const AttributeValue &v7)
+{
+  NS_LOG_FUNCTION (this << discoveryType);
+  
+  m_discoveryFactory.SetTypeId (discoveryType);
+  m_discoveryEnabled = true;
+  
+  if (n0 != "")
+    {
+      m_discoveryFactory.Set (n0, v0);
+    }
+  if (n1 != "")
+    {
+      m_discoveryFactory.Set (n1, v1);
+    }
+  if (n2 != "")
+    {
+      m_discoveryFactory.Set (n2, v2);
+    }
+  if (n3 != "")
+    {
+      m_discoveryFactory.Set (n3, v3);
+    }
+  if (n4 != "")
+    {
+      m_discoveryFactory.Set (n4, v4);
+    }
+  if (n5 != "")
+    {
+      m_discoveryFactory.Set (n5, v5);
+    }
+  if (n6 != "")
+    {
+      m_discoveryFactory.Set (n6, v6);
+    }
+  if (n7 != "")
+    {
+      m_discoveryFactory.Set (n7, v7);
+    }
+}
+
 ApplicationContainer 
 Dtn7Helper::Install (NodeContainer c)
 {
@@ -177,7 +284,11 @@ Dtn7Helper::Install (NodeContainer c)
   
   for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
     {
-      apps.Add (InstallPriv (*i));
+      Ptr<Application> app = InstallPriv (*i);
+      if (app)
+        {
+          apps.Add (app);
+        }
     }
   
   return apps;
@@ -189,7 +300,11 @@ Dtn7Helper::Install (Ptr<Node> node)
   NS_LOG_FUNCTION (this << node);
   
   ApplicationContainer apps;
-  apps.Add (InstallPriv (node));
+  Ptr<Application> app = InstallPriv (node);
+  if (app)
+    {
+      apps.Add (app);
+    }
   return apps;
 }
 
@@ -202,6 +317,108 @@ Dtn7Helper::Install (std::string nodeName)
   return Install (node);
 }
 
+ApplicationContainer 
+Dtn7Helper::InstallBulk (NodeContainer c, Time start, Time startJitter)
+{
+  NS_LOG_FUNCTION (this << c.GetN () << start << startJitter);
+  
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now ();
+  
+  // 支持的路由算法共享同一份只读的联系计划，只解析一次
+  ObjectFactory routingFactory = m_routingFactory;
+  TypeId::AttributeInformation info;
+  if (m_routingFactory.GetTypeId ().LookupAttributeByName ("SharedContactPlan", &info))
+    {
+      m_routingFactory.Set ("SharedContactPlan", BooleanValue (true));
+    }
+  
+  ApplicationContainer apps;
+  Time lastStart = start;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<Application> app = InstallPriv (*i);
+      if (!app)
+        {
+          continue;
+        }
+      
+      // 错开启动时间，避免所有节点的信标同时触发；共享定时器按启动相位分组，
+      // 周期任务只在SharedTimerSlots的粒度上错开
+      Time offset = Seconds (m_startJitter->GetValue (0, startJitter.GetSeconds ()));
+      app->SetStartTime (start + offset);
+      lastStart = std::max (lastStart, start + offset);
+      apps.Add (app);
+    }
+  
+  m_routingFactory = routingFactory;
+  
+  m_lastSetupTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - begin).count ();
+  NS_LOG_INFO ("Installed " << apps.GetN () << " DTN nodes in " << m_lastSetupTime
+               << " s, all started by " << lastStart.GetSeconds () << " s");
+  return apps;
+}
+
+double 
+Dtn7Helper::GetLastSetupTime () const
+{
+  return m_lastSetupTime;
+}
+
+int64_t 
+Dtn7Helper::AssignStreams (int64_t stream)
+{
+  m_startJitter->SetStream (stream);
+  return 1;
+}
+
+std::vector<uint32_t> 
+Dtn7Helper::PartitionByRegion (const std::vector<Vector>& positions, uint32_t systemCount)
+{
+  std::vector<uint32_t> systemIds (positions.size (), 0);
+  std::vector<size_t> order (positions.size ());
+  std::iota (order.begin (), order.end (), 0);
+  Bisect (positions, order.begin (), order.end (), 0, std::max (systemCount, 1u), systemIds);
+  return systemIds;
+}
+
+NodeContainer 
+Dtn7Helper::CreatePartitionedNodes (const std::vector<Vector>& positions, uint32_t systemCount)
+{
+  NodeContainer nodes;
+  for (uint32_t systemId : PartitionByRegion (positions, systemCount))
+    {
+      nodes.Add (CreateObject<Node> (systemId));
+    }
+  return nodes;
+}
+
+bool 
+Dtn7Helper::IsDistributed ()
+{
+  StringValue type;
+  GlobalValue::GetValueByName ("SimulatorImplementationType", type);
+  return type.Get () == "ns3::DistributedSimulatorImpl" || type.Get () == "ns3::NullMessageSimulatorImpl";
+}
+
+std::string 
+Dtn7Helper::GetRankFileName (const std::string& fileName)
+{
+  if (fileName.empty () || !IsDistributed ())
+    {
+      return fileName;
+    }
+  
+  // 在扩展名前插入rank，如metrics.csv -> metrics.rank1.csv
+  std::string rank = ".rank" + std::to_string (Simulator::GetSystemId ());
+  size_t dot = fileName.rfind ('.');
+  size_t slash = fileName.rfind ('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+      return fileName + rank;
+    }
+  return fileName.substr (0, dot) + rank + fileName.substr (dot);
+}
+
 Ptr<Application> 
 Dtn7Helper::InstallPriv (Ptr<Node> node)
 {
@@ -212,6 +429,13 @@ Dtn7Helper::InstallPriv (Ptr<Node> node)
     return nullptr;
   }
   
+  // 分布式仿真中每个rank只安装自己的节点
+  if (IsDistributed () && node->GetSystemId () != Simulator::GetSystemId ())
+    {
+      NS_LOG_LOGIC ("Node " << node->GetId () << " belongs to rank " << node->GetSystemId ());
+      return nullptr;
+    }
+  
   // 创建DTN节点
   Ptr<DtnNode> app = m_nodeFactory.Create<DtnNode> ();
   if (!app) {
@@ -250,38 +474,261 @@ Dtn7Helper::InstallPriv (Ptr<Node> node)
       return app;  // 返回app但没有CLA配置
     }
   
+  // 获取第一个非回环IPv4地址
+  Ipv4Address localAddress = Ipv4Address::GetAny ();
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  if (ipv4 && ipv4->GetNInterfaces () > 0)
+    {
+      for (uint32_t i = 0; i < ipv4->GetNInterfaces (); ++i)
+        {
+          if (ipv4->GetAddress (i, 0).GetLocal () != Ipv4Address::GetLoopback ())
+            {
+              localAddress = ipv4->GetAddress (i, 0).GetLocal ();
+              break;
+            }
+        }
+    }
+  
   // 使用节点的IP地址配置TCP收敛层
   Ptr<TcpConvergenceLayer> tcpCla = DynamicCast<TcpConvergenceLayer> (cla);
   if (tcpCla)
     {
       // 为TcpConvergenceLayer设置节点指针
       tcpCla->SetNode(node); // 确保TcpConvergenceLayer有一个公开的m_node成员
-
-      // 获取第一个IPv4地址
-      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-      if (ipv4 && ipv4->GetNInterfaces () > 0)
+      tcpCla->SetLocalNodeId(NodeID (ss.str ())); // 在SESS_INIT中声明的节点ID
+      
+      if (localAddress != Ipv4Address::GetAny ())
         {
-          // 使用第一个非回环接口
-          for (uint32_t i = 0; i < ipv4->GetNInterfaces (); ++i)
-            {
-              if (ipv4->GetAddress (i, 0).GetLocal () != Ipv4Address::GetLoopback ())
-                {
-                  Ipv4Address addr = ipv4->GetAddress (i, 0).GetLocal ();
-                  tcpCla->SetAttribute ("LocalAddress", Ipv4AddressValue (addr));
-                  break;
-                }
-            }
+          tcpCla->SetAttribute ("LocalAddress", Ipv4AddressValue (localAddress));
         }
     }
   
   app->AddConvergenceLayer (cla);
   
+  // 创建发现代理，对端由此得知本节点各端点对应的节点ID
+  if (m_discoveryEnabled)
+    {
+      Ptr<DiscoveryAgent> discovery = m_discoveryFactory.Create<DiscoveryAgent> ();
+      Ptr<IpDiscoveryAgent> ipDiscovery = DynamicCast<IpDiscoveryAgent> (discovery);
+      if (ipDiscovery)
+        {
+          ipDiscovery->SetNode (node);
+          if (localAddress != Ipv4Address::GetAny ())
+            {
+              ipDiscovery->SetAttribute ("LocalAddress", Ipv4AddressValue (localAddress));
+            }
+        }
+      app->SetDiscoveryAgent (discovery);
+    }
+  
   // 在节点上安装应用
   node->AddApplication (app);
   
   return app;
 }
 
+bool 
+Dtn7Helper::WriteMetrics (ApplicationContainer apps, const std::string& fileName)
+{
+  std::ofstream file (GetRankFileName (fileName));
+  if (!file)
+    {
+      NS_LOG_ERROR ("Cannot open metrics file " << GetRankFileName (fileName));
+      return false;
+    }
+  
+  bool json = fileName.size () >= 5 && fileName.compare (fileName.size () - 5, 5, ".json") == 0;
+  if (json)
+    {
+      file << "{";
+    }
+  else
+    {
+      file << MetricsRegistry::GetCsvHeader () << "\n";
+    }
+  
+  bool first = true;
+  for (auto it = apps.Begin (); it != apps.End (); ++it)
+    {
+      Ptr<DtnNode> node = DynamicCast<DtnNode> (*it);
+      if (!node)
+        {
+          continue;
+        }
+      
+      std::string nodeId = node->GetNodeId ().ToString ();
+      if (json)
+        {
+          file << (first ? "" : ",") << "\"" << nodeId << "\":";
+          node->GetMetrics ()->WriteJson (file);
+        }
+      else
+        {
+          node->GetMetrics ()->WriteCsv (file, nodeId);
+        }
+      first = false;
+    }
+  
+  if (json)
+    {
+      file << "}\n";
+    }
+  
+  return file.good ();
+}
+
+bool 
+Dtn7Helper::MergeMetrics (const std::vector<std::string>& files, const std::string& fileName)
+{
+  bool json = fileName.size () >= 5 && fileName.compare (fileName.size () - 5, 5, ".json") == 0;
+  std::string header;
+  std::stringstream body;
+  bool first = true;
+  
+  for (const std::string& input : files)
+    {
+      std::ifstream in (input);
+      if (!in)
+        {
+          NS_LOG_ERROR ("Cannot open metrics file " << input);
+          return false;
+        }
+      
+      if (json)
+        {
+          // 去掉每个文件最外层的花括号，拼接其中按节点ID索引的对象
+          std::string content ((std::istreambuf_iterator<char> (in)), std::istreambuf_iterator<char> ());
+          size_t open = content.find ('{');
+          size_t close = content.rfind ('}');
+          if (open == std::string::npos || close == std::string::npos || close < open)
+            {
+              NS_LOG_ERROR ("Malformed metrics file " << input);
+              return false;
+            }
+          std::string members = content.substr (open + 1, close - open - 1);
+          if (!members.empty ())
+            {
+              body << (first ? "" : ",") << members;
+              first = false;
+            }
+          continue;
+        }
+      
+      // CSV的每行已带节点ID，只保留一个表头
+      std::string line;
+      if (!std::getline (in, line))
+        {
+          continue;
+        }
+      header = line;
+      while (std::getline (in, line))
+        {
+          if (!line.empty ())
+            {
+              body << line << "\n";
+            }
+        }
+    }
+  
+  std::ofstream file (fileName);
+  if (!file)
+    {
+      NS_LOG_ERROR ("Cannot open metrics file " << fileName);
+      return false;
+    }
+  if (json)
+    {
+      file << "{" << body.str () << "}\n";
+    }
+  else
+    {
+      file << (header.empty () ? MetricsRegistry::GetCsvHeader () : header) << "\n" << body.str ();
+    }
+  return file.good ();
+}
+
+Ptr<BundleLifecycleTracker> 
+Dtn7Helper::EnableLifecycleTracing (ApplicationContainer apps)
+{
+  Ptr<BundleLifecycleTracker> tracker = Create<BundleLifecycleTracker> ();
+  for (auto it = apps.Begin (); it != apps.End (); ++it)
+    {
+      Ptr<DtnNode> node = DynamicCast<DtnNode> (*it);
+      if (node)
+        {
+          node->TraceConnectWithoutContext ("BundleLifecycle",
+                                            MakeCallback (&BundleLifecycleTracker::Record, tracker));
+        }
+    }
+  return tracker;
+}
+
+bool 
+Dtn7Helper::WriteLifecycle (Ptr<BundleLifecycleTracker> tracker, const std::string& timelineFile,
+                            const std::string& summaryFile)
+{
+  return WriteLifecycleFiles (tracker, GetRankFileName (timelineFile), GetRankFileName (summaryFile));
+}
+
+bool 
+Dtn7Helper::MergeLifecycle (const std::vector<std::string>& files, const std::string& timelineFile,
+                            const std::string& summaryFile)
+{
+  Ptr<BundleLifecycleTracker> tracker = Create<BundleLifecycleTracker> ();
+  for (const std::string& input : files)
+    {
+      std::ifstream in (input);
+      if (!in || !tracker->ReadTimelines (in))
+        {
+          NS_LOG_ERROR ("Cannot read timeline file " << input);
+          return false;
+        }
+    }
+  return WriteLifecycleFiles (tracker, timelineFile, summaryFile);
+}
+
+bool 
+Dtn7Helper::WriteLifecycleFiles (Ptr<BundleLifecycleTracker> tracker, const std::string& timelineFile,
+                                 const std::string& summaryFile)
+{
+  if (!tracker)
+    {
+      return false;
+    }
+  
+  if (!timelineFile.empty ())
+    {
+      std::ofstream file (timelineFile);
+      if (!file)
+        {
+          NS_LOG_ERROR ("Cannot open timeline file " << timelineFile);
+          return false;
+        }
+      tracker->WriteTimelines (file);
+      if (!file.good ())
+        {
+          return false;
+        }
+    }
+  
+  if (!summaryFile.empty ())
+    {
+      std::ofstream file (summaryFile);
+      if (!file)
+        {
+          NS_LOG_ERROR ("Cannot open summary file " << summaryFile);
+          return false;
+        }
+      tracker->WriteSummary (file);
+      if (!file.good ())
+        {
+          return false;
+        }
+    }
+  
+  return true;
+}
+
 } // namespace dtn7
 
 } // namespace ns3
\ No newline at end of file
@@ -5,8 +5,15 @@
 #include "ns3/node-container.h"
 #include "ns3/application-container.h"
 #include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/vector.h"
+
+#include <string>
+#include <vector>
 
 #include "../model/dtn-node.h"
+#include "../model/bundle-lifecycle.h"
 #include "../model/routing.h"
 #include "../model/bundle-store.h"
 #include "../model/convergence-layer.h"
@@ -18,6 +25,20 @@ namespace dtn7 {
 /**
  * \ingroup dtn7
  * \brief Helper class to install DTN nodes
+ *
+ * In a distributed simulation (ns-3 MPI, with SimulatorImplementationType
+ * set to ns3::DistributedSimulatorImpl or ns3::NullMessageSimulatorImpl)
+ * every rank runs the same script; the Install methods then only install
+ * on the nodes whose system ID is the rank's, and the returned containers
+ * hold those applications only. DTN nodes exchange bundles only through
+ * their convergence layers, so links between ranks must be ones ns-3 can
+ * carry across ranks, i.e. point-to-point links. Process-wide state,
+ * such as DtnNode's shared timer groups, which hold pointers to all
+ * running nodes of the process, and shared contact plans, thus only
+ * ever covers the nodes of the local rank. CreatePartitionedNodes
+ * assigns nodes to ranks by region so that most contacts stay within one
+ * rank. WriteMetrics and WriteLifecycle write one file per rank, which
+ * MergeMetrics and MergeLifecycle join after the run.
  */
 class Dtn7Helper
 {
@@ -117,6 +138,40 @@ public:
                            std::string n6 = "", const AttributeValue &v6 = EmptyAttributeValue (),
                            std::string n7 = "", const AttributeValue &v7 = EmptyAttributeValue ());
   
+  /**
+   * \brief Enable peer discovery with the given agent type
+   *
+   * Without a discovery agent, peers reached over connectionless
+   * convergence layers are only identified once a bundle from them
+   * carries a previous node block.
+   * \param discoveryType Type of discovery agent to use
+   * \param n0 First attribute name
+   * \param v0 First attribute value
+   * \param n1 Second attribute name
+   * \param v1 Second attribute value
+   * \param n2 Third attribute name
+   * \param v2 Third attribute value
+   * \param n3 Fourth attribute name
+   * \param v3 Fourth attribute value
+   * \param n4 Fifth attribute name
+   * \param v4 Fifth attribute value
+   * \param n5 Sixth attribute name
+   * \param v5 Sixth attribute value
+   * \param n6 Seventh attribute name
+   * \param v6 Seventh attribute value
+   * \param n7 Eighth attribute name
+   * \param v7 Eighth attribute value
+   */
+  void SetDiscoveryAgent (std::string discoveryType,
+                          std::string n0 = "", const AttributeValue &v0 = EmptyAttributeValue (),
+                          std::string n1 = "", const AttributeValue &v1 = EmptyAttributeValue (),
+                          std::string n2 = "", const AttributeValue &v2 = EmptyAttributeValue (),
+                          std::string n3 = "", const AttributeValue &v3 = EmptyAttributeValue (),
+                          std::string n4 = "", const AttributeValue &v4 = EmptyAttributeValue (),
+                          std::string n5 = "", const AttributeValue &v5 = EmptyAttributeValue (),
+                          std::string n6 = "", const AttributeValue &v6 = EmptyAttributeValue (),
+                          std::string n7 = "", const AttributeValue &v7 = EmptyAttributeValue ());
+  
   /**
    * \brief Install DTN nodes on a container of nodes
    * \param c NodeContainer of nodes to install DTN on
@@ -137,12 +192,145 @@ public:
    * \return Container with the DTN node application
    */
   ApplicationContainer Install (std::string nodeName);
+  
+  /**
+   * \brief Install DTN nodes on a large container of nodes
+   *
+   * Unlike Install, the nodes get start times spread uniformly over
+   * [start, start + startJitter], so that the discovery beacons of
+   * thousands of nodes do not fire in lockstep at the same instant. With
+   * DtnNode's SharedTimers, the periodic routing and cleanup tasks run
+   * from one event per start phase, so they are staggered only as finely
+   * as the SharedTimerSlots phases of each interval allow; nodes starting
+   * in the same phase still run these tasks together. Routing algorithms with a
+   * SharedContactPlan attribute share one read-only contact plan between
+   * all nodes. Calling Start on the returned container undoes the
+   * staggering. The wall-clock setup time is logged and available from
+   * GetLastSetupTime.
+   * \param c NodeContainer of nodes to install DTN on
+   * \param start Earliest start time
+   * \param startJitter Width of the start time window
+   * \return Container of DTN node applications
+   */
+  ApplicationContainer InstallBulk (NodeContainer c, Time start, Time startJitter);
+  
+  /**
+   * \brief Get the wall-clock duration of the last InstallBulk
+   * \return Setup time in seconds
+   */
+  double GetLastSetupTime () const;
+  
+  /**
+   * \brief Assign a fixed random variable stream to the start time jitter
+   * \param stream Stream index to use
+   * \return Number of stream indices assigned
+   */
+  int64_t AssignStreams (int64_t stream);
+  
+  /**
+   * \brief Assign nodes to ranks by region
+   *
+   * Recursively splits the area along its longer side into regions with
+   * equal numbers of nodes, one region per rank, so that nearby nodes,
+   * which are the ones in contact, share a rank.
+   * \param positions Initial node positions
+   * \param systemCount Number of ranks
+   * \return System ID of each node, in the order of positions
+   */
+  static std::vector<uint32_t> PartitionByRegion (const std::vector<Vector>& positions, uint32_t systemCount);
+  
+  /**
+   * \brief Create nodes assigned to ranks by PartitionByRegion
+   *
+   * Call on every rank with the same positions, before installing
+   * mobility with the same initial positions, e.g. through a
+   * ListPositionAllocator.
+   * \param positions Initial node positions
+   * \param systemCount Number of ranks
+   * \return Nodes, in the order of positions
+   */
+  static NodeContainer CreatePartitionedNodes (const std::vector<Vector>& positions, uint32_t systemCount);
+  
+  /**
+   * \brief Check whether the simulation is distributed over ranks
+   * \return true with a distributed simulator implementation
+   */
+  static bool IsDistributed ();
+  
+  /**
+   * \brief Get the name of this rank's output file
+   * \param fileName Output file of the whole simulation
+   * \return fileName with ".rank<N>" inserted before the extension in
+   * distributed simulations, fileName otherwise
+   */
+  static std::string GetRankFileName (const std::string& fileName);
+  
+  /**
+   * \brief Write the metrics of installed DTN nodes to a file
+   *
+   * Call after Simulator::Run (). Files ending in ".json" get one JSON
+   * object keyed by node ID, all others CSV rows in the format described
+   * at MetricsRegistry, with the node ID in the first column.
+   * \param apps DTN node applications, as returned by Install
+   * \param fileName Output file
+   * \return true if the file was written
+   */
+  static bool WriteMetrics (ApplicationContainer apps, const std::string& fileName);
+  
+  /**
+   * \brief Join metrics files written by WriteMetrics, e.g. of all ranks
+   * \param files Input files, all CSV or all JSON
+   * \param fileName Output file, JSON if it ends in ".json"
+   * \return true if all files were read and the output written
+   */
+  static bool MergeMetrics (const std::vector<std::string>& files, const std::string& fileName);
+  
+  /**
+   * \brief Follow bundles across the installed DTN nodes
+   *
+   * Connects a new tracker to the BundleLifecycle trace source of every
+   * node. Call before Simulator::Run ().
+   * \param apps DTN node applications, as returned by Install
+   * \return Tracker collecting the events
+   */
+  static Ptr<BundleLifecycleTracker> EnableLifecycleTracing (ApplicationContainer apps);
+  
+  /**
+   * \brief Write the per-bundle timelines and the summary of a tracker
+   *
+   * Call after Simulator::Run (). The summary holds the delivery ratio,
+   * delay percentiles and overhead ratio as "Metric,Value" rows, like the
+   * result files of the research scenarios.
+   * \param tracker Tracker returned by EnableLifecycleTracing
+   * \param timelineFile Output file for the timelines, none if empty
+   * \param summaryFile Output file for the summary, none if empty
+   * \return true if the files were written
+   */
+  static bool WriteLifecycle (Ptr<BundleLifecycleTracker> tracker, const std::string& timelineFile,
+                              const std::string& summaryFile);
+  
+  /**
+   * \brief Join timeline files written by WriteLifecycle, e.g. of all ranks
+   *
+   * Bundles travel between ranks, so only the joined timelines give the
+   * delivery ratio, delays and overhead of the whole network.
+   * \param files Timeline files
+   * \param timelineFile Output file for the joined timelines, none if empty
+   * \param summaryFile Output file for the summary, none if empty
+   * \return true if all files were read and the outputs written
+   */
+  static bool MergeLifecycle (const std::vector<std::string>& files, const std::string& timelineFile,
+                              const std::string& summaryFile);
 
 private:
   ObjectFactory m_routingFactory;    //!< Routing algorithm factory
   ObjectFactory m_storeFactory;      //!< Bundle store factory
   ObjectFactory m_claFactory;        //!< Convergence layer factory
   ObjectFactory m_nodeFactory;       //!< DTN node factory
+  ObjectFactory m_discoveryFactory;  //!< Discovery agent factory
+  bool m_discoveryEnabled;           //!< Whether a discovery agent is installed
+  Ptr<UniformRandomVariable> m_startJitter; //!< Start time offsets of InstallBulk
+  double m_lastSetupTime;            //!< Wall-clock duration of the last InstallBulk in seconds
   
   /**
    * \brief Install DTN node on a node
@@ -150,6 +338,16 @@ private:
    * \return DTN node application
    */
   Ptr<Application> InstallPriv (Ptr<Node> node);
+  
+  /**
+   * \brief Write the timelines and summary of a tracker to the given files
+   * \param tracker Tracker
+   * \param timelineFile Output file for the timelines, none if empty
+   * \param summaryFile Output file for the summary, none if empty
+   * \return true if the files were written
+   */
+  static bool WriteLifecycleFiles (Ptr<BundleLifecycleTracker> tracker, const std::string& timelineFile,
+                                   const std::string& summaryFile);
 };
 
 } // namespace dtn7
@@ -10,7 +10,13 @@ namespace dtn7 {
 std::optional<Ptr<AdministrativeRecord>> 
 AdministrativeRecord::FromCbor(Buffer buffer)
 {
-  auto cborOpt = Cbor::Decode(buffer);
+  return FromCbor(buffer.PeekData(), buffer.GetSize());
+}
+
+std::optional<Ptr<AdministrativeRecord>> 
+AdministrativeRecord::FromCbor(const uint8_t* data, size_t size)
+{
+  auto cborOpt = Cbor::Decode(data, size);
   if (!cborOpt)
     {
       return std::nullopt;
@@ -35,7 +41,7 @@ AdministrativeRecord::FromCbor(Buffer buffer)
     {
       case AdminRecordType::BUNDLE_STATUS_REPORT:
         {
-          auto reportOpt = BundleStatusReport::FromCbor(buffer);
+          auto reportOpt = BundleStatusReport::FromCborValue(array[1]);
           if (!reportOpt)
             {
               return std::nullopt;
@@ -43,6 +49,16 @@ AdministrativeRecord::FromCbor(Buffer buffer)
           Ptr<BundleStatusReport> report = Create<BundleStatusReport>(*reportOpt);
           return report;
         }
+      case AdminRecordType::AGGREGATE_STATUS_REPORT:
+        {
+          auto aggregateOpt = AggregateStatusReport::FromCborValue(cbor);
+          if (!aggregateOpt)
+            {
+              return std::nullopt;
+            }
+          Ptr<AggregateStatusReport> aggregate = Create<AggregateStatusReport>(*aggregateOpt);
+          return aggregate;
+        }
       case AdminRecordType::CUSTODY_SIGNAL:
         // 暂不支持管理信号
         // TODO: 实现管理信号
@@ -86,6 +102,15 @@ BundleStatusReport::ToCbor() const
   // 添加记录类型
   array.push_back(Cbor::CborValue(static_cast<uint64_t>(AdminRecordType::BUNDLE_STATUS_REPORT)));
   
+  // 添加状态报告数组到主数组
+  array.push_back(ToCborValue());
+  
+  return Cbor::Encode(Cbor::CborValue(array));
+}
+
+Cbor::CborValue 
+BundleStatusReport::ToCborValue() const
+{
   // 创建状态报告数组
   Cbor::CborArray reportArray;
   
@@ -151,10 +176,7 @@ BundleStatusReport::ToCbor() const
       reportArray.push_back(Cbor::CborValue(static_cast<uint64_t>(0)));
     }
   
-  // 添加状态报告数组到主数组
-  array.push_back(Cbor::CborValue(reportArray));
-  
-  return Cbor::Encode(Cbor::CborValue(array));
+  return Cbor::CborValue(reportArray);
 }
 
 std::string 
@@ -222,7 +244,18 @@ BundleStatusReport::FromCbor(Buffer buffer)
       return std::nullopt;
     }
 
-  const auto& reportArray = array[1].GetArray();
+  return FromCborValue(array[1]);
+}
+
+std::optional<BundleStatusReport> 
+BundleStatusReport::FromCborValue(const Cbor::CborValue& value)
+{
+  if (!value.IsArray())
+    {
+      return std::nullopt;
+    }
+
+  const auto& reportArray = value.GetArray();
   if (reportArray.size() < 7)  // 至少需要7个元素
     {
       return std::nullopt;
@@ -360,6 +393,78 @@ BundleStatusReport::HasStatusFlag(BundleStatusFlag flag) const
   return (static_cast<uint64_t>(m_statusFlags) & static_cast<uint64_t>(flag)) != 0;
 }
 
+// AggregateStatusReport 实现
+
+AdminRecordType 
+AggregateStatusReport::GetAdministrativeRecordType() const
+{
+  return AdminRecordType::AGGREGATE_STATUS_REPORT;
+}
+
+Buffer 
+AggregateStatusReport::ToCbor() const
+{
+  Cbor::CborArray reports;
+  reports.reserve(m_reports.size());
+  for (const BundleStatusReport& report : m_reports)
+    {
+      reports.push_back(report.ToCborValue());
+    }
+  
+  Cbor::CborArray array;
+  array.push_back(Cbor::CborValue(static_cast<uint64_t>(AdminRecordType::AGGREGATE_STATUS_REPORT)));
+  array.push_back(Cbor::CborValue(reports));
+  
+  return Cbor::Encode(Cbor::CborValue(array));
+}
+
+std::string 
+AggregateStatusReport::ToString() const
+{
+  std::stringstream ss;
+  
+  ss << "AggregateStatusReport(";
+  for (size_t i = 0; i < m_reports.size(); i++)
+    {
+      ss << (i > 0 ? ", " : "") << m_reports[i].ToString();
+    }
+  ss << ")";
+  
+  return ss.str();
+}
+
+std::optional<AggregateStatusReport> 
+AggregateStatusReport::FromCborValue(const Cbor::CborValue& value)
+{
+  if (!value.IsArray())
+    {
+      return std::nullopt;
+    }
+  
+  const auto& array = value.GetArray();
+  if (array.size() < 2 || 
+      array[0].GetUnsignedInteger() != static_cast<uint64_t>(AdminRecordType::AGGREGATE_STATUS_REPORT) ||
+      !array[1].IsArray())
+    {
+      return std::nullopt;
+    }
+  
+  // 无法解析的单条报告被跳过，不影响其余报告
+  AggregateStatusReport aggregate;
+  const auto& reports = array[1].GetArray();
+  aggregate.m_reports.reserve(reports.size());
+  for (size_t i = 0; i < reports.size(); i++)
+    {
+      auto reportOpt = BundleStatusReport::FromCborValue(reports[i]);
+      if (reportOpt)
+        {
+          aggregate.m_reports.push_back(*reportOpt);
+        }
+    }
+  
+  return aggregate;
+}
+
 } // namespace dtn7
 
 } // namespace ns3
\ No newline at end of file
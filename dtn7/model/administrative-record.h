@@ -10,6 +10,7 @@
 #include <optional>
 
 #include "bundle-id.h"
+#include "cbor.h"
 #include "endpoint.h"
 #include "dtn-time.h"
 #include "bundle.h"
@@ -23,7 +24,8 @@ namespace dtn7 {
  */
 enum class AdminRecordType : uint64_t {
   BUNDLE_STATUS_REPORT = 1,  //!< Bundle状态报告
-  CUSTODY_SIGNAL = 2         //!< 管理信号
+  CUSTODY_SIGNAL = 2,        //!< 管理信号
+  AGGREGATE_STATUS_REPORT = 192 //!< 多条状态报告的聚合（私有类型）
 };
 
 /**
@@ -74,6 +76,14 @@ public:
    */
   static std::optional<Ptr<AdministrativeRecord>> FromCbor(Buffer buffer);
   
+  /**
+   * \brief 从CBOR反序列化，直接读取bundle载荷
+   * \param data CBOR编码数据的指针
+   * \param size CBOR编码数据的大小
+   * \return 反序列化的管理记录，失败返回空
+   */
+  static std::optional<Ptr<AdministrativeRecord>> FromCbor(const uint8_t* data, size_t size);
+  
   /**
    * \brief 获取文本表示
    * \return 文本表示
@@ -121,6 +131,19 @@ public:
    */
   static std::optional<BundleStatusReport> FromCbor(Buffer buffer);
   
+  /**
+   * \brief 获取不含记录类型的报告内容，供聚合报告逐条编码
+   * \return 状态报告数组
+   */
+  Cbor::CborValue ToCborValue() const;
+  
+  /**
+   * \brief 从不含记录类型的报告内容解析
+   * \param value 状态报告数组
+   * \return 状态报告，失败返回空
+   */
+  static std::optional<BundleStatusReport> FromCborValue(const Cbor::CborValue& value);
+  
   /**
    * \brief 创建Bundle成功接收状态报告
    * \param bundle 源Bundle
@@ -268,6 +291,44 @@ private:
   std::optional<DtnTime> m_deletionTime;   //!< 删除时间
 };
 
+/**
+ * \ingroup dtn7
+ * \brief 发往同一报告端点的多条状态报告
+ *
+ * 一个管理记录bundle携带多条状态报告，避免每条报告各占一个bundle。
+ * 编码为 [AGGREGATE_STATUS_REPORT, [报告1, 报告2, ...]]，每条报告与
+ * BundleStatusReport中记录类型之后的数组相同，接收方只需解码一次。
+ */
+class AggregateStatusReport : public AdministrativeRecord {
+public:
+  // 继承自AdministrativeRecord
+  AdminRecordType GetAdministrativeRecordType() const override;
+  Buffer ToCbor() const override;
+  std::string ToString() const override;
+  
+  /**
+   * \brief 从CBOR反序列化
+   * \param value 解码后的管理记录
+   * \return 聚合报告，失败返回空
+   */
+  static std::optional<AggregateStatusReport> FromCborValue(const Cbor::CborValue& value);
+  
+  /**
+   * \brief 添加一条状态报告
+   * \param report 状态报告
+   */
+  void AddReport(const BundleStatusReport& report) { m_reports.push_back(report); }
+  
+  /**
+   * \brief 获取所有状态报告
+   * \return 状态报告
+   */
+  const std::vector<BundleStatusReport>& GetReports() const { return m_reports; }
+
+private:
+  std::vector<BundleStatusReport> m_reports; //!< 状态报告
+};
+
 /**
  * \brief 原因代码
  */
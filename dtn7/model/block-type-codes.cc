@@ -17,6 +17,14 @@ BlockTypeToString(BlockType type)
         return "BundleAgeBlock";
       case BlockType::HOP_COUNT_BLOCK:
         return "HopCountBlock";
+      case BlockType::SUMMARY_VECTOR_BLOCK:
+        return "SummaryVectorBlock";
+      case BlockType::SPRAY_COPIES_BLOCK:
+        return "SprayCopiesBlock";
+      case BlockType::PROPHET_VECTOR_BLOCK:
+        return "ProphetVectorBlock";
+      case BlockType::ANTI_PACKET_BLOCK:
+        return "AntiPacketBlock";
       default:
         return "UnknownBlock_" + std::to_string(static_cast<uint64_t>(type));
     }
@@ -41,6 +49,22 @@ BlockTypeFromString(const std::string& typeStr)
     {
       return BlockType::HOP_COUNT_BLOCK;
     }
+  else if (typeStr == "SummaryVectorBlock")
+    {
+      return BlockType::SUMMARY_VECTOR_BLOCK;
+    }
+  else if (typeStr == "SprayCopiesBlock")
+    {
+      return BlockType::SPRAY_COPIES_BLOCK;
+    }
+  else if (typeStr == "ProphetVectorBlock")
+    {
+      return BlockType::PROPHET_VECTOR_BLOCK;
+    }
+  else if (typeStr == "AntiPacketBlock")
+    {
+      return BlockType::ANTI_PACKET_BLOCK;
+    }
   // Default to payload block for unknown types
   return BlockType::PAYLOAD_BLOCK;
 }
@@ -15,7 +15,11 @@ enum class BlockType : uint64_t {
   PAYLOAD_BLOCK = 1,               //!< Bundle payload
   PREVIOUS_NODE_BLOCK = 6,         //!< Previous node endpoint
   BUNDLE_AGE_BLOCK = 7,            //!< Bundle age
-  HOP_COUNT_BLOCK = 10             //!< Hop count
+  HOP_COUNT_BLOCK = 10,            //!< Hop count
+  SUMMARY_VECTOR_BLOCK = 192,      //!< Epidemic summary vector (private use range)
+  SPRAY_COPIES_BLOCK = 193,        //!< Spray-and-wait copy tokens (private use range)
+  PROPHET_VECTOR_BLOCK = 194,      //!< PRoPHET delivery predictabilities (private use range)
+  ANTI_PACKET_BLOCK = 195          //!< Delivery acknowledgements of replicated bundles (private use range)
 };
 
 /**
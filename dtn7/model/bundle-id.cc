@@ -116,23 +116,77 @@ BundleID::ToString() const
   return ss.str();
 }
 
+std::optional<BundleID> 
+BundleID::FromString(const std::string& str)
+{
+  // The source EID may contain '@', the timestamp and numbers do not
+  size_t at = str.rfind('@');
+  if (at == std::string::npos)
+    {
+      return std::nullopt;
+    }
+  size_t hash = str.find('#', at);
+  if (hash == std::string::npos)
+    {
+      return std::nullopt;
+    }
+  
+  auto timestamp = DtnTime::FromString(str.substr(at + 1, hash - at - 1));
+  if (!timestamp)
+    {
+      return std::nullopt;
+    }
+  
+  // Sequence number, then the fragment offset of fragments
+  std::istringstream numbers(str.substr(hash + 1));
+  uint64_t sequenceNumber;
+  if (!(numbers >> sequenceNumber))
+    {
+      return std::nullopt;
+    }
+  bool isFragment = false;
+  uint64_t fragmentOffset = 0;
+  if (numbers.peek() == ':')
+    {
+      numbers.get();
+      if (!(numbers >> fragmentOffset))
+        {
+          return std::nullopt;
+        }
+      isFragment = true;
+    }
+  if (numbers.peek() != std::char_traits<char>::eof())
+    {
+      return std::nullopt;
+    }
+  
+  return BundleID(EndpointID(str.substr(0, at)), *timestamp, sequenceNumber, isFragment, fragmentOffset);
+}
+
 size_t 
 BundleID::Hash() const
 {
-  size_t hash = 0;
-  std::string sourceStr = m_source.ToString();
+  // Mix the cached EID hash with the numeric fields, splitmix64 style,
+  // so the same source with consecutive sequence numbers spreads well
+  auto mix = [](uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+  };
   
-  // Combine hash values from all fields
-  hash ^= std::hash<std::string>{}(sourceStr);
-  hash ^= std::hash<uint64_t>{}(m_timestamp.GetSeconds()) << 1;
-  hash ^= std::hash<uint64_t>{}(m_sequenceNumber) << 1;
+  uint64_t hash = m_source.Hash();
+  hash = mix(hash ^ m_timestamp.GetSeconds());
+  hash = mix(hash ^ m_sequenceNumber);
   
   if (m_isFragment)
     {
-      hash ^= std::hash<uint64_t>{}(m_fragmentOffset) << 1;
+      hash = mix(hash ^ m_fragmentOffset);
     }
   
-  return hash;
+  return static_cast<size_t>(hash);
 }
 
 } // namespace dtn7
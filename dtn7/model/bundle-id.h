@@ -2,6 +2,7 @@
 #define DTN7_BUNDLE_ID_H
 
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <functional> // 添加这行来支持哈希函数
 #include "endpoint.h"
@@ -97,6 +98,13 @@ public:
    */
   std::string ToString () const;
   
+  /**
+   * \brief Parse the string representation written by ToString
+   * \param str String representation
+   * \return Bundle ID, empty if the string is malformed
+   */
+  static std::optional<BundleID> FromString (const std::string& str);
+  
   /**
    * \brief Calculate hash for use in hash maps
    * \return Hash value
@@ -0,0 +1,315 @@
+#include "bundle-lifecycle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+std::string 
+GetLifecycleEventName (BundleLifecycleEvent event)
+{
+  switch (event)
+    {
+    case BundleLifecycleEvent::CREATED:
+      return "created";
+    case BundleLifecycleEvent::STORED:
+      return "stored";
+    case BundleLifecycleEvent::SENT:
+      return "sent";
+    case BundleLifecycleEvent::RECEIVED:
+      return "received";
+    case BundleLifecycleEvent::DUPLICATE:
+      return "duplicate";
+    case BundleLifecycleEvent::DELIVERED:
+      return "delivered";
+    case BundleLifecycleEvent::EXPIRED:
+      return "expired";
+    case BundleLifecycleEvent::EVICTED:
+      return "evicted";
+    }
+  return "unknown";
+}
+
+namespace {
+
+// Inverse of GetLifecycleEventName
+bool 
+ParseLifecycleEvent (const std::string& name, BundleLifecycleEvent& event)
+{
+  for (uint8_t value = 0; value <= static_cast<uint8_t> (BundleLifecycleEvent::EVICTED); value++)
+    {
+      if (GetLifecycleEventName (static_cast<BundleLifecycleEvent> (value)) == name)
+        {
+          event = static_cast<BundleLifecycleEvent> (value);
+          return true;
+        }
+    }
+  return false;
+}
+
+} // anonymous namespace
+
+void 
+BundleLifecycleTracker::Record (const BundleLifecycleRecord& record)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  auto inserted = m_timelines.try_emplace (record.id);
+  if (inserted.second)
+    {
+      m_order.push_back (record.id);
+    }
+  inserted.first->second.push_back (record);
+}
+
+std::vector<BundleLifecycleRecord> 
+BundleLifecycleTracker::GetTimeline (const BundleID& id) const
+{
+  std::vector<BundleLifecycleRecord> timeline;
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    auto it = m_timelines.find (id);
+    if (it != m_timelines.end ())
+      {
+        timeline = it->second;
+      }
+  }
+  
+  // Events of one simulator time keep the order they were recorded in
+  std::stable_sort (timeline.begin (), timeline.end (),
+                    [] (const BundleLifecycleRecord& a, const BundleLifecycleRecord& b) {
+                      return a.time < b.time;
+                    });
+  return timeline;
+}
+
+BundleLifecycleTracker::Totals 
+BundleLifecycleTracker::GetTotals () const
+{
+  Totals totals;
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  for (const auto& pair : m_timelines)
+    {
+      const std::vector<BundleLifecycleRecord>& events = pair.second;
+      auto created = std::find_if (events.begin (), events.end (), [] (const BundleLifecycleRecord& r) {
+        return r.event == BundleLifecycleEvent::CREATED;
+      });
+      if (created == events.end ())
+        {
+          continue;
+        }
+      
+      totals.created++;
+      bool delivered = false;
+      Time firstDelivery;
+      for (const BundleLifecycleRecord& record : events)
+        {
+          switch (record.event)
+            {
+            case BundleLifecycleEvent::SENT:
+              totals.transmissions++;
+              break;
+            case BundleLifecycleEvent::DUPLICATE:
+              totals.duplicates++;
+              break;
+            case BundleLifecycleEvent::EXPIRED:
+              totals.expired++;
+              break;
+            case BundleLifecycleEvent::EVICTED:
+              totals.evicted++;
+              break;
+            case BundleLifecycleEvent::DELIVERED:
+              if (!delivered || record.time < firstDelivery)
+                {
+                  firstDelivery = record.time;
+                }
+              delivered = true;
+              break;
+            default:
+              break;
+            }
+        }
+      
+      if (delivered)
+        {
+          totals.delivered++;
+          totals.latencies.push_back (firstDelivery - created->time);
+        }
+    }
+  
+  std::sort (totals.latencies.begin (), totals.latencies.end ());
+  return totals;
+}
+
+uint64_t 
+BundleLifecycleTracker::GetCreatedCount () const
+{
+  return GetTotals ().created;
+}
+
+uint64_t 
+BundleLifecycleTracker::GetDeliveredCount () const
+{
+  return GetTotals ().delivered;
+}
+
+double 
+BundleLifecycleTracker::GetDeliveryRatio () const
+{
+  Totals totals = GetTotals ();
+  return totals.created > 0 ? static_cast<double> (totals.delivered) / totals.created : 0.0;
+}
+
+double 
+BundleLifecycleTracker::GetOverheadRatio () const
+{
+  Totals totals = GetTotals ();
+  if (totals.delivered == 0)
+    {
+      return 0.0;
+    }
+  return (static_cast<double> (totals.transmissions) - totals.delivered) / totals.delivered;
+}
+
+std::vector<Time> 
+BundleLifecycleTracker::GetLatencies () const
+{
+  return GetTotals ().latencies;
+}
+
+namespace {
+
+Time 
+Quantile (const std::vector<Time>& sorted, double q)
+{
+  if (sorted.empty ())
+    {
+      return Time (0);
+    }
+  
+  // Nearest rank
+  size_t rank = static_cast<size_t> (std::ceil (std::clamp (q, 0.0, 1.0) * sorted.size ()));
+  return sorted[std::max<size_t> (rank, 1) - 1];
+}
+
+} // anonymous namespace
+
+Time 
+BundleLifecycleTracker::GetLatencyQuantile (double q) const
+{
+  return Quantile (GetLatencies (), q);
+}
+
+void 
+BundleLifecycleTracker::WriteTimelines (std::ostream& os) const
+{
+  std::vector<BundleID> order;
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    order = m_order;
+  }
+  
+  // Times to the nanosecond, so that ReadTimelines gets them back exactly
+  std::ios::fmtflags flags = os.flags ();
+  std::streamsize precision = os.precision ();
+  os << std::fixed << std::setprecision (9);
+  
+  os << "bundle,node,event,time_s,bytes,cla\n";
+  for (const BundleID& id : order)
+    {
+      std::string bundle = id.ToString ();
+      for (const BundleLifecycleRecord& record : GetTimeline (id))
+        {
+          os << bundle << "," << record.node.ToString () << "," << GetLifecycleEventName (record.event)
+             << "," << record.time.GetSeconds () << "," << record.bytes << "," << record.cla << "\n";
+        }
+    }
+  
+  os.flags (flags);
+  os.precision (precision);
+}
+
+bool 
+BundleLifecycleTracker::ReadTimelines (std::istream& is)
+{
+  std::string line;
+  if (!std::getline (is, line) || line != "bundle,node,event,time_s,bytes,cla")
+    {
+      return false;
+    }
+  
+  while (std::getline (is, line))
+    {
+      if (line.empty ())
+        {
+          continue;
+        }
+      
+      std::vector<std::string> fields;
+      std::istringstream row (line);
+      std::string field;
+      while (std::getline (row, field, ','))
+        {
+          fields.push_back (field);
+        }
+      if (!line.empty () && line.back () == ',')
+        {
+          fields.push_back ("");
+        }
+      if (fields.size () != 6)
+        {
+          return false;
+        }
+      
+      std::optional<BundleID> id = BundleID::FromString (fields[0]);
+      BundleLifecycleEvent event;
+      double seconds;
+      uint64_t bytes;
+      std::istringstream time (fields[3]);
+      std::istringstream size (fields[4]);
+      if (!id || !ParseLifecycleEvent (fields[2], event) || !(time >> seconds) || !(size >> bytes))
+        {
+          return false;
+        }
+      
+      Record ({*id, NodeID (fields[1]), event, NanoSeconds (std::llround (seconds * 1e9)), bytes, fields[5]});
+    }
+  return true;
+}
+
+void 
+BundleLifecycleTracker::WriteSummary (std::ostream& os) const
+{
+  Totals totals = GetTotals ();
+  Time sum;
+  for (const Time& latency : totals.latencies)
+    {
+      sum += latency;
+    }
+  
+  os << "Metric,Value\n";
+  os << "BundlesCreated," << totals.created << "\n";
+  os << "BundlesDelivered," << totals.delivered << "\n";
+  os << "DeliveryRatio," << (totals.created > 0 ? static_cast<double> (totals.delivered) / totals.created : 0.0) << "\n";
+  os << "AverageDelay," << (totals.latencies.empty () ? 0.0 : sum.GetSeconds () / totals.latencies.size ()) << "\n";
+  os << "MedianDelay," << Quantile (totals.latencies, 0.5).GetSeconds () << "\n";
+  os << "P90Delay," << Quantile (totals.latencies, 0.9).GetSeconds () << "\n";
+  os << "P99Delay," << Quantile (totals.latencies, 0.99).GetSeconds () << "\n";
+  os << "MaxDelay," << (totals.latencies.empty () ? 0.0 : totals.latencies.back ().GetSeconds ()) << "\n";
+  os << "Transmissions," << totals.transmissions << "\n";
+  os << "OverheadRatio,"
+     << (totals.delivered > 0 ? (static_cast<double> (totals.transmissions) - totals.delivered) / totals.delivered : 0.0)
+     << "\n";
+  os << "Duplicates," << totals.duplicates << "\n";
+  os << "Expired," << totals.expired << "\n";
+  os << "Evicted," << totals.evicted << "\n";
+}
+
+} // namespace dtn7
+
+} // namespace ns3
@@ -0,0 +1,182 @@
+#ifndef DTN7_BUNDLE_LIFECYCLE_H
+#define DTN7_BUNDLE_LIFECYCLE_H
+
+#include "ns3/nstime.h"
+#include "ns3/simple-ref-count.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bundle-id.h"
+#include "endpoint.h"
+#include "optional-mutex.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Step in the life of a bundle at one node
+ */
+enum class BundleLifecycleEvent : uint8_t {
+  CREATED,    //!< Handed to the node by a local application
+  STORED,     //!< Accepted by the node's store
+  SENT,       //!< Handed to a convergence layer towards a peer
+  RECEIVED,   //!< Received from a peer
+  DUPLICATE,  //!< Received again and dropped
+  DELIVERED,  //!< Delivered to a local endpoint
+  EXPIRED,    //!< Deleted from the store after its lifetime
+  EVICTED     //!< Deleted from the store for space
+};
+
+/**
+ * \brief Get the name of a lifecycle event
+ * \param event Event
+ * \return Name, e.g. "delivered"
+ */
+std::string GetLifecycleEventName (BundleLifecycleEvent event);
+
+/**
+ * \ingroup dtn7
+ * \brief One lifecycle event of a bundle
+ */
+struct BundleLifecycleRecord
+{
+  BundleID id;                 //!< Bundle
+  NodeID node;                 //!< Node the event happened at
+  BundleLifecycleEvent event;  //!< Event
+  Time time;                   //!< Simulation time
+  uint64_t bytes;              //!< Payload bytes, or encoded bytes for STORED and SENT
+  std::string cla;             //!< Convergence layer type for SENT, empty otherwise
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Stitches the lifecycle events of all nodes into per-bundle timelines
+ *
+ * Connect Record to the BundleLifecycle trace source of every DtnNode,
+ * e.g. with Dtn7Helper::EnableLifecycleTracing. Since bundle IDs are the
+ * same at every hop, the events of one bundle form its timeline across
+ * the network.
+ *
+ * Only bundles with a CREATED event, i.e. sent by applications, count
+ * for the summary. Their latency is the time from creation to the first
+ * delivery; the overhead ratio is (transmissions - delivered) / delivered,
+ * where transmissions counts the SENT events of those bundles.
+ */
+class BundleLifecycleTracker : public SimpleRefCount<BundleLifecycleTracker>
+{
+public:
+  /**
+   * \brief Add an event
+   * \param record Event
+   */
+  void Record (const BundleLifecycleRecord& record);
+  
+  /**
+   * \brief Get the events of one bundle in time order
+   * \param id Bundle ID
+   * \return Events, empty if the bundle is unknown
+   */
+  std::vector<BundleLifecycleRecord> GetTimeline (const BundleID& id) const;
+  
+  /**
+   * \brief Get the number of bundles created by applications
+   * \return Count
+   */
+  uint64_t GetCreatedCount () const;
+  
+  /**
+   * \brief Get the number of created bundles delivered at least once
+   * \return Count
+   */
+  uint64_t GetDeliveredCount () const;
+  
+  /**
+   * \brief Get the share of created bundles that were delivered
+   * \return Ratio in [0, 1], 0 if nothing was created
+   */
+  double GetDeliveryRatio () const;
+  
+  /**
+   * \brief Get the transmissions per delivered bundle beyond the first
+   * \return Overhead ratio, 0 if nothing was delivered
+   */
+  double GetOverheadRatio () const;
+  
+  /**
+   * \brief Get the end-to-end latencies of the delivered bundles
+   * \return Latencies in ascending order
+   */
+  std::vector<Time> GetLatencies () const;
+  
+  /**
+   * \brief Get a latency quantile
+   * \param q Quantile in [0, 1]
+   * \return Latency, zero if nothing was delivered
+   */
+  Time GetLatencyQuantile (double q) const;
+  
+  /**
+   * \brief Write all timelines as CSV, one event per row, grouped by bundle
+   *
+   * Columns are "bundle,node,event,time_s,bytes,cla".
+   * \param os Output stream
+   */
+  void WriteTimelines (std::ostream& os) const;
+  
+  /**
+   * \brief Add the events of timelines written by WriteTimelines
+   *
+   * Used to join the trackers of the ranks of a distributed simulation,
+   * each of which only sees the events of its own nodes.
+   * \param is Input stream
+   * \return true if every row was read
+   */
+  bool ReadTimelines (std::istream& is);
+  
+  /**
+   * \brief Write the summary as "Metric,Value" CSV rows
+   *
+   * Delays are in seconds, as in the result files of the research
+   * scenarios.
+   * \param os Output stream
+   */
+  void WriteSummary (std::ostream& os) const;
+
+private:
+  /**
+   * \brief Totals over the created bundles
+   */
+  struct Totals
+  {
+    uint64_t created = 0;        //!< Bundles created by applications
+    uint64_t delivered = 0;      //!< Of those, delivered at least once
+    uint64_t transmissions = 0;  //!< Of those, SENT events
+    uint64_t duplicates = 0;     //!< Of those, DUPLICATE events
+    uint64_t expired = 0;        //!< Of those, EXPIRED events
+    uint64_t evicted = 0;        //!< Of those, EVICTED events
+    std::vector<Time> latencies; //!< Latencies of the delivered ones, ascending
+  };
+  
+  /**
+   * \brief Compute the totals
+   * \return Totals
+   */
+  Totals GetTotals () const;
+  
+  std::unordered_map<BundleID, std::vector<BundleLifecycleRecord>> m_timelines; //!< Events by bundle, guarded by m_mutex
+  std::vector<BundleID> m_order;                                                //!< Bundles in order of their first event, guarded by m_mutex
+  mutable OptionalMutex m_mutex;                                                //!< Mutex for the events
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_BUNDLE_LIFECYCLE_H */
@@ -1,4 +1,7 @@
 #include "bundle-store.h"
+#include "administrative-record.h"
+#include "trace-events.h"
+#include <algorithm>
 
 namespace ns3 {
 
@@ -24,6 +27,124 @@ BundleStore::~BundleStore ()
 {
 }
 
+std::vector<Ptr<Bundle>> 
+BundleStore::QueryByDestination (const EndpointID& destination) const
+{
+  return Query ([&destination] (Ptr<Bundle> bundle) {
+    return bundle->GetPrimaryBlock ().GetDestinationEID () == destination;
+  });
+}
+
+std::vector<Ptr<Bundle>> 
+BundleStore::QueryBySource (const EndpointID& source) const
+{
+  return Query ([&source] (Ptr<Bundle> bundle) {
+    return bundle->GetPrimaryBlock ().GetSourceNodeEID () == source;
+  });
+}
+
+void 
+BundleStore::ForEach (BundleVisitor visitor, uint64_t since, size_t pageSize) const
+{
+  BundleCursor cursor (since);
+  pageSize = std::max<size_t> (pageSize, 1);
+  
+  // A page may be short when bundles fail to load, so the walk ends only
+  // when the cursor stops advancing
+  uint64_t previous;
+  do
+    {
+      previous = cursor.generation;
+      for (const StoredBundle& entry : GetPage (cursor, pageSize))
+        {
+          if (!visitor (entry.bundle, entry.generation))
+            {
+              return;
+            }
+        }
+    }
+  while (cursor.generation != previous);
+}
+
+void 
+BundleStore::ForEachId (BundleIdVisitor visitor, uint64_t since, size_t pageSize) const
+{
+  BundleCursor cursor (since);
+  pageSize = std::max<size_t> (pageSize, 1);
+  
+  std::vector<StoredBundleId> page;
+  do
+    {
+      page = GetIdPage (cursor, pageSize);
+      for (const StoredBundleId& entry : page)
+        {
+          if (!visitor (entry.id, entry.generation))
+            {
+              return;
+            }
+        }
+    }
+  while (page.size () == pageSize);
+}
+
+void 
+BundleStore::SetReplicationHint (const BundleID& id, uint32_t copies)
+{
+}
+
+void 
+BundleStore::RegisterDeletionCallback (BundleDeletedCallback callback)
+{
+  m_deletedCallback = callback;
+}
+
+void 
+BundleStore::RegisterStoredCallback (BundleStoredCallback callback)
+{
+  m_storedCallback = callback;
+}
+
+void 
+BundleStore::SetMetrics (Ptr<MetricsRegistry> metrics)
+{
+  m_metrics = metrics;
+  m_evictionCounter = metrics ? metrics->GetCounter ("store.evictions") : nullptr;
+  m_expirationCounter = metrics ? metrics->GetCounter ("store.expirations") : nullptr;
+}
+
+void 
+BundleStore::NotifyDeleted (Ptr<Bundle> bundle, uint64_t reasonCode)
+{
+  if (m_evictionCounter && reasonCode == static_cast<uint64_t> (ReasonCode::DEPLETED_STORAGE))
+    {
+      m_evictionCounter->Add ();
+    }
+  else if (m_expirationCounter && reasonCode == static_cast<uint64_t> (ReasonCode::LIFETIME_EXPIRED))
+    {
+      m_expirationCounter->Add ();
+    }
+  
+  DTN7_TRACE_EVENT (reasonCode == static_cast<uint64_t> (ReasonCode::DEPLETED_STORAGE)
+                    ? TraceEventType::BUNDLE_EVICTED : TraceEventType::BUNDLE_EXPIRED,
+                    bundle->GetId ().Hash (), reasonCode);
+  
+  if (!m_deletedCallback.IsNull ())
+    {
+      m_deletedCallback (bundle, reasonCode);
+    }
+}
+
+void 
+BundleStore::NotifyStored (Ptr<Bundle> bundle, uint64_t size)
+{
+  DTN7_TRACE_EVENT (TraceEventType::BUNDLE_STORED, bundle->GetId ().Hash (), size);
+  
+  if (!m_storedCallback.IsNull ())
+    {
+      m_storedCallback (bundle, size);
+    }
+}
+
 } // namespace dtn7
 
 } // namespace ns3
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "ns3/object.h"
 #include "ns3/ptr.h"
+#include "ns3/callback.h"
 
 #include <vector>
 #include <unordered_map>
@@ -12,11 +13,79 @@
 
 #include "bundle.h"
 #include "bundle-id.h"
+#include "metrics.h"
 
 namespace ns3 {
 
 namespace dtn7 {
 
+/**
+ * \brief Callback for bundles the store deleted on its own
+ *
+ * Arguments are the deleted bundle and the status report reason code
+ * (see ReasonCode), e.g. DEPLETED_STORAGE for an eviction.
+ */
+typedef Callback<void, Ptr<Bundle>, uint64_t> BundleDeletedCallback;
+
+/**
+ * \brief Callback for bundles the store accepted
+ *
+ * Arguments are the stored bundle and its encoded size in bytes.
+ */
+typedef Callback<void, Ptr<Bundle>, uint64_t> BundleStoredCallback;
+
+/**
+ * \brief Visitor for streaming over a store
+ *
+ * Arguments are the bundle and the store generation at which it was
+ * stored; returning false stops the walk.
+ */
+typedef std::function<bool(Ptr<Bundle>, uint64_t)> BundleVisitor;
+
+/**
+ * \brief Visitor for streaming over the bundle IDs of a store
+ *
+ * Arguments are the bundle ID and the store generation at which the
+ * bundle was stored; returning false stops the walk.
+ */
+typedef std::function<bool(const BundleID&, uint64_t)> BundleIdVisitor;
+
+/**
+ * \brief A stored bundle and the generation at which it was stored
+ */
+struct StoredBundle
+{
+  Ptr<Bundle> bundle;  //!< Bundle
+  uint64_t generation; //!< Store generation of the push that stored this copy
+};
+
+/**
+ * \brief The ID of a stored bundle and the generation at which it was stored
+ */
+struct StoredBundleId
+{
+  BundleID id;         //!< Bundle ID
+  uint64_t generation; //!< Store generation of the push that stored the bundle
+};
+
+/**
+ * \brief Position of a paged walk over a bundle store
+ *
+ * Pages come in generation order and the cursor holds the generation of
+ * the last bundle returned, so a cursor started at generation G yields
+ * only the bundles stored or replaced after G.
+ */
+struct BundleCursor
+{
+  uint64_t generation; //!< Generation of the last returned bundle
+  
+  /**
+   * \brief Start a walk after a generation
+   * \param since Generation to start after, 0 for the whole store
+   */
+  explicit BundleCursor (uint64_t since = 0) : generation (since) {}
+};
+
 /**
  * \ingroup dtn7
  * \brief Interface for bundle storage
@@ -81,6 +150,83 @@ public:
    */
   virtual std::vector<Ptr<Bundle>> Query (std::function<bool(Ptr<Bundle>)> predicate) const = 0;
   
+  /**
+   * \brief Get the current store generation
+   *
+   * Every push that stores or replaces a bundle advances the generation
+   * and tags the bundle with it.
+   * \return Generation of the most recent push, 0 if nothing was stored
+   */
+  virtual uint64_t GetGeneration () const = 0;
+  
+  /**
+   * \brief Get the next page of a walk over the store
+   *
+   * A page covers up to limit stored bundles. Bundles that cannot be
+   * loaded are left out, so a page may hold fewer bundles although the
+   * walk is not over; the walk ends when the cursor stops advancing. A
+   * bundle replaced during the walk moves to its new generation and may
+   * be returned again.
+   * \param cursor Walk position, advanced past the covered bundles
+   * \param limit Maximum number of stored bundles to cover
+   * \return Bundles in generation order
+   */
+  virtual std::vector<StoredBundle> GetPage (BundleCursor& cursor, size_t limit) const = 0;
+  
+  /**
+   * \brief Get the next page of a walk over the IDs in the store
+   *
+   * Like GetPage, but returns only the IDs, which the store can list
+   * without loading the bundles.
+   * \param cursor Walk position, advanced past the returned IDs
+   * \param limit Maximum number of IDs to return
+   * \return IDs in generation order, fewer than limit at the end
+   */
+  virtual std::vector<StoredBundleId> GetIdPage (BundleCursor& cursor, size_t limit) const = 0;
+  
+  /**
+   * \brief Visit the bundles stored after a generation
+   *
+   * Fetches one page at a time and calls the visitor outside the store's
+   * lock, so it may use the store, and only a page of bundles is held
+   * instead of a copy of the whole store.
+   * \param visitor Function called for each bundle, returns false to stop
+   * \param since Generation to start after, 0 for the whole store
+   * \param pageSize Number of bundles fetched at once
+   */
+  void ForEach (BundleVisitor visitor, uint64_t since = 0, size_t pageSize = 64) const;
+  
+  /**
+   * \brief Visit the IDs of the bundles stored after a generation
+   *
+   * Like ForEach, but does not load the bundles, for callers that only
+   * collect IDs and fetch the bundles they need later.
+   * \param visitor Function called for each bundle ID, returns false to stop
+   * \param since Generation to start after, 0 for the whole store
+   * \param pageSize Number of IDs fetched at once
+   */
+  void ForEachId (BundleIdVisitor visitor, uint64_t since = 0, size_t pageSize = 64) const;
+  
+  /**
+   * \brief Get the bundles addressed to an endpoint
+   *
+   * The default implementation scans the store with Query; stores that
+   * keep a destination index should override it.
+   * \param destination Destination EID
+   * \return Vector of matching bundles
+   */
+  virtual std::vector<Ptr<Bundle>> QueryByDestination (const EndpointID& destination) const;
+  
+  /**
+   * \brief Get the bundles created by a node
+   *
+   * The default implementation scans the store with Query; stores that
+   * keep a source index should override it.
+   * \param source Source node EID
+   * \return Vector of matching bundles
+   */
+  virtual std::vector<Ptr<Bundle>> QueryBySource (const EndpointID& source) const;
+  
   /**
    * \brief Get the number of stored bundles
    * \return Number of bundles
@@ -98,6 +244,65 @@ public:
    * \return Statistics string
    */
   virtual std::string GetStats () const = 0;
+  
+  /**
+   * \brief Record how many copies of a bundle are known to exist elsewhere
+   *
+   * Routing reports this as it forwards copies, so eviction can prefer
+   * bundles that are already well replicated. Stores keep the largest
+   * value reported; the default implementation ignores it.
+   * \param id Bundle ID
+   * \param copies Number of copies handed to other nodes
+   */
+  virtual void SetReplicationHint (const BundleID& id, uint32_t copies);
+  
+  /**
+   * \brief Register a callback for bundles the store deletes on its own
+   *
+   * Called for evicted and expired bundles, outside the store's lock, so
+   * the node can issue deletion status reports.
+   * \param callback Function to call on each deletion
+   */
+  void RegisterDeletionCallback (BundleDeletedCallback callback);
+  
+  /**
+   * \brief Register a callback for bundles the store accepts
+   *
+   * Called for every successful Push, outside the store's lock.
+   * \param callback Function to call on each stored bundle
+   */
+  void RegisterStoredCallback (BundleStoredCallback callback);
+  
+  /**
+   * \brief Count the bundles the store deletes on its own in a node's metrics
+   *
+   * Evictions and expirations are counted as "store.evictions" and
+   * "store.expirations".
+   * \param metrics Metrics of the node, nullptr to stop counting
+   */
+  void SetMetrics (Ptr<MetricsRegistry> metrics);
+
+protected:
+  /**
+   * \brief Report a deleted bundle to the registered callback
+   * \param bundle Deleted bundle
+   * \param reasonCode Status report reason code
+   */
+  void NotifyDeleted (Ptr<Bundle> bundle, uint64_t reasonCode);
+  
+  /**
+   * \brief Report a stored bundle to the registered callback
+   * \param bundle Stored bundle
+   * \param size Encoded size in bytes
+   */
+  void NotifyStored (Ptr<Bundle> bundle, uint64_t size);
+
+private:
+  BundleDeletedCallback m_deletedCallback; //!< Deletion callback
+  BundleStoredCallback m_storedCallback;   //!< Storage callback
+  Ptr<MetricsRegistry> m_metrics;          //!< Metrics of the node
+  MetricCounter* m_evictionCounter = nullptr;   //!< Evicted bundles, nullptr if not counted
+  MetricCounter* m_expirationCounter = nullptr; //!< Expired bundles, nullptr if not counted
 };
 
 } // namespace dtn7
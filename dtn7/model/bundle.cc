@@ -16,6 +16,11 @@ Bundle::Bundle(const PrimaryBlock& primaryBlock)
 {
 }
 
+Bundle::Bundle(PrimaryBlock&& primaryBlock)
+  : m_primaryBlock(std::move(primaryBlock))
+{
+}
+
 Bundle 
 Bundle::NewBundle(const PrimaryBlock& primaryBlock, 
                   const std::vector<Ptr<CanonicalBlock>>& canonicalBlocks)
@@ -58,17 +63,6 @@ Bundle::MustNewBundle(const std::string& source,
   return bundle;
 }
 
-BundleID 
-Bundle::GetId() const
-{
-  return BundleID(
-      m_primaryBlock.GetSourceNodeEID(),
-      m_primaryBlock.GetCreationTimestamp(),
-      m_primaryBlock.GetSequenceNumber(),
-      m_primaryBlock.IsFragment(),
-      m_primaryBlock.GetFragmentOffset());
-}
-
 std::string 
 Bundle::ToString() const
 {
@@ -171,7 +165,7 @@ Bundle::GetPayloadBlock() const
   return GetBlockByType(BlockType::PAYLOAD_BLOCK);
 }
 
-std::vector<uint8_t> 
+PayloadBuffer 
 Bundle::GetPayload() const
 {
   Ptr<CanonicalBlock> payloadBlock = GetPayloadBlock();
@@ -180,20 +174,20 @@ Bundle::GetPayload() const
       return payloadBlock->GetData();
     }
   
-  return std::vector<uint8_t>();
+  return PayloadBuffer();
 }
 
 void 
-Bundle::SetPayload(const std::vector<uint8_t>& payload)
+Bundle::SetPayload(PayloadBuffer payload)
 {
   Ptr<CanonicalBlock> payloadBlock = GetPayloadBlock();
   if (payloadBlock)
     {
-      payloadBlock->SetData(payload);
+      payloadBlock->SetData(std::move(payload));
     }
   else
     {
-      Ptr<PayloadBlock> newPayloadBlock = Create<PayloadBlock>(payload);
+      Ptr<PayloadBlock> newPayloadBlock = Create<PayloadBlock>(std::move(payload));
       newPayloadBlock->SetCRCType(CRCType::CRC_32);
       AddBlock(newPayloadBlock);
     }
@@ -233,88 +227,333 @@ Bundle::CheckCRC() const
   return true;
 }
 
+bool 
+Bundle::IsEncodingCurrent() const
+{
+  if (m_segments.size() != 1 + m_canonicalBlocks.size() ||
+      m_segments[0].generation != m_primaryBlock.GetGeneration())
+    {
+      return false;
+    }
+  
+  for (size_t i = 0; i < m_canonicalBlocks.size(); ++i)
+    {
+      const EncodedSegment& segment = m_segments[i + 1];
+      if (segment.block != m_canonicalBlocks[i] ||
+          segment.generation != m_canonicalBlocks[i]->GetGeneration())
+        {
+          return false;
+        }
+    }
+  
+  return true;
+}
+
 Buffer 
 Bundle::ToCbor() const
 {
-  // Create CBOR array for bundle
-  Cbor::CborArray array;
+  // Blocks track their own generation, so this also catches blocks
+  // modified through GetBlockByType or GetCanonicalBlocks
+  if (IsEncodingCurrent())
+    {
+      return m_encoded;
+    }
   
-  // Add primary block
-  Buffer primaryBuffer = m_primaryBlock.ToCbor();
+  // Find which blocks are unchanged since the last encoding; those are
+  // copied over instead of being encoded (and checksummed) again
+  std::vector<const EncodedSegment*> reuse(1 + m_canonicalBlocks.size(), nullptr);
+  if (!m_segments.empty() && m_segments[0].generation == m_primaryBlock.GetGeneration())
+    {
+      reuse[0] = &m_segments[0];
+    }
+  for (size_t i = 0; i < m_canonicalBlocks.size(); ++i)
+    {
+      const Ptr<CanonicalBlock>& block = m_canonicalBlocks[i];
+      
+      // Blocks usually keep their position; look there first
+      const EncodedSegment* segment = nullptr;
+      if (i + 1 < m_segments.size() && m_segments[i + 1].block == block)
+        {
+          segment = &m_segments[i + 1];
+        }
+      for (size_t j = 1; !segment && j < m_segments.size(); ++j)
+        {
+          if (m_segments[j].block == block)
+            {
+              segment = &m_segments[j];
+            }
+        }
+      
+      if (segment && segment->generation == block->GetGeneration())
+        {
+          reuse[i + 1] = segment;
+        }
+    }
+  
+  // Size the output once: array header, primary block and all canonical blocks
+  size_t size = CborWriter::HeaderSize(1 + m_canonicalBlocks.size());
+  size += reuse[0] ? reuse[0]->length : m_primaryBlock.GetCborSize();
+  for (size_t i = 0; i < m_canonicalBlocks.size(); ++i)
+    {
+      size += reuse[i + 1] ? reuse[i + 1]->length : m_canonicalBlocks[i]->GetCborSize();
+    }
+  
+  Buffer buffer;
+  buffer.AddAtStart(size);
+  const uint8_t* previous = m_encoded.PeekData();
+  std::vector<EncodedSegment> segments;
+  segments.reserve(1 + m_canonicalBlocks.size());
   
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> primaryData(primaryBuffer.GetSize());
-  primaryBuffer.CopyData(primaryData.data(), primaryBuffer.GetSize());
+  // Stream every block straight into the output buffer
+  CborWriter writer(buffer.Begin());
+  writer.WriteArrayHeader(1 + m_canonicalBlocks.size());
   
-  auto primaryCbor = Cbor::Decode(primaryBuffer);
-  if (primaryCbor)
+  size_t offset = writer.GetBytesWritten();
+  if (reuse[0])
     {
-      array.push_back(*primaryCbor);
+      writer.WriteRaw(previous + reuse[0]->offset, reuse[0]->length);
     }
+  else
+    {
+      m_primaryBlock.WriteCbor(writer);
+    }
+  segments.push_back({nullptr, m_primaryBlock.GetGeneration(), offset, writer.GetBytesWritten() - offset});
   
-  // Add canonical blocks
-  for (const auto& block : m_canonicalBlocks)
+  for (size_t i = 0; i < m_canonicalBlocks.size(); ++i)
+    {
+      const Ptr<CanonicalBlock>& block = m_canonicalBlocks[i];
+      offset = writer.GetBytesWritten();
+      if (reuse[i + 1])
+        {
+          writer.WriteRaw(previous + reuse[i + 1]->offset, reuse[i + 1]->length);
+        }
+      else
+        {
+          block->WriteCbor(writer);
+        }
+      segments.push_back({block, block->GetGeneration(), offset, writer.GetBytesWritten() - offset});
+    }
+  
+  m_encoded = buffer;
+  m_segments = std::move(segments);
+  return buffer;
+}
+
+Ptr<Bundle> 
+Bundle::ForwardCopy(const EndpointID& previousNode, Time residence) const
+{
+  // The copy inherits the cached encoding, so fill it first
+  ToCbor();
+  Ptr<Bundle> copy = Create<Bundle>(*this);
+  
+  // Hop-local blocks are replaced, never modified: they are shared with
+  // this bundle
+  bool hasPreviousNode = false;
+  for (Ptr<CanonicalBlock>& block : copy->m_canonicalBlocks)
     {
-      Buffer blockBuffer = block->ToCbor();
-      auto blockCbor = Cbor::Decode(blockBuffer);
-      if (blockCbor)
+      switch (block->GetBlockType())
         {
-          array.push_back(*blockCbor);
+        case BlockType::PREVIOUS_NODE_BLOCK:
+          {
+            hasPreviousNode = true;
+            Ptr<PreviousNodeBlock> previous = DynamicCast<PreviousNodeBlock>(block);
+            if (!previous || previous->GetPreviousNode() != previousNode)
+              {
+                block = Create<PreviousNodeBlock>(block->GetBlockNumber(), block->GetBlockControlFlags(),
+                                                  block->GetCRCType(), previousNode);
+              }
+            break;
+          }
+        case BlockType::BUNDLE_AGE_BLOCK:
+          {
+            Ptr<BundleAgeBlock> age = DynamicCast<BundleAgeBlock>(block);
+            if (age && residence.IsStrictlyPositive())
+              {
+                block = Create<BundleAgeBlock>(block->GetBlockNumber(), block->GetBlockControlFlags(),
+                                               block->GetCRCType(),
+                                               age->GetAge() + residence.GetMicroSeconds());
+              }
+            break;
+          }
+        case BlockType::HOP_COUNT_BLOCK:
+          {
+            Ptr<HopCountBlock> hops = DynamicCast<HopCountBlock>(block);
+            if (hops)
+              {
+                block = Create<HopCountBlock>(block->GetBlockNumber(), block->GetBlockControlFlags(),
+                                              block->GetCRCType(), hops->GetLimit(), hops->GetCount() + 1);
+              }
+            break;
+          }
+        default:
+          break;
         }
     }
   
-  return Cbor::Encode(Cbor::CborValue(array));
+  if (!hasPreviousNode)
+    {
+      copy->AddBlock(Create<PreviousNodeBlock>(previousNode));
+    }
+  
+  return copy;
 }
 
 std::optional<Bundle> 
 Bundle::FromCbor(Buffer buffer)
 {
-  auto cborOpt = Cbor::Decode(buffer);
-  if (!cborOpt)
+  return FromCbor(buffer.PeekData(), buffer.GetSize());
+}
+
+std::optional<Bundle> 
+Bundle::FromCbor(const uint8_t* data, size_t size)
+{
+  CborReader reader(data, size);
+  
+  uint64_t count;
+  if (!reader.ReadArrayHeader(count) || count == 0)
     {
       return std::nullopt;
     }
   
-  const auto& cbor = *cborOpt;
-  if (!cbor.IsArray() || cbor.GetArray().empty())
+  // Extract primary block
+  auto primaryBlockOpt = PrimaryBlock::ReadCbor(reader);
+  if (!primaryBlockOpt)
     {
       return std::nullopt;
     }
   
-  const auto& array = cbor.GetArray();
+  Bundle bundle(std::move(*primaryBlockOpt));
   
-  // Extract primary block
-  if (!array[0].IsArray())
+  // Extract canonical blocks straight from the input; blocks that cannot be
+  // parsed are skipped as before, but a failed CRC discards the bundle
+  for (uint64_t i = 1; i < count; ++i)
+    {
+      const uint8_t* blockStart = reader.GetCurrent();
+      if (!reader.Skip())
+        {
+          return std::nullopt;
+        }
+      
+      CborReader blockReader(blockStart, reader.GetCurrent() - blockStart);
+      bool crcMismatch = false;
+      auto blockOpt = CanonicalBlock::ReadCbor(blockReader, &crcMismatch);
+      if (blockOpt)
+        {
+          bundle.AddBlock(std::move(*blockOpt));
+        }
+      else if (crcMismatch)
+        {
+          return std::nullopt;
+        }
+    }
+  
+  return bundle;
+}
+
+std::optional<BundleID> 
+Bundle::PeekId(const uint8_t* data, size_t size)
+{
+  CborReader reader(data, size);
+  
+  uint64_t count;
+  if (!reader.ReadArrayHeader(count) || count == 0)
     {
       return std::nullopt;
     }
   
-  Buffer primaryBuffer = Cbor::Encode(array[0]);
-  auto primaryBlockOpt = PrimaryBlock::FromCbor(primaryBuffer);
+  auto primaryBlockOpt = PrimaryBlock::ReadCbor(reader);
   if (!primaryBlockOpt)
     {
       return std::nullopt;
     }
   
-  Bundle bundle(*primaryBlockOpt);
+  return BundleID(
+      primaryBlockOpt->GetSourceNodeEID(),
+      primaryBlockOpt->GetCreationTimestamp(),
+      primaryBlockOpt->GetSequenceNumber(),
+      primaryBlockOpt->IsFragment(),
+      primaryBlockOpt->GetFragmentOffset());
+}
+
+std::optional<Bundle> 
+Bundle::FromCborPrefix(const uint8_t* data, size_t size)
+{
+  CborReader reader(data, size);
+  
+  uint64_t count;
+  if (!reader.ReadArrayHeader(count) || count == 0)
+    {
+      return std::nullopt;
+    }
+  
+  auto primaryBlockOpt = PrimaryBlock::ReadCbor(reader);
+  if (!primaryBlockOpt || primaryBlockOpt->MustNotFragment() || 
+      primaryBlockOpt->IsAdministrativeRecord())
+    {
+      return std::nullopt;
+    }
+  
+  Bundle fragment(std::move(*primaryBlockOpt));
   
-  // Extract canonical blocks
-  for (size_t i = 1; i < array.size(); ++i)
+  for (uint64_t i = 1; i < count; ++i)
     {
-      if (!array[i].IsArray())
+      const uint8_t* blockStart = reader.GetCurrent();
+      if (reader.Skip())
         {
+          CborReader blockReader(blockStart, reader.GetCurrent() - blockStart);
+          auto blockOpt = CanonicalBlock::ReadCbor(blockReader);
+          if (!blockOpt || (*blockOpt)->GetBlockType() == BlockType::PAYLOAD_BLOCK)
+            {
+              // A complete payload means only a later block was cut off;
+              // there is nothing to gain from a fragment then
+              return std::nullopt;
+            }
+          fragment.AddBlock(*blockOpt);
           continue;
         }
       
-      Buffer blockBuffer = Cbor::Encode(array[i]);
-      auto blockOpt = CanonicalBlock::FromCbor(blockBuffer);
-      if (blockOpt)
+      // The transfer stopped inside this block, which must be the payload
+      CborReader blockReader(blockStart, data + size - blockStart);
+      uint64_t fields, type, blockNumber, flags, crc;
+      uint8_t majorType;
+      uint64_t payloadLength;
+      if (!blockReader.ReadArrayHeader(fields) ||
+          !blockReader.ReadUnsigned(type) ||
+          !blockReader.ReadUnsigned(blockNumber) ||
+          !blockReader.ReadUnsigned(flags) ||
+          !blockReader.ReadUnsigned(crc) ||
+          !blockReader.ReadHeader(majorType, payloadLength) ||
+          static_cast<BlockType>(type) != BlockType::PAYLOAD_BLOCK ||
+          majorType != 2)
         {
-          bundle.AddBlock(*blockOpt);
+          return std::nullopt;
         }
+      
+      size_t received = std::min<uint64_t>(payloadLength, blockReader.GetRemaining());
+      if (received == 0)
+        {
+          return std::nullopt;
+        }
+      
+      // Fragment offsets are relative to the original ADU
+      PrimaryBlock& primary = fragment.m_primaryBlock;
+      if (!primary.IsFragment())
+        {
+          primary.SetFragmentation(true);
+          primary.SetFragmentOffset(0);
+          primary.SetTotalApplicationDataUnitLength(payloadLength);
+        }
+      
+      Ptr<PayloadBlock> payloadBlock = Create<PayloadBlock>(PayloadBuffer(blockReader.GetCurrent(), received));
+      payloadBlock->SetBlockNumber(blockNumber);
+      payloadBlock->SetBlockControlFlags(static_cast<BlockControlFlags>(flags));
+      payloadBlock->SetCRCType(static_cast<CRCType>(crc));
+      fragment.AddBlock(payloadBlock);
+      fragment.CalculateCRC();
+      return fragment;
     }
   
-  return bundle;
+  return std::nullopt;
 }
 
 std::vector<Bundle> 
@@ -342,7 +581,7 @@ Bundle::Fragment(size_t maxFragmentSize) const
       return fragments;
     }
   
-  std::vector<uint8_t> fullPayload = payloadBlock->GetData();
+  const PayloadBuffer& fullPayload = payloadBlock->GetData();
   uint64_t totalLength = fullPayload.size();
   
   // Calculate payload size per fragment
@@ -365,11 +604,8 @@ Bundle::Fragment(size_t maxFragmentSize) const
       // Calculate fragment payload size
       size_t payloadSize = std::min(payloadPerFragment, static_cast<size_t>(totalLength - offset));
       
-      // Create payload block with fragment
-      std::vector<uint8_t> fragmentPayload(fullPayload.begin() + offset, 
-                                         fullPayload.begin() + offset + payloadSize);
-      
-      Ptr<PayloadBlock> fragmentPayloadBlock = Create<PayloadBlock>(fragmentPayload);
+      // Create payload block with fragment; the slice shares the original storage
+      Ptr<PayloadBlock> fragmentPayloadBlock = Create<PayloadBlock>(fullPayload.Slice(offset, payloadSize));
       fragmentPayloadBlock->SetCRCType(payloadBlock->GetCRCType());
       fragment.AddBlock(fragmentPayloadBlock);
       
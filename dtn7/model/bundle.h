@@ -16,6 +16,7 @@
 #include "primary-block.h"
 #include "canonical-block.h"
 #include "bundle-id.h"
+#include "object-pool.h"
 
 namespace ns3 {
 
@@ -24,8 +25,10 @@ namespace dtn7 {
 /**
  * \ingroup dtn7
  * \brief A Bundle Protocol 7 bundle as defined in RFC 9171
+ *
+ * Bundles are allocated from the PoolAllocated free lists.
  */
-class Bundle : public SimpleRefCount<Bundle>
+class Bundle : public SimpleRefCount<Bundle>, public PoolAllocated<Bundle>
 {
 public:
   /**
@@ -39,6 +42,12 @@ public:
    */
   explicit Bundle (const PrimaryBlock& primaryBlock);
   
+  /**
+   * \brief Constructor taking over a primary block
+   * \param primaryBlock The primary block of the bundle
+   */
+  explicit Bundle (PrimaryBlock&& primaryBlock);
+  
   /**
    * \brief Create a new bundle
    * \param primaryBlock The primary block
@@ -91,7 +100,7 @@ public:
    * \brief Get the bundle ID
    * \return Bundle ID
    */
-  BundleID GetId () const;
+  const BundleID& GetId () const { return m_primaryBlock.GetId (); }
   
   /**
    * \brief Get string representation
@@ -146,15 +155,15 @@ public:
   
   /**
    * \brief Get the payload data
-   * \return Payload data
+   * \return Payload data, sharing the payload block's storage
    */
-  std::vector<uint8_t> GetPayload () const;
+  PayloadBuffer GetPayload () const;
   
   /**
    * \brief Set the payload data
    * \param payload Payload data
    */
-  void SetPayload (const std::vector<uint8_t>& payload);
+  void SetPayload (PayloadBuffer payload);
   
   /**
    * \brief Calculate CRC for all blocks
@@ -169,10 +178,29 @@ public:
   
   /**
    * \brief Serialize to CBOR format
+   *
+   * The encoding is cached. As long as no block changes, later calls return
+   * the same buffer without re-encoding. When only some blocks changed, such
+   * as the previous node or bundle age block on each hop, the unchanged
+   * blocks are copied over from the cached encoding.
    * \return CBOR encoded data
    */
   Buffer ToCbor () const;
   
+  /**
+   * \brief Get a copy of the bundle with the hop-local blocks set for the next hop
+   *
+   * The previous node block is set to the forwarding node (and appended if
+   * missing), a bundle age block is advanced by the residence time and a
+   * hop count block is incremented. All other blocks, and their cached
+   * encoding, are shared with this bundle, so encoding the copy only
+   * encodes those few bytes. This bundle is left unchanged.
+   * \param previousNode Forwarding node
+   * \param residence Time the bundle spent at the forwarding node
+   * \return Copy for the next hop
+   */
+  Ptr<Bundle> ForwardCopy (const EndpointID& previousNode, Time residence) const;
+  
   /**
    * \brief Deserialize from CBOR format
    * \param buffer CBOR encoded data
@@ -180,6 +208,39 @@ public:
    */
   static std::optional<Bundle> FromCbor (Buffer buffer);
   
+  /**
+   * \brief Deserialize from CBOR format without an intermediate value tree
+   * \param data Pointer to the CBOR encoded data
+   * \param size Size of the encoded data
+   * \return Deserialized bundle
+   */
+  static std::optional<Bundle> FromCbor (const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Get the ID of an encoded bundle by decoding only its primary block
+   *
+   * Lets receivers drop bundles they already have before the canonical
+   * blocks and the payload are decoded and checked.
+   * \param data Pointer to the CBOR encoded data
+   * \param size Size of the encoded data
+   * \return Bundle ID, or nullopt if the primary block is malformed
+   */
+  static std::optional<BundleID> PeekId (const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Turn the received start of an interrupted transfer into a fragment
+   *
+   * The prefix must contain the primary block, every block before the
+   * payload block and at least one payload byte. The result is a fragment
+   * at the bundle's own payload offset holding the payload bytes received.
+   * The truncated payload's CRC cannot be checked and is recomputed.
+   * \param data Pointer to the first bytes of a bundle encoding
+   * \param size Number of bytes received
+   * \return Fragment, or nullopt if the bundle may not be fragmented or
+   *         the prefix does not reach the payload data
+   */
+  static std::optional<Bundle> FromCborPrefix (const uint8_t* data, size_t size);
+  
   /**
    * \brief Fragment a bundle into smaller bundles
    * \param maxFragmentSize Maximum size of each fragment
@@ -188,8 +249,27 @@ public:
   std::vector<Bundle> Fragment (size_t maxFragmentSize) const;
 
 private:
+  /**
+   * \brief Location of one block inside the cached encoding
+   */
+  struct EncodedSegment
+  {
+    Ptr<CanonicalBlock> block;  //!< Encoded block, nullptr for the primary block
+    uint64_t generation;        //!< Block generation at encoding time
+    size_t offset;              //!< Offset in the cached encoding
+    size_t length;              //!< Encoded length
+  };
+  
+  /**
+   * \brief Check whether the cached encoding matches the current blocks
+   * \return true if the cache can be returned as is
+   */
+  bool IsEncodingCurrent () const;
+  
   PrimaryBlock m_primaryBlock;                      //!< Primary block
   std::vector<Ptr<CanonicalBlock>> m_canonicalBlocks;  //!< Canonical blocks
+  mutable Buffer m_encoded;                         //!< Cached wire encoding
+  mutable std::vector<EncodedSegment> m_segments;   //!< Layout of m_encoded, primary block first
 };
 
 } // namespace dtn7
@@ -1,6 +1,8 @@
 #include "canonical-block.h"
 #include "cbor.h"
 #include "crc.h"
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -15,19 +17,30 @@ CanonicalBlock::CanonicalBlock()
     m_blockControlFlags(BlockControlFlags::NO_FLAGS),
     m_crcType(CRCType::NO_CRC)
 {
+  Touch();
 }
 
 CanonicalBlock::CanonicalBlock(BlockType blockType,
                                uint64_t blockNumber,
                                BlockControlFlags blockControlFlags,
                                CRCType crcType,
-                               const std::vector<uint8_t>& data)
+                               PayloadBuffer data)
   : m_blockType(blockType),
     m_blockNumber(blockNumber),
     m_blockControlFlags(blockControlFlags),
     m_crcType(crcType),
-    m_data(data)
+    m_data(std::move(data))
 {
+  Touch();
+}
+
+void 
+CanonicalBlock::Touch()
+{
+  // Each change gets a new generation number, unique across blocks, so a
+  // copy only shares a generation with a block it is identical to
+  static std::atomic<uint64_t> generations(0);
+  m_generation = ++generations;
 }
 
 Ptr<CanonicalBlock> 
@@ -35,12 +48,19 @@ CanonicalBlock::CreateBlock(BlockType blockType,
                             uint64_t blockNumber,
                             BlockControlFlags blockControlFlags,
                             CRCType crcType,
-                            const std::vector<uint8_t>& data)
+                            PayloadBuffer data)
 {
   switch (blockType)
     {
       case BlockType::PAYLOAD_BLOCK:
-        return Create<PayloadBlock>(blockNumber, blockControlFlags, crcType, data);
+        {
+          Ptr<PayloadBlock> block = Create<PayloadBlock>();
+          block->SetBlockNumber(blockNumber);
+          block->SetBlockControlFlags(blockControlFlags);
+          block->SetCRCType(crcType);
+          block->SetData(std::move(data));
+          return block;
+        }
       
       case BlockType::PREVIOUS_NODE_BLOCK:
         {
@@ -48,7 +68,7 @@ CanonicalBlock::CreateBlock(BlockType blockType,
           block->SetBlockNumber(blockNumber);
           block->SetBlockControlFlags(blockControlFlags);
           block->SetCRCType(crcType);
-          block->SetData(data);
+          block->SetData(std::move(data));
           return block;
         }
       
@@ -58,7 +78,7 @@ CanonicalBlock::CreateBlock(BlockType blockType,
           block->SetBlockNumber(blockNumber);
           block->SetBlockControlFlags(blockControlFlags);
           block->SetCRCType(crcType);
-          block->SetData(data);
+          block->SetData(std::move(data));
           return block;
         }
       
@@ -68,7 +88,7 @@ CanonicalBlock::CreateBlock(BlockType blockType,
           block->SetBlockNumber(blockNumber);
           block->SetBlockControlFlags(blockControlFlags);
           block->SetCRCType(crcType);
-          block->SetData(data);
+          block->SetData(std::move(data));
           return block;
         }
       
@@ -80,7 +100,7 @@ CanonicalBlock::CreateBlock(BlockType blockType,
           block->SetBlockNumber(blockNumber);
           block->SetBlockControlFlags(blockControlFlags);
           block->SetCRCType(crcType);
-          block->SetData(data);
+          block->SetData(std::move(data));
           return block;
         }
     }
@@ -134,6 +154,8 @@ CanonicalBlock::SetMustBeReplicated(bool enable)
           static_cast<uint64_t>(m_blockControlFlags) & 
           ~static_cast<uint64_t>(BlockControlFlags::BLOCK_MUST_BE_REPLICATED));
     }
+  
+  Touch();
 }
 
 void 
@@ -149,6 +171,8 @@ CanonicalBlock::SetReportIfUnprocessable(bool enable)
           static_cast<uint64_t>(m_blockControlFlags) & 
           ~static_cast<uint64_t>(BlockControlFlags::REPORT_BLOCK_IF_UNPROCESSABLE));
     }
+  
+  Touch();
 }
 
 void 
@@ -164,6 +188,8 @@ CanonicalBlock::SetDeleteBundleIfUnprocessable(bool enable)
           static_cast<uint64_t>(m_blockControlFlags) & 
           ~static_cast<uint64_t>(BlockControlFlags::DELETE_BUNDLE_IF_BLOCK_UNPROCESSABLE));
     }
+  
+  Touch();
 }
 
 void 
@@ -179,6 +205,8 @@ CanonicalBlock::SetRemoveBlockIfUnprocessable(bool enable)
           static_cast<uint64_t>(m_blockControlFlags) & 
           ~static_cast<uint64_t>(BlockControlFlags::REMOVE_BLOCK_IF_UNPROCESSABLE));
     }
+  
+  Touch();
 }
 
 void 
@@ -194,151 +222,196 @@ CanonicalBlock::SetStatusReportRequested(bool enable)
           static_cast<uint64_t>(m_blockControlFlags) & 
           ~static_cast<uint64_t>(BlockControlFlags::STATUS_REPORT_REQUESTED));
     }
+  
+  Touch();
 }
 
 void 
 CanonicalBlock::CalculateCRC()
 {
-  if (m_crcType == CRCType::NO_CRC)
+  if (CrcState::GetValueSize(m_crcType) == 0)
     {
       m_crcValue.clear();
       return;
     }
   
-  // Create CBOR representation of the block without CRC value
-  std::vector<uint8_t> crcValue;
-  m_crcValue = crcValue; // Temporarily clear CRC value
-  
-  Buffer buffer = ToCbor();
-  
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
-  
-  // Calculate CRC
-  if (m_crcType == CRCType::CRC_16)
-  {
-      uint16_t crc = CalculateCRC16(data);
-      m_crcValue.clear();
-      m_crcValue.push_back((crc >> 8) & 0xFF);  // 高字节
-      m_crcValue.push_back(crc & 0xFF);         // 低字节
-  }
-  else if (m_crcType == CRCType::CRC_32)
-  {
-      uint32_t crc = CalculateCRC32(data);
-      m_crcValue.clear();
-      m_crcValue.push_back((crc >> 24) & 0xFF); // 最高字节
-      m_crcValue.push_back((crc >> 16) & 0xFF);
-      m_crcValue.push_back((crc >> 8) & 0xFF);
-      m_crcValue.push_back(crc & 0xFF);         // 最低字节
-  }
-  else
-  {
-      // NO_CRC的情况
-      m_crcValue.clear();
-  }
+  // Checksum the encoding without materialising it
+  CborWriter sink;
+  uint8_t crc[4];
+  size_t crcSize = EncodeCbor(sink, crc);
+  m_crcValue.assign(crc, crc + crcSize);
 }
 
 bool 
 CanonicalBlock::CheckCRC() const
 {
-  if (m_crcType == CRCType::NO_CRC)
+  if (CrcState::GetValueSize(m_crcType) == 0)
     {
       return true;
     }
   
-  // Create CBOR representation of the block without CRC value
-  CanonicalBlock tempBlock = *this;
-  tempBlock.m_crcValue.clear();
-  
-  Buffer buffer = tempBlock.ToCbor();
-  
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
-  
-  // Verify CRC
-  return VerifyCRC(m_crcType, data, m_crcValue);
+  CborWriter sink;
+  uint8_t crc[4];
+  size_t crcSize = EncodeCbor(sink, crc);
+  return m_crcValue.size() == crcSize && std::equal(crc, crc + crcSize, m_crcValue.begin());
 }
 
 Buffer 
 CanonicalBlock::ToCbor() const
 {
-  // Create CBOR array for canonical block
-  Cbor::CborArray array;
+  Buffer buffer;
+  buffer.AddAtStart(GetCborSize());
+  
+  CborWriter writer(buffer.Begin());
+  WriteCbor(writer);
+  
+  return buffer;
+}
+
+void 
+CanonicalBlock::WriteCbor(CborWriter& writer) const
+{
+  uint8_t crc[4];
+  EncodeCbor(writer, crc);
+}
+
+size_t 
+CanonicalBlock::EncodeCbor(CborWriter& writer, uint8_t* crcValue) const
+{
+  size_t crcSize = CrcState::GetValueSize(m_crcType);
+  CrcState crc(m_crcType);
+  if (crcSize > 0)
+    {
+      writer.SetCrc(&crc);
+    }
   
   // Add block elements according to BP specification
-  array.push_back(Cbor::CborValue(static_cast<uint64_t>(m_blockType)));
-  array.push_back(Cbor::CborValue(m_blockNumber));
-  array.push_back(Cbor::CborValue(static_cast<uint64_t>(m_blockControlFlags)));
-  array.push_back(Cbor::CborValue(static_cast<uint64_t>(m_crcType)));
-  array.push_back(Cbor::CborValue(m_data));
-  
-  // Add CRC value if present
-  if (m_crcType != CRCType::NO_CRC && !m_crcValue.empty())
+  writer.WriteArrayHeader(crcSize > 0 ? 6 : 5);
+  writer.WriteUnsigned(static_cast<uint64_t>(m_blockType));
+  writer.WriteUnsigned(m_blockNumber);
+  writer.WriteUnsigned(static_cast<uint64_t>(m_blockControlFlags));
+  writer.WriteUnsigned(static_cast<uint64_t>(m_crcType));
+  
+  // The data may be a stitched set of slices; write them back to back
+  writer.WriteHeader(2, m_data.size());
+  for (size_t i = 0; i < m_data.GetSegmentCount(); ++i)
+    {
+      size_t length;
+      const uint8_t* segment = m_data.GetSegment(i, length);
+      writer.WriteRaw(segment, length);
+    }
+  
+  // The CRC covers the whole block with its own value zeroed (RFC 9171 4.2.1),
+  // so it is complete once the byte string header has been written
+  if (crcSize > 0)
     {
-      array.push_back(Cbor::CborValue(m_crcValue));
+      writer.WriteHeader(2, crcSize);
+      crc.UpdateZeros(crcSize);
+      writer.SetCrc(nullptr);
+      crc.Finalize(crcValue);
+      writer.WriteRaw(crcValue, crcSize);
     }
   
-  return Cbor::Encode(Cbor::CborValue(array));
+  return crcSize;
 }
 
-std::optional<Ptr<CanonicalBlock>> 
-CanonicalBlock::FromCbor(Buffer buffer)
+size_t 
+CanonicalBlock::GetCborSize() const
 {
-  auto cborOpt = Cbor::Decode(buffer);
-  if (!cborOpt)
-    {
-      return std::nullopt;
-    }
+  size_t crcSize = CrcState::GetValueSize(m_crcType);
   
-  const auto& cbor = *cborOpt;
-  if (!cbor.IsArray())
+  size_t size = CborWriter::HeaderSize(crcSize > 0 ? 6 : 5);
+  size += CborWriter::HeaderSize(static_cast<uint64_t>(m_blockType));
+  size += CborWriter::HeaderSize(m_blockNumber);
+  size += CborWriter::HeaderSize(static_cast<uint64_t>(m_blockControlFlags));
+  size += CborWriter::HeaderSize(static_cast<uint64_t>(m_crcType));
+  size += CborWriter::StringSize(m_data.size());
+  
+  if (crcSize > 0)
     {
-      return std::nullopt;
+      size += CborWriter::StringSize(crcSize);
     }
   
-  const auto& array = cbor.GetArray();
-  if (array.size() < 5) // At least 5 elements required (without CRC)
+  return size;
+}
+
+std::optional<Ptr<CanonicalBlock>> 
+CanonicalBlock::FromCbor(Buffer buffer)
+{
+  CborReader reader(buffer.PeekData(), buffer.GetSize());
+  return ReadCbor(reader);
+}
+
+std::optional<Ptr<CanonicalBlock>> 
+CanonicalBlock::ReadCbor(CborReader& reader, bool* crcMismatch)
+{
+  const uint8_t* blockStart = reader.GetCurrent();
+  
+  uint64_t count;
+  if (!reader.ReadArrayHeader(count) || count < 5) // At least 5 elements required (without CRC)
     {
       return std::nullopt;
     }
   
   // Extract fields
-  BlockType blockType = static_cast<BlockType>(array[0].GetUnsignedInteger());
-  uint64_t blockNumber = array[1].GetUnsignedInteger();
-  BlockControlFlags blockControlFlags = static_cast<BlockControlFlags>(array[2].GetUnsignedInteger());
-  CRCType crcType = static_cast<CRCType>(array[3].GetUnsignedInteger());
-  
-  if (!array[4].IsByteString())
+  uint64_t type;
+  uint64_t blockNumber;
+  uint64_t flags;
+  uint64_t crc;
+  const uint8_t* data;
+  size_t dataLength;
+  if (!reader.ReadUnsigned(type) ||
+      !reader.ReadUnsigned(blockNumber) ||
+      !reader.ReadUnsigned(flags) ||
+      !reader.ReadUnsigned(crc) ||
+      !reader.ReadByteString(data, dataLength))
     {
       return std::nullopt;
     }
   
-  std::vector<uint8_t> data = array[4].GetByteString();
+  CRCType crcType = static_cast<CRCType>(crc);
   
-  // Create block of the appropriate type
+  // Create block of the appropriate type; the block data is the only copy
   Ptr<CanonicalBlock> block = CreateBlock(
-      blockType,
+      static_cast<BlockType>(type),
       blockNumber,
-      blockControlFlags,
+      static_cast<BlockControlFlags>(flags),
       crcType,
-      data);
+      PayloadBuffer(data, dataLength));
+  
+  uint64_t consumed = 5;
   
   // Extract CRC if present
+  const uint8_t* crcData = nullptr;
+  size_t crcLength = 0;
   if (crcType != CRCType::NO_CRC)
     {
-      if (array.size() <= 5)
+      if (count <= 5 || !reader.ReadByteString(crcData, crcLength))
         {
           return std::nullopt;
         }
       
-      if (!array[5].IsByteString())
+      block->m_crcValue.assign(crcData, crcData + crcLength);
+      consumed += 1;
+    }
+  
+  // Skip unknown trailing elements
+  for (; consumed < count; ++consumed)
+    {
+      if (!reader.Skip())
         {
           return std::nullopt;
         }
-      
-      block->m_crcValue = array[5].GetByteString();
+    }
+  
+  // Verify the CRC over the received bytes in place
+  if (crcData && !VerifyBlockCRC(crcType, blockStart, reader.GetCurrent(), crcData, crcLength))
+    {
+      if (crcMismatch)
+        {
+          *crcMismatch = true;
+        }
+      return std::nullopt;
     }
   
   return block;
@@ -372,29 +445,29 @@ PayloadBlock::PayloadBlock()
 {
 }
 
-PayloadBlock::PayloadBlock(const std::vector<uint8_t>& payload)
-  : CanonicalBlock(BlockType::PAYLOAD_BLOCK, 1, BlockControlFlags::NO_FLAGS, CRCType::NO_CRC, payload)
+PayloadBlock::PayloadBlock(PayloadBuffer payload)
+  : CanonicalBlock(BlockType::PAYLOAD_BLOCK, 1, BlockControlFlags::NO_FLAGS, CRCType::NO_CRC, std::move(payload))
 {
 }
 
 PayloadBlock::PayloadBlock(uint64_t blockNumber,
                          BlockControlFlags blockControlFlags,
                          CRCType crcType,
-                         const std::vector<uint8_t>& payload)
-  : CanonicalBlock(BlockType::PAYLOAD_BLOCK, blockNumber, blockControlFlags, crcType, payload)
+                         PayloadBuffer payload)
+  : CanonicalBlock(BlockType::PAYLOAD_BLOCK, blockNumber, blockControlFlags, crcType, std::move(payload))
 {
 }
 
-std::vector<uint8_t> 
+const PayloadBuffer& 
 PayloadBlock::GetPayload() const
 {
   return GetData();
 }
 
 void 
-PayloadBlock::SetPayload(const std::vector<uint8_t>& payload)
+PayloadBlock::SetPayload(PayloadBuffer payload)
 {
-  SetData(payload);
+  SetData(std::move(payload));
 }
 
 std::string 
@@ -441,16 +514,8 @@ PreviousNodeBlock::PreviousNodeBlock(uint64_t blockNumber,
 EndpointID 
 PreviousNodeBlock::GetPreviousNode() const
 {
-  Buffer buffer;
-  buffer.AddAtStart(GetData().size());
-  Buffer::Iterator it = buffer.Begin();
-  
-  for (size_t i = 0; i < GetData().size(); ++i)
-    {
-      it.WriteU8(GetData()[i]);
-    }
-  
-  auto eidOpt = EndpointID::FromCbor(buffer);
+  CborReader reader(GetData().data(), GetData().size());
+  auto eidOpt = EndpointID::ReadCbor(reader);
   if (eidOpt)
     {
       return *eidOpt;
@@ -516,24 +581,11 @@ BundleAgeBlock::BundleAgeBlock(uint64_t blockNumber,
 uint64_t 
 BundleAgeBlock::GetAge() const
 {
-  if (GetData().empty())
+  uint64_t age;
+  CborReader reader(GetData().data(), GetData().size());
+  if (reader.ReadUnsigned(age))
     {
-      return 0;
-    }
-  
-  Buffer buffer;
-  buffer.AddAtStart(GetData().size());
-  Buffer::Iterator it = buffer.Begin();
-  
-  for (size_t i = 0; i < GetData().size(); ++i)
-    {
-      it.WriteU8(GetData()[i]);
-    }
-  
-  auto cborOpt = Cbor::Decode(buffer);
-  if (cborOpt && cborOpt->IsUnsignedInteger())
-    {
-      return cborOpt->GetUnsignedInteger();
+      return age;
     }
   
   return 0;
@@ -542,14 +594,12 @@ BundleAgeBlock::GetAge() const
 void 
 BundleAgeBlock::SetAge(uint64_t microseconds)
 {
-  Cbor::CborValue value(microseconds);
-  Buffer buffer = Cbor::Encode(value);
+  std::vector<uint8_t> data;
+  data.reserve(CborWriter::HeaderSize(microseconds));
+  CborWriter writer(data);
+  writer.WriteUnsigned(microseconds);
   
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
-  
-  SetData(data);
+  SetData(std::move(data));
 }
 
 std::string 
@@ -601,24 +651,12 @@ HopCountBlock::HopCountBlock(uint64_t blockNumber,
 uint64_t 
 HopCountBlock::GetLimit() const
 {
-  if (GetData().empty())
-    {
-      return 0;
-    }
-  
-  Buffer buffer;
-  buffer.AddAtStart(GetData().size());
-  Buffer::Iterator it = buffer.Begin();
-  
-  for (size_t i = 0; i < GetData().size(); ++i)
+  uint64_t count;
+  uint64_t limit;
+  CborReader reader(GetData().data(), GetData().size());
+  if (reader.ReadArrayHeader(count) && count >= 2 && reader.ReadUnsigned(limit))
     {
-      it.WriteU8(GetData()[i]);
-    }
-  
-  auto cborOpt = Cbor::Decode(buffer);
-  if (cborOpt && cborOpt->IsArray() && cborOpt->GetArray().size() >= 2)
-    {
-      return cborOpt->GetArray()[0].GetUnsignedInteger();
+      return limit;
     }
   
   return 0;
@@ -627,24 +665,14 @@ HopCountBlock::GetLimit() const
 uint64_t 
 HopCountBlock::GetCount() const
 {
-  if (GetData().empty())
+  uint64_t count;
+  uint64_t limit;
+  uint64_t hops;
+  CborReader reader(GetData().data(), GetData().size());
+  if (reader.ReadArrayHeader(count) && count >= 2 &&
+      reader.ReadUnsigned(limit) && reader.ReadUnsigned(hops))
     {
-      return 0;
-    }
-  
-  Buffer buffer;
-  buffer.AddAtStart(GetData().size());
-  Buffer::Iterator it = buffer.Begin();
-  
-  for (size_t i = 0; i < GetData().size(); ++i)
-    {
-      it.WriteU8(GetData()[i]);
-    }
-  
-  auto cborOpt = Cbor::Decode(buffer);
-  if (cborOpt && cborOpt->IsArray() && cborOpt->GetArray().size() >= 2)
-    {
-      return cborOpt->GetArray()[1].GetUnsignedInteger();
+      return hops;
     }
   
   return 0;
@@ -653,35 +681,33 @@ HopCountBlock::GetCount() const
 void 
 HopCountBlock::SetLimit(uint64_t limit)
 {
-  Cbor::CborArray array = {
-    Cbor::CborValue(limit),
-    Cbor::CborValue(GetCount())
-  };
+  uint64_t hopLimit = limit;
+  uint64_t hopCount = GetCount();
   
-  Buffer buffer = Cbor::Encode(Cbor::CborValue(array));
-  
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
+  std::vector<uint8_t> data;
+  data.reserve(1 + CborWriter::HeaderSize(hopLimit) + CborWriter::HeaderSize(hopCount));
+  CborWriter writer(data);
+  writer.WriteArrayHeader(2);
+  writer.WriteUnsigned(hopLimit);
+  writer.WriteUnsigned(hopCount);
   
-  SetData(data);
+  SetData(std::move(data));
 }
 
 void 
 HopCountBlock::SetCount(uint64_t count)
 {
-  Cbor::CborArray array = {
-    Cbor::CborValue(GetLimit()),
-    Cbor::CborValue(count)
-  };
+  uint64_t hopLimit = GetLimit();
+  uint64_t hopCount = count;
   
-  Buffer buffer = Cbor::Encode(Cbor::CborValue(array));
+  std::vector<uint8_t> data;
+  data.reserve(1 + CborWriter::HeaderSize(hopLimit) + CborWriter::HeaderSize(hopCount));
+  CborWriter writer(data);
+  writer.WriteArrayHeader(2);
+  writer.WriteUnsigned(hopLimit);
+  writer.WriteUnsigned(hopCount);
   
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
-  
-  SetData(data);
+  SetData(std::move(data));
 }
 
 void 
@@ -12,11 +12,16 @@
 
 #include "block-type-codes.h"
 #include "endpoint.h"
+#include "payload-buffer.h"
+#include "object-pool.h"
 #include "ns3/ptr.h"
 namespace ns3 {
 
 namespace dtn7 {
 
+class CborWriter;
+class CborReader;
+
 /**
  * \brief Block control flags as defined in RFC 9171
  */
@@ -48,8 +53,11 @@ inline BlockControlFlags operator& (BlockControlFlags a, BlockControlFlags b)
 /**
  * \ingroup dtn7
  * \brief Base class for canonical blocks in a bundle
+ *
+ * Blocks of all types share the PoolAllocated free lists of this class,
+ * which are kept per object size.
  */
-class CanonicalBlock : public SimpleRefCount<CanonicalBlock>
+class CanonicalBlock : public SimpleRefCount<CanonicalBlock>, public PoolAllocated<CanonicalBlock>
 {
 public:
   /**
@@ -69,7 +77,7 @@ public:
                  uint64_t blockNumber,
                  BlockControlFlags blockControlFlags,
                  CRCType crcType,
-                 const std::vector<uint8_t>& data);
+                 PayloadBuffer data);
   
   /**
    * \brief Virtual destructor
@@ -89,21 +97,30 @@ public:
                                          uint64_t blockNumber,
                                          BlockControlFlags blockControlFlags,
                                          CRCType crcType,
-                                         const std::vector<uint8_t>& data);
+                                         PayloadBuffer data);
   
   // Getters
   BlockType GetBlockType () const { return m_blockType; }
   uint64_t GetBlockNumber () const { return m_blockNumber; }
   BlockControlFlags GetBlockControlFlags () const { return m_blockControlFlags; }
   CRCType GetCRCType () const { return m_crcType; }
-  const std::vector<uint8_t>& GetData () const { return m_data; }
+  const PayloadBuffer& GetData () const { return m_data; }
   
   // Setters
-  void SetBlockType (BlockType type) { m_blockType = type; }
-  void SetBlockNumber (uint64_t number) { m_blockNumber = number; }
-  void SetBlockControlFlags (BlockControlFlags flags) { m_blockControlFlags = flags; }
-  void SetCRCType (CRCType type) { m_crcType = type; }
-  void SetData (const std::vector<uint8_t>& data) { m_data = data; }
+  void SetBlockType (BlockType type) { m_blockType = type; Touch (); }
+  void SetBlockNumber (uint64_t number) { m_blockNumber = number; Touch (); }
+  void SetBlockControlFlags (BlockControlFlags flags) { m_blockControlFlags = flags; Touch (); }
+  void SetCRCType (CRCType type) { m_crcType = type; Touch (); }
+  void SetData (PayloadBuffer data) { m_data = std::move(data); Touch (); }
+  
+  /**
+   * \brief Get the generation of the block contents
+   *
+   * The generation changes on every modification that affects the encoded
+   * form, which lets cached encodings detect stale blocks.
+   * \return Generation number
+   */
+  uint64_t GetGeneration () const { return m_generation; }
   
   /**
    * \brief Check if block must be replicated
@@ -182,6 +199,18 @@ public:
    */
   virtual Buffer ToCbor () const;
   
+  /**
+   * \brief Serialize to CBOR format into an existing writer
+   * \param writer CBOR writer
+   */
+  void WriteCbor (CborWriter& writer) const;
+  
+  /**
+   * \brief Get the size of the CBOR encoding
+   * \return Encoded size in bytes
+   */
+  size_t GetCborSize () const;
+  
   /**
    * \brief Deserialize from CBOR format
    * \param buffer CBOR encoded data
@@ -189,6 +218,16 @@ public:
    */
   static std::optional<Ptr<CanonicalBlock>> FromCbor (Buffer buffer);
   
+  /**
+   * \brief Deserialize from a CBOR reader positioned at the block
+   *
+   * The block CRC, if any, is verified against the input bytes.
+   * \param reader CBOR reader, advanced past the block on success
+   * \param crcMismatch Set to true if the block was rejected for its CRC
+   * \return Deserialized block
+   */
+  static std::optional<Ptr<CanonicalBlock>> ReadCbor (CborReader& reader, bool* crcMismatch = nullptr);
+  
   /**
    * \brief Get string representation
    * \return String representation of the block
@@ -196,12 +235,26 @@ public:
   virtual std::string ToString () const;
 
 private:
+  /**
+   * \brief Serialize, computing the CRC on the fly
+   * \param writer CBOR writer
+   * \param crcValue Receives the CRC value (up to 4 bytes)
+   * \return Size of the CRC value, 0 if the block has none
+   */
+  size_t EncodeCbor (CborWriter& writer, uint8_t* crcValue) const;
+  
+  /**
+   * \brief Assign a new generation after a modification
+   */
+  void Touch ();
+  
   BlockType m_blockType;                 //!< Block type
   uint64_t m_blockNumber;                //!< Block number
   BlockControlFlags m_blockControlFlags; //!< Block control flags
   CRCType m_crcType;                     //!< CRC type
-  std::vector<uint8_t> m_data;           //!< Block data
+  PayloadBuffer m_data;                  //!< Block data, shared between copies
   std::vector<uint8_t> m_crcValue;       //!< CRC value
+  uint64_t m_generation;                 //!< Generation of the encoded contents
 };
 
 /**
@@ -220,7 +273,7 @@ public:
    * \brief Constructor with payload
    * \param payload Payload data
    */
-  explicit PayloadBlock (const std::vector<uint8_t>& payload);
+  explicit PayloadBlock (PayloadBuffer payload);
   
   /**
    * \brief Constructor with parameters
@@ -232,19 +285,19 @@ public:
   PayloadBlock (uint64_t blockNumber,
                BlockControlFlags blockControlFlags,
                CRCType crcType,
-               const std::vector<uint8_t>& payload);
+               PayloadBuffer payload);
   
   /**
    * \brief Get payload data
    * \return Payload data
    */
-  std::vector<uint8_t> GetPayload () const;
+  const PayloadBuffer& GetPayload () const;
   
   /**
    * \brief Set payload data
    * \param payload Payload data
    */
-  void SetPayload (const std::vector<uint8_t>& payload);
+  void SetPayload (PayloadBuffer payload);
   
   /**
    * \brief Get string representation
@@ -1,5 +1,9 @@
 #include "cbor.h"
+#include "crc.h"
+#include <cmath>
+#include <cstring>
 #include <limits>
+#include <new>
 #include <sstream>
 #include <iomanip>
 
@@ -7,115 +11,348 @@ namespace ns3 {
 
 namespace dtn7 {
 
+// CborArena implementation
+
+CborArena::CborArena(size_t capacityHint)
+  : m_chunks(nullptr),
+    m_cursor(nullptr),
+    m_remaining(0),
+    m_nextChunkSize(std::max<size_t>(capacityHint, 256)),
+    m_bytesAllocated(0),
+    m_references(0)
+{
+}
+
+CborArena::~CborArena()
+{
+  while (m_chunks)
+    {
+      Chunk* next = m_chunks->next;
+      ::operator delete(m_chunks);
+      m_chunks = next;
+    }
+  
+  for (CborArena* arena : m_adopted)
+    {
+      arena->Unref();
+    }
+}
+
+void* 
+CborArena::Allocate(size_t size, size_t alignment)
+{
+  size_t padding = (alignment - reinterpret_cast<uintptr_t>(m_cursor) % alignment) % alignment;
+  if (!m_cursor || padding + size > m_remaining)
+    {
+      // Start a new chunk, large enough for this request
+      size_t chunkSize = std::max(m_nextChunkSize, size + alignment + sizeof(Chunk));
+      Chunk* chunk = static_cast<Chunk*>(::operator new(chunkSize));
+      chunk->next = m_chunks;
+      m_chunks = chunk;
+      m_cursor = reinterpret_cast<uint8_t*>(chunk) + sizeof(Chunk);
+      m_remaining = chunkSize - sizeof(Chunk);
+      m_nextChunkSize = std::min<size_t>(chunkSize * 2, 64 * 1024);
+      padding = (alignment - reinterpret_cast<uintptr_t>(m_cursor) % alignment) % alignment;
+    }
+  
+  void* result = m_cursor + padding;
+  m_cursor += padding + size;
+  m_remaining -= padding + size;
+  m_bytesAllocated += size;
+  return result;
+}
+
+void 
+CborArena::Adopt(CborArena* other)
+{
+  if (!other || other == this)
+    {
+      return;
+    }
+  
+  // Items built together usually share an arena; avoid piling up references
+  if (!m_adopted.empty() && m_adopted.back() == other)
+    {
+      return;
+    }
+  
+  other->Ref();
+  m_adopted.push_back(other);
+}
+
+void 
+CborArena::Unref() const
+{
+  if (--m_references == 0)
+    {
+      delete this;
+    }
+}
+
 // CborValue implementation
 
+struct Cbor::CborValue::TagNode
+{
+  uint64_t tag;     //!< Tag number
+  CborValue value;  //!< Tagged value
+};
+
 Cbor::CborValue::CborValue()
-  : m_value(std::monostate{})
+  : m_type(static_cast<uint8_t>(CborType::INVALID)),
+    m_owning(false),
+    m_size(0),
+    m_unsigned(0),
+    m_arena(nullptr)
 {
 }
 
 Cbor::CborValue::CborValue(uint64_t value)
-  : m_value(value)
+  : CborValue()
 {
+  m_type = static_cast<uint8_t>(CborType::UNSIGNED_INTEGER);
+  m_unsigned = value;
 }
 
 Cbor::CborValue::CborValue(int64_t value)
+  : CborValue()
 {
   if (value >= 0)
     {
-      m_value = static_cast<uint64_t>(value);
+      m_type = static_cast<uint8_t>(CborType::UNSIGNED_INTEGER);
+      m_unsigned = static_cast<uint64_t>(value);
     }
   else
     {
-      m_value = value;
+      m_type = static_cast<uint8_t>(CborType::NEGATIVE_INTEGER);
+      m_negative = value;
     }
 }
 
 Cbor::CborValue::CborValue(const std::vector<uint8_t>& value)
-  : m_value(value)
+  : CborValue(value.data(), value.size())
 {
 }
 
+Cbor::CborValue::CborValue(const uint8_t* data, size_t size)
+  : CborValue()
+{
+  m_type = static_cast<uint8_t>(CborType::BYTE_STRING);
+  m_size = static_cast<uint32_t>(size);
+  if (size > 0)
+    {
+      m_arena = new CborArena(size);
+      m_arena->Ref();
+      m_owning = true;
+      void* bytes = m_arena->Allocate(size, 1);
+      std::memcpy(bytes, data, size);
+      m_pointer = bytes;
+    }
+}
+
 Cbor::CborValue::CborValue(const std::string& value)
-  : m_value(value)
+  : CborValue()
 {
+  m_type = static_cast<uint8_t>(CborType::TEXT_STRING);
+  m_size = static_cast<uint32_t>(value.size());
+  if (!value.empty())
+    {
+      m_arena = new CborArena(value.size());
+      m_arena->Ref();
+      m_owning = true;
+      void* text = m_arena->Allocate(value.size(), 1);
+      std::memcpy(text, value.data(), value.size());
+      m_pointer = text;
+    }
 }
 
 Cbor::CborValue::CborValue(const CborArray& value)
-  : m_value(std::make_shared<CborArray>(value))
+  : CborValue()
 {
+  m_type = static_cast<uint8_t>(CborType::ARRAY);
+  m_size = static_cast<uint32_t>(value.size());
+  if (!value.empty())
+    {
+      m_arena = new CborArena(value.size() * sizeof(CborValue));
+      m_arena->Ref();
+      m_owning = true;
+      CborValue* items = static_cast<CborValue*>(
+          m_arena->Allocate(value.size() * sizeof(CborValue), alignof(CborValue)));
+      for (size_t i = 0; i < value.size(); ++i)
+        {
+          PlaceInArena(&items[i], value[i], m_arena);
+        }
+      m_pointer = items;
+    }
 }
 
 Cbor::CborValue::CborValue(const CborMap& value)
-  : m_value(std::make_shared<CborMap>(value))
+  : CborValue()
 {
+  m_type = static_cast<uint8_t>(CborType::MAP);
+  if (value.empty())
+    {
+      return;
+    }
+  
+  // Sort by key, keeping the last of several equal keys
+  std::vector<size_t> order(value.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    {
+      order[i] = i;
+    }
+  std::stable_sort(order.begin(), order.end(), [&value] (size_t a, size_t b) {
+    return value[a].first < value[b].first;
+  });
+  
+  std::vector<size_t> unique;
+  unique.reserve(order.size());
+  for (size_t index : order)
+    {
+      if (!unique.empty() && value[unique.back()].first == value[index].first)
+        {
+          unique.back() = index;
+        }
+      else
+        {
+          unique.push_back(index);
+        }
+    }
+  
+  using Entry = std::pair<CborValue, CborValue>;
+  m_size = static_cast<uint32_t>(unique.size());
+  m_arena = new CborArena(unique.size() * sizeof(Entry));
+  m_arena->Ref();
+  m_owning = true;
+  Entry* entries = static_cast<Entry*>(m_arena->Allocate(unique.size() * sizeof(Entry), alignof(Entry)));
+  for (size_t i = 0; i < unique.size(); ++i)
+    {
+      new (&entries[i]) Entry();
+      PlaceInArena(&entries[i].first, value[unique[i]].first, m_arena);
+      PlaceInArena(&entries[i].second, value[unique[i]].second, m_arena);
+    }
+  m_pointer = entries;
 }
 
-// 工厂方法替代了原来的构造函数
 Cbor::CborValue 
 Cbor::CborValue::CreateTaggedValue(uint64_t tag, const CborValue& value)
 {
   CborValue result;
-  // 创建shared_ptr并存储在pair中
-  result.m_value = std::pair<uint64_t, std::shared_ptr<CborValue>>(
-      tag, std::make_shared<CborValue>(value));
+  result.m_type = static_cast<uint8_t>(CborType::TAG);
+  result.m_arena = new CborArena(sizeof(TagNode));
+  result.m_arena->Ref();
+  result.m_owning = true;
+  
+  TagNode* node = static_cast<TagNode*>(result.m_arena->Allocate(sizeof(TagNode), alignof(TagNode)));
+  node->tag = tag;
+  PlaceInArena(&node->value, value, result.m_arena);
+  result.m_pointer = node;
   return result;
 }
 
 Cbor::CborValue::CborValue(CborSimpleValue value)
-  : m_value(value)
+  : CborValue()
 {
+  m_type = static_cast<uint8_t>(CborType::SIMPLE);
+  m_size = static_cast<uint8_t>(value);
 }
 
-CborType 
-Cbor::CborValue::GetType() const
+Cbor::CborValue::CborValue(const CborValue& other)
+  : m_type(other.m_type),
+    m_owning(other.m_arena != nullptr),
+    m_size(other.m_size),
+    m_unsigned(other.m_unsigned),
+    m_arena(other.m_arena)
 {
-  if (std::holds_alternative<uint64_t>(m_value))
-    {
-      return CborType::UNSIGNED_INTEGER;
-    }
-  else if (std::holds_alternative<int64_t>(m_value))
+  if (m_arena)
     {
-      return CborType::NEGATIVE_INTEGER;
+      m_arena->Ref();
     }
-  else if (std::holds_alternative<std::vector<uint8_t>>(m_value))
-    {
-      return CborType::BYTE_STRING;
-    }
-  else if (std::holds_alternative<std::string>(m_value))
-    {
-      return CborType::TEXT_STRING;
-    }
-  else if (std::holds_alternative<std::shared_ptr<CborArray>>(m_value))
-    {
-      return CborType::ARRAY;
-    }
-  else if (std::holds_alternative<std::shared_ptr<CborMap>>(m_value))
+}
+
+Cbor::CborValue::CborValue(CborValue&& other) noexcept
+  : m_type(other.m_type),
+    m_owning(other.m_owning),
+    m_size(other.m_size),
+    m_unsigned(other.m_unsigned),
+    m_arena(other.m_arena)
+{
+  // Ownership moves along with the value; arena-resident values stay
+  // non-owning, which keeps in-place sorting of decoded maps cycle-free
+  other.m_type = static_cast<uint8_t>(CborType::INVALID);
+  other.m_owning = false;
+  other.m_size = 0;
+  other.m_unsigned = 0;
+  other.m_arena = nullptr;
+}
+
+Cbor::CborValue& 
+Cbor::CborValue::operator=(const CborValue& other)
+{
+  if (this != &other)
     {
-      return CborType::MAP;
+      CborValue copy(other);
+      *this = std::move(copy);
     }
-  else if (std::holds_alternative<std::pair<uint64_t, std::shared_ptr<CborValue>>>(m_value))
+  return *this;
+}
+
+Cbor::CborValue& 
+Cbor::CborValue::operator=(CborValue&& other) noexcept
+{
+  if (this != &other)
     {
-      return CborType::TAG;
+      Release();
+      m_type = other.m_type;
+      m_owning = other.m_owning;
+      m_size = other.m_size;
+      m_unsigned = other.m_unsigned;
+      m_arena = other.m_arena;
+      other.m_type = static_cast<uint8_t>(CborType::INVALID);
+      other.m_owning = false;
+      other.m_size = 0;
+      other.m_unsigned = 0;
+      other.m_arena = nullptr;
     }
-  else if (std::holds_alternative<CborSimpleValue>(m_value))
+  return *this;
+}
+
+Cbor::CborValue::~CborValue()
+{
+  Release();
+}
+
+void 
+Cbor::CborValue::Release()
+{
+  if (m_owning && m_arena)
     {
-      return CborType::SIMPLE;
+      m_arena->Unref();
     }
-  
-  return CborType::INVALID;
+  m_owning = false;
+  m_arena = nullptr;
+}
+
+void 
+Cbor::CborValue::PlaceInArena(CborValue* slot, const CborValue& source, CborArena* arena)
+{
+  new (slot) CborValue();
+  slot->m_type = source.m_type;
+  slot->m_size = source.m_size;
+  slot->m_unsigned = source.m_unsigned;
+  slot->m_arena = source.m_arena;
+  arena->Adopt(source.m_arena);
 }
 
 bool 
 Cbor::CborValue::IsUnsignedInteger() const
 {
-  return std::holds_alternative<uint64_t>(m_value);
+  return GetType() == CborType::UNSIGNED_INTEGER;
 }
 
 bool 
 Cbor::CborValue::IsNegativeInteger() const
 {
-  return std::holds_alternative<int64_t>(m_value);
+  return GetType() == CborType::NEGATIVE_INTEGER;
 }
 
 bool 
@@ -127,37 +364,37 @@ Cbor::CborValue::IsInteger() const
 bool 
 Cbor::CborValue::IsByteString() const
 {
-  return std::holds_alternative<std::vector<uint8_t>>(m_value);
+  return GetType() == CborType::BYTE_STRING;
 }
 
 bool 
 Cbor::CborValue::IsTextString() const
 {
-  return std::holds_alternative<std::string>(m_value);
+  return GetType() == CborType::TEXT_STRING;
 }
 
 bool 
 Cbor::CborValue::IsArray() const
 {
-  return std::holds_alternative<std::shared_ptr<CborArray>>(m_value);
+  return GetType() == CborType::ARRAY;
 }
 
 bool 
 Cbor::CborValue::IsMap() const
 {
-  return std::holds_alternative<std::shared_ptr<CborMap>>(m_value);
+  return GetType() == CborType::MAP;
 }
 
 bool 
 Cbor::CborValue::IsTag() const
 {
-  return std::holds_alternative<std::pair<uint64_t, std::shared_ptr<CborValue>>>(m_value);
+  return GetType() == CborType::TAG;
 }
 
 bool 
 Cbor::CborValue::IsSimple() const
 {
-  return std::holds_alternative<CborSimpleValue>(m_value);
+  return GetType() == CborType::SIMPLE;
 }
 
 bool 
@@ -191,7 +428,7 @@ Cbor::CborValue::GetUnsignedInteger() const
 {
   if (IsUnsignedInteger())
     {
-      return std::get<uint64_t>(m_value);
+      return m_unsigned;
     }
   return 0;
 }
@@ -201,7 +438,7 @@ Cbor::CborValue::GetNegativeInteger() const
 {
   if (IsNegativeInteger())
     {
-      return std::get<int64_t>(m_value);
+      return m_negative;
     }
   return 0;
 }
@@ -224,61 +461,56 @@ Cbor::CborValue::GetInteger() const
   return 0;
 }
 
-const std::vector<uint8_t>& 
+CborBytes 
 Cbor::CborValue::GetByteString() const
 {
-  static const std::vector<uint8_t> empty;
   if (IsByteString())
     {
-      return std::get<std::vector<uint8_t>>(m_value);
+      return CborBytes(static_cast<const uint8_t*>(m_pointer), m_size);
     }
-  return empty;
+  return CborBytes();
 }
 
-const std::string& 
+CborText 
 Cbor::CborValue::GetTextString() const
 {
-  static const std::string empty;
   if (IsTextString())
     {
-      return std::get<std::string>(m_value);
+      return CborText(static_cast<const char*>(m_pointer), m_size);
     }
-  return empty;
+  return CborText();
 }
 
-const Cbor::CborArray& 
+Cbor::CborArrayView 
 Cbor::CborValue::GetArray() const
 {
-  static const CborArray empty;
   if (IsArray())
     {
-      return *std::get<std::shared_ptr<CborArray>>(m_value);
+      return CborArrayView(static_cast<const CborValue*>(m_pointer), m_size);
     }
-  return empty;
+  return CborArrayView();
 }
 
-const Cbor::CborMap& 
+Cbor::CborMapView 
 Cbor::CborValue::GetMap() const
 {
-  static const CborMap empty;
   if (IsMap())
     {
-      return *std::get<std::shared_ptr<CborMap>>(m_value);
+      return CborMapView(static_cast<const std::pair<CborValue, CborValue>*>(m_pointer), m_size);
     }
-  return empty;
+  return CborMapView();
 }
 
-// 修改返回类型和实现
-std::pair<uint64_t, std::shared_ptr<const Cbor::CborValue>> 
+std::pair<uint64_t, const Cbor::CborValue*> 
 Cbor::CborValue::GetTag() const
 {
-  static const auto emptyValue = std::make_shared<CborValue>();
+  static const CborValue emptyValue;
   if (IsTag())
     {
-      const auto& tag = std::get<std::pair<uint64_t, std::shared_ptr<CborValue>>>(m_value);
-      return std::make_pair(tag.first, std::const_pointer_cast<const CborValue>(tag.second));
+      const TagNode* node = static_cast<const TagNode*>(m_pointer);
+      return std::make_pair(node->tag, &node->value);
     }
-  return std::make_pair(0, emptyValue);
+  return std::make_pair(static_cast<uint64_t>(0), &emptyValue);
 }
 
 CborSimpleValue 
@@ -286,7 +518,7 @@ Cbor::CborValue::GetSimple() const
 {
   if (IsSimple())
     {
-      return std::get<CborSimpleValue>(m_value);
+      return static_cast<CborSimpleValue>(m_size);
     }
   return CborSimpleValue::UNDEFINED;
 }
@@ -304,9 +536,46 @@ Cbor::CborValue::GetBoolean() const
 double 
 Cbor::CborValue::GetFloat() const
 {
-  // In a real implementation, we would extract the float value
-  // This is simplified for now
-  return 0.0;
+  // The raw IEEE 754 bits are kept inline
+  switch (GetSimple())
+    {
+      case CborSimpleValue::FLOAT16:
+        {
+          uint16_t half = static_cast<uint16_t>(m_unsigned);
+          int exponent = (half >> 10) & 0x1F;
+          double mantissa = half & 0x3FF;
+          double value;
+          if (exponent == 0)
+            {
+              value = std::ldexp(mantissa, -24);
+            }
+          else if (exponent != 31)
+            {
+              value = std::ldexp(mantissa + 1024, exponent - 25);
+            }
+          else
+            {
+              value = mantissa == 0 ? std::numeric_limits<double>::infinity()
+                                    : std::numeric_limits<double>::quiet_NaN();
+            }
+          return (half & 0x8000) ? -value : value;
+        }
+      case CborSimpleValue::FLOAT32:
+        {
+          uint32_t bits = static_cast<uint32_t>(m_unsigned);
+          float value;
+          std::memcpy(&value, &bits, sizeof(value));
+          return value;
+        }
+      case CborSimpleValue::FLOAT64:
+        {
+          double value;
+          std::memcpy(&value, &m_unsigned, sizeof(value));
+          return value;
+        }
+      default:
+        return 0.0;
+    }
 }
 
 bool 
@@ -340,7 +609,7 @@ Cbor::CborValue::operator==(const CborValue& other) const
           return thisTag.first == otherTag.first && *thisTag.second == *otherTag.second;
         }
       case CborType::SIMPLE:
-        return GetSimple() == other.GetSimple();
+        return GetSimple() == other.GetSimple() && m_unsigned == other.m_unsigned;
       case CborType::INVALID:
         return true; // Both are invalid
     }
@@ -389,7 +658,11 @@ Cbor::CborValue::operator<(const CborValue& other) const
           return *thisTag.second < *otherTag.second;
         }
       case CborType::SIMPLE:
-        return static_cast<int>(GetSimple()) < static_cast<int>(other.GetSimple());
+        if (GetSimple() != other.GetSimple())
+          {
+            return static_cast<int>(GetSimple()) < static_cast<int>(other.GetSimple());
+          }
+        return m_unsigned < other.m_unsigned;
       case CborType::INVALID:
         return false; // Both are invalid
     }
@@ -405,72 +678,58 @@ Cbor::CborValue::ToString() const
   switch (GetType())
     {
       case CborType::UNSIGNED_INTEGER:
-        {
-          // 使用str()将数值转换为字符串
-          uint64_t val = GetUnsignedInteger();
-          ss.str(ss.str() + std::to_string(val));
-        }
+        ss << GetUnsignedInteger();
         break;
       case CborType::NEGATIVE_INTEGER:
-        {
-          int64_t val = GetNegativeInteger();
-          ss.str(ss.str() + std::to_string(val));
-        }
+        ss << GetNegativeInteger();
         break;
       case CborType::BYTE_STRING:
         {
-          const auto& bytes = GetByteString();
-          ss.str(ss.str() + "h'");
-          for (uint8_t byte : bytes)
+          ss << "h'";
+          for (uint8_t byte : GetByteString())
             {
-              char buf[3];
-              std::snprintf(buf, sizeof(buf), "%02x", static_cast<int>(byte));
-              ss.str(ss.str() + buf);
+              ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
             }
-          ss.str(ss.str() + "'");
+          ss << std::dec << "'";
         }
         break;
       case CborType::TEXT_STRING:
-        {
-          ss.str(ss.str() + "\"" + GetTextString() + "\"");
-        }
+        ss << "\"" << std::string(GetTextString()) << "\"";
         break;
       case CborType::ARRAY:
         {
-          const auto& array = GetArray();
-          ss.str(ss.str() + "[");
+          auto array = GetArray();
+          ss << "[";
           for (size_t i = 0; i < array.size(); ++i)
             {
               if (i > 0)
                 {
-                  ss.str(ss.str() + ", ");
+                  ss << ", ";
                 }
-              ss.str(ss.str() + array[i].ToString());
+              ss << array[i].ToString();
             }
-          ss.str(ss.str() + "]");
+          ss << "]";
         }
         break;
       case CborType::MAP:
         {
-          const auto& map = GetMap();
-          ss.str(ss.str() + "{");
-          bool first = true;
-          for (const auto& pair : map)
+          auto map = GetMap();
+          ss << "{";
+          for (size_t i = 0; i < map.size(); ++i)
             {
-              if (!first)
+              if (i > 0)
                 {
-                  ss.str(ss.str() + ", ");
+                  ss << ", ";
                 }
-              first = false;
-              ss.str(ss.str() + pair.first.ToString() + ": " + pair.second.ToString());
+              ss << map[i].first.ToString() << ": " << map[i].second.ToString();
             }
-          ss.str(ss.str() + "}");
+          ss << "}";
         }
         break;
       case CborType::TAG:
         {
           auto tag = GetTag();
-          ss.str(ss.str() + std::to_string(tag.first) + "(" + tag.second->ToString() + ")");
+          ss << tag.first << "(" << tag.second->ToString() << ")";
         }
         break;
       case CborType::SIMPLE:
@@ -479,283 +738,828 @@ Cbor::CborValue::ToString() const
           switch (simple)
             {
               case CborSimpleValue::FALSE:
-                ss.str(ss.str() + "false");
+                ss << "false";
                 break;
               case CborSimpleValue::TRUE:
-                ss.str(ss.str() + "true");
+                ss << "true";
                 break;
               case CborSimpleValue::NULL_VALUE:
-                ss.str(ss.str() + "null");
+                ss << "null";
                 break;
               case CborSimpleValue::UNDEFINED:
-                ss.str(ss.str() + "undefined");
+                ss << "undefined";
+                break;
+              case CborSimpleValue::FLOAT16:
+              case CborSimpleValue::FLOAT32:
+              case CborSimpleValue::FLOAT64:
+                ss << GetFloat();
                 break;
               default:
-                ss.str(ss.str() + "simple(" + std::to_string(static_cast<int>(simple)) + ")");
+                ss << "simple(" << static_cast<int>(simple) << ")";
                 break;
             }
         }
         break;
       case CborType::INVALID:
-        ss.str(ss.str() + "invalid");
+        ss << "invalid";
         break;
     }
   
   return ss.str();
 }
 
+const Cbor::CborValue* 
+Cbor::CborMapView::Find(const CborValue& key) const
+{
+  auto it = std::lower_bound(begin(), end(), key,
+                             [] (const std::pair<CborValue, CborValue>& entry, const CborValue& k) {
+    return entry.first < k;
+  });
+  if (it != end() && it->first == key)
+    {
+      return &it->second;
+    }
+  return nullptr;
+}
+
 // Cbor implementation
 
 Buffer 
 Cbor::Encode(const CborValue& value)
 {
+  // Size the buffer exactly, then stream the value tree into it
   Buffer buffer;
-  buffer.AddAtStart(1024); // Start with reasonable size, will be resized as needed
-  Buffer::Iterator it = buffer.Begin();
+  buffer.AddAtStart(CborWriter::ValueSize(value));
+  
+  CborWriter writer(buffer.Begin());
+  writer.WriteValue(value);
+  
+  return buffer;
+}
+
+std::optional<Cbor::CborValue> 
+Cbor::Decode(Buffer buffer)
+{
+  return Decode(buffer.PeekData(), buffer.GetSize());
+}
+
+std::optional<Cbor::CborValue> 
+Cbor::Decode(const uint8_t* data, size_t size)
+{
+  if (size == 0)
+    {
+      return std::nullopt;
+    }
+  
+  CborReader reader(data, size);
+  CborValue value;
+  if (!reader.ReadValue(value))
+    {
+      return std::nullopt;
+    }
   
-  // Encode based on type
+  return value;
+}
+
+// CborWriter implementation
+
+namespace {
+
+/**
+ * \brief Get the number of bytes following a float header
+ * \param simple FLOAT16, FLOAT32 or FLOAT64
+ * \return Width in bytes
+ */
+size_t 
+FloatWidth(CborSimpleValue simple)
+{
+  switch (simple)
+    {
+      case CborSimpleValue::FLOAT16:
+        return 2;
+      case CborSimpleValue::FLOAT32:
+        return 4;
+      default:
+        return 8;
+    }
+}
+
+} // anonymous namespace
+
+CborWriter::CborWriter(std::vector<uint8_t>& output)
+  : m_vector(&output),
+    m_bytesWritten(0),
+    m_discard(false),
+    m_crc(nullptr)
+{
+}
+
+CborWriter::CborWriter(Buffer::Iterator output)
+  : m_vector(nullptr),
+    m_iterator(output),
+    m_bytesWritten(0),
+    m_discard(false),
+    m_crc(nullptr)
+{
+}
+
+CborWriter::CborWriter()
+  : m_vector(nullptr),
+    m_bytesWritten(0),
+    m_discard(true),
+    m_crc(nullptr)
+{
+}
+
+void 
+CborWriter::Append(const uint8_t* data, size_t size)
+{
+  if (size == 0)
+    {
+      return;
+    }
+  
+  if (m_crc)
+    {
+      m_crc->Update(data, size);
+    }
+  
+  if (m_vector)
+    {
+      m_vector->insert(m_vector->end(), data, data + size);
+    }
+  else if (!m_discard)
+    {
+      m_iterator.Write(data, static_cast<uint32_t>(size));
+    }
+  
+  m_bytesWritten += size;
+}
+
+void 
+CborWriter::WriteHeader(uint8_t majorType, uint64_t value)
+{
+  uint8_t header[9];
+  size_t length;
+  uint8_t type = static_cast<uint8_t>(majorType << 5);
+  
+  if (value <= 23)
+    {
+      header[0] = type | static_cast<uint8_t>(value);
+      length = 1;
+    }
+  else if (value <= 0xFF)
+    {
+      header[0] = type | 24;
+      length = 2;
+    }
+  else if (value <= 0xFFFF)
+    {
+      header[0] = type | 25;
+      length = 3;
+    }
+  else if (value <= 0xFFFFFFFF)
+    {
+      header[0] = type | 26;
+      length = 5;
+    }
+  else
+    {
+      header[0] = type | 27;
+      length = 9;
+    }
+  
+  // Argument in network byte order
+  for (size_t i = 1; i < length; ++i)
+    {
+      header[i] = static_cast<uint8_t>(value >> (8 * (length - 1 - i)));
+    }
+  
+  Append(header, length);
+}
+
+void 
+CborWriter::WriteUnsigned(uint64_t value)
+{
+  WriteHeader(0, value);
+}
+
+void 
+CborWriter::WriteInteger(int64_t value)
+{
+  if (value >= 0)
+    {
+      WriteHeader(0, static_cast<uint64_t>(value));
+    }
+  else
+    {
+      // In CBOR, negative integers are encoded as -1-n
+      WriteHeader(1, static_cast<uint64_t>(-1 - value));
+    }
+}
+
+void 
+CborWriter::WriteByteString(const uint8_t* data, size_t size)
+{
+  WriteHeader(2, size);
+  Append(data, size);
+}
+
+void 
+CborWriter::WriteByteString(const std::vector<uint8_t>& data)
+{
+  WriteByteString(data.data(), data.size());
+}
+
+void 
+CborWriter::WriteTextString(const std::string& text)
+{
+  WriteHeader(3, text.size());
+  Append(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+void 
+CborWriter::WriteArrayHeader(uint64_t size)
+{
+  WriteHeader(4, size);
+}
+
+void 
+CborWriter::WriteMapHeader(uint64_t size)
+{
+  WriteHeader(5, size);
+}
+
+void 
+CborWriter::WriteSimple(CborSimpleValue value)
+{
+  uint8_t val = static_cast<uint8_t>(value);
+  if (val <= 23)
+    {
+      uint8_t header = static_cast<uint8_t>(7 << 5) | val;
+      Append(&header, 1);
+    }
+  else
+    {
+      uint8_t header[2] = {static_cast<uint8_t>((7 << 5) | 24), val};
+      Append(header, 2);
+    }
+}
+
+void 
+CborWriter::WriteValue(const Cbor::CborValue& value)
+{
   switch (value.GetType())
     {
       case CborType::UNSIGNED_INTEGER:
-        {
-          uint64_t val = value.GetUnsignedInteger();
-          EncodeUnsigned(buffer, 0, val);
-        }
+        WriteUnsigned(value.GetUnsignedInteger());
         break;
       case CborType::NEGATIVE_INTEGER:
-        {
-          int64_t val = value.GetNegativeInteger();
-          // In CBOR, negative integers are encoded as -1-n
-          EncodeUnsigned(buffer, 1, static_cast<uint64_t>(-1 - val));
-        }
+        WriteInteger(value.GetNegativeInteger());
         break;
       case CborType::BYTE_STRING:
         {
-          const auto& bytes = value.GetByteString();
-          EncodeUnsigned(buffer, 2, bytes.size());
-          it.Write(bytes.data(), bytes.size());
+          CborBytes bytes = value.GetByteString();
+          WriteByteString(bytes.data(), bytes.size());
         }
         break;
       case CborType::TEXT_STRING:
         {
-          const auto& text = value.GetTextString();
-          EncodeUnsigned(buffer, 3, text.size());
-          it.Write(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+          CborText text = value.GetTextString();
+          WriteHeader(3, text.size());
+          Append(reinterpret_cast<const uint8_t*>(text.data()), text.size());
         }
         break;
       case CborType::ARRAY:
         {
           const auto& array = value.GetArray();
-          EncodeUnsigned(buffer, 4, array.size());
+          WriteArrayHeader(array.size());
           for (const auto& item : array)
             {
-              Buffer itemBuffer = Encode(item);
-              // Append item to buffer
-              // Note: In a real implementation, this needs proper buffer management
+              WriteValue(item);
             }
         }
         break;
       case CborType::MAP:
         {
           const auto& map = value.GetMap();
-          EncodeUnsigned(buffer, 5, map.size());
+          WriteMapHeader(map.size());
           for (const auto& pair : map)
             {
-              Buffer keyBuffer = Encode(pair.first);
-              Buffer valueBuffer = Encode(pair.second);
-              // Append key and value to buffer
-              // Note: In a real implementation, this needs proper buffer management
+              WriteValue(pair.first);
+              WriteValue(pair.second);
             }
         }
         break;
       case CborType::TAG:
         {
           auto tag = value.GetTag();
-          EncodeUnsigned(buffer, 6, tag.first);
-          Buffer valueBuffer = Encode(*tag.second);
-          // Append tagged value to buffer
-          // Note: In a real implementation, this needs proper buffer management
+          WriteHeader(6, tag.first);
+          WriteValue(*tag.second);
         }
         break;
       case CborType::SIMPLE:
-        {
-          auto simple = value.GetSimple();
-          uint8_t val = static_cast<uint8_t>(simple);
-          if (val <= 23)
-            {
-              it.WriteU8(EncodeHeader(7, val));
-            }
-          else
-            {
-              it.WriteU8(EncodeHeader(7, 24));
-              it.WriteU8(val);
-            }
-        }
+        if (value.IsFloat())
+          {
+            // Floats keep their original width and raw bits
+            size_t width = FloatWidth(value.GetSimple());
+            uint8_t bytes[9];
+            bytes[0] = static_cast<uint8_t>((7 << 5) | static_cast<uint8_t>(value.GetSimple()));
+            for (size_t i = 0; i < width; ++i)
+              {
+                bytes[width - i] = static_cast<uint8_t>(value.m_unsigned >> (8 * i));
+              }
+            Append(bytes, 1 + width);
+          }
+        else
+          {
+            WriteSimple(value.GetSimple());
+          }
         break;
       case CborType::INVALID:
         // Don't encode invalid values
         break;
     }
-  
-  return buffer;
 }
 
-std::optional<Cbor::CborValue> 
-Cbor::Decode(Buffer buffer)
+void 
+CborWriter::WriteRaw(const uint8_t* data, size_t size)
 {
-  // In a real implementation, this would parse CBOR data from the buffer
-  // This is a simplified placeholder
-  
-  if (buffer.GetSize() == 0)
+  Append(data, size);
+}
+
+size_t 
+CborWriter::HeaderSize(uint64_t value)
+{
+  if (value <= 23)
     {
-      return std::nullopt;
+      return 1;
     }
-  
-  Buffer::Iterator it = buffer.Begin();
-  uint8_t header = it.ReadU8();
-  
-  uint8_t majorType, additionalInfo;
-  DecodeHeader(header, majorType, additionalInfo);
-  
-  size_t bytesRead = 1;
-  
-  switch (majorType)
+  else if (value <= 0xFF)
     {
-      case 0: // Unsigned integer
+      return 2;
+    }
+  else if (value <= 0xFFFF)
+    {
+      return 3;
+    }
+  else if (value <= 0xFFFFFFFF)
+    {
+      return 5;
+    }
+  return 9;
+}
+
+size_t 
+CborWriter::IntegerSize(int64_t value)
+{
+  if (value >= 0)
+    {
+      return HeaderSize(static_cast<uint64_t>(value));
+    }
+  return HeaderSize(static_cast<uint64_t>(-1 - value));
+}
+
+size_t 
+CborWriter::StringSize(size_t length)
+{
+  return HeaderSize(length) + length;
+}
+
+size_t 
+CborWriter::ValueSize(const Cbor::CborValue& value)
+{
+  switch (value.GetType())
+    {
+      case CborType::UNSIGNED_INTEGER:
+        return HeaderSize(value.GetUnsignedInteger());
+      case CborType::NEGATIVE_INTEGER:
+        return IntegerSize(value.GetNegativeInteger());
+      case CborType::BYTE_STRING:
+        return StringSize(value.GetByteString().size());
+      case CborType::TEXT_STRING:
+        return StringSize(value.GetTextString().size());
+      case CborType::ARRAY:
         {
-          auto unsignedOpt = DecodeUnsigned(buffer, majorType, bytesRead);
-          if (!unsignedOpt)
+          const auto& array = value.GetArray();
+          size_t size = HeaderSize(array.size());
+          for (const auto& item : array)
             {
-              return std::nullopt;
+              size += ValueSize(item);
             }
-          return CborValue(*unsignedOpt);
+          return size;
         }
-      case 1: // Negative integer
+      case CborType::MAP:
         {
-          auto unsignedOpt = DecodeUnsigned(buffer, majorType, bytesRead);
-          if (!unsignedOpt)
+          const auto& map = value.GetMap();
+          size_t size = HeaderSize(map.size());
+          for (const auto& pair : map)
             {
-              return std::nullopt;
+              size += ValueSize(pair.first) + ValueSize(pair.second);
             }
-          return CborValue(static_cast<int64_t>(-1 - static_cast<int64_t>(*unsignedOpt)));
+          return size;
+        }
+      case CborType::TAG:
+        {
+          auto tag = value.GetTag();
+          return HeaderSize(tag.first) + ValueSize(*tag.second);
         }
-      // Additional cases for other types would be implemented similarly
+      case CborType::SIMPLE:
+        if (value.IsFloat())
+          {
+            return 1 + FloatWidth(value.GetSimple());
+          }
+        return static_cast<uint8_t>(value.GetSimple()) <= 23 ? 1 : 2;
+      case CborType::INVALID:
+        return 0;
     }
   
-  return std::nullopt;
+  return 0;
 }
 
-uint8_t 
-Cbor::EncodeHeader(uint8_t majorType, uint8_t additionalInfo)
+// CborReader implementation
+
+CborReader::CborReader(const uint8_t* data, size_t size)
+  : m_data(data),
+    m_size(data ? size : 0),
+    m_position(0)
 {
-  return (majorType << 5) | (additionalInfo & 0x1F);
 }
 
-void 
-Cbor::DecodeHeader(uint8_t header, uint8_t& majorType, uint8_t& additionalInfo)
+bool 
+CborReader::PeekMajorType(uint8_t& majorType) const
 {
-  majorType = (header >> 5) & 0x07;
-  additionalInfo = header & 0x1F;
+  if (AtEnd())
+    {
+      return false;
+    }
+  
+  majorType = (m_data[m_position] >> 5) & 0x07;
+  return true;
 }
 
-void 
-Cbor::EncodeUnsigned(Buffer& buffer, uint8_t majorType, uint64_t value)
+bool 
+CborReader::ReadHeader(uint8_t& majorType, uint64_t& value)
 {
-  Buffer::Iterator it = buffer.Begin();
+  if (AtEnd())
+    {
+      return false;
+    }
   
-  if (value <= 23)
+  uint8_t header = m_data[m_position];
+  majorType = (header >> 5) & 0x07;
+  uint8_t additionalInfo = header & 0x1F;
+  
+  size_t length;
+  if (additionalInfo <= 23)
     {
-      it.WriteU8(EncodeHeader(majorType, static_cast<uint8_t>(value)));
+      value = additionalInfo;
+      m_position += 1;
+      return true;
     }
-  else if (value <= 0xFF)
+  else if (additionalInfo == 24)
     {
-      it.WriteU8(EncodeHeader(majorType, 24));
-      it.WriteU8(static_cast<uint8_t>(value));
+      length = 1;
     }
-  else if (value <= 0xFFFF)
+  else if (additionalInfo == 25)
     {
-      it.WriteU8(EncodeHeader(majorType, 25));
-      it.WriteHtonU16(static_cast<uint16_t>(value));
+      length = 2;
     }
-  else if (value <= 0xFFFFFFFF)
+  else if (additionalInfo == 26)
+    {
+      length = 4;
+    }
+  else if (additionalInfo == 27)
     {
-      it.WriteU8(EncodeHeader(majorType, 26));
-      it.WriteHtonU32(static_cast<uint32_t>(value));
+      length = 8;
     }
   else
     {
-      it.WriteU8(EncodeHeader(majorType, 27));
-      it.WriteHtonU64(value);
+      // Reserved values and indefinite-length items are not supported
+      return false;
+    }
+  
+  if (GetRemaining() < 1 + length)
+    {
+      return false;
+    }
+  
+  // Argument in network byte order
+  value = 0;
+  for (size_t i = 1; i <= length; ++i)
+    {
+      value = (value << 8) | m_data[m_position + i];
+    }
+  
+  m_position += 1 + length;
+  return true;
+}
+
+bool 
+CborReader::ReadUnsigned(uint64_t& value)
+{
+  size_t start = m_position;
+  uint8_t majorType;
+  if (!ReadHeader(majorType, value) || majorType != 0)
+    {
+      m_position = start;
+      return false;
     }
+  return true;
 }
 
-std::optional<uint64_t> 
-Cbor::DecodeUnsigned(Buffer& buffer, uint8_t majorType, size_t& bytesRead)
+bool 
+CborReader::ReadInteger(int64_t& value)
 {
-  Buffer::Iterator it = buffer.Begin();
+  size_t start = m_position;
+  uint8_t majorType;
+  uint64_t raw;
+  if (!ReadHeader(majorType, raw) || (majorType != 0 && majorType != 1) ||
+      raw > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+    {
+      m_position = start;
+      return false;
+    }
   
-  if (buffer.GetSize() < 1)
+  // In CBOR, negative integers are encoded as -1-n
+  value = majorType == 0 ? static_cast<int64_t>(raw) : -1 - static_cast<int64_t>(raw);
+  return true;
+}
+
+bool 
+CborReader::ReadString(uint8_t majorType, const uint8_t*& data, size_t& size)
+{
+  size_t start = m_position;
+  uint8_t readMajorType;
+  uint64_t length;
+  if (!ReadHeader(readMajorType, length) || readMajorType != majorType || length > GetRemaining())
     {
-      return std::nullopt;
+      m_position = start;
+      return false;
     }
   
-  uint8_t header = it.ReadU8();
-  bytesRead = 1;
+  data = m_data + m_position;
+  size = static_cast<size_t>(length);
+  m_position += size;
+  return true;
+}
+
+bool 
+CborReader::ReadByteString(const uint8_t*& data, size_t& size)
+{
+  return ReadString(2, data, size);
+}
+
+bool 
+CborReader::ReadTextString(const char*& data, size_t& size)
+{
+  const uint8_t* bytes;
+  if (!ReadString(3, bytes, size))
+    {
+      return false;
+    }
+  data = reinterpret_cast<const char*>(bytes);
+  return true;
+}
+
+bool 
+CborReader::ReadArrayHeader(uint64_t& size)
+{
+  size_t start = m_position;
+  uint8_t majorType;
+  if (!ReadHeader(majorType, size) || majorType != 4)
+    {
+      m_position = start;
+      return false;
+    }
+  return true;
+}
+
+bool 
+CborReader::ReadMapHeader(uint64_t& size)
+{
+  size_t start = m_position;
+  uint8_t majorType;
+  if (!ReadHeader(majorType, size) || majorType != 5)
+    {
+      m_position = start;
+      return false;
+    }
+  return true;
+}
+
+bool 
+CborReader::Skip()
+{
+  return ReadItem(nullptr, nullptr, MAX_DEPTH);
+}
+
+bool 
+CborReader::ReadValue(Cbor::CborValue& value)
+{
+  // Everything decoded below shares one arena, released in one go
+  CborArena* arena = new CborArena(GetRemaining());
+  arena->Ref();
   
-  uint8_t readMajorType, additionalInfo;
-  DecodeHeader(header, readMajorType, additionalInfo);
+  size_t start = m_position;
+  Cbor::CborValue result;
+  bool ok = ReadItem(&result, arena, MAX_DEPTH);
+  if (ok)
+    {
+      value = result;
+    }
+  else
+    {
+      m_position = start;
+    }
   
-  if (readMajorType != majorType)
+  arena->Unref();
+  return ok;
+}
+
+bool 
+CborReader::ReadItem(Cbor::CborValue* value, CborArena* arena, uint32_t depth)
+{
+  if (depth == 0)
     {
-      return std::nullopt;
+      return false;
     }
   
-  if (additionalInfo <= 23)
+  size_t start = m_position;
+  uint8_t majorType;
+  uint64_t argument;
+  if (!ReadHeader(majorType, argument))
     {
-      return static_cast<uint64_t>(additionalInfo);
+      return false;
     }
-  else if (additionalInfo == 24)
+  
+  // Decoded values are filled in place and point into the arena without
+  // holding a reference; only the root taken by ReadValue owns it
+  switch (majorType)
     {
-      if (buffer.GetSize() < 2)
+      case 0: // Unsigned integer
+        if (value)
+          {
+            value->m_type = static_cast<uint8_t>(CborType::UNSIGNED_INTEGER);
+            value->m_unsigned = argument;
+          }
+        return true;
+      case 1: // Negative integer
+        if (argument > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+          {
+            return false;
+          }
+        if (value)
+          {
+            value->m_type = static_cast<uint8_t>(CborType::NEGATIVE_INTEGER);
+            value->m_negative = -1 - static_cast<int64_t>(argument);
+          }
+        return true;
+      case 2: // Byte string
+      case 3: // Text string
         {
-          return std::nullopt;
+          if (argument > GetRemaining() || argument > std::numeric_limits<uint32_t>::max())
+            {
+              return false;
+            }
+          const uint8_t* data = m_data + m_position;
+          m_position += static_cast<size_t>(argument);
+          if (value)
+            {
+              value->m_type = static_cast<uint8_t>(majorType == 2 ? CborType::BYTE_STRING
+                                                                  : CborType::TEXT_STRING);
+              value->m_size = static_cast<uint32_t>(argument);
+              value->m_arena = arena;
+              value->m_pointer = nullptr;
+              if (argument > 0)
+                {
+                  void* copy = arena->Allocate(static_cast<size_t>(argument), 1);
+                  std::memcpy(copy, data, static_cast<size_t>(argument));
+                  value->m_pointer = copy;
+                }
+            }
+          return true;
         }
-      uint8_t value = it.ReadU8();
-      bytesRead = 2;
-      return static_cast<uint64_t>(value);
-    }
-  else if (additionalInfo == 25)
-    {
-      if (buffer.GetSize() < 3)
+      case 4: // Array
         {
-          return std::nullopt;
+          // Every item takes at least one byte, which bounds bogus lengths
+          if (argument > GetRemaining())
+            {
+              return false;
+            }
+          Cbor::CborValue* items = nullptr;
+          if (value && argument > 0)
+            {
+              items = static_cast<Cbor::CborValue*>(
+                  arena->Allocate(static_cast<size_t>(argument) * sizeof(Cbor::CborValue),
+                                  alignof(Cbor::CborValue)));
+            }
+          for (uint64_t i = 0; i < argument; ++i)
+            {
+              if (items)
+                {
+                  new (&items[i]) Cbor::CborValue();
+                }
+              if (!ReadItem(items ? &items[i] : nullptr, arena, depth - 1))
+                {
+                  return false;
+                }
+            }
+          if (value)
+            {
+              value->m_type = static_cast<uint8_t>(CborType::ARRAY);
+              value->m_size = static_cast<uint32_t>(argument);
+              value->m_arena = arena;
+              value->m_pointer = items;
+            }
+          return true;
         }
-      uint16_t value = it.ReadNtohU16();
-      bytesRead = 3;
-      return static_cast<uint64_t>(value);
-    }
-  else if (additionalInfo == 26)
-    {
-      if (buffer.GetSize() < 5)
+      case 5: // Map
+        {
+          if (argument > GetRemaining() / 2)
+            {
+              return false;
+            }
+          using Entry = std::pair<Cbor::CborValue, Cbor::CborValue>;
+          Entry* entries = nullptr;
+          if (value && argument > 0)
+            {
+              entries = static_cast<Entry*>(
+                  arena->Allocate(static_cast<size_t>(argument) * sizeof(Entry), alignof(Entry)));
+            }
+          for (uint64_t i = 0; i < argument; ++i)
+            {
+              if (entries)
+                {
+                  new (&entries[i]) Entry();
+                }
+              if (!ReadItem(entries ? &entries[i].first : nullptr, arena, depth - 1) ||
+                  !ReadItem(entries ? &entries[i].second : nullptr, arena, depth - 1))
+                {
+                  return false;
+                }
+            }
+          if (entries)
+            {
+              // Maps are kept as sorted vectors; duplicate keys are malformed
+              std::sort(entries, entries + argument, [] (const Entry& a, const Entry& b) {
+                return a.first < b.first;
+              });
+              for (uint64_t i = 1; i < argument; ++i)
+                {
+                  if (entries[i - 1].first == entries[i].first)
+                    {
+                      return false;
+                    }
+                }
+            }
+          if (value)
+            {
+              value->m_type = static_cast<uint8_t>(CborType::MAP);
+              value->m_size = static_cast<uint32_t>(argument);
+              value->m_arena = arena;
+              value->m_pointer = entries;
+            }
+          return true;
+        }
+      case 6: // Tag
         {
-          return std::nullopt;
+          Cbor::CborValue::TagNode* node = nullptr;
+          if (value)
+            {
+              node = static_cast<Cbor::CborValue::TagNode*>(
+                  arena->Allocate(sizeof(Cbor::CborValue::TagNode), alignof(Cbor::CborValue::TagNode)));
+              node->tag = argument;
+              new (&node->value) Cbor::CborValue();
+            }
+          if (!ReadItem(node ? &node->value : nullptr, arena, depth - 1))
+            {
+              return false;
+            }
+          if (value)
+            {
+              value->m_type = static_cast<uint8_t>(CborType::TAG);
+              value->m_arena = arena;
+              value->m_pointer = node;
+            }
+          return true;
         }
-      uint32_t value = it.ReadNtohU32();
-      bytesRead = 5;
-      return static_cast<uint64_t>(value);
-    }
-  else if (additionalInfo == 27)
-    {
-      if (buffer.GetSize() < 9)
+      case 7: // Simple value or float
         {
-          return std::nullopt;
+          if (value)
+            {
+              // Floats keep their raw bits, tagged by the width they came in
+              uint8_t additionalInfo = m_data[start] & 0x1F;
+              bool isFloat = additionalInfo >= 25;
+              value->m_type = static_cast<uint8_t>(CborType::SIMPLE);
+              value->m_size = isFloat ? additionalInfo : static_cast<uint8_t>(argument);
+              value->m_unsigned = isFloat ? argument : 0;
+            }
+          return true;
         }
-      uint64_t value = it.ReadNtohU64();
-      bytesRead = 9;
-      return value;
     }
   
-  return std::nullopt;
+  return false;
 }
 
 } // namespace dtn7
@@ -3,11 +3,11 @@
 
 #include "ns3/buffer.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <map>
-#include <memory>
-#include <variant>
+#include <utility>
 #include <optional>
 
 namespace ns3 {
@@ -43,6 +43,157 @@ enum class CborSimpleValue : uint8_t {
   BREAK = 31          //!< Stop code for indefinite-length items
 };
 
+class CborReader;
+class CrcState;
+class CborWriter;
+
+/**
+ * \ingroup dtn7
+ * \brief Read-only view of a contiguous sequence owned by a CBOR value
+ *
+ * Supports the read-only subset of std::vector and converts to a
+ * std::vector when a copy is needed.  The view is only valid while the
+ * value it was obtained from is alive.
+ */
+template <typename T>
+class CborSpan
+{
+public:
+  using value_type = T;
+  using const_iterator = const T*;
+  using iterator = const T*;
+  
+  CborSpan() : m_data(nullptr), m_size(0) {}
+  CborSpan(const T* data, size_t size) : m_data(data), m_size(size) {}
+  
+  const T* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  const T* begin() const { return m_data; }
+  const T* end() const { return m_data + m_size; }
+  const T& operator[](size_t index) const { return m_data[index]; }
+  const T& front() const { return m_data[0]; }
+  const T& back() const { return m_data[m_size - 1]; }
+  
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+  
+  bool operator==(const CborSpan& other) const
+  {
+    return m_size == other.m_size && std::equal(begin(), end(), other.begin());
+  }
+  bool operator!=(const CborSpan& other) const { return !(*this == other); }
+  bool operator<(const CborSpan& other) const
+  {
+    return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+  }
+  bool operator==(const std::vector<T>& other) const
+  {
+    return m_size == other.size() && std::equal(begin(), end(), other.begin());
+  }
+  bool operator!=(const std::vector<T>& other) const { return !(*this == other); }
+  
+protected:
+  const T* m_data;  //!< First element
+  size_t m_size;    //!< Number of elements
+};
+
+/**
+ * \brief Byte string view
+ */
+using CborBytes = CborSpan<uint8_t>;
+
+/**
+ * \brief Text string view, converts to std::string
+ */
+class CborText : public CborSpan<char>
+{
+public:
+  using CborSpan<char>::CborSpan;
+  
+  operator std::string() const { return std::string(m_data, m_size); }
+  
+  bool operator==(const std::string& other) const
+  {
+    return other.size() == m_size && other.compare(0, m_size, m_data, m_size) == 0;
+  }
+  bool operator!=(const std::string& other) const { return !(*this == other); }
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Monotonic arena backing CBOR values
+ *
+ * Strings, array items and map entries of a value tree are carved out of
+ * a few chunks and released in one go when the last value referencing the
+ * arena is destroyed.  Arenas of values copied into a tree are kept alive
+ * by the arena of that tree.  Reference counting is intrusive and, like
+ * SimpleRefCount, not thread-safe.
+ */
+class CborArena
+{
+public:
+  /**
+   * \brief Constructor
+   * \param capacityHint Expected number of bytes, used to size the first chunk
+   */
+  explicit CborArena(size_t capacityHint = 0);
+  
+  /**
+   * \brief Destructor, frees all chunks at once
+   */
+  ~CborArena();
+  
+  CborArena(const CborArena&) = delete;
+  CborArena& operator=(const CborArena&) = delete;
+  
+  /**
+   * \brief Allocate uninitialized memory
+   * \param size Number of bytes
+   * \param alignment Required alignment (power of two)
+   * \return Pointer to the memory
+   */
+  void* Allocate(size_t size, size_t alignment);
+  
+  /**
+   * \brief Keep another arena alive for the lifetime of this one
+   * \param other Other arena
+   */
+  void Adopt(CborArena* other);
+  
+  /**
+   * \brief Increment the reference count
+   */
+  void Ref() const { ++m_references; }
+  
+  /**
+   * \brief Decrement the reference count, deleting the arena at zero
+   */
+  void Unref() const;
+  
+  /**
+   * \brief Get the number of bytes handed out so far
+   * \return Number of bytes allocated
+   */
+  size_t GetBytesAllocated() const { return m_bytesAllocated; }
+  
+private:
+  /**
+   * \brief Header at the start of every chunk
+   */
+  struct Chunk
+  {
+    Chunk* next;  //!< Previously allocated chunk
+  };
+  
+  Chunk* m_chunks;                   //!< Most recent chunk
+  uint8_t* m_cursor;                 //!< Next free byte in the current chunk
+  size_t m_remaining;                //!< Free bytes left in the current chunk
+  size_t m_nextChunkSize;            //!< Size of the next chunk to allocate
+  size_t m_bytesAllocated;           //!< Bytes handed out
+  std::vector<CborArena*> m_adopted; //!< Arenas kept alive by this one
+  mutable uint32_t m_references;     //!< Reference count
+};
+
 /**
  * \ingroup dtn7
  * \brief CBOR encoder/decoder
@@ -50,32 +201,36 @@ enum class CborSimpleValue : uint8_t {
 class Cbor
 {
 public:
-  // Forward declaration for map value type
   class CborValue;
+  class CborMapView;
   
-  // Define map and array types to avoid cycles
+  /**
+   * \brief Array builder type, items are copied into the value's arena
+   */
   using CborArray = std::vector<CborValue>;
-  using CborMap = std::map<CborValue, CborValue>;
+  
+  /**
+   * \brief Map builder type, entries are sorted by key (last duplicate
+   * wins) when the map value is constructed
+   */
+  using CborMap = std::vector<std::pair<CborValue, CborValue>>;
+  
+  /**
+   * \brief Read-only view of the items of an array value
+   */
+  using CborArrayView = CborSpan<CborValue>;
   
   /**
    * \brief CBOR value class
+   *
+   * A 24-byte handle.  Integers and simple values are stored inline; strings,
+   * array items and map entries live in a CborArena shared by the whole
+   * value tree, so decoding a message costs a handful of chunk allocations
+   * instead of one or more per item.
    */
   class CborValue
   {
   public:
-    // Variant type for different CBOR values - 关键修改：使用std::shared_ptr<CborValue>替代直接使用CborValue
-    using ValueType = std::variant<
-        uint64_t,                                   // UNSIGNED_INTEGER
-        int64_t,                                    // NEGATIVE_INTEGER
-        std::vector<uint8_t>,                       // BYTE_STRING
-        std::string,                                // TEXT_STRING
-        std::shared_ptr<CborArray>,                 // ARRAY
-        std::shared_ptr<CborMap>,                   // MAP
-        std::pair<uint64_t, std::shared_ptr<CborValue>>, // TAG - 修改这里使用std::shared_ptr
-        CborSimpleValue,                            // SIMPLE
-        std::monostate                              // INVALID
-    >;
-    
     /**
      * \brief Default constructor (invalid value)
      */
@@ -99,6 +254,13 @@ public:
      */
     CborValue(const std::vector<uint8_t>& value);
     
+    /**
+     * \brief Constructor for byte string
+     * \param data Pointer to the bytes
+     * \param size Number of bytes
+     */
+    CborValue(const uint8_t* data, size_t size);
+    
     /**
      * \brief Constructor for text string
      * \param value Text string
@@ -118,7 +280,7 @@ public:
     CborValue(const CborMap& value);
     
     /**
-     * \brief Factory method for tag - 替换原始的构造函数
+     * \brief Factory method for tag
      * \param tag Tag number
      * \param value Tagged value
      * \return CborValue with tag
@@ -131,11 +293,42 @@ public:
      */
     CborValue(CborSimpleValue value);
     
+    /**
+     * \brief Copy constructor, shares the arena of the other value
+     * \param other Other value
+     */
+    CborValue(const CborValue& other);
+    
+    /**
+     * \brief Move constructor
+     * \param other Other value, left invalid
+     */
+    CborValue(CborValue&& other) noexcept;
+    
+    /**
+     * \brief Copy assignment
+     * \param other Other value
+     * \return This value
+     */
+    CborValue& operator=(const CborValue& other);
+    
+    /**
+     * \brief Move assignment
+     * \param other Other value, left invalid
+     * \return This value
+     */
+    CborValue& operator=(CborValue&& other) noexcept;
+    
+    /**
+     * \brief Destructor
+     */
+    ~CborValue();
+    
     /**
      * \brief Get the CBOR type
      * \return CBOR type
      */
-    CborType GetType() const;
+    CborType GetType() const { return static_cast<CborType>(m_type); }
     
     /**
      * \brief Check if value is unsigned integer
@@ -235,33 +428,33 @@ public:
     
     /**
      * \brief Get byte string value
-     * \return Byte string value
+     * \return View of the byte string (empty if not a byte string)
      */
-    const std::vector<uint8_t>& GetByteString() const;
+    CborBytes GetByteString() const;
     
     /**
      * \brief Get text string value
-     * \return Text string value
+     * \return View of the text string (empty if not a text string)
      */
-    const std::string& GetTextString() const;
+    CborText GetTextString() const;
     
     /**
      * \brief Get array value
-     * \return Array value
+     * \return View of the array items (empty if not an array)
      */
-    const CborArray& GetArray() const;
+    CborArrayView GetArray() const;
     
     /**
      * \brief Get map value
-     * \return Map value
+     * \return View of the map entries sorted by key (empty if not a map)
      */
-    const CborMap& GetMap() const;
+    CborMapView GetMap() const;
     
     /**
-     * \brief Get tag value - 修改返回类型
-     * \return Tag value (tag number and tagged value)
+     * \brief Get tag value
+     * \return Tag number and tagged value
      */
-    std::pair<uint64_t, std::shared_ptr<const CborValue>> GetTag() const;
+    std::pair<uint64_t, const CborValue*> GetTag() const;
     
     /**
      * \brief Get simple value
@@ -296,16 +489,58 @@ public:
      */
     std::string ToString() const;
     
+  private:
+    friend class ns3::dtn7::CborReader;
+    friend class ns3::dtn7::CborWriter;
+    
     /**
-     * \brief Get the underlying variant value
-     * \return Variant value
+     * \brief Tag number and tagged value, stored in the arena
      */
-    const ValueType& GetValue() const { return m_value; }
+    struct TagNode;
     
-  private:
-    ValueType m_value;  //!< CBOR value
+    /**
+     * \brief Drop the arena reference held by this value, if any
+     */
+    void Release();
+    
+    /**
+     * \brief Store a copy of a value inside an arena without taking a
+     * reference on that arena
+     * \param slot Uninitialized storage inside the arena
+     * \param source Value to copy
+     * \param arena Arena owning slot
+     */
+    static void PlaceInArena(CborValue* slot, const CborValue& source, CborArena* arena);
+    
+    uint8_t m_type;       //!< CborType of the value
+    bool m_owning;        //!< Whether this value holds a reference on m_arena
+    uint32_t m_size;      //!< String length, item count or simple value number
+    union
+    {
+      uint64_t m_unsigned;    //!< Unsigned integer, tag number or float bits
+      int64_t m_negative;     //!< Negative integer
+      const void* m_pointer;  //!< String bytes, items, entries or TagNode
+    };
+    CborArena* m_arena;   //!< Arena holding the out-of-line data, or nullptr
+  };
+  
+  /**
+   * \brief Read-only view of the entries of a map value
+   */
+  class CborMapView : public CborSpan<std::pair<CborValue, CborValue>>
+  {
+  public:
+    using CborSpan<std::pair<CborValue, CborValue>>::CborSpan;
+    
+    /**
+     * \brief Look up a key with a binary search
+     * \param key Key to look up
+     * \return Pointer to the value, or nullptr if the key is absent
+     */
+    const CborValue* Find(const CborValue& key) const;
   };
   
+  
   /**
    * \brief Encode CBOR value to binary data
    * \param value CBOR value
@@ -320,39 +555,311 @@ public:
    */
   static std::optional<CborValue> Decode(Buffer buffer);
   
-private:
   /**
-   * \brief Encode header byte for a major type and additional info
-   * \param majorType Major type (0-7)
-   * \param additionalInfo Additional info (0-31)
-   * \return Header byte
+   * \brief Decode binary data to CBOR value
+   * \param data Pointer to the encoded data
+   * \param size Size of the encoded data
+   * \return Decoded CBOR value or empty optional if error
    */
-  static uint8_t EncodeHeader(uint8_t majorType, uint8_t additionalInfo);
+  static std::optional<CborValue> Decode(const uint8_t* data, size_t size);
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Streaming CBOR writer
+ *
+ * Appends CBOR items directly to an output instead of building a
+ * Cbor::CborValue tree first.  The output is either a std::vector (grown
+ * on demand) or a Buffer::Iterator over a Buffer that has already been
+ * sized with the Size helpers below, so a whole bundle can be serialized
+ * in a single pass with a single allocation.
+ */
+class CborWriter
+{
+public:
+  /**
+   * \brief Construct a writer appending to a vector
+   * \param output Output vector
+   */
+  explicit CborWriter(std::vector<uint8_t>& output);
+  
+  /**
+   * \brief Construct a writer over a pre-sized buffer
+   * \param output Iterator to the first byte to write
+   */
+  explicit CborWriter(Buffer::Iterator output);
   
   /**
-   * \brief Decode header byte to major type and additional info
-   * \param header Header byte
-   * \param majorType Output parameter for major type
-   * \param additionalInfo Output parameter for additional info
+   * \brief Construct a writer that discards its output
+   *
+   * Useful together with SetCrc() to checksum an encoding without
+   * materialising it.
    */
-  static void DecodeHeader(uint8_t header, uint8_t& majorType, uint8_t& additionalInfo);
+  CborWriter();
   
   /**
-   * \brief Encode unsigned integer
-   * \param buffer Output buffer
+   * \brief Write the header of a data item
    * \param majorType Major type (0-7)
+   * \param value Argument (integer value, length or item count)
+   */
+  void WriteHeader(uint8_t majorType, uint64_t value);
+  
+  /**
+   * \brief Write an unsigned integer (major type 0)
    * \param value Integer value
    */
-  static void EncodeUnsigned(Buffer& buffer, uint8_t majorType, uint64_t value);
+  void WriteUnsigned(uint64_t value);
   
   /**
-   * \brief Decode unsigned integer
-   * \param buffer Input buffer
-   * \param majorType Major type (0-7)
-   * \param bytesRead Output parameter for number of bytes read
-   * \return Decoded value or empty optional if error
+   * \brief Write a signed integer (major type 0 or 1)
+   * \param value Integer value
+   */
+  void WriteInteger(int64_t value);
+  
+  /**
+   * \brief Write a byte string (major type 2)
+   * \param data Pointer to the bytes
+   * \param size Number of bytes
+   */
+  void WriteByteString(const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Write a byte string (major type 2)
+   * \param data Bytes
+   */
+  void WriteByteString(const std::vector<uint8_t>& data);
+  
+  /**
+   * \brief Write a text string (major type 3)
+   * \param text Text
+   */
+  void WriteTextString(const std::string& text);
+  
+  /**
+   * \brief Write a definite-length array header (major type 4)
+   * \param size Number of items that follow
+   */
+  void WriteArrayHeader(uint64_t size);
+  
+  /**
+   * \brief Write a definite-length map header (major type 5)
+   * \param size Number of key/value pairs that follow
+   */
+  void WriteMapHeader(uint64_t size);
+  
+  /**
+   * \brief Write a simple value (major type 7)
+   * \param value Simple value
+   */
+  void WriteSimple(CborSimpleValue value);
+  
+  /**
+   * \brief Write a complete value tree
+   * \param value CBOR value
+   */
+  void WriteValue(const Cbor::CborValue& value);
+  
+  /**
+   * \brief Write already encoded CBOR bytes verbatim
+   * \param data Pointer to the bytes
+   * \param size Number of bytes
+   */
+  void WriteRaw(const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Get the number of bytes written so far
+   * \return Number of bytes written
+   */
+  size_t GetBytesWritten() const { return m_bytesWritten; }
+  
+  /**
+   * \brief Feed every byte written from now on into a CRC
+   * \param crc CRC state, or nullptr to stop checksumming
+   */
+  void SetCrc(CrcState* crc) { m_crc = crc; }
+  
+  /**
+   * \brief Encoded size of a data item header
+   * \param value Argument (integer value, length or item count)
+   * \return Size in bytes
+   */
+  static size_t HeaderSize(uint64_t value);
+  
+  /**
+   * \brief Encoded size of a signed integer
+   * \param value Integer value
+   * \return Size in bytes
+   */
+  static size_t IntegerSize(int64_t value);
+  
+  /**
+   * \brief Encoded size of a byte or text string
+   * \param length String length in bytes
+   * \return Size in bytes
+   */
+  static size_t StringSize(size_t length);
+  
+  /**
+   * \brief Encoded size of a complete value tree
+   * \param value CBOR value
+   * \return Size in bytes
+   */
+  static size_t ValueSize(const Cbor::CborValue& value);
+  
+private:
+  /**
+   * \brief Append bytes to the output
+   * \param data Pointer to the bytes
+   * \param size Number of bytes
+   */
+  void Append(const uint8_t* data, size_t size);
+  
+  std::vector<uint8_t>* m_vector;  //!< Output vector (nullptr when writing to a buffer)
+  Buffer::Iterator m_iterator;     //!< Output buffer iterator
+  size_t m_bytesWritten;           //!< Number of bytes written
+  bool m_discard;                  //!< Output is dropped, only counted
+  CrcState* m_crc;                 //!< CRC fed with the output, if any
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Non-allocating CBOR pull parser
+ *
+ * Reads CBOR items one at a time from a contiguous byte range.  Byte and
+ * text strings are returned as pointer/length pairs into the input, so the
+ * caller decides if and where the data is copied.  The input must outlive
+ * the reader and any pointers obtained from it.
+ */
+class CborReader
+{
+public:
+  /**
+   * \brief Construct a reader over a byte range
+   * \param data Pointer to the first byte
+   * \param size Number of bytes
+   */
+  CborReader(const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Peek at the major type of the next item
+   * \param majorType Output parameter for major type (0-7)
+   * \return false if no data is left
+   */
+  bool PeekMajorType(uint8_t& majorType) const;
+  
+  /**
+   * \brief Read the header of the next item
+   * \param majorType Output parameter for major type (0-7)
+   * \param value Output parameter for the argument (value, length or count)
+   * \return false on truncated data or indefinite-length items
+   */
+  bool ReadHeader(uint8_t& majorType, uint64_t& value);
+  
+  /**
+   * \brief Read an unsigned integer (major type 0)
+   * \param value Output parameter for the value
+   * \return false on type mismatch or truncated data
+   */
+  bool ReadUnsigned(uint64_t& value);
+  
+  /**
+   * \brief Read a signed integer (major type 0 or 1)
+   * \param value Output parameter for the value
+   * \return false on type mismatch, overflow or truncated data
+   */
+  bool ReadInteger(int64_t& value);
+  
+  /**
+   * \brief Read a byte string (major type 2) without copying
+   * \param data Output parameter pointing into the input
+   * \param size Output parameter for the string length
+   * \return false on type mismatch or truncated data
+   */
+  bool ReadByteString(const uint8_t*& data, size_t& size);
+  
+  /**
+   * \brief Read a text string (major type 3) without copying
+   * \param data Output parameter pointing into the input
+   * \param size Output parameter for the string length
+   * \return false on type mismatch or truncated data
+   */
+  bool ReadTextString(const char*& data, size_t& size);
+  
+  /**
+   * \brief Read an array header (major type 4)
+   * \param size Output parameter for the number of items
+   * \return false on type mismatch or truncated data
    */
-  static std::optional<uint64_t> DecodeUnsigned(Buffer& buffer, uint8_t majorType, size_t& bytesRead);
+  bool ReadArrayHeader(uint64_t& size);
+  
+  /**
+   * \brief Read a map header (major type 5)
+   * \param size Output parameter for the number of pairs
+   * \return false on type mismatch or truncated data
+   */
+  bool ReadMapHeader(uint64_t& size);
+  
+  /**
+   * \brief Skip the next item, including all nested items
+   * \return false on malformed or truncated data
+   */
+  bool Skip();
+  
+  /**
+   * \brief Read the next item into a value tree
+   * \param value Output parameter for the value
+   * \return false on malformed or truncated data
+   */
+  bool ReadValue(Cbor::CborValue& value);
+  
+  /**
+   * \brief Get a pointer to the next unread byte
+   * \return Pointer into the input
+   */
+  const uint8_t* GetCurrent() const { return m_data + m_position; }
+  
+  /**
+   * \brief Get the number of bytes consumed so far
+   * \return Number of bytes consumed
+   */
+  size_t GetPosition() const { return m_position; }
+  
+  /**
+   * \brief Get the number of bytes left
+   * \return Number of bytes left
+   */
+  size_t GetRemaining() const { return m_size - m_position; }
+  
+  /**
+   * \brief Check if all input has been consumed
+   * \return true if no data is left
+   */
+  bool AtEnd() const { return m_position >= m_size; }
+  
+private:
+  /**
+   * \brief Read a string header and return its payload range
+   * \param majorType Expected major type (2 or 3)
+   * \param data Output parameter pointing into the input
+   * \param size Output parameter for the string length
+   * \return false on type mismatch or truncated data
+   */
+  bool ReadString(uint8_t majorType, const uint8_t*& data, size_t& size);
+  
+  /**
+   * \brief Skip or read the next item with a nesting limit
+   * \param value Default-constructed value to fill, or nullptr to skip
+   * \param arena Arena receiving strings, items and entries
+   * \param depth Remaining nesting depth
+   * \return false on malformed or truncated data
+   */
+  bool ReadItem(Cbor::CborValue* value, CborArena* arena, uint32_t depth);
+  
+  static constexpr uint32_t MAX_DEPTH = 32;  //!< Maximum nesting depth
+  
+  const uint8_t* m_data;  //!< Input data
+  size_t m_size;          //!< Input size
+  size_t m_position;      //!< Read position
 };
 
 } // namespace dtn7
@@ -0,0 +1,530 @@
+#include "contact-graph-routing.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/boolean.h"
+#include "ns3/nstime.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <sstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ContactGraphRouting");
+
+namespace dtn7 {
+
+NS_OBJECT_ENSURE_REGISTERED (ContactGraphRouting);
+
+TypeId 
+ContactGraphRouting::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::dtn7::ContactGraphRouting")
+    .SetParent<RoutingAlgorithm> ()
+    .SetGroupName ("Dtn7")
+    .AddConstructor<ContactGraphRouting> ()
+    .AddAttribute ("ContactPlan",
+                   "Contact plan file loaded on initialization, empty for none",
+                   StringValue (""),
+                   MakeStringAccessor (&ContactGraphRouting::m_planFile),
+                   MakeStringChecker ())
+    .AddAttribute ("SharedContactPlan",
+                   "Share one read-only copy of the contact plan file between all nodes loading it",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&ContactGraphRouting::m_sharePlan),
+                   MakeBooleanChecker ())
+  ;
+  return tid;
+}
+
+ContactGraphRouting::ContactGraphRouting ()
+  : m_plan (std::make_shared<Plan> ()),
+    m_nextExpiry (Time::Max ()),
+    m_sharePlan (false),
+    m_searches (0),
+    m_declined (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+ContactGraphRouting::~ContactGraphRouting ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void 
+ContactGraphRouting::Initialize (Ptr<BundleStore> store,
+                                 std::vector<Ptr<ConvergenceSender>> senders,
+                                 NodeID localNodeID)
+{
+  RoutingAlgorithm::Initialize (store, senders, localNodeID);
+  
+  if (!m_planFile.empty ())
+    {
+      if (m_sharePlan)
+        {
+          ShareContactPlan (m_planFile);
+        }
+      else
+        {
+          LoadContactPlan (m_planFile);
+        }
+    }
+  
+  // Routes depend on the local node
+  std::lock_guard<OptionalMutex> lock (m_planMutex);
+  m_routes.clear ();
+}
+
+void 
+ContactGraphRouting::NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source)
+{
+  NS_LOG_FUNCTION (this << bundle << source.ToString ());
+  
+  // Store the bundle
+  if (!m_store->Push (bundle))
+    {
+      NS_LOG_ERROR ("Failed to store bundle");
+      return;
+    }
+  
+  // Update bundle descriptor
+  BundleDescriptor& desc = UpdateBundleDescriptor (bundle);
+  
+  // Mark as sent to source node
+  desc.AddSentNode (GetPeerIndex (source));
+  
+  NS_LOG_INFO ("Added new bundle from " << source.ToString () << " to store");
+}
+
+void 
+ContactGraphRouting::NotifyPeerAppeared (const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
+  
+  // Store peer information
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    m_peers[peer.nodeID] = peer;
+  }
+  
+  NS_LOG_INFO ("Peer appeared: " << peer.nodeID.ToString ());
+  
+  // Dispatch bundles routed through the new peer
+  DispatchBundles ();
+}
+
+void 
+ContactGraphRouting::NotifyPeerDisappeared (const NodeID& peer)
+{
+  NS_LOG_FUNCTION (this << peer.ToString ());
+  
+  // Remove peer information
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    m_peers.erase (peer);
+    m_peerQueues.erase (peer);
+  }
+  
+  NS_LOG_INFO ("Peer disappeared: " << peer.ToString ());
+}
+
+void 
+ContactGraphRouting::AddContact (const Contact& contact)
+{
+  NS_LOG_FUNCTION (this << contact.from.ToString () << contact.to.ToString ()
+                   << contact.start << contact.end);
+  
+  std::lock_guard<OptionalMutex> lock (m_planMutex);
+  AddContactLocked (contact);
+}
+
+void 
+ContactGraphRouting::AddContactLocked (const Contact& contact)
+{
+  Plan& plan = GetWritablePlanLocked ();
+  plan.outgoing[contact.from].push_back (plan.contacts.size ());
+  plan.contacts.push_back (contact);
+  m_nextExpiry = std::min (m_nextExpiry, contact.end);
+  
+  // A new contact can shorten any route
+  m_routes.clear ();
+}
+
+ContactGraphRouting::Plan& 
+ContactGraphRouting::GetWritablePlanLocked ()
+{
+  if (m_plan->shared)
+    {
+      // Copy on write, the other nodes keep the shared plan
+      std::shared_ptr<Plan> copy = std::make_shared<Plan> (*m_plan);
+      copy->shared = false;
+      m_plan = copy;
+    }
+  return *m_plan;
+}
+
+bool 
+ContactGraphRouting::LoadContactPlan (const std::string& fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  
+  std::vector<Contact> contacts;
+  bool ok = ReadContactPlan (fileName, contacts);
+  
+  std::lock_guard<OptionalMutex> lock (m_planMutex);
+  Plan& plan = GetWritablePlanLocked ();
+  plan.contacts.reserve (plan.contacts.size () + contacts.size ());
+  for (const Contact& contact : contacts)
+    {
+      AddContactLocked (contact);
+    }
+  
+  NS_LOG_INFO ("Loaded contact plan " << fileName << " with " << m_plan->contacts.size () << " contacts");
+  return ok;
+}
+
+bool 
+ContactGraphRouting::ShareContactPlan (const std::string& fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  
+  std::shared_ptr<Plan> shared = GetSharedPlan (fileName);
+  if (!shared)
+    {
+      return false;
+    }
+  
+  std::lock_guard<OptionalMutex> lock (m_planMutex);
+  if (!m_plan->contacts.empty ())
+    {
+      // Keep the contacts added before in a private plan
+      for (const Contact& contact : shared->contacts)
+        {
+          AddContactLocked (contact);
+        }
+      return shared->complete;
+    }
+  
+  m_plan = shared;
+  m_nextExpiry = shared->nextExpiry;
+  m_routes.clear ();
+  return shared->complete;
+}
+
+std::shared_ptr<ContactGraphRouting::Plan> 
+ContactGraphRouting::GetSharedPlan (const std::string& fileName)
+{
+  // Plans live as long as a node uses them
+  static std::map<std::string, std::weak_ptr<Plan>> plans;
+  static OptionalMutex plansMutex;
+  
+  std::lock_guard<OptionalMutex> lock (plansMutex);
+  std::shared_ptr<Plan> plan = plans[fileName].lock ();
+  if (plan)
+    {
+      return plan;
+    }
+  
+  std::vector<Contact> contacts;
+  plan = std::make_shared<Plan> ();
+  plan->complete = ReadContactPlan (fileName, contacts);
+  if (!plan->complete && contacts.empty ())
+    {
+      return nullptr;
+    }
+  
+  plan->contacts = std::move (contacts);
+  for (size_t index = 0; index < plan->contacts.size (); index++)
+    {
+      plan->outgoing[plan->contacts[index].from].push_back (index);
+      plan->nextExpiry = std::min (plan->nextExpiry, plan->contacts[index].end);
+    }
+  plan->shared = true;
+  plans[fileName] = plan;
+  
+  NS_LOG_INFO ("Loaded shared contact plan " << fileName << " with " << plan->contacts.size () << " contacts");
+  return plan;
+}
+
+bool 
+ContactGraphRouting::ReadContactPlan (const std::string& fileName, std::vector<Contact>& contacts)
+{
+  std::ifstream file (fileName);
+  if (!file)
+    {
+      NS_LOG_ERROR ("Cannot open contact plan " << fileName);
+      return false;
+    }
+  
+  bool ok = true;
+  size_t lineNumber = 0;
+  std::string line;
+  while (std::getline (file, line))
+    {
+      lineNumber++;
+      std::istringstream fields (line);
+      std::string keyword;
+      if (!(fields >> keyword) || keyword[0] == '#')
+        {
+          continue;
+        }
+  
+      double start;
+      double end;
+      std::string from;
+      std::string to;
+      double rate;
+      double owlt = 0;
+      if (keyword != "contact" || !(fields >> start >> end >> from >> to >> rate) || end <= start)
+        {
+          NS_LOG_ERROR ("Malformed contact in " << fileName << ":" << lineNumber);
+          ok = false;
+          continue;
+        }
+      fields >> owlt;
+  
+      contacts.push_back ({EndpointID (from), EndpointID (to), Seconds (start), Seconds (end), rate, Seconds (owlt)});
+    }
+  
+  return ok;
+}
+
+std::optional<NodeID> 
+ContactGraphRouting::GetNextHop (const NodeID& destination)
+{
+  std::lock_guard<OptionalMutex> lock (m_planMutex);
+  const Route& route = GetRouteLocked (destination);
+  if (!route.found)
+    {
+      return std::nullopt;
+    }
+  return route.first.to;
+}
+
+bool 
+ContactGraphRouting::OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer)
+{
+  BundleID id = bundle->GetId ();
+  const EndpointID& destinationEID = bundle->GetPrimaryBlock ().GetDestinationEID ();
+  
+  // Skip expired bundles and peers the bundle was already sent to
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end () && it->second.IsExpired ())
+      {
+        NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
+        return true;
+      }
+    if (it != m_bundles.end () && it->second.SentTo (peer.index))
+      {
+        return true;
+      }
+  }
+  
+  // Skip if destination is local
+  if (destinationEID == m_localNodeID)
+    {
+      return true;
+    }
+  
+  // Always deliver to the destination itself
+  if (destinationEID == peer.nodeID)
+    {
+      return SendBundle (bundle, peer.nodeID, peer.endpoint);
+    }
+  
+  // Otherwise only along the planned route, if the first contact still
+  // has room for the bundle
+  bool onRoute = false;
+  {
+    std::lock_guard<OptionalMutex> lock (m_planMutex);
+    const Route& route = GetRouteLocked (destinationEID);
+    if (route.found && route.first.to == peer.nodeID)
+      {
+        Time left = route.first.end - std::max (Simulator::Now (), route.first.start);
+        onRoute = left.GetSeconds () * route.first.rate >= bundle->ToCbor ().GetSize ();
+      }
+  }
+  
+  if (!onRoute)
+    {
+      m_declined++;
+      return true;
+    }
+  
+  NS_LOG_INFO ("Forwarding bundle " << id.ToString () << " to " << peer.nodeID.ToString ()
+               << " on route to " << destinationEID.ToString ());
+  return SendBundle (bundle, peer.nodeID, peer.endpoint);
+}
+
+const ContactGraphRouting::Route& 
+ContactGraphRouting::GetRouteLocked (const NodeID& destination)
+{
+  if (Simulator::Now () >= m_nextExpiry)
+    {
+      PruneLocked ();
+    }
+  
+  auto it = m_routes.find (destination);
+  if (it == m_routes.end ())
+    {
+      m_searches++;
+      it = m_routes.emplace (destination, FindRoute (destination)).first;
+    }
+  return it->second;
+}
+
+ContactGraphRouting::Route 
+ContactGraphRouting::FindRoute (const NodeID& destination) const
+{
+  // Dijkstra over contacts: the distance of a contact is the earliest
+  // time a bundle can arrive at its receiving node through it
+  Time now = Simulator::Now ();
+  const Plan& plan = *m_plan;
+  std::vector<Time> arrival (plan.contacts.size (), Time::Max ());
+  std::vector<size_t> first (plan.contacts.size ());
+  std::vector<Time> validUntil (plan.contacts.size ());
+  
+  using Entry = std::pair<Time, size_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  
+  auto local = plan.outgoing.find (m_localNodeID);
+  if (local != plan.outgoing.end ())
+    {
+      for (size_t index : local->second)
+        {
+          const Contact& contact = plan.contacts[index];
+          Time departure = std::max (now, contact.start);
+          if (departure < contact.end)
+            {
+              arrival[index] = departure + contact.owlt;
+              first[index] = index;
+              validUntil[index] = contact.end;
+              queue.push ({arrival[index], index});
+            }
+        }
+    }
+  
+  Route route = {false, Contact (), Time::Max (), Time::Max ()};
+  while (!queue.empty ())
+    {
+      Entry entry = queue.top ();
+      queue.pop ();
+      size_t index = entry.second;
+      if (entry.first > arrival[index])
+        {
+          continue;
+        }
+  
+      const Contact& contact = plan.contacts[index];
+      if (contact.to == destination)
+        {
+          route = {true, plan.contacts[first[index]], arrival[index], validUntil[index]};
+          break;
+        }
+  
+      auto next = plan.outgoing.find (contact.to);
+      if (next == plan.outgoing.end ())
+        {
+          continue;
+        }
+      for (size_t nextIndex : next->second)
+        {
+          const Contact& nextContact = plan.contacts[nextIndex];
+          Time departure = std::max (arrival[index], nextContact.start);
+          if (nextContact.to == m_localNodeID || departure >= nextContact.end ||
+              departure + nextContact.owlt >= arrival[nextIndex])
+            {
+              continue;
+            }
+          arrival[nextIndex] = departure + nextContact.owlt;
+          first[nextIndex] = first[index];
+          validUntil[nextIndex] = std::min (validUntil[index], nextContact.end);
+          queue.push ({arrival[nextIndex], nextIndex});
+        }
+    }
+  
+  NS_LOG_INFO ("Route to " << destination.ToString ()
+               << (route.found ? " via " + route.first.to.ToString () : std::string (" not found")));
+  return route;
+}
+
+void 
+ContactGraphRouting::PruneLocked ()
+{
+  Time now = Simulator::Now ();
+  
+  m_nextExpiry = Time::Max ();
+  if (m_plan->shared)
+    {
+      // Shared plans are read-only, ended contacts are skipped by FindRoute
+      for (const Contact& contact : m_plan->contacts)
+        {
+          if (contact.end > now)
+            {
+              m_nextExpiry = std::min (m_nextExpiry, contact.end);
+            }
+        }
+    }
+  else
+    {
+      Plan& plan = *m_plan;
+      plan.contacts.erase (std::remove_if (plan.contacts.begin (), plan.contacts.end (),
+                                           [now] (const Contact& contact) { return contact.end <= now; }),
+                           plan.contacts.end ());
+      
+      plan.outgoing.clear ();
+      for (size_t index = 0; index < plan.contacts.size (); index++)
+        {
+          plan.outgoing[plan.contacts[index].from].push_back (index);
+          m_nextExpiry = std::min (m_nextExpiry, plan.contacts[index].end);
+        }
+    }
+  
+  // Routes over the remaining contacts are kept; later contacts cannot
+  // make them arrive earlier
+  for (auto it = m_routes.begin (); it != m_routes.end (); )
+    {
+      if (it->second.validUntil <= now)
+        {
+          it = m_routes.erase (it);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+}
+
+std::string 
+ContactGraphRouting::GetName () const
+{
+  return "ContactGraphRouting";
+}
+
+std::string 
+ContactGraphRouting::GetStats () const
+{
+  std::stringstream ss;
+  
+  ss << "ContactGraphRouting(";
+  ss << "peers=" << m_peers.size ();
+  ss << ", bundles=" << m_bundles.size ();
+  ss << ", contacts=" << m_plan->contacts.size ();
+  ss << ", routes=" << m_routes.size ();
+  ss << ", searches=" << m_searches;
+  ss << ", sent=" << m_sentBundles;
+  ss << ", failed=" << m_failedBundles;
+  ss << ", declined=" << m_declined;
+  ss << ")";
+  
+  return ss.str ();
+}
+
+} // namespace dtn7
+
+} // namespace ns3
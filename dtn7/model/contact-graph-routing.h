@@ -0,0 +1,201 @@
+#ifndef DTN7_CONTACT_GRAPH_ROUTING_H
+#define DTN7_CONTACT_GRAPH_ROUTING_H
+
+#include "routing.h"
+
+#include <memory>
+#include <optional>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Scheduled contact between two nodes
+ */
+struct Contact
+{
+  NodeID from;   //!< Sending node
+  NodeID to;     //!< Receiving node
+  Time start;    //!< Start of the contact window
+  Time end;      //!< End of the contact window
+  double rate;   //!< Transmission rate in bytes per second
+  Time owlt;     //!< One-way light time
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Contact graph routing over a scheduled contact plan
+ *
+ * The contact plan is a time-varying graph whose vertices are contacts.
+ * For each destination a Dijkstra search finds the route with the
+ * earliest arrival time, starting from the contacts of the local node.
+ * Routes are cached per destination until one of their contacts ends;
+ * only then is that destination searched again. Bundles are sent only
+ * to the first hop of their route, or to their destination directly.
+ *
+ * A contact plan file has one contact per line, times in seconds:
+ * \verbatim
+   contact <start> <end> <from> <to> <rate> [owlt]
+   \endverbatim
+ * Empty lines and lines starting with '#' are ignored.
+ *
+ * With SharedContactPlan set, all nodes loading the same file use one
+ * read-only copy of the parsed plan. Ended contacts then stay in the
+ * shared plan and are skipped by the route search, and a node that adds
+ * contacts of its own gets a private copy first.
+ */
+class ContactGraphRouting : public RoutingAlgorithm
+{
+public:
+  /**
+   * \brief Get the type ID
+   * \return Type ID
+   */
+  static TypeId GetTypeId ();
+  
+  /**
+   * \brief Default constructor
+   */
+  ContactGraphRouting ();
+  
+  /**
+   * \brief Destructor
+   */
+  virtual ~ContactGraphRouting ();
+  
+  // Inherited from RoutingAlgorithm
+  void Initialize (Ptr<BundleStore> store,
+                   std::vector<Ptr<ConvergenceSender>> senders,
+                   NodeID localNodeID) override;
+  void NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source) override;
+  void NotifyPeerAppeared (const PeerInfo& peer) override;
+  void NotifyPeerDisappeared (const NodeID& peer) override;
+  std::string GetName () const override;
+  std::string GetStats () const override;
+  
+  /**
+   * \brief Add a contact to the plan
+   * \param contact Contact
+   */
+  void AddContact (const Contact& contact);
+  
+  /**
+   * \brief Load contacts from a contact plan file
+   * \param fileName Contact plan file
+   * \return true if the whole file was read
+   */
+  bool LoadContactPlan (const std::string& fileName);
+  
+  /**
+   * \brief Use the shared, read-only copy of a contact plan file
+   *
+   * The file is parsed once for all nodes sharing it. Contacts added
+   * before are kept, in which case the shared contacts are copied.
+   * \param fileName Contact plan file
+   * \return true if the whole file was read
+   */
+  bool ShareContactPlan (const std::string& fileName);
+  
+  /**
+   * \brief Get the next hop towards a destination
+   * \param destination Destination node
+   * \return Next hop, empty if no route is known
+   */
+  std::optional<NodeID> GetNextHop (const NodeID& destination);
+  
+protected:
+  // Inherited from RoutingAlgorithm
+  bool OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer) override;
+  
+private:
+  /**
+   * \brief Contacts indexed by sending node
+   */
+  struct Plan
+  {
+    std::vector<Contact> contacts;                            //!< Contacts
+    std::unordered_map<NodeID, std::vector<size_t>> outgoing; //!< Contact indices by sending node
+    Time nextExpiry = Time::Max ();                           //!< Earliest end of a contact
+    bool shared = false;                                      //!< Whether nodes share the plan read-only
+    bool complete = true;                                     //!< Whether the whole file was read
+  };
+  
+  /**
+   * \brief Cached route to one destination
+   */
+  struct Route
+  {
+    bool found;         //!< Whether the destination is reachable
+    Contact first;      //!< First contact of the route
+    Time arrival;       //!< Earliest arrival time at the destination
+    Time validUntil;    //!< End of the earliest ending contact on the route
+  };
+  
+  /**
+   * \brief Get the route to a destination, searching it if the cached
+   * one has expired, the caller holds m_planMutex
+   * \param destination Destination node
+   * \return Route
+   */
+  const Route& GetRouteLocked (const NodeID& destination);
+  
+  /**
+   * \brief Find the earliest-arrival route to a destination, the caller
+   * holds m_planMutex
+   * \param destination Destination node
+   * \return Route
+   */
+  Route FindRoute (const NodeID& destination) const;
+  
+  /**
+   * \brief Drop contacts that have ended, rebuild the adjacency and
+   * forget the routes that used them, the caller holds m_planMutex
+   */
+  void PruneLocked ();
+  
+  /**
+   * \brief Add a contact, the caller holds m_planMutex
+   * \param contact Contact
+   */
+  void AddContactLocked (const Contact& contact);
+  
+  /**
+   * \brief Get the plan for modification, copying a shared plan first,
+   * the caller holds m_planMutex
+   * \return Plan owned by this node
+   */
+  Plan& GetWritablePlanLocked ();
+  
+  /**
+   * \brief Read the contacts of a contact plan file
+   * \param fileName Contact plan file
+   * \param contacts Contacts read
+   * \return true if the whole file was read
+   */
+  static bool ReadContactPlan (const std::string& fileName, std::vector<Contact>& contacts);
+  
+  /**
+   * \brief Get the shared plan of a file, parsing it if no node uses it yet
+   * \param fileName Contact plan file
+   * \return Plan, null if the file cannot be opened
+   */
+  static std::shared_ptr<Plan> GetSharedPlan (const std::string& fileName);
+  
+  std::shared_ptr<Plan> m_plan;                                //!< Contact plan, guarded by m_planMutex
+  std::unordered_map<NodeID, Route> m_routes;                  //!< Cached routes by destination, guarded by m_planMutex
+  Time m_nextExpiry;                                           //!< Earliest end of a planned contact
+  mutable OptionalMutex m_planMutex;                           //!< Mutex for the contact plan and routes
+  
+  std::string m_planFile;                                      //!< Contact plan file loaded on initialization
+  bool m_sharePlan;                                            //!< Whether to share the plan file with other nodes
+  uint64_t m_searches;                                         //!< Number of route searches
+  uint64_t m_declined;                                         //!< Bundles not sent because the peer is off route
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_CONTACT_GRAPH_ROUTING_H */
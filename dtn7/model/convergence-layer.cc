@@ -44,6 +44,12 @@ ConvergenceSender::~ConvergenceSender ()
 {
 }
 
+uint64_t 
+ConvergenceSender::GetMtu (const std::string& endpoint) const
+{
+  return 0;
+}
+
 TypeId 
 ConvergenceLayer::GetTypeId ()
 {
@@ -55,6 +61,8 @@ ConvergenceLayer::GetTypeId ()
 }
 
 ConvergenceLayer::ConvergenceLayer ()
+  : m_bytesSentCounter (nullptr),
+    m_bytesReceivedCounter (nullptr)
 {
 }
 
@@ -62,6 +70,56 @@ ConvergenceLayer::~ConvergenceLayer ()
 {
 }
 
+void 
+ConvergenceLayer::RegisterConnectionCallback (ConnectionCallback callback)
+{
+  m_connectionCallback = callback;
+}
+
+void 
+ConvergenceLayer::NotifyConnectionChanged (const std::string& endpoint, const std::string& nodeId, bool up)
+{
+  if (!m_connectionCallback.IsNull ())
+    {
+      m_connectionCallback (GetEndpoint (), endpoint, nodeId, up);
+    }
+}
+
+void 
+ConvergenceLayer::RegisterKnownBundleCallback (KnownBundleCallback callback)
+{
+  m_knownBundleCallback = callback;
+}
+
+void 
+ConvergenceLayer::SetMetrics (Ptr<MetricsRegistry> metrics)
+{
+  m_metrics = metrics;
+  m_bytesSentCounter = nullptr;
+  m_bytesReceivedCounter = nullptr;
+  if (!metrics)
+    {
+      return;
+    }
+  
+  std::string name = GetInstanceTypeId ().GetName ();
+  name = name.substr (name.rfind (':') + 1);
+  m_bytesSentCounter = metrics->GetCounter (name + ".bytesSent");
+  m_bytesReceivedCounter = metrics->GetCounter (name + ".bytesReceived");
+}
+
+bool 
+ConvergenceLayer::IsKnownBundle (const uint8_t* data, size_t size) const
+{
+  if (m_knownBundleCallback.IsNull ())
+    {
+      return false;
+    }
+  
+  std::optional<BundleID> id = Bundle::PeekId (data, size);
+  return id && m_knownBundleCallback (*id);
+}
+
 } // namespace dtn7
 
 } // namespace ns3
\ No newline at end of file
@@ -12,6 +12,8 @@
 
 #include "bundle.h"
 #include "endpoint.h"
+#include "metrics.h"
+#include "trace-events.h"
 
 namespace ns3 {
 
@@ -103,6 +105,16 @@ public:
    */
   virtual bool IsEndpointReachable (const std::string& endpoint) const = 0;
   
+  /**
+   * \brief Get the largest bundle the sender transmits to an endpoint as one unit
+   *
+   * Larger bundles are fragmented at the bundle layer before they are
+   * handed to the sender. The default has no limit.
+   * \param endpoint Destination endpoint address
+   * \return Maximum encoded bundle size in bytes, 0 for no limit
+   */
+  virtual uint64_t GetMtu (const std::string& endpoint) const;
+  
   /**
    * \brief Start the sender
    * \return true if started successfully
@@ -116,6 +128,24 @@ public:
   virtual bool Stop () = 0;
 };
 
+/**
+ * \brief Callback for connection state changes
+ *
+ * Arguments are the endpoint of the convergence layer reporting the
+ * change, the peer endpoint, the peer node ID (empty if the convergence
+ * layer does not learn it) and whether the connection came up or went
+ * down.
+ */
+typedef Callback<void, const std::string&, const std::string&, const std::string&, bool> ConnectionCallback;
+
+/**
+ * \brief Callback telling whether the node already has a bundle
+ *
+ * Called with the ID peeked from a received bundle's primary block;
+ * bundles it returns true for are dropped without decoding the rest.
+ */
+typedef Callback<bool, const BundleID&> KnownBundleCallback;
+
 /**
  * \ingroup dtn7
  * \brief Combined interface for bundle receivers and senders
@@ -157,6 +187,86 @@ public:
    * \return true if there is an active connection
    */
   virtual bool HasActiveConnection (const std::string& endpoint) const = 0;
+  
+  /**
+   * \brief Register a callback for connections coming up and going down
+   *
+   * Lets the node react to peers as they change instead of polling
+   * GetActiveConnections().
+   * \param callback Function to call on each change
+   */
+  void RegisterConnectionCallback (ConnectionCallback callback);
+  
+  /**
+   * \brief Register a callback that filters out bundles the node already has
+   *
+   * Duplicates are dropped right after their primary block is decoded,
+   * before the canonical blocks, the payload and the CRCs are processed.
+   * \param callback Function to ask for each received bundle
+   */
+  void RegisterKnownBundleCallback (KnownBundleCallback callback);
+  
+  /**
+   * \brief Count the bytes sent and received in a node's metrics
+   *
+   * The counters are named after the convergence layer type, e.g.
+   * "UdpConvergenceLayer.bytesSent"; layers of the same type share them.
+   * \param metrics Metrics of the node, nullptr to stop counting
+   */
+  void SetMetrics (Ptr<MetricsRegistry> metrics);
+
+protected:
+  /**
+   * \brief Report a connection state change to the registered callback
+   * \param endpoint Peer endpoint
+   * \param nodeId Peer node ID, empty if unknown
+   * \param up true if the connection came up, false if it went down
+   */
+  void NotifyConnectionChanged (const std::string& endpoint, const std::string& nodeId, bool up);
+  
+  /**
+   * \brief Check whether the node already has an encoded bundle
+   *
+   * Only the primary block is decoded. Encodings whose primary block
+   * cannot be read are reported as unknown and fail later when decoded.
+   * \param data Pointer to the encoded bundle, or to a prefix holding its primary block
+   * \param size Number of bytes available
+   * \return true if the bundle can be dropped
+   */
+  bool IsKnownBundle (const uint8_t* data, size_t size) const;
+  
+  /**
+   * \brief Count bytes handed to the network and trace the datagram or segment
+   * \param bytes Number of bytes
+   */
+  void CountSent (uint64_t bytes)
+  {
+    if (m_bytesSentCounter)
+      {
+        m_bytesSentCounter->Add (bytes);
+      }
+    DTN7_TRACE_EVENT (TraceEventType::DATAGRAM_SENT, 0, bytes);
+  }
+  
+  /**
+   * \brief Count bytes read from the network and trace the datagram or segment
+   * \param bytes Number of bytes
+   */
+  void CountReceived (uint64_t bytes)
+  {
+    if (m_bytesReceivedCounter)
+      {
+        m_bytesReceivedCounter->Add (bytes);
+      }
+    DTN7_TRACE_EVENT (TraceEventType::DATAGRAM_RECEIVED, 0, bytes);
+  }
+
+private:
+  ConnectionCallback m_connectionCallback; //!< Connection state callback
+  KnownBundleCallback m_knownBundleCallback; //!< Duplicate filter
+  Ptr<MetricsRegistry> m_metrics;          //!< Metrics of the node
+  MetricCounter* m_bytesSentCounter;       //!< Bytes sent, nullptr if not counted
+  MetricCounter* m_bytesReceivedCounter;   //!< Bytes received, nullptr if not counted
 };
 
 } // namespace dtn7
@@ -1,59 +1,349 @@
 #include "crc.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(DTN7_NO_HW_CRC)
+#include <nmmintrin.h>
+#define DTN7_HW_CRC_SSE42 1
+#elif defined(__aarch64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__)) && !defined(DTN7_NO_HW_CRC)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define DTN7_HW_CRC_ARMV8 1
+#endif
+
+#include <cstring>
+
 namespace ns3 {
 
 namespace dtn7 {
 
-uint16_t 
-CalculateCRC16(const std::vector<uint8_t>& data)
+namespace {
+
+// CCITT CRC-16 polynomial: x^16 + x^12 + x^5 + 1
+const uint16_t CRC16_POLYNOMIAL = 0x1021;
+
+// CRC-32C (Castagnoli) polynomial 0x1EDC6F41 in reflected bit order
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+/**
+ * \brief Lookup table for the MSB-first CRC-16, one byte per step
+ */
+struct Crc16Table
+{
+  uint16_t entries[256];
+  
+  constexpr Crc16Table()
+    : entries ()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+      {
+        uint16_t crc = static_cast<uint16_t>(i << 8);
+        for (int bit = 0; bit < 8; ++bit)
+          {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ CRC16_POLYNOMIAL)
+                                 : static_cast<uint16_t>(crc << 1);
+          }
+        entries[i] = crc;
+      }
+  }
+};
+
+/**
+ * \brief Slice-by-8 lookup tables for the reflected CRC-32C
+ *
+ * slices[k][b] is the CRC of byte b followed by k zero bytes, which lets
+ * eight input bytes be folded in with eight independent lookups.
+ */
+struct Crc32cTables
 {
-  // CCITT CRC-16 polynomial: x^16 + x^12 + x^5 + 1
-  const uint16_t polynomial = 0x1021;
-  uint16_t crc = 0xFFFF; // Initial value
+  uint32_t slices[8][256];
   
-  for (uint8_t byte : data)
+  constexpr Crc32cTables()
+    : slices ()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+      {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+          {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+          }
+        slices[0][i] = crc;
+      }
+    for (uint32_t i = 0; i < 256; ++i)
+      {
+        for (int k = 1; k < 8; ++k)
+          {
+            uint32_t previous = slices[k - 1][i];
+            slices[k][i] = (previous >> 8) ^ slices[0][previous & 0xFF];
+          }
+      }
+  }
+};
+
+constexpr Crc16Table CRC16_TABLE;
+constexpr Crc32cTables CRC32C_TABLES;
+
+/**
+ * \brief Read a little-endian 32-bit word without alignment requirements
+ */
+inline uint32_t 
+LoadLE32(const uint8_t* p)
+{
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint32_t 
+Crc32cSoftware(uint32_t crc, const uint8_t* data, size_t size)
+{
+  const auto& t = CRC32C_TABLES.slices;
+  
+  while (size >= 8)
     {
-      crc ^= static_cast<uint16_t>(byte) << 8;
-      for (int i = 0; i < 8; ++i)
-        {
-          if (crc & 0x8000)
-            {
-              crc = (crc << 1) ^ polynomial;
-            }
-          else
-            {
-              crc = crc << 1;
-            }
-        }
+      uint32_t low = LoadLE32(data) ^ crc;
+      uint32_t high = LoadLE32(data + 4);
+      crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^
+            t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+            t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+            t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+      data += 8;
+      size -= 8;
+    }
+  
+  while (size--)
+    {
+      crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
     }
   
   return crc;
 }
 
-uint32_t 
-CalculateCRC32(const std::vector<uint8_t>& data)
+#if defined(DTN7_HW_CRC_SSE42)
+
+__attribute__((target("sse4.2"))) uint32_t
+Crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
 {
-  // CRC-32C (Castagnoli) polynomial: x^32 + x^28 + x^27 + x^26 + x^25 + x^23 + x^22 + x^20 + x^19 + x^18 + x^14 + x^13 + x^11 + x^10 + x^9 + x^8 + x^6 + 1
-  const uint32_t polynomial = 0x1EDC6F41;
-  uint32_t crc = 0xFFFFFFFF; // Initial value
+  uint64_t crc64 = crc;
+  while (size >= 8)
+    {
+      uint64_t word;
+      std::memcpy(&word, data, sizeof(word));
+      crc64 = _mm_crc32_u64(crc64, word);
+      data += 8;
+      size -= 8;
+    }
   
-  for (uint8_t byte : data)
+  crc = static_cast<uint32_t>(crc64);
+  while (size--)
     {
-      crc ^= byte;
-      for (int i = 0; i < 8; ++i)
-        {
-          if (crc & 1)
-            {
-              crc = (crc >> 1) ^ polynomial;
-            }
-          else
-            {
-              crc = crc >> 1;
-            }
-        }
+      crc = _mm_crc32_u8(crc, *data++);
+    }
+  
+  return crc;
+}
+
+bool 
+HardwareAvailable()
+{
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(DTN7_HW_CRC_ARMV8)
+
+__attribute__((target("+crc"))) uint32_t
+Crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+  while (size >= 8)
+    {
+      uint64_t word;
+      std::memcpy(&word, data, sizeof(word));
+      crc = __crc32cd(crc, word);
+      data += 8;
+      size -= 8;
     }
   
-  return ~crc; // Final XOR
+  while (size--)
+    {
+      crc = __crc32cb(crc, *data++);
+    }
+  
+  return crc;
+}
+
+bool 
+HardwareAvailable()
+{
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#endif
+
+using Crc32cKernel = uint32_t (*) (uint32_t, const uint8_t*, size_t);
+
+/**
+ * \brief Pick the CRC-32C kernel once per process
+ */
+Crc32cKernel 
+GetCrc32cKernel()
+{
+#if defined(DTN7_HW_CRC_SSE42) || defined(DTN7_HW_CRC_ARMV8)
+  static const Crc32cKernel kernel = HardwareAvailable() ? &Crc32cHardware : &Crc32cSoftware;
+#else
+  static const Crc32cKernel kernel = &Crc32cSoftware;
+#endif
+  return kernel;
+}
+
+} // anonymous namespace
+
+// Crc16State implementation
+
+Crc16State::Crc16State()
+  : m_crc(0xFFFF) // Initial value
+{
+}
+
+void 
+Crc16State::Reset()
+{
+  m_crc = 0xFFFF;
+}
+
+void 
+Crc16State::Update(const uint8_t* data, size_t size)
+{
+  uint16_t crc = m_crc;
+  for (size_t i = 0; i < size; ++i)
+    {
+      crc = static_cast<uint16_t>((crc << 8) ^ CRC16_TABLE.entries[((crc >> 8) ^ data[i]) & 0xFF]);
+    }
+  m_crc = crc;
+}
+
+// Crc32cState implementation
+
+Crc32cState::Crc32cState()
+  : m_crc(0xFFFFFFFF) // Initial value
+{
+}
+
+void 
+Crc32cState::Reset()
+{
+  m_crc = 0xFFFFFFFF;
+}
+
+void 
+Crc32cState::Update(const uint8_t* data, size_t size)
+{
+  if (size > 0)
+    {
+      m_crc = GetCrc32cKernel()(m_crc, data, size);
+    }
+}
+
+bool 
+Crc32cState::IsHardwareAccelerated()
+{
+  return GetCrc32cKernel() != &Crc32cSoftware;
+}
+
+// CrcState implementation
+
+CrcState::CrcState(CRCType type)
+  : m_type(type)
+{
+}
+
+void 
+CrcState::Update(const uint8_t* data, size_t size)
+{
+  if (m_type == CRCType::CRC_16)
+    {
+      m_crc16.Update(data, size);
+    }
+  else if (m_type == CRCType::CRC_32)
+    {
+      m_crc32.Update(data, size);
+    }
+}
+
+void 
+CrcState::UpdateZeros(size_t size)
+{
+  static const uint8_t zeros[8] = {};
+  while (size > 0)
+    {
+      size_t chunk = size < sizeof(zeros) ? size : sizeof(zeros);
+      Update(zeros, chunk);
+      size -= chunk;
+    }
+}
+
+size_t 
+CrcState::Finalize(uint8_t* output) const
+{
+  if (m_type == CRCType::CRC_16)
+    {
+      uint16_t crc = m_crc16.Finalize();
+      output[0] = static_cast<uint8_t>(crc >> 8);
+      output[1] = static_cast<uint8_t>(crc);
+      return 2;
+    }
+  else if (m_type == CRCType::CRC_32)
+    {
+      uint32_t crc = m_crc32.Finalize();
+      output[0] = static_cast<uint8_t>(crc >> 24);
+      output[1] = static_cast<uint8_t>(crc >> 16);
+      output[2] = static_cast<uint8_t>(crc >> 8);
+      output[3] = static_cast<uint8_t>(crc);
+      return 4;
+    }
+  return 0;
+}
+
+size_t 
+CrcState::GetValueSize(CRCType type)
+{
+  switch (type)
+    {
+      case CRCType::CRC_16:
+        return 2;
+      case CRCType::CRC_32:
+        return 4;
+      default:
+        return 0;
+    }
+}
+
+uint16_t 
+CalculateCRC16(const std::vector<uint8_t>& data)
+{
+  return CalculateCRC16(data.data(), data.size());
+}
+
+uint16_t 
+CalculateCRC16(const uint8_t* data, size_t size)
+{
+  Crc16State state;
+  state.Update(data, size);
+  return state.Finalize();
+}
+
+uint32_t 
+CalculateCRC32(const std::vector<uint8_t>& data)
+{
+  return CalculateCRC32(data.data(), data.size());
+}
+
+uint32_t 
+CalculateCRC32(const uint8_t* data, size_t size)
+{
+  Crc32cState state;
+  state.Update(data, size);
+  return state.Finalize(); // Final XOR
 }
 
 std::vector<uint8_t> 
@@ -115,6 +405,34 @@ VerifyCRC(CRCType type, const std::vector<uint8_t>& data, const std::vector<uint
   return true;
 }
 
+bool 
+VerifyBlockCRC(CRCType type,
+               const uint8_t* blockStart,
+               const uint8_t* blockEnd,
+               const uint8_t* crcValue,
+               size_t crcLength)
+{
+  size_t crcSize = CrcState::GetValueSize(type);
+  if (crcSize == 0)
+    {
+      return true; // No CRC to verify
+    }
+  
+  if (crcLength != crcSize || crcValue < blockStart || crcValue + crcLength > blockEnd)
+    {
+      return false;
+    }
+  
+  CrcState crc(type);
+  crc.Update(blockStart, static_cast<size_t>(crcValue - blockStart));
+  crc.UpdateZeros(crcLength);
+  crc.Update(crcValue + crcLength, static_cast<size_t>(blockEnd - (crcValue + crcLength)));
+  
+  uint8_t calculated[4];
+  crc.Finalize(calculated);
+  return std::memcmp(calculated, crcValue, crcSize) == 0;
+}
+
 } // namespace dtn7
 
-} // namespace ns3
\ No newline at end of file
+} // namespace ns3
@@ -1,6 +1,7 @@
 #ifndef DTN7_CRC_H
 #define DTN7_CRC_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include "block-type-codes.h"
@@ -9,6 +10,153 @@ namespace ns3 {
 
 namespace dtn7 {
 
+/**
+ * \ingroup dtn7
+ * \brief Incremental CRC-16-CCITT computation
+ *
+ * Data may be fed in any number of pieces; the result equals the CRC of
+ * their concatenation.
+ */
+class Crc16State
+{
+public:
+  /**
+   * \brief Constructor, starts a new checksum
+   */
+  Crc16State ();
+
+  /**
+   * \brief Restart the checksum
+   */
+  void Reset ();
+
+  /**
+   * \brief Feed data into the checksum
+   * \param data Pointer to data
+   * \param size Number of bytes
+   */
+  void Update (const uint8_t* data, size_t size);
+
+  /**
+   * \brief Feed data into the checksum
+   * \param data Data
+   */
+  void Update (const std::vector<uint8_t>& data) { Update (data.data (), data.size ()); }
+
+  /**
+   * \brief Get the CRC of all data fed so far
+   * \return 16-bit CRC value
+   */
+  uint16_t Finalize () const { return m_crc; }
+
+private:
+  uint16_t m_crc; //!< Running CRC register
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Incremental CRC-32C (Castagnoli) computation
+ *
+ * Uses the SSE4.2 or ARMv8 CRC instructions when the CPU provides them
+ * and a slice-by-8 table otherwise.
+ */
+class Crc32cState
+{
+public:
+  /**
+   * \brief Constructor, starts a new checksum
+   */
+  Crc32cState ();
+
+  /**
+   * \brief Restart the checksum
+   */
+  void Reset ();
+
+  /**
+   * \brief Feed data into the checksum
+   * \param data Pointer to data
+   * \param size Number of bytes
+   */
+  void Update (const uint8_t* data, size_t size);
+
+  /**
+   * \brief Feed data into the checksum
+   * \param data Data
+   */
+  void Update (const std::vector<uint8_t>& data) { Update (data.data (), data.size ()); }
+
+  /**
+   * \brief Get the CRC of all data fed so far
+   * \return 32-bit CRC value
+   */
+  uint32_t Finalize () const { return ~m_crc; }
+
+  /**
+   * \brief Check whether a hardware CRC-32C kernel is in use
+   * \return true if the CPU instructions are used
+   */
+  static bool IsHardwareAccelerated ();
+
+private:
+  uint32_t m_crc; //!< Running CRC register, pre-inverted
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Incremental CRC of the type selected for a block
+ *
+ * Wraps Crc16State and Crc32cState so block serialization can checksum
+ * its output as it is written, whatever CRC type the block uses.
+ */
+class CrcState
+{
+public:
+  /**
+   * \brief Constructor
+   * \param type CRC type
+   */
+  explicit CrcState (CRCType type);
+
+  /**
+   * \brief Feed data into the checksum
+   * \param data Pointer to data
+   * \param size Number of bytes
+   */
+  void Update (const uint8_t* data, size_t size);
+
+  /**
+   * \brief Feed zero bytes into the checksum, e.g. for the CRC field itself
+   * \param size Number of zero bytes
+   */
+  void UpdateZeros (size_t size);
+
+  /**
+   * \brief Write the CRC in network byte order
+   * \param output Destination, at least GetValueSize() bytes
+   * \return Number of bytes written
+   */
+  size_t Finalize (uint8_t* output) const;
+
+  /**
+   * \brief Get the CRC type
+   * \return CRC type
+   */
+  CRCType GetType () const { return m_type; }
+
+  /**
+   * \brief Get the encoded size of a CRC value
+   * \param type CRC type
+   * \return 2 for CRC-16, 4 for CRC-32C, 0 otherwise
+   */
+  static size_t GetValueSize (CRCType type);
+
+private:
+  CRCType m_type;      //!< CRC type
+  Crc16State m_crc16;  //!< State for CRC_16
+  Crc32cState m_crc32; //!< State for CRC_32
+};
+
 /**
  * \brief Calculate CRC-16-CCITT
  * \param data Data to calculate CRC for
@@ -16,6 +164,14 @@ namespace dtn7 {
  */
 uint16_t CalculateCRC16(const std::vector<uint8_t>& data);
 
+/**
+ * \brief Calculate CRC-16-CCITT
+ * \param data Pointer to data
+ * \param size Number of bytes
+ * \return 16-bit CRC value
+ */
+uint16_t CalculateCRC16(const uint8_t* data, size_t size);
+
 /**
  * \brief Calculate CRC-32C (Castagnoli)
  * \param data Data to calculate CRC for
@@ -23,6 +179,14 @@ uint16_t CalculateCRC16(const std::vector<uint8_t>& data);
  */
 uint32_t CalculateCRC32(const std::vector<uint8_t>& data);
 
+/**
+ * \brief Calculate CRC-32C (Castagnoli)
+ * \param data Pointer to data
+ * \param size Number of bytes
+ * \return 32-bit CRC value
+ */
+uint32_t CalculateCRC32(const uint8_t* data, size_t size);
+
 /**
  * \brief Calculate CRC based on type
  * \param type CRC type
@@ -40,8 +204,26 @@ std::vector<uint8_t> CalculateCRC(CRCType type, const std::vector<uint8_t>& data
  */
 bool VerifyCRC(CRCType type, const std::vector<uint8_t>& data, const std::vector<uint8_t>& crc);
 
+/**
+ * \brief Verify the CRC of an encoded block in place
+ *
+ * The CRC is computed over the block's wire bytes with the CRC value
+ * itself taken as zero, as RFC 9171 specifies.
+ * \param type CRC type
+ * \param blockStart First byte of the encoded block
+ * \param blockEnd One past the last byte of the encoded block
+ * \param crcValue CRC value bytes inside the block
+ * \param crcLength Length of the CRC value
+ * \return true if the CRC is valid or the type carries no CRC
+ */
+bool VerifyBlockCRC(CRCType type,
+                    const uint8_t* blockStart,
+                    const uint8_t* blockEnd,
+                    const uint8_t* crcValue,
+                    size_t crcLength);
+
 } // namespace dtn7
 
 } // namespace ns3
 
-#endif /* DTN7_CRC_H */
\ No newline at end of file
+#endif /* DTN7_CRC_H */
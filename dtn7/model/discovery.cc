@@ -18,9 +18,13 @@
 #include "ns3/double.h"
 #include "ns3/net-device.h"
 #include "ns3/event-id.h"
+#include "ns3/mobility-model.h"
+
+#include "cbor.h"
 
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 
 namespace ns3 {
 
@@ -28,39 +32,106 @@ NS_LOG_COMPONENT_DEFINE ("DiscoveryAgent");
 
 namespace dtn7 {
 
+namespace {
+
+// 服务集变化后连续携带服务列表的通告数，容忍个别通告丢失
+const uint32_t FULL_BEACONS_AFTER_CHANGE = 3;
+
+} // anonymous namespace
+
 // BeaconMessage实现
 
-std::string 
+std::vector<uint8_t> 
 BeaconMessage::Serialize() const
 {
-  std::stringstream ss;
-  ss << "DTN7|" << nodeId << "|" << endpoint << "|" << services << "|" 
-     << timestamp.GetSeconds();
-  return ss.str();
+  std::vector<uint8_t> data;
+  CborWriter writer(data);
+  
+  writer.WriteArrayHeader(hasServices ? 7 : 6);
+  writer.WriteUnsigned(VERSION);
+  writer.WriteUnsigned(hasServices ? FLAG_HAS_SERVICES : 0);
+  writer.WriteTextString(nodeId);
+  writer.WriteTextString(endpoint);
+  writer.WriteUnsigned(serviceVersion);
+  writer.WriteUnsigned(static_cast<uint64_t>(period.GetMilliSeconds()));
+  
+  if (hasServices)
+    {
+      writer.WriteMapHeader(services.size());
+      for (const auto& pair : services)
+        {
+          writer.WriteTextString(pair.first);
+          writer.WriteTextString(pair.second);
+        }
+    }
+  
+  return data;
 }
 
 bool 
-BeaconMessage::Deserialize(const std::string& data)
+BeaconMessage::Deserialize(const uint8_t* data, size_t size)
 {
-  std::stringstream ss(data);
-  std::string prefix;
+  CborReader reader(data, size);
+  
+  uint64_t length;
+  if (!reader.ReadArrayHeader(length) || (length != 6 && length != 7))
+    {
+      return false;
+    }
   
-  // 检查协议前缀
-  std::getline(ss, prefix, '|');
-  if (prefix != "DTN7")
+  // 检查协议版本
+  uint64_t version, flags, version2, periodMs;
+  if (!reader.ReadUnsigned(version) || version != VERSION || !reader.ReadUnsigned(flags))
     {
       return false;
     }
   
   // 解析各字段
-  std::getline(ss, nodeId, '|');
-  std::getline(ss, endpoint, '|');
-  std::getline(ss, services, '|');
+  const char* text;
+  size_t textSize;
+  if (!reader.ReadTextString(text, textSize))
+    {
+      return false;
+    }
+  nodeId.assign(text, textSize);
+  if (!reader.ReadTextString(text, textSize))
+    {
+      return false;
+    }
+  endpoint.assign(text, textSize);
   
-  // 解析时间戳
-  double timestampSec;
-  ss >> timestampSec;
-  timestamp = Seconds(timestampSec);
+  if (!reader.ReadUnsigned(version2) || !reader.ReadUnsigned(periodMs))
+    {
+      return false;
+    }
+  serviceVersion = static_cast<uint32_t>(version2);
+  period = MilliSeconds(periodMs);
+  
+  // 解析服务映射
+  hasServices = (flags & FLAG_HAS_SERVICES) != 0;
+  services.clear();
+  if (hasServices != (length == 7))
+    {
+      return false;
+    }
+  if (hasServices)
+    {
+      uint64_t count;
+      if (!reader.ReadMapHeader(count))
+        {
+          return false;
+        }
+      for (uint64_t i = 0; i < count; i++)
+        {
+          const char* name;
+          size_t nameSize;
+          if (!reader.ReadTextString(name, nameSize) || !reader.ReadTextString(text, textSize))
+            {
+              return false;
+            }
+          services[std::string(name, nameSize)] = std::string(text, textSize);
+        }
+    }
   
   return true;
 }
@@ -120,6 +191,36 @@ IpDiscoveryAgent::GetTypeId ()
                    TimeValue (Seconds (10)),
                    MakeTimeAccessor (&IpDiscoveryAgent::m_announceInterval),
                    MakeTimeChecker ())
+    .AddAttribute ("AdaptiveInterval",
+                   "是否根据邻居变化与移动速度自适应调整通告间隔",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&IpDiscoveryAgent::m_adaptive),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MinAnnounceInterval",
+                   "自适应模式的最短通告间隔",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&IpDiscoveryAgent::m_minAnnounceInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxAnnounceInterval",
+                   "自适应模式的最长通告间隔",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&IpDiscoveryAgent::m_maxAnnounceInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("ReferenceSpeed",
+                   "节点速度(m/s)达到该值时通告间隔减半，0表示不按速度调整",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IpDiscoveryAgent::m_referenceSpeed),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("PeerTimeoutFactor",
+                   "对端超过多少个其声明的通告周期没有消息视为失联",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&IpDiscoveryAgent::m_peerTimeoutFactor),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FullBeaconInterval",
+                   "服务未变化时每隔多少次通告携带一次完整服务列表",
+                   UintegerValue (5),
+                   MakeUintegerAccessor (&IpDiscoveryAgent::m_fullBeaconInterval),
+                   MakeUintegerChecker<uint32_t> (1))
   ;
   return tid;
 }
@@ -129,10 +230,23 @@ IpDiscoveryAgent::IpDiscoveryAgent()
     m_port(3835),
     m_multicastAddress("224.0.0.26"),
     m_announceInterval(Seconds(10)),
+    m_adaptive(false),
+    m_minAnnounceInterval(Seconds(1)),
+    m_maxAnnounceInterval(Seconds(30)),
+    m_referenceSpeed(0.0),
+    m_currentInterval(Seconds(10)),
+    m_neighbourhoodChanged(false),
+    m_peerTimeoutFactor(3),
     m_running(false),
     m_nodeId("dtn://local/"),
     m_announcementsSent(0),
-    m_announcementsReceived(0)
+    m_announcementsReceived(0),
+    m_serviceUpdates(0),
+    m_peersLost(0),
+    m_serviceVersion(0),
+    m_fullBeaconInterval(5),
+    m_fullBeaconsPending(0),
+    m_beaconsSinceFull(0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -147,10 +261,23 @@ IpDiscoveryAgent::IpDiscoveryAgent(Ptr<Node> node,
     m_port(port),
     m_multicastAddress(multicastAddress),
     m_announceInterval(announceInterval),
+    m_adaptive(false),
+    m_minAnnounceInterval(Seconds(1)),
+    m_maxAnnounceInterval(Seconds(30)),
+    m_referenceSpeed(0.0),
+    m_currentInterval(announceInterval),
+    m_neighbourhoodChanged(false),
+    m_peerTimeoutFactor(3),
     m_running(false),
     m_nodeId("dtn://local/"),
     m_announcementsSent(0),
-    m_announcementsReceived(0)
+    m_announcementsReceived(0),
+    m_serviceUpdates(0),
+    m_peersLost(0),
+    m_serviceVersion(0),
+    m_fullBeaconInterval(5),
+    m_fullBeaconsPending(0),
+    m_beaconsSinceFull(0)
 {
   NS_LOG_FUNCTION (this << node << address << port << multicastAddress
                   << announceInterval);
@@ -169,6 +296,13 @@ IpDiscoveryAgent::RegisterDiscoveryCallback(DiscoveryCallback callback)
   m_discoveryCallback = callback;
 }
 
+void 
+IpDiscoveryAgent::RegisterPeerLostCallback(PeerLostCallback callback)
+{
+  NS_LOG_FUNCTION (this);
+  m_peerLostCallback = callback;
+}
+
 void 
 IpDiscoveryAgent::SetNodeId(const std::string& nodeId)
 {
@@ -181,8 +315,11 @@ IpDiscoveryAgent::AddService(const std::string& service, const std::string& endp
 {
   NS_LOG_FUNCTION (this << service << endpoint);
   
-  std::lock_guard<std::mutex> lock(m_servicesMutex);
-  m_services[service] = endpoint;
+  {
+    std::lock_guard<OptionalMutex> lock(m_servicesMutex);
+    m_services[service] = endpoint;
+    ServicesChanged();
+  }
   
   // 如果已运行，立即发送更新的通告
   if (m_running)
@@ -196,8 +333,14 @@ IpDiscoveryAgent::RemoveService(const std::string& service)
 {
   NS_LOG_FUNCTION (this << service);
   
-  std::lock_guard<std::mutex> lock(m_servicesMutex);
-  m_services.erase(service);
+  {
+    std::lock_guard<OptionalMutex> lock(m_servicesMutex);
+    if (m_services.erase(service) == 0)
+      {
+        return;
+      }
+    ServicesChanged();
+  }
   
   // 如果已运行，立即发送更新的通告
   if (m_running)
@@ -281,10 +424,14 @@ IpDiscoveryAgent::GetStats() const
   ss << "IpDiscoveryAgent(";
   ss << "addr=" << m_address << ":" << m_port;
   ss << ", mcast=" << m_multicastAddress;
-  ss << ", interval=" << m_announceInterval.GetSeconds() << "s";
+  ss << ", interval=" << m_currentInterval.GetSeconds() << "s";
   ss << ", sent=" << m_announcementsSent;
   ss << ", recv=" << m_announcementsReceived;
   ss << ", services=" << m_services.size();
+  ss << ", version=" << m_serviceVersion;
+  ss << ", peers=" << m_peers.size();
+  ss << ", updates=" << m_serviceUpdates;
+  ss << ", lost=" << m_peersLost;
   ss << ")";
   
   return ss.str();
@@ -363,6 +510,10 @@ IpDiscoveryAgent::SendAnnouncement()
       return;
     }
   
+  // 失联检查与间隔计算在构造通告前进行，通告中声明本次使用的间隔
+  ExpirePeers();
+  m_currentInterval = GetNextInterval();
+  
   // 创建通告消息
   BeaconMessage beacon;
   beacon.nodeId = m_nodeId;
@@ -391,19 +542,33 @@ IpDiscoveryAgent::SendAnnouncement()
       beacon.endpoint = ss.str();
     }
   
-  // 获取服务列表
-  beacon.services = GetServicesString();
-  
-  // 设置时间戳
-  beacon.timestamp = Simulator::Now();
+  // 服务集刚变化或到了周期时携带完整服务列表，否则只带版本号
+  {
+    std::lock_guard<OptionalMutex> lock(m_servicesMutex);
+    beacon.serviceVersion = m_serviceVersion;
+    if (m_fullBeaconsPending > 0 || m_beaconsSinceFull + 1 >= m_fullBeaconInterval)
+      {
+        beacon.hasServices = true;
+        beacon.services = m_services;
+        m_beaconsSinceFull = 0;
+        if (m_fullBeaconsPending > 0)
+          {
+            m_fullBeaconsPending--;
+          }
+      }
+    else
+      {
+        m_beaconsSinceFull++;
+      }
+  }
+  beacon.period = m_currentInterval;
   
   // 序列化消息
-  std::string message = beacon.Serialize();
+  std::vector<uint8_t> message = beacon.Serialize();
   
   // 发送到多播组
   InetSocketAddress dest(m_multicastAddress, m_port);
-  m_socket->SendTo(reinterpret_cast<const uint8_t*>(message.c_str()),
-                  message.size(), 0, dest);
+  m_socket->SendTo(message.data(), message.size(), 0, dest);
   
   m_announcementsSent++;
   NS_LOG_INFO ("已发送通告到 " << m_multicastAddress << ":" << m_port);
@@ -437,44 +602,80 @@ IpDiscoveryAgent::HandleReceive(Ptr<Socket> socket)
           continue;
         }
       
-      // 读取数据
+      // 读取数据到复用的接收缓冲区
       uint32_t size = packet->GetSize();
-      uint8_t *data = new uint8_t[size + 1];
-      packet->CopyData(data, size);
-      data[size] = '\0';  // 确保字符串以null结尾
-      
-      std::string message(reinterpret_cast<char*>(data));
-      delete[] data;
+      if (m_receiveBuffer.size() < size)
+        {
+          m_receiveBuffer.resize(size);
+        }
+      packet->CopyData(m_receiveBuffer.data(), size);
       
       // 解析通告消息
       BeaconMessage beacon;
-      if (!beacon.Deserialize(message))
+      if (!beacon.Deserialize(m_receiveBuffer.data(), size))
+        {
+          NS_LOG_WARN ("无法解析通告消息，来自 " << address.GetIpv4());
+          continue;
+        }
+      
+      if (beacon.nodeId == m_nodeId)
         {
-          NS_LOG_WARN ("无法解析通告消息: " << message);
           continue;
         }
       
       m_announcementsReceived++;
       NS_LOG_INFO ("收到通告来自 " << address.GetIpv4() << ":" << address.GetPort() 
-                   << " (nodeId=" << beacon.nodeId << ")");
+                   << " (nodeId=" << beacon.nodeId << ", version=" << beacon.serviceVersion << ")");
       
-      // 解析服务列表
-      std::stringstream ss(beacon.services);
-      std::string service, endpoint;
+      auto it = m_peers.find(beacon.nodeId);
+      if (it == m_peers.end())
+        {
+          PeerState state;
+          state.serviceVersion = 0;
+          state.hasServices = false;
+          it = m_peers.emplace(beacon.nodeId, state).first;
+          
+          // 新的邻居：自适应模式下尽快发出通告让对方也发现本节点，
+          // 下一个通告携带服务列表，对方无需等待周期性的完整通告
+          m_neighbourhoodChanged = true;
+          m_fullBeaconsPending = std::max<uint32_t>(m_fullBeaconsPending, 1);
+          if (m_adaptive && m_running &&
+              Simulator::GetDelayLeft(m_announceEvent) > m_minAnnounceInterval)
+            {
+              Simulator::Cancel(m_announceEvent);
+              m_announceEvent = Simulator::Schedule(m_minAnnounceInterval,
+                                                  &IpDiscoveryAgent::SendAnnouncement,
+                                                  this);
+            }
+        }
+      PeerState& peer = it->second;
+      peer.endpoint = beacon.endpoint;
+      peer.lastSeen = Simulator::Now();
+      peer.period = beacon.period;
       
-      while (std::getline(ss, service, ';'))
+      // 服务集未变化时不再重复通知
+      if (peer.hasServices && peer.serviceVersion == beacon.serviceVersion)
         {
-          size_t sep = service.find('=');
-          if (sep != std::string::npos)
+          continue;
+        }
+      
+      // 版本已变化但本次通告没有服务列表，等待下一个完整通告
+      if (!beacon.hasServices)
+        {
+          NS_LOG_DEBUG ("节点 " << beacon.nodeId << " 的服务集已变化，等待完整通告");
+          continue;
+        }
+      
+      peer.serviceVersion = beacon.serviceVersion;
+      peer.hasServices = true;
+      m_serviceUpdates++;
+      
+      // 调用发现回调
+      if (!m_discoveryCallback.IsNull())
+        {
+          for (const auto& service : beacon.services)
             {
-              std::string serviceName = service.substr(0, sep);
-              std::string serviceEndpoint = service.substr(sep + 1);
-              
-              // 调用发现回调
-              if (!m_discoveryCallback.IsNull())
-                {
-                  m_discoveryCallback(beacon.nodeId, serviceName, serviceEndpoint);
-                }
+              m_discoveryCallback(beacon.nodeId, service.first, service.second);
             }
         }
     }
@@ -492,33 +693,90 @@ IpDiscoveryAgent::ScheduleNextAnnouncement()
     }
   
   // 安排下一次通告
-  m_announceEvent = Simulator::Schedule(m_announceInterval,
+  m_announceEvent = Simulator::Schedule(m_currentInterval,
                                       &IpDiscoveryAgent::SendAnnouncement,
                                       this);
 }
 
-std::string 
-IpDiscoveryAgent::GetServicesString() const
+Time 
+IpDiscoveryAgent::GetNextInterval()
 {
-  NS_LOG_FUNCTION (this);
+  if (!m_adaptive)
+    {
+      return m_announceInterval;
+    }
   
-  std::stringstream ss;
+  // 邻居变化时回到最短间隔，否则加倍
+  if (m_neighbourhoodChanged || m_baseInterval.IsZero())
+    {
+      m_baseInterval = m_minAnnounceInterval;
+    }
+  else
+    {
+      m_baseInterval = std::min(m_baseInterval + m_baseInterval, m_maxAnnounceInterval);
+    }
+  m_neighbourhoodChanged = false;
+  
+  // 移动越快邻居变化越频繁，按速度缩短间隔
+  Time interval = m_baseInterval;
+  if (m_referenceSpeed > 0 && m_node)
+    {
+      Ptr<MobilityModel> mobility = m_node->GetObject<MobilityModel>();
+      if (mobility)
+        {
+          Vector velocity = mobility->GetVelocity();
+          double speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y +
+                                   velocity.z * velocity.z);
+          interval = Seconds(interval.GetSeconds() / (1.0 + speed / m_referenceSpeed));
+        }
+    }
   
-  std::lock_guard<std::mutex> lock(m_servicesMutex);
+  return std::max(interval, m_minAnnounceInterval);
+}
+
+void 
+IpDiscoveryAgent::ExpirePeers()
+{
+  Time now = Simulator::Now();
+  std::vector<std::string> lost;
   
-  bool first = true;
-  for (const auto& pair : m_services)
+  for (auto it = m_peers.begin(); it != m_peers.end();)
     {
-      if (!first)
+      Time period = it->second.period.IsStrictlyPositive() ? it->second.period : m_announceInterval;
+      if (now - it->second.lastSeen > Seconds(period.GetSeconds() * m_peerTimeoutFactor))
         {
-          ss << ";";
+          NS_LOG_INFO ("节点失联: " << it->first);
+          lost.push_back(it->first);
+          it = m_peers.erase(it);
+        }
+      else
+        {
+          ++it;
         }
-      first = false;
-      
-      ss << pair.first << "=" << pair.second;
     }
   
-  return ss.str();
+  if (lost.empty())
+    {
+      return;
+    }
+  
+  m_neighbourhoodChanged = true;
+  m_peersLost += lost.size();
+  
+  if (!m_peerLostCallback.IsNull())
+    {
+      for (const std::string& nodeId : lost)
+        {
+          m_peerLostCallback(nodeId);
+        }
+    }
+}
+
+void 
+IpDiscoveryAgent::ServicesChanged()
+{
+  m_serviceVersion++;
+  m_fullBeaconsPending = FULL_BEACONS_AFTER_CHANGE;
 }
 
 } // namespace dtn7
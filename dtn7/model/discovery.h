@@ -16,6 +16,7 @@
 #include <mutex>
 
 #include "endpoint.h"
+#include "optional-mutex.h"
 
 namespace ns3 {
 
@@ -23,25 +24,36 @@ namespace dtn7 {
 
 /**
  * \brief 节点通告消息结构
+ *
+ * 按dtn7发现协议编码为CBOR数组：
+ * [版本, 标志, 节点ID, 端点, 服务集版本, 通告周期(ms), 服务映射(可选)]。
+ * 服务集版本在服务增删时递增，接收方只在版本变化时处理服务列表，
+ * 因此大多数通告可以省略服务映射。
  */
 struct BeaconMessage {
+  static const uint8_t VERSION = 7;            //!< 通告格式版本
+  static const uint8_t FLAG_HAS_SERVICES = 0x01; //!< 携带服务映射
+  
   std::string nodeId;      //!< 节点ID
   std::string endpoint;    //!< 端点地址
-  std::string services;    //!< 支持的服务列表
-  Time timestamp;          //!< 时间戳
+  uint32_t serviceVersion = 0; //!< 服务集版本
+  bool hasServices = false;    //!< 是否携带服务映射
+  std::map<std::string, std::string> services; //!< 支持的服务列表
+  Time period;             //!< 发送方的通告周期
   
   /**
-   * \brief 序列化为字符串
-   * \return 序列化后的字符串
+   * \brief 序列化为CBOR
+   * \return 序列化后的数据
    */
-  std::string Serialize() const;
+  std::vector<uint8_t> Serialize() const;
   
   /**
-   * \brief 从字符串反序列化
+   * \brief 从CBOR反序列化
    * \param data 序列化数据
+   * \param size 数据大小
    * \return 解析成功返回true
    */
-  bool Deserialize(const std::string& data);
+  bool Deserialize(const uint8_t* data, size_t size);
 };
 
 /**
@@ -49,6 +61,11 @@ struct BeaconMessage {
  */
 typedef Callback<void, const std::string&, const std::string&, const std::string&> DiscoveryCallback;
 
+/**
+ * \brief 节点失联回调函数类型，参数为节点ID
+ */
+typedef Callback<void, const std::string&> PeerLostCallback;
+
 /**
  * \ingroup dtn7
  * \brief 节点发现接口
@@ -78,6 +95,12 @@ public:
    */
   virtual void RegisterDiscoveryCallback(DiscoveryCallback callback) = 0;
   
+  /**
+   * \brief 注册节点失联回调
+   * \param callback 节点在若干通告周期内没有消息时调用的回调函数
+   */
+  virtual void RegisterPeerLostCallback(PeerLostCallback callback) = 0;
+  
   /**
    * \brief 设置节点ID
    * \param nodeId 节点ID
@@ -155,6 +178,7 @@ public:
   
   // 继承自DiscoveryAgent的方法
   void RegisterDiscoveryCallback(DiscoveryCallback callback) override;
+  void RegisterPeerLostCallback(PeerLostCallback callback) override;
   void SetNodeId(const std::string& nodeId) override;
   void AddService(const std::string& service, const std::string& endpoint) override;
   void RemoveService(const std::string& service) override;
@@ -173,19 +197,50 @@ private:
   Ipv4Address m_address;               //!< 本地地址
   uint16_t m_port;                     //!< 本地端口
   Ipv4Address m_multicastAddress;      //!< 组播地址
-  Time m_announceInterval;             //!< 通告间隔
+  Time m_announceInterval;             //!< 通告间隔（非自适应模式）
+  
+  bool m_adaptive;                     //!< 是否自适应调整通告间隔
+  Time m_minAnnounceInterval;          //!< 自适应模式的最短间隔，邻居变化时使用
+  Time m_maxAnnounceInterval;          //!< 自适应模式的最长间隔，邻居稳定时逐步增加到此值
+  double m_referenceSpeed;             //!< 速度达到该值时间隔减半，0表示不按速度调整
+  Time m_baseInterval;                 //!< 未按速度缩放的自适应间隔
+  Time m_currentInterval;              //!< 当前使用的通告间隔
+  bool m_neighbourhoodChanged;         //!< 上次通告后是否有对端出现或失联
+  uint32_t m_peerTimeoutFactor;        //!< 对端超过多少个通告周期没有消息视为失联
   
   bool m_running;                      //!< 运行状态
   std::string m_nodeId;                //!< 节点ID
   std::map<std::string, std::string> m_services; //!< 服务映射
-  mutable std::mutex m_servicesMutex;  //!< 服务映射互斥锁
+  mutable OptionalMutex m_servicesMutex;  //!< 服务映射互斥锁
   
   DiscoveryCallback m_discoveryCallback; //!< 发现回调
+  PeerLostCallback m_peerLostCallback;   //!< 失联回调
   EventId m_announceEvent;               //!< 通告定时器
   Ptr<Socket> m_socket;                //!< UDP套接字
   
   uint64_t m_announcementsSent;        //!< 已发送通告数
   uint64_t m_announcementsReceived;    //!< 已接收通告数
+  uint64_t m_serviceUpdates;           //!< 处理过的服务集变化数
+  uint64_t m_peersLost;                //!< 失联的对端数
+  
+  uint32_t m_serviceVersion;           //!< 本地服务集版本
+  uint32_t m_fullBeaconInterval;       //!< 每隔多少次通告携带一次完整服务列表
+  uint32_t m_fullBeaconsPending;       //!< 服务变化后仍需携带服务列表的通告数
+  uint32_t m_beaconsSinceFull;         //!< 上次携带服务列表后的通告数
+  
+  /**
+   * \brief 已知对端的通告状态
+   */
+  struct PeerState
+  {
+    std::string endpoint;      //!< 最近通告的端点
+    uint32_t serviceVersion;   //!< 已处理的服务集版本
+    bool hasServices;          //!< 是否已收到过服务列表
+    Time lastSeen;             //!< 最后收到通告的时间
+    Time period;               //!< 对端声明的通告周期
+  };
+  std::map<std::string, PeerState> m_peers; //!< 以节点ID为键的对端状态
+  std::vector<uint8_t> m_receiveBuffer;     //!< 复用的接收缓冲区
   
   /**
    * \brief 创建套接字
@@ -210,10 +265,23 @@ private:
   void ScheduleNextAnnouncement();
   
   /**
-   * \brief 生成服务列表字符串
-   * \return 服务列表字符串
+   * \brief 计算下一次通告的间隔
+   *
+   * 自适应模式下邻居变化时回到最短间隔，稳定时每次加倍直到最长间隔，
+   * 并按节点移动速度缩短。
+   * \return 通告间隔
+   */
+  Time GetNextInterval();
+  
+  /**
+   * \brief 移除超时未通告的对端并通知失联
+   */
+  void ExpirePeers();
+  
+  /**
+   * \brief 服务集变化后让接下来的通告携带服务列表，调用者需持有m_servicesMutex
    */
-  std::string GetServicesString() const;
+  void ServicesChanged();
 };
 
 } // namespace dtn7
@@ -1,8 +1,12 @@
 #include "dtn-node.h"
+#include "administrative-record.h"
+#include "trace-events.h"
 #include "ns3/log.h"
 #include "ns3/address.h"
 #include "ns3/simulator.h"
 #include "ns3/string.h"        // StringValue
+#include "ns3/boolean.h"       // BooleanValue
+#include "ns3/uinteger.h"      // UintegerValue
 #include "ns3/nstime.h"        // TimeValue, Minutes, Seconds
 #include "ns3/object.h"
 #include "ns3/ptr.h"
@@ -10,6 +14,7 @@
 #include "ns3/config.h"        // 添加其他可能需要的头文件
 #include "ns3/object-base.h"   // 添加其他可能需要的头文件
 #include "ns3/core-module.h"   // 添加核心模块包含更多辅助函数
+#include <algorithm>
 #include <sstream>
 #include <functional> // 添加这行来支持哈希函数
 namespace ns3 {
@@ -28,6 +33,36 @@ DtnNode::GetTypeId ()
     .SetGroupName ("Dtn7")
     .AddConstructor<DtnNode> ()
     // 简化属性定义，仅保留必要部分
+    .AddAttribute ("CleanupInterval",
+                   "Interval between cleanups of expired bundles and fragments",
+                   TimeValue (Minutes (1)),
+                   MakeTimeAccessor (&DtnNode::m_cleanupInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("RoutingInterval",
+                   "Interval between periodic dispatches of queued bundles",
+                   TimeValue (Seconds (10)),
+                   MakeTimeAccessor (&DtnNode::m_routingInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("SharedTimers",
+                   "Whether nodes with the same intervals run their periodic tasks from one shared event",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&DtnNode::m_sharedTimers),
+                   MakeBooleanChecker ())
+    .AddAttribute ("SharedTimerSlots",
+                   "Number of phases per interval; nodes share a timer event only with nodes that started in the same phase",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&DtnNode::m_sharedTimerSlots),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("StatusReportDelay",
+                   "How long status reports wait to be sent together with others to the same endpoint, 0 to send each at once",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&DtnNode::m_reportDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxReportsPerBundle",
+                   "Number of waiting status reports for one endpoint that are sent at once",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&DtnNode::m_maxReportsPerBundle),
+                   MakeUintegerChecker<uint32_t> (1))
     .AddTraceSource ("BundleReceived",
                      "Trace source for received bundles",
                      MakeTraceSourceAccessor (&DtnNode::m_bundleReceivedTrace),
@@ -36,6 +71,15 @@ DtnNode::GetTypeId ()
                      "Trace source for delivered bundles",
                      MakeTraceSourceAccessor (&DtnNode::m_bundleDeliveredTrace),
                      "ns3::dtn7::DtnNode::BundleTracedCallback")
+    .AddTraceSource ("StatusReport",
+                     "Trace source for status reports delivered to this node, one call per report",
+                     MakeTraceSourceAccessor (&DtnNode::m_statusReportTrace),
+                     "ns3::dtn7::DtnNode::StatusReportTracedCallback")
+    .AddTraceSource ("BundleLifecycle",
+                     "Trace source for bundles created, stored, sent, received, dropped as duplicates, "
+                     "delivered, expired or evicted at this node",
+                     MakeTraceSourceAccessor (&DtnNode::m_lifecycleTrace),
+                     "ns3::dtn7::DtnNode::BundleLifecycleTracedCallback")
   ;
   return tid;
 }
@@ -47,10 +91,25 @@ DtnNode::DtnNode ()
     m_running (false),
     m_cleanupInterval (Minutes (1)),
     m_routingInterval (Seconds (10)),
+    m_sharedTimers (true),
+    m_sharedTimerSlots (10),
     m_receivedBundles (0),
-    m_deliveredBundles (0)
+    m_deliveredBundles (0),
+    m_knownBundles (0),
+    m_metrics (Create<MetricsRegistry> ()),
+    m_nextRegistration (1),
+    m_droppedDeliveries (0),
+    m_reportDelay (Seconds (1)),
+    m_maxReportsPerBundle (64),
+    m_sentReports (0),
+    m_sentReportBundles (0)
 {
   NS_LOG_FUNCTION (this);
+  
+  m_receivedCounter = m_metrics->GetCounter ("node.bundlesReceived");
+  m_deliveredCounter = m_metrics->GetCounter ("node.bundlesDelivered");
+  m_duplicateCounter = m_metrics->GetCounter ("node.duplicatesDropped");
+  m_deliveryLatency = m_metrics->GetHistogram ("node.deliveryLatency");
 }
 
 DtnNode::~DtnNode ()
@@ -73,6 +132,12 @@ DtnNode::GetNodeId () const
   return m_nodeId;
 }
 
+Ptr<MetricsRegistry> 
+DtnNode::GetMetrics () const
+{
+  return m_metrics;
+}
+
 void 
 DtnNode::AddConvergenceLayer (Ptr<ConvergenceLayer> cla)
 {
@@ -98,6 +163,20 @@ DtnNode::SetBundleStore (Ptr<BundleStore> store)
   m_store = store;
 }
 
+void 
+DtnNode::SetDiscoveryAgent (Ptr<DiscoveryAgent> agent)
+{
+  NS_LOG_FUNCTION (this << agent);
+  m_discovery = agent;
+}
+
+Ptr<DiscoveryAgent> 
+DtnNode::GetDiscoveryAgent () const
+{
+  NS_LOG_FUNCTION (this);
+  return m_discovery;
+}
+
 bool 
 DtnNode::Send (Ptr<Bundle> bundle)
 {
@@ -120,6 +199,9 @@ DtnNode::Send (Ptr<Bundle> bundle)
     return false;
   }
   
+  DTN7_TRACE_EVENT (TraceEventType::BUNDLE_CREATED, bundle->GetId ().Hash (), bundle->GetPayload ().size ());
+  TraceLifecycle (BundleLifecycleEvent::CREATED, bundle);
+  
   // 通知路由算法有关新bundle
   m_routingAlgorithm->NotifyNewBundle (bundle, m_nodeId);
   
@@ -211,7 +293,7 @@ DtnNode::Send (const std::string& source,
   DtnTime creationTime = GetDtnNow ();
   Bundle bundle = Bundle::MustNewBundle (source, destination, creationTime, lifetime, payload);
   
-  Ptr<Bundle> bundlePtr = Create<Bundle> (bundle);
+  Ptr<Bundle> bundlePtr = Create<Bundle> (std::move (bundle));
   if (!bundlePtr) {
     NS_LOG_ERROR ("Failed to create Bundle object");
     return false;
@@ -252,6 +334,10 @@ DtnNode::GetStats () const
   ss << "id=" << m_nodeId.ToString ();
   ss << ", recv=" << m_receivedBundles;
   ss << ", delivered=" << m_deliveredBundles;
+  ss << ", known=" << m_knownBundles;
+  ss << ", registrations=" << m_registrations.size ();
+  ss << ", droppedDeliveries=" << m_droppedDeliveries;
+  ss << ", reports=" << m_sentReports << "/" << m_sentReportBundles;
   
   if (m_store)
     {
@@ -290,6 +376,13 @@ DtnNode::LogReceivedBundle (Ptr<Bundle> bundle)
     return;
   }
   
+#ifdef NS3_LOG_ENABLE
+  // 负载扫描不在NS_LOG宏内，日志关闭时直接跳过
+  if (!g_log.IsEnabled (LOG_LEVEL_INFO))
+    {
+      return;
+    }
+  
   NS_LOG_INFO ("Received bundle: " << bundle->ToString ());
   
   // 打印bundle信息
@@ -299,7 +392,7 @@ DtnNode::LogReceivedBundle (Ptr<Bundle> bundle)
   NS_LOG_INFO ("  Lifetime: " << bundle->GetPrimaryBlock ().GetLifetime ().GetSeconds () << "s");
   
   // 如可能，将有效载荷打印为ASCII
-  std::vector<uint8_t> payload = bundle->GetPayload ();
+  PayloadBuffer payload = bundle->GetPayload ();
   std::string payloadText;
   bool isPrintable = true;
   
@@ -321,6 +414,7 @@ DtnNode::LogReceivedBundle (Ptr<Bundle> bundle)
     {
       NS_LOG_INFO ("  Payload: " << payload.size () << " bytes (binary)");
     }
+#endif /* NS3_LOG_ENABLE */
 }
 
 void 
@@ -335,7 +429,17 @@ DtnNode::DoDispose ()
 {
   NS_LOG_FUNCTION (this);
   
+  LeaveTimerGroups ();
+  Simulator::Cancel (m_batchEvent);
+  Simulator::Cancel (m_reportEvent);
+  m_pendingReports.clear ();
+  m_registrations.clear ();
+  m_endpointRegistrations.clear ();
+  m_prefixRegistrations.clear ();
+  m_pendingBatches.clear ();
+  m_bundleCallback = Callback<void, Ptr<Bundle>, NodeID> ();
   m_convergenceLayers.clear ();
+  m_discovery = nullptr;
   m_routingAlgorithm = nullptr;
   m_store = nullptr;
   m_fragmentManager = nullptr;
@@ -380,6 +484,19 @@ DtnNode::StartApplication ()
   
   m_routingAlgorithm->Initialize (m_store, senders, m_nodeId);
   
+  // 超过所选CLA的MTU的bundle由路由在bundle层分片
+  m_routingAlgorithm->SetFragmentationManager (m_fragmentManager);
+  
+  // 各组件计数到节点的指标中
+  m_routingAlgorithm->SetMetrics (m_metrics);
+  m_store->SetMetrics (m_metrics);
+  m_fragmentManager->SetMetrics (m_metrics);
+  
+  // 存储自行删除（驱逐或过期）的bundle需要删除状态报告
+  m_store->RegisterDeletionCallback (MakeCallback (&DtnNode::HandleBundleDeleted, this));
+  m_store->RegisterStoredCallback (MakeCallback (&DtnNode::HandleBundleStored, this));
+  m_routingAlgorithm->RegisterTransmittedCallback (MakeCallback (&DtnNode::HandleBundleTransmitted, this));
+  
   // 启动收敛层
   for (const auto& cla : m_convergenceLayers)
     {
@@ -398,6 +515,13 @@ DtnNode::StartApplication ()
         NS_LOG_WARN ("Convergence layer is not a ConvergenceReceiver");
       }
       
+      // 对端的出现与消失以事件方式上报，不再轮询活跃连接
+      cla->RegisterConnectionCallback (MakeCallback (&DtnNode::HandleConnectionChanged, this));
+      
+      // 已有的bundle在收敛层只解码主区块即丢弃
+      cla->RegisterKnownBundleCallback (MakeCallback (&DtnNode::IsKnownBundle, this));
+      cla->SetMetrics (m_metrics);
+      
       // 修复歧义调用问题 - 显式指定调用ConvergenceReceiver::Start
       if (receiver)
         {
@@ -407,9 +531,35 @@ DtnNode::StartApplication ()
         }
     }
   
-  // 安排周期性任务
-  m_cleanupEvent = Simulator::Schedule (m_cleanupInterval, &DtnNode::CleanupExpiredBundles, this);
-  m_routingEvent = Simulator::Schedule (m_routingInterval, &DtnNode::RoutingTask, this);
+  // 通过发现代理通告各收敛层的端点，并从对端的通告得知其节点ID
+  if (m_discovery)
+    {
+      m_discovery->SetNodeId (m_nodeId.ToString ());
+      for (const auto& cla : m_convergenceLayers)
+        {
+          if (cla)
+            {
+              m_discovery->AddService (cla->GetInstanceTypeId ().GetName (), cla->GetEndpoint ());
+            }
+        }
+      m_discovery->RegisterDiscoveryCallback (MakeCallback (&DtnNode::HandleDiscovery, this));
+      m_discovery->RegisterPeerLostCallback (MakeCallback (&DtnNode::HandlePeerLost, this));
+      if (!m_discovery->Start ())
+        {
+          NS_LOG_ERROR ("Failed to start discovery agent");
+        }
+    }
+  
+  // 安排周期性任务；共享定时器时由同一间隔的所有节点共用一个事件
+  if (m_sharedTimers)
+    {
+      JoinTimerGroups ();
+    }
+  else
+    {
+      m_cleanupEvent = Simulator::Schedule (m_cleanupInterval, &DtnNode::CleanupExpiredBundles, this);
+      m_routingEvent = Simulator::Schedule (m_routingInterval, &DtnNode::RoutingTask, this);
+    }
   
   m_running = true;
   
@@ -437,6 +587,11 @@ DtnNode::StopApplication ()
       Simulator::Cancel (m_routingEvent);
     }
   
+  LeaveTimerGroups ();
+  
+  // 等待中的状态报告在停止前发出
+  FlushStatusReports ();
+  
   // 停止收敛层
   for (const auto& cla : m_convergenceLayers)
     {
@@ -452,6 +607,13 @@ DtnNode::StopApplication ()
         }
     }
   
+  if (m_discovery)
+    {
+      m_discovery->Stop ();
+    }
+  
+  m_peerConnections.clear ();
+  m_unresolvedConnections.clear ();
   m_running = false;
   
   NS_LOG_INFO ("DTN node stopped");
@@ -470,13 +632,23 @@ DtnNode::HandleReceivedBundle (Ptr<Bundle> bundle, NodeID source)
     }
   
   m_receivedBundles++;
+  m_receivedCounter->Add ();
   // 这里需要确保Bundle对象不是空指针
   m_bundleReceivedTrace (bundle);
- 
-  
-  NS_LOG_INFO("Received bundle from " << source.ToString());
+  DTN7_TRACE_EVENT (TraceEventType::BUNDLE_RECEIVED, bundle->GetId ().Hash (), bundle->GetPayload ().size ());
+  TraceLifecycle (BundleLifecycleEvent::RECEIVED, bundle);
   
   NS_LOG_INFO ("Received bundle from " << source.ToString ());
+  
+  // 未经收敛层过滤的重复bundle在分片重组和路由之前丢弃
+  if (IsKnownBundle (bundle->GetId ()))
+    {
+      DTN7_TRACE_EVENT (TraceEventType::BUNDLE_DUPLICATE, bundle->GetId ().Hash ());
+      TraceLifecycle (BundleLifecycleEvent::DUPLICATE, bundle);
+      NS_LOG_INFO ("Dropping known bundle " << bundle->GetId ().ToString ());
+      return;
+    }
+  
   // 检查bundle是否为片段
   if (bundle->IsFragment())
     {
@@ -502,24 +674,83 @@ DtnNode::HandleReceivedBundle (Ptr<Bundle> bundle, NodeID source)
         }
     }
   
+  // 路由控制bundle（如摘要向量、已投递确认）及已投递bundle的副本由路由算法消费，既不投递也不转发
+  if (m_routingAlgorithm && m_routingAlgorithm->ReceiveControlBundle (bundle, source))
+    {
+      NS_LOG_INFO ("Bundle consumed by routing algorithm");
+      return;
+    }
+  
+  const PrimaryBlock& primary = bundle->GetPrimaryBlock ();
+  if (primary.RequestsBundleReceptionStatusReport ())
+    {
+      QueueStatusReport (BundleStatusReport::CreateReceivedReport (bundle, m_nodeId), primary);
+    }
+  
   // 检查此节点是否为目标
   if (IsDeliverable (bundle))
     {
       m_deliveredBundles++;
+      m_deliveredCounter->Add ();
+      
+      // 线上的创建时间只精确到秒
+      m_deliveryLatency->Record (GetDtnNow ().ToTime () - primary.GetCreationTimestamp ().ToTime ());
       // 这里需要确保Bundle对象不是空指针
       m_bundleDeliveredTrace (bundle);
+      DTN7_TRACE_EVENT (TraceEventType::BUNDLE_DELIVERED, bundle->GetId ().Hash (), bundle->GetPayload ().size ());
+      TraceLifecycle (BundleLifecycleEvent::DELIVERED, bundle);
+      
+      if (bundle->IsAdministrativeRecord ())
+        {
+          ReceiveStatusReports (bundle);
+        }
+      else if (primary.RequestsBundleDeliveryStatusReport ())
+        {
+          QueueStatusReport (BundleStatusReport::CreateDeliveredReport (bundle, m_nodeId), primary);
+        }
+      
+      // 交给注册了目的端点的应用
+      DeliverLocally (bundle, source);
+      
+      // 记录已投递，向之后遇到的对端传播以清除网络中的副本
+      if (m_routingAlgorithm)
+        {
+          m_routingAlgorithm->NotifyDelivered (bundle);
+        }
       
       NS_LOG_INFO ("Bundle delivered to this node");
     }
   else
     {
+      // 不再发回上一跳：有上一跳区块时以它代替源节点
+      NodeID previousHop = source;
+      Ptr<PreviousNodeBlock> previousNode =
+        DynamicCast<PreviousNodeBlock> (bundle->GetBlockByType (BlockType::PREVIOUS_NODE_BLOCK));
+      if (previousNode)
+        {
+          previousHop = previousNode->GetPreviousNode ();
+        }
+      
       // 转发bundle到路由算法
-      m_routingAlgorithm->NotifyNewBundle (bundle, source);
+      m_routingAlgorithm->NotifyNewBundle (bundle, previousHop);
       
       NS_LOG_INFO ("Bundle forwarded to routing algorithm");
     }
 }
 
+bool 
+DtnNode::IsKnownBundle (const BundleID& id)
+{
+  if (!m_routingAlgorithm || !m_routingAlgorithm->IsKnownBundle (id))
+    {
+      return false;
+    }
+  
+  m_knownBundles++;
+  m_duplicateCounter->Add ();
+  return true;
+}
+
 void 
 DtnNode::CleanupExpiredBundles ()
 {
@@ -536,7 +767,10 @@ DtnNode::CleanupExpiredBundles ()
   NS_LOG_INFO ("Cleaned up " << removedCount << " expired bundles and " 
     << removedFragments << " expired fragment sets");
   // 安排下一次清理
-  m_cleanupEvent = Simulator::Schedule (m_cleanupInterval, &DtnNode::CleanupExpiredBundles, this);
+  if (!m_sharedTimers)
+    {
+      m_cleanupEvent = Simulator::Schedule (m_cleanupInterval, &DtnNode::CleanupExpiredBundles, this);
+    }
 }
 
 void 
@@ -544,36 +778,323 @@ DtnNode::RoutingTask ()
 {
   NS_LOG_FUNCTION (this);
   
-  // 检查收敛层并发现对等节点
-  for (const auto& cla : m_convergenceLayers)
+  // 对端变化已由连接事件通知，这里只周期性地重试分发
+  if (m_routingAlgorithm)
     {
-      if (!cla) continue;  // 跳过空CLA
+      m_routingAlgorithm->DispatchBundles ();
+    }
+  
+  // 安排下一次路由任务
+  if (!m_sharedTimers)
+    {
+      m_routingEvent = Simulator::Schedule (m_routingInterval, &DtnNode::RoutingTask, this);
+    }
+}
+
+std::map<std::pair<int64_t, uint32_t>, DtnNode::TimerGroup>& 
+DtnNode::GetTimerGroups (bool routing)
+{
+  static std::map<std::pair<int64_t, uint32_t>, TimerGroup> cleanupGroups;
+  static std::map<std::pair<int64_t, uint32_t>, TimerGroup> routingGroups;
+  return routing ? routingGroups : cleanupGroups;
+}
+
+void 
+DtnNode::JoinTimerGroups ()
+{
+  NS_LOG_FUNCTION (this);
+  
+  for (bool routing : {false, true})
+    {
+      Time interval = routing ? m_routingInterval : m_cleanupInterval;
       
-      std::vector<std::string> activeConnections = cla->GetActiveConnections ();
+      // 按启动时刻在间隔内的相位分组，错开启动的节点其周期任务也保持错开
+      int64_t steps = std::max<int64_t> (interval.GetTimeStep (), 1);
+      int64_t phase = Simulator::Now ().GetTimeStep () % steps;
+      uint32_t slot = static_cast<uint32_t> ((static_cast<double> (phase) / steps) * m_sharedTimerSlots);
+      slot = std::min (slot, m_sharedTimerSlots - 1);
       
-      for (const auto& endpoint : activeConnections)
+      TimerGroup& group = GetTimerGroups (routing)[std::make_pair (interval.GetTimeStep (), slot)];
+      group.nodes.push_back (this);
+      
+      // 组内第一个节点启动共享事件
+      if (!group.event.IsPending ())
         {
-          // 创建对等信息
-          PeerInfo peer;
-          peer.nodeID = NodeID ("dtn://peer/"); // 在实际实现中，我们会发现真实的EID
-          peer.lastSeen = Simulator::Now ();
-          peer.receptionTime = Simulator::Now ();
-          peer.reachable = true;
-          peer.cla = cla->GetEndpoint ();
-          peer.endpoint = endpoint;
+          group.event = Simulator::Schedule (interval, &DtnNode::RunTimerGroup, routing, interval, slot);
+        }
+    }
+}
+
+void 
+DtnNode::LeaveTimerGroups ()
+{
+  NS_LOG_FUNCTION (this);
+  
+  for (bool routing : {false, true})
+    {
+      std::map<std::pair<int64_t, uint32_t>, TimerGroup>& groups = GetTimerGroups (routing);
+      for (auto it = groups.begin (); it != groups.end (); )
+        {
+          std::vector<DtnNode*>& nodes = it->second.nodes;
+          nodes.erase (std::remove (nodes.begin (), nodes.end (), this), nodes.end ());
           
-          UpdatePeer (peer);
+          // 最后一个节点离开时取消共享事件
+          if (nodes.empty ())
+            {
+              Simulator::Cancel (it->second.event);
+              it = groups.erase (it);
+            }
+          else
+            {
+              ++it;
+            }
+        }
+    }
+}
+
+void 
+DtnNode::RunTimerGroup (bool routing, Time interval, uint32_t slot)
+{
+  auto it = GetTimerGroups (routing).find (std::make_pair (interval.GetTimeStep (), slot));
+  if (it == GetTimerGroups (routing).end ())
+    {
+      return;
+    }
+  
+  // 先安排下一次事件，任务中停止的节点会自行离开组
+  it->second.event = Simulator::Schedule (interval, &DtnNode::RunTimerGroup, routing, interval, slot);
+  NS_LOG_INFO ("Running shared " << (routing ? "routing" : "cleanup") << " task on " 
+               << it->second.nodes.size () << " nodes");
+  
+  // 每个节点的任务在该节点自己的上下文中运行，其发送、事件和日志归属正确
+  for (DtnNode* node : it->second.nodes)
+    {
+      Simulator::ScheduleWithContext (node->GetNode ()->GetId (), Seconds (0),
+                                      &DtnNode::RunSharedTask, Ptr<DtnNode> (node), routing);
+    }
+}
+
+void 
+DtnNode::RunSharedTask (bool routing)
+{
+  NS_LOG_FUNCTION (this << routing);
+  
+  // 在同一时刻先前的事件中停止的节点不再运行任务
+  if (!m_running)
+    {
+      return;
+    }
+  
+  if (routing)
+    {
+      RoutingTask ();
+    }
+  else
+    {
+      CleanupExpiredBundles ();
+    }
+}
+
+void 
+DtnNode::HandleConnectionChanged (const std::string& cla, const std::string& endpoint,
+                                  const std::string& nodeId, bool up)
+{
+  NS_LOG_FUNCTION (this << cla << endpoint << nodeId << up);
+  Simulator::ScheduleNow (&DtnNode::ProcessConnectionChange, this, cla, endpoint, nodeId, up);
+}
+
+void 
+DtnNode::ProcessConnectionChange (std::string cla, std::string endpoint, std::string nodeId, bool up)
+{
+  NS_LOG_FUNCTION (this << cla << endpoint << nodeId << up);
+  
+  if (!m_running || !m_routingAlgorithm)
+    {
+      return;
+    }
+  
+  std::string key = cla + " " + endpoint;
+  
+  if (!up)
+    {
+      m_unresolvedConnections.erase (key);
+      
+      auto it = m_peerConnections.find (key);
+      if (it == m_peerConnections.end ())
+        {
+          return;
         }
+      
+      NodeID lost = it->second.nodeID;
+      m_peerConnections.erase (it);
+      ReleasePeer (lost);
+      return;
     }
   
-  // 让路由算法分发bundles
-  if (m_routingAlgorithm)
+  // 会话握手或上一跳区块给出的节点ID优先于已记录的映射
+  if (!nodeId.empty ())
     {
-      m_routingAlgorithm->DispatchBundles ();
+      m_endpointNodeIds[endpoint] = NodeID (nodeId);
     }
   
-  // 安排下一次路由任务
-  m_routingEvent = Simulator::Schedule (m_routingInterval, &DtnNode::RoutingTask, this);
+  // 创建对等信息
+  PeerInfo peer;
+  peer.lastSeen = Simulator::Now ();
+  peer.receptionTime = Simulator::Now ();
+  peer.reachable = true;
+  peer.cla = cla;
+  peer.endpoint = endpoint;
+  
+  if (!ResolvePeer (endpoint, peer.nodeID))
+    {
+      // 等待通告或Bundle给出对端的节点ID，避免所有未知对端合并成同一个路由条目
+      NS_LOG_INFO ("Connection " << key << " waits for the peer node ID");
+      m_unresolvedConnections[key] = peer;
+      return;
+    }
+  
+  m_unresolvedConnections.erase (key);
+  ConnectPeer (key, peer);
+}
+
+void 
+DtnNode::HandleDiscovery (const std::string& nodeId, const std::string& service,
+                          const std::string& endpoint)
+{
+  NS_LOG_FUNCTION (this << nodeId << service << endpoint);
+  
+  if (nodeId == m_nodeId.ToString ())
+    {
+      return;
+    }
+  
+  Simulator::ScheduleNow (&DtnNode::LearnPeer, this, endpoint, nodeId);
+}
+
+void 
+DtnNode::LearnPeer (std::string endpoint, std::string nodeId)
+{
+  NS_LOG_FUNCTION (this << endpoint << nodeId);
+  
+  if (!m_running || !m_routingAlgorithm)
+    {
+      return;
+    }
+  
+  NodeID id (nodeId);
+  m_endpointNodeIds[endpoint] = id;
+  
+  // 解析正在等待该端点节点ID的连接
+  for (auto it = m_unresolvedConnections.begin (); it != m_unresolvedConnections.end ();)
+    {
+      if (it->second.endpoint != endpoint)
+        {
+          ++it;
+          continue;
+        }
+      
+      PeerInfo peer = it->second;
+      peer.nodeID = id;
+      std::string key = it->first;
+      it = m_unresolvedConnections.erase (it);
+      ConnectPeer (key, peer);
+    }
+}
+
+void 
+DtnNode::HandlePeerLost (const std::string& nodeId)
+{
+  NS_LOG_FUNCTION (this << nodeId);
+  Simulator::ScheduleNow (&DtnNode::ProcessPeerLost, this, nodeId);
+}
+
+void 
+DtnNode::ProcessPeerLost (std::string nodeId)
+{
+  NS_LOG_FUNCTION (this << nodeId);
+  
+  if (!m_running || !m_routingAlgorithm)
+    {
+      return;
+    }
+  
+  // 通告中断的对端按连接断开处理；连接转为等待解析，再次发现时恢复
+  NodeID id (nodeId);
+  bool found = false;
+  for (auto it = m_peerConnections.begin (); it != m_peerConnections.end ();)
+    {
+      if (it->second.nodeID != id)
+        {
+          ++it;
+          continue;
+        }
+      
+      m_unresolvedConnections[it->first] = it->second;
+      it = m_peerConnections.erase (it);
+      found = true;
+    }
+  
+  if (found)
+    {
+      ReleasePeer (id);
+    }
+}
+
+void 
+DtnNode::ConnectPeer (const std::string& key, const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << key << peer.nodeID.ToString ());
+  
+  auto it = m_peerConnections.find (key);
+  if (it != m_peerConnections.end ())
+    {
+      if (it->second.nodeID == peer.nodeID)
+        {
+          it->second.lastSeen = peer.lastSeen;
+          return;
+        }
+      
+      // 该端点已属于另一个节点
+      NodeID previous = it->second.nodeID;
+      it->second = peer;
+      ReleasePeer (previous);
+    }
+  else
+    {
+      m_peerConnections[key] = peer;
+    }
+  
+  UpdatePeer (peer);
+}
+
+void 
+DtnNode::ReleasePeer (const NodeID& nodeId)
+{
+  NS_LOG_FUNCTION (this << nodeId.ToString ());
+  
+  // 同一节点仍有其他连接时不算消失
+  for (const auto& pair : m_peerConnections)
+    {
+      if (pair.second.nodeID == nodeId)
+        {
+          return;
+        }
+    }
+  
+  NS_LOG_INFO ("Peer disappeared: " << nodeId.ToString ());
+  m_routingAlgorithm->NotifyPeerDisappeared (nodeId);
+}
+
+bool 
+DtnNode::ResolvePeer (const std::string& endpoint, NodeID& nodeId) const
+{
+  auto it = m_endpointNodeIds.find (endpoint);
+  if (it == m_endpointNodeIds.end ())
+    {
+      return false;
+    }
+  nodeId = it->second;
+  return true;
 }
 
 void 
@@ -590,6 +1111,187 @@ DtnNode::UpdatePeer (const PeerInfo& peer)
   m_routingAlgorithm->NotifyPeerAppeared (peer);
 }
 
+void 
+DtnNode::HandleBundleDeleted (Ptr<Bundle> bundle, uint64_t reasonCode)
+{
+  NS_LOG_FUNCTION (this << bundle << reasonCode);
+  TraceLifecycle (reasonCode == static_cast<uint64_t> (ReasonCode::DEPLETED_STORAGE)
+                  ? BundleLifecycleEvent::EVICTED : BundleLifecycleEvent::EXPIRED,
+                  bundle);
+  Simulator::ScheduleNow (&DtnNode::SendDeletionReport, this, bundle, reasonCode);
+}
+
+void 
+DtnNode::HandleBundleStored (Ptr<Bundle> bundle, uint64_t size)
+{
+  TraceLifecycle (BundleLifecycleEvent::STORED, bundle, size);
+}
+
+void 
+DtnNode::HandleBundleTransmitted (Ptr<Bundle> bundle, const NodeID& receiver, uint64_t size,
+                                  Ptr<ConvergenceSender> sender)
+{
+  if (m_lifecycleTrace.IsEmpty ())
+    {
+      return;
+    }
+  
+  std::string cla = sender->GetInstanceTypeId ().GetName ();
+  TraceLifecycle (BundleLifecycleEvent::SENT, bundle, size, cla.substr (cla.rfind (':') + 1));
+}
+
+void 
+DtnNode::TraceLifecycle (BundleLifecycleEvent event, Ptr<Bundle> bundle, uint64_t bytes,
+                         const std::string& cla)
+{
+  // 未连接时不构造记录
+  if (m_lifecycleTrace.IsEmpty () || !bundle)
+    {
+      return;
+    }
+  
+  BundleLifecycleRecord record;
+  record.id = bundle->GetId ();
+  record.node = m_nodeId;
+  record.event = event;
+  record.time = Simulator::Now ();
+  record.bytes = event == BundleLifecycleEvent::STORED || event == BundleLifecycleEvent::SENT
+                 ? bytes : bundle->GetPayload ().size ();
+  record.cla = cla;
+  m_lifecycleTrace (record);
+}
+
+void 
+DtnNode::SendDeletionReport (Ptr<Bundle> bundle, uint64_t reasonCode)
+{
+  NS_LOG_FUNCTION (this << bundle << reasonCode);
+  
+  if (!m_running || !bundle)
+    {
+      return;
+    }
+  
+  const PrimaryBlock& primary = bundle->GetPrimaryBlock ();
+  
+  // 不为管理记录生成报告，避免报告引发报告
+  if (!primary.RequestsBundleDeletionStatusReport () || bundle->IsAdministrativeRecord () ||
+      primary.GetReportToEID ().IsNone ())
+    {
+      return;
+    }
+  
+  NS_LOG_INFO ("Reporting deletion of " << bundle->GetId ().ToString ()
+               << " to " << primary.GetReportToEID ().ToString () << ", reason " << reasonCode);
+  QueueStatusReport (BundleStatusReport::CreateDeletedReport (bundle, reasonCode, m_nodeId), primary);
+}
+
+void 
+DtnNode::QueueStatusReport (Ptr<BundleStatusReport> report, const PrimaryBlock& primary)
+{
+  NS_LOG_FUNCTION (this << report->ToString ());
+  
+  // 不为管理记录生成报告，避免报告引发报告
+  const EndpointID& reportTo = primary.GetReportToEID ();
+  if (!m_running || primary.IsAdministrativeRecord () || reportTo.IsNone ())
+    {
+      return;
+    }
+  
+  PendingReports& pending = m_pendingReports[reportTo];
+  pending.reports.push_back (*report);
+  pending.lifetime = std::max (pending.lifetime, primary.GetLifetime ());
+  
+  // 攒够一个bundle或不等待时立即发送，否则等其他报告一起发送
+  if (m_reportDelay.IsZero () || pending.reports.size () >= m_maxReportsPerBundle)
+    {
+      PendingReports full = std::move (pending);
+      m_pendingReports.erase (reportTo);
+      SendStatusReports (reportTo, full);
+    }
+  else if (!m_reportEvent.IsPending ())
+    {
+      m_reportEvent = Simulator::Schedule (m_reportDelay, &DtnNode::FlushStatusReports, this);
+    }
+}
+
+void 
+DtnNode::FlushStatusReports ()
+{
+  NS_LOG_FUNCTION (this);
+  
+  Simulator::Cancel (m_reportEvent);
+  std::map<EndpointID, PendingReports> pending;
+  pending.swap (m_pendingReports);
+  for (const auto& pair : pending)
+    {
+      SendStatusReports (pair.first, pair.second);
+    }
+}
+
+void 
+DtnNode::SendStatusReports (const EndpointID& reportTo, const PendingReports& pending)
+{
+  NS_LOG_FUNCTION (this << reportTo.ToString () << pending.reports.size ());
+  
+  if (pending.reports.empty ())
+    {
+      return;
+    }
+  
+  // 单条报告仍以标准状态报告发送
+  Buffer encoded;
+  if (pending.reports.size () == 1)
+    {
+      encoded = pending.reports.front ().ToCbor ();
+    }
+  else
+    {
+      AggregateStatusReport aggregate;
+      for (const BundleStatusReport& report : pending.reports)
+        {
+          aggregate.AddReport (report);
+        }
+      encoded = aggregate.ToCbor ();
+    }
+  std::vector<uint8_t> payload (encoded.PeekData (), encoded.PeekData () + encoded.GetSize ());
+  
+  Bundle reportBundle = Bundle::MustNewBundle (m_nodeId.ToString (), reportTo.ToString (),
+                                               GetDtnNow (), pending.lifetime, payload);
+  reportBundle.GetPrimaryBlock ().SetAdministrativeRecord (true);
+  reportBundle.CalculateCRC ();
+  
+  NS_LOG_INFO ("Sending " << pending.reports.size () << " status reports to " << reportTo.ToString ());
+  m_sentReports += pending.reports.size ();
+  m_sentReportBundles++;
+  Send (Create<Bundle> (reportBundle));
+}
+
+void 
+DtnNode::ReceiveStatusReports (Ptr<Bundle> bundle)
+{
+  NS_LOG_FUNCTION (this << bundle);
+  
+  PayloadBuffer payload = bundle->GetPayload ();
+  std::optional<Ptr<AdministrativeRecord>> record = AdministrativeRecord::FromCbor (payload.data (), payload.size ());
+  if (!record)
+    {
+      NS_LOG_WARN ("Undecodable administrative record " << bundle->GetId ().ToString ());
+      return;
+    }
+  
+  if (Ptr<BundleStatusReport> report = DynamicCast<BundleStatusReport> (*record))
+    {
+      m_statusReportTrace (*report);
+    }
+  else if (Ptr<AggregateStatusReport> aggregate = DynamicCast<AggregateStatusReport> (*record))
+    {
+      for (const BundleStatusReport& report : aggregate->GetReports ())
+        {
+          m_statusReportTrace (report);
+        }
+    }
+}
+
 bool 
 DtnNode::IsDeliverable (Ptr<Bundle> bundle) const
 {
@@ -602,8 +1304,237 @@ DtnNode::IsDeliverable (Ptr<Bundle> bundle) const
   
   const EndpointID& destination = bundle->GetPrimaryBlock ().GetDestinationEID ();
   
-  // 检查此节点是否为目标
-  return destination == m_nodeId;
+  // 检查此节点是否为目标，或目的端点有应用注册
+  if (destination == m_nodeId)
+    {
+      return true;
+    }
+  std::vector<uint32_t> matches;
+  FindRegistrations (destination, matches);
+  return !matches.empty ();
+}
+
+void 
+DtnNode::RegisterBundleCallback (Callback<void, Ptr<Bundle>, NodeID> callback)
+{
+  NS_LOG_FUNCTION (this);
+  m_bundleCallback = callback;
+}
+
+uint32_t 
+DtnNode::RegisterEndpoint (const std::string& endpoint, DeliveryCallback callback)
+{
+  NS_LOG_FUNCTION (this << endpoint);
+  
+  Registration registration;
+  registration.callback = callback;
+  return AddRegistration (endpoint, std::move (registration));
+}
+
+uint32_t 
+DtnNode::RegisterEndpoint (const std::string& endpoint, BatchDeliveryCallback callback)
+{
+  NS_LOG_FUNCTION (this << endpoint);
+  
+  Registration registration;
+  registration.batchCallback = callback;
+  return AddRegistration (endpoint, std::move (registration));
+}
+
+uint32_t 
+DtnNode::RegisterMailbox (const std::string& endpoint, size_t capacity)
+{
+  NS_LOG_FUNCTION (this << endpoint << capacity);
+  
+  Registration registration;
+  registration.capacity = capacity;
+  return AddRegistration (endpoint, std::move (registration));
+}
+
+uint32_t 
+DtnNode::AddRegistration (const std::string& endpoint, Registration registration)
+{
+  // 以"/*"结尾的是服务前缀，保留到最后一个'/'为止
+  registration.prefix = endpoint.size () >= 2 && endpoint.compare (endpoint.size () - 2, 2, "/*") == 0;
+  registration.key = registration.prefix ? endpoint.substr (0, endpoint.size () - 1) : endpoint;
+  if (!registration.prefix && !EndpointID::IsValid (endpoint))
+    {
+      NS_LOG_ERROR ("Invalid endpoint registration " << endpoint);
+      return 0;
+    }
+  
+  uint32_t id = m_nextRegistration++;
+  if (registration.prefix)
+    {
+      m_prefixRegistrations[registration.key].push_back (id);
+    }
+  else
+    {
+      m_endpointRegistrations[EndpointID (endpoint)].push_back (id);
+    }
+  m_registrations.emplace (id, std::move (registration));
+  
+  NS_LOG_INFO ("Registered endpoint " << endpoint << " as " << id);
+  return id;
+}
+
+bool 
+DtnNode::Unregister (uint32_t registration)
+{
+  NS_LOG_FUNCTION (this << registration);
+  
+  auto it = m_registrations.find (registration);
+  if (it == m_registrations.end ())
+    {
+      return false;
+    }
+  
+  auto remove = [registration] (std::vector<uint32_t>& ids) {
+    ids.erase (std::remove (ids.begin (), ids.end (), registration), ids.end ());
+    return ids.empty ();
+  };
+  if (it->second.prefix)
+    {
+      auto prefix = m_prefixRegistrations.find (it->second.key);
+      if (prefix != m_prefixRegistrations.end () && remove (prefix->second))
+        {
+          m_prefixRegistrations.erase (prefix);
+        }
+    }
+  else
+    {
+      auto endpoint = m_endpointRegistrations.find (EndpointID (it->second.key));
+      if (endpoint != m_endpointRegistrations.end () && remove (endpoint->second))
+        {
+          m_endpointRegistrations.erase (endpoint);
+        }
+    }
+  
+  m_registrations.erase (it);
+  return true;
+}
+
+std::vector<Ptr<Bundle>> 
+DtnNode::Poll (uint32_t registration, size_t max)
+{
+  NS_LOG_FUNCTION (this << registration << max);
+  
+  std::vector<Ptr<Bundle>> bundles;
+  auto it = m_registrations.find (registration);
+  if (it == m_registrations.end ())
+    {
+      return bundles;
+    }
+  
+  std::deque<Ptr<Bundle>>& mailbox = it->second.mailbox;
+  size_t count = std::min (max, mailbox.size ());
+  bundles.assign (mailbox.begin (), mailbox.begin () + count);
+  mailbox.erase (mailbox.begin (), mailbox.begin () + count);
+  return bundles;
+}
+
+void 
+DtnNode::FindRegistrations (const EndpointID& destination, std::vector<uint32_t>& matches) const
+{
+  auto endpoint = m_endpointRegistrations.find (destination);
+  if (endpoint != m_endpointRegistrations.end ())
+    {
+      matches.insert (matches.end (), endpoint->second.begin (), endpoint->second.end ());
+    }
+  
+  if (m_prefixRegistrations.empty ())
+    {
+      return;
+    }
+  
+  // 依次查找目的端点在每个'/'处截断的前缀
+  const std::string& uri = destination.ToString ();
+  std::string prefix;
+  prefix.reserve (uri.size ());
+  for (size_t i = 0; i < uri.size (); i++)
+    {
+      prefix.push_back (uri[i]);
+      if (uri[i] != '/')
+        {
+          continue;
+        }
+      auto it = m_prefixRegistrations.find (prefix);
+      if (it != m_prefixRegistrations.end ())
+        {
+          matches.insert (matches.end (), it->second.begin (), it->second.end ());
+        }
+    }
+}
+
+void 
+DtnNode::DeliverLocally (Ptr<Bundle> bundle, const NodeID& source)
+{
+  NS_LOG_FUNCTION (this << bundle);
+  
+  std::vector<uint32_t> matches;
+  FindRegistrations (bundle->GetPrimaryBlock ().GetDestinationEID (), matches);
+  
+  for (uint32_t id : matches)
+    {
+      // 回调可能注销其他注册
+      auto it = m_registrations.find (id);
+      if (it == m_registrations.end ())
+        {
+          continue;
+        }
+      Registration& registration = it->second;
+      
+      if (!registration.callback.IsNull ())
+        {
+          registration.callback (bundle);
+        }
+      else if (!registration.batchCallback.IsNull ())
+        {
+          if (registration.batch.empty ())
+            {
+              m_pendingBatches.push_back (id);
+            }
+          registration.batch.push_back (bundle);
+          if (!m_batchEvent.IsPending ())
+            {
+              m_batchEvent = Simulator::ScheduleNow (&DtnNode::FlushBatches, this);
+            }
+        }
+      else
+        {
+          if (registration.capacity > 0 && registration.mailbox.size () >= registration.capacity)
+            {
+              registration.mailbox.pop_front ();
+              m_droppedDeliveries++;
+            }
+          registration.mailbox.push_back (bundle);
+        }
+    }
+  
+  if (!m_bundleCallback.IsNull ())
+    {
+      m_bundleCallback (bundle, source);
+    }
+}
+
+void 
+DtnNode::FlushBatches ()
+{
+  NS_LOG_FUNCTION (this);
+  
+  std::vector<uint32_t> pending;
+  pending.swap (m_pendingBatches);
+  for (uint32_t id : pending)
+    {
+      auto it = m_registrations.find (id);
+      if (it == m_registrations.end ())
+        {
+          continue;
+        }
+      std::vector<Ptr<Bundle>> batch;
+      batch.swap (it->second.batch);
+      it->second.batchCallback (batch);
+    }
 }
 
 } // namespace dtn7
@@ -12,20 +12,61 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <map>
+#include <deque>
+#include <limits>
+#include <unordered_map>
 
+#include "administrative-record.h"
 #include "bundle.h"
+#include "bundle-lifecycle.h"
 #include "endpoint.h"
 #include "convergence-layer.h"
 #include "routing.h"
 #include "bundle-store.h"
+#include "metrics.h"
 #include "fragmentation-manager.h"
+#include "discovery.h"
 namespace ns3 {
 
 namespace dtn7 {
 
+/**
+ * \brief Callback for a bundle delivered to a registered endpoint
+ */
+typedef Callback<void, Ptr<Bundle>> DeliveryCallback;
+
+/**
+ * \brief Callback for the bundles delivered to a registered endpoint
+ * during one simulator event
+ */
+typedef Callback<void, const std::vector<Ptr<Bundle>>&> BatchDeliveryCallback;
+
 /**
  * \ingroup dtn7
  * \brief DTN node application
+ *
+ * Expired bundles are cleaned up and queued bundles dispatched
+ * periodically. With SharedTimers, which is the default, all running
+ * nodes with the same interval share one simulator event per task
+ * instead of each scheduling its own, so large populations do not fill
+ * the event queue with timers. Each interval is divided into
+ * SharedTimerSlots phases, and a node joins the group of the phase it
+ * starts in, so nodes with staggered start times keep their tasks
+ * staggered at that granularity.
+ *
+ * Applications register the endpoints they receive bundles for. A
+ * registration is an endpoint ID or a service prefix, and receives its
+ * bundles one by one, batched per simulator event, or through a mailbox
+ * the application polls.
+ *
+ * Status reports for the same report-to endpoint are collected for
+ * StatusReportDelay and sent together as one AggregateStatusReport
+ * bundle, or earlier once MaxReportsPerBundle are waiting.
+ *
+ * The BundleLifecycle trace source reports each step of a bundle at this
+ * node with its ID, so a BundleLifecycleTracker connected to all nodes
+ * can follow bundles across hops.
  */
 class DtnNode : public Application
 {
@@ -58,6 +99,16 @@ public:
    */
   NodeID GetNodeId () const;
   
+  /**
+   * \brief Get the node's metrics
+   *
+   * The node, its routing algorithm, store, fragmentation manager and
+   * convergence layers count into this registry once the application has
+   * started; see Dtn7Helper::WriteMetrics for exporting it.
+   * \return Metrics registry
+   */
+  Ptr<MetricsRegistry> GetMetrics () const;
+  
   /**
    * \brief Add a convergence layer
    * \param cla Convergence layer
@@ -77,9 +128,38 @@ public:
   void SetBundleStore (Ptr<BundleStore> store);
   
   /**
-   * \brief Send a bundle
-   * \param bundle Bundle to send
-   * \return true if bundle was added to the store
+   * \brief Set the discovery agent
+   *
+   * The node announces its convergence layer endpoints through the agent
+   * and learns which node ID is behind each peer endpoint from the
+   * beacons it receives.
+   * \param agent Discovery agent, may be null
+   */
+  void SetDiscoveryAgent (Ptr<DiscoveryAgent> agent);
+  
+  /**
+   * \brief Get the discovery agent
+   * \return Discovery agent, null if none is set
+   */
+  Ptr<DiscoveryAgent> GetDiscoveryAgent () const;
+  
+  /**
+   * \brief Look up the node ID behind a peer endpoint
+   * \param endpoint Convergence layer endpoint of the peer
+   * \param nodeId Receives the node ID if known
+   * \return true if the endpoint has been resolved
+   */
+  bool ResolvePeer (const std::string& endpoint, NodeID& nodeId) const;
+  
+  /**
+   * \brief Fragment a bundle for a given size and hand the fragments to routing
+   *
+   * Bundles larger than the MTU of the convergence layer they are sent
+   * through are fragmented by the routing algorithm anyway; this is for
+   * fragmenting ahead of time.
+   * \param bundle Bundle to fragment
+   * \param maxFragmentSize Maximum encoded size of a fragment
+   * \return true if the bundle was fragmented
    */
   bool FragmentIfNeeded (Ptr<Bundle> bundle, size_t maxFragmentSize);
 
@@ -133,7 +213,64 @@ Ptr<FragmentationManager> GetFragmentationManager () const;
    */
   void LogReceivedBundle (Ptr<Bundle> bundle);
 
+  /**
+   * \brief Register a callback for every bundle delivered to this node
+   * \param callback Function called with each delivered bundle and its source
+   */
   void RegisterBundleCallback(Callback<void, Ptr<Bundle>, NodeID> callback);
+  
+  /**
+   * \brief Register an application endpoint
+   *
+   * Bundles delivered to the endpoint are passed to the callback as they
+   * arrive. An endpoint ending in "/*" registers a service prefix that
+   * matches every endpoint below it, e.g. "dtn://node1/news/*" matches
+   * "dtn://node1/news/sports". Finding the registrations of a bundle
+   * costs one hash lookup per path level of its destination, however
+   * many endpoints are registered.
+   * \param endpoint Endpoint ID or service prefix
+   * \param callback Delivery callback
+   * \return Registration ID, 0 if the endpoint is invalid
+   */
+  uint32_t RegisterEndpoint (const std::string& endpoint, DeliveryCallback callback);
+  
+  /**
+   * \brief Register an application endpoint with batched delivery
+   *
+   * The bundles delivered to the endpoint during one simulator event are
+   * passed to the callback together, once the event has been processed.
+   * \param endpoint Endpoint ID or service prefix
+   * \param callback Batch delivery callback
+   * \return Registration ID, 0 if the endpoint is invalid
+   */
+  uint32_t RegisterEndpoint (const std::string& endpoint, BatchDeliveryCallback callback);
+  
+  /**
+   * \brief Register an application endpoint whose bundles wait to be polled
+   * \param endpoint Endpoint ID or service prefix
+   * \param capacity Maximum number of waiting bundles, beyond which the
+   *        oldest are dropped, 0 for no limit
+   * \return Registration ID, 0 if the endpoint is invalid
+   */
+  uint32_t RegisterMailbox (const std::string& endpoint, size_t capacity);
+  
+  /**
+   * \brief Take the bundles waiting in a mailbox
+   * \param registration Mailbox registration ID
+   * \param max Maximum number of bundles to take
+   * \return Bundles, oldest first
+   */
+  std::vector<Ptr<Bundle>> Poll (uint32_t registration,
+                                 size_t max = std::numeric_limits<size_t>::max ());
+  
+  /**
+   * \brief Remove an endpoint registration
+   *
+   * Bundles still waiting in its batch or mailbox are discarded.
+   * \param registration Registration ID
+   * \return true if the registration existed
+   */
+  bool Unregister (uint32_t registration);
 
 protected:
   // Inherited from Application
@@ -152,14 +289,69 @@ private:
   bool m_running;                                  //!< Whether the node is running
   Time m_cleanupInterval;                          //!< Interval for cleanup
   Time m_routingInterval;                          //!< Interval for routing
-  EventId m_cleanupEvent;                          //!< Event for cleanup
-  EventId m_routingEvent;                          //!< Event for routing
+  EventId m_cleanupEvent;                          //!< Event for cleanup, unused with shared timers
+  EventId m_routingEvent;                          //!< Event for routing, unused with shared timers
+  bool m_sharedTimers;                             //!< Whether periodic tasks run from shared events
+  uint32_t m_sharedTimerSlots;                     //!< Number of shared timer phases per interval
+  
+  Ptr<DiscoveryAgent> m_discovery;                 //!< Discovery agent, may be null
+  
+  std::map<std::string, PeerInfo> m_peerConnections; //!< Connected peers by CLA and peer endpoint
+  std::map<std::string, PeerInfo> m_unresolvedConnections; //!< Connections whose node ID is not known yet
+  std::map<std::string, NodeID> m_endpointNodeIds;   //!< Peer node IDs by endpoint, from handshakes, beacons and bundles
   
   uint64_t m_receivedBundles;                      //!< Number of received bundles
   uint64_t m_deliveredBundles;                     //!< Number of delivered bundles
+  uint64_t m_knownBundles;                         //!< Received bundles dropped as already known
+  Ptr<MetricsRegistry> m_metrics;                  //!< Counters and latency histograms
+  MetricCounter* m_receivedCounter;                //!< Received bundles
+  MetricCounter* m_deliveredCounter;               //!< Delivered bundles
+  MetricCounter* m_duplicateCounter;               //!< Received bundles dropped as duplicates
+  LatencyHistogram* m_deliveryLatency;             //!< Creation to delivery latency
+  
+  /**
+   * \brief Application endpoint registration
+   */
+  struct Registration
+  {
+    std::string key;                     //!< Endpoint ID, or service prefix up to its last '/'
+    bool prefix = false;                 //!< Whether key is a service prefix
+    DeliveryCallback callback;           //!< Per bundle callback, may be null
+    BatchDeliveryCallback batchCallback; //!< Batch callback, may be null
+    std::vector<Ptr<Bundle>> batch;      //!< Bundles waiting for the batch callback
+    std::deque<Ptr<Bundle>> mailbox;     //!< Bundles waiting to be polled, if there is no callback
+    size_t capacity = 0;                 //!< Maximum mailbox size, 0 for no limit
+  };
+  
+  std::unordered_map<uint32_t, Registration> m_registrations;                      //!< Registrations by ID
+  std::unordered_map<EndpointID, std::vector<uint32_t>> m_endpointRegistrations;   //!< Registration IDs by endpoint
+  std::unordered_map<std::string, std::vector<uint32_t>> m_prefixRegistrations;   //!< Registration IDs by service prefix
+  std::vector<uint32_t> m_pendingBatches;                                          //!< Registrations with a non-empty batch
+  EventId m_batchEvent;                                                            //!< Event flushing the batches
+  uint32_t m_nextRegistration;                                                     //!< Next registration ID
+  uint64_t m_droppedDeliveries;                                                    //!< Bundles dropped from full mailboxes
+  Callback<void, Ptr<Bundle>, NodeID> m_bundleCallback;                            //!< Callback for every delivered bundle
+  
+  /**
+   * \brief Status reports waiting to be sent to one report-to endpoint
+   */
+  struct PendingReports
+  {
+    std::vector<BundleStatusReport> reports; //!< Reports, oldest first
+    Time lifetime;                           //!< Longest lifetime of the reported bundles
+  };
+  
+  std::map<EndpointID, PendingReports> m_pendingReports;   //!< Waiting reports by report-to endpoint
+  EventId m_reportEvent;                                   //!< Event sending the waiting reports
+  Time m_reportDelay;                                      //!< How long reports wait for others, 0 to send each at once
+  uint32_t m_maxReportsPerBundle;                          //!< Reports that trigger sending at once
+  uint64_t m_sentReports;                                  //!< Number of status reports sent
+  uint64_t m_sentReportBundles;                            //!< Number of bundles carrying them
+  TracedCallback<const BundleStatusReport&> m_statusReportTrace; //!< Trace for status reports delivered to this node
   
   TracedCallback<Ptr<Bundle>> m_bundleReceivedTrace;  //!< Trace for received bundles
   TracedCallback<Ptr<Bundle>> m_bundleDeliveredTrace; //!< Trace for delivered bundles
+  TracedCallback<const BundleLifecycleRecord&> m_lifecycleTrace; //!< Trace for lifecycle events of bundles at this node
   
   /**
    * \brief Handle a received bundle
@@ -168,6 +360,14 @@ private:
    */
   void HandleReceivedBundle (Ptr<Bundle> bundle, NodeID source);
   
+  /**
+   * \brief Check whether a received bundle is already known, for the
+   * convergence layers to drop duplicates before decoding them
+   * \param id Bundle ID from the primary block
+   * \return true if the bundle can be dropped
+   */
+  bool IsKnownBundle (const BundleID& id);
+  
   /**
    * \brief Periodic cleanup of expired bundles
    */
@@ -178,18 +378,227 @@ private:
    */
   void RoutingTask ();
   
+  /**
+   * \brief Running nodes whose periodic task shares one event
+   */
+  struct TimerGroup
+  {
+    std::vector<DtnNode*> nodes; //!< Nodes in the group
+    EventId event;               //!< Pending event of the group
+  };
+  
+  /**
+   * \brief Get the shared timer groups of one periodic task
+   * \param routing true for the routing task, false for cleanup
+   * \return Groups by interval in time steps and phase slot
+   */
+  static std::map<std::pair<int64_t, uint32_t>, TimerGroup>& GetTimerGroups (bool routing);
+  
+  /**
+   * \brief Add this node to the shared timer groups of its intervals
+   */
+  void JoinTimerGroups ();
+  
+  /**
+   * \brief Remove this node from the shared timer groups
+   */
+  void LeaveTimerGroups ();
+  
+  /**
+   * \brief Schedule one periodic task on every node of a group, each in
+   * the context of its node, and reschedule the group
+   * \param routing true for the routing task, false for cleanup
+   * \param interval Interval of the group
+   * \param slot Phase slot of the group
+   */
+  static void RunTimerGroup (bool routing, Time interval, uint32_t slot);
+  
+  /**
+   * \brief Run one periodic task of a timer group on this node
+   * \param routing true for the routing task, false for cleanup
+   */
+  void RunSharedTask (bool routing);
+  
   /**
    * \brief Update peer information
    * \param peer Peer information
    */
   void UpdatePeer (const PeerInfo& peer);
   
+  /**
+   * \brief Connection state callback registered with each convergence layer
+   *
+   * Defers the change to its own event, so routing never runs inside a
+   * convergence layer call (e.g. a Send issued by DispatchBundles).
+   * \param cla Endpoint of the reporting convergence layer
+   * \param endpoint Peer endpoint
+   * \param nodeId Peer node ID, empty if unknown
+   * \param up true if the connection came up
+   */
+  void HandleConnectionChanged (const std::string& cla, const std::string& endpoint,
+                                const std::string& nodeId, bool up);
+  
+  /**
+   * \brief Notify routing of a peer appearing or disappearing
+   * \param cla Endpoint of the reporting convergence layer
+   * \param endpoint Peer endpoint
+   * \param nodeId Peer node ID, empty if unknown
+   * \param up true if the connection came up
+   */
+  void ProcessConnectionChange (std::string cla, std::string endpoint, std::string nodeId, bool up);
+  
+  /**
+   * \brief Discovery callback, records the node ID behind an endpoint
+   *
+   * Deferred to its own event like HandleConnectionChanged.
+   * \param nodeId Node ID announced in the beacon
+   * \param service Announced service
+   * \param endpoint Endpoint of the service
+   */
+  void HandleDiscovery (const std::string& nodeId, const std::string& service,
+                        const std::string& endpoint);
+  
+  /**
+   * \brief Record the node ID behind an endpoint and resolve waiting connections
+   * \param endpoint Peer endpoint
+   * \param nodeId Peer node ID
+   */
+  void LearnPeer (std::string endpoint, std::string nodeId);
+  
+  /**
+   * \brief Discovery callback for a peer whose beacons stopped
+   *
+   * Deferred to its own event like HandleConnectionChanged.
+   * \param nodeId Node ID of the lost peer
+   */
+  void HandlePeerLost (const std::string& nodeId);
+  
+  /**
+   * \brief Take down the connections of a lost peer and notify routing
+   *
+   * The connections wait as unresolved until the peer is discovered
+   * again or its convergence layer reports them down.
+   * \param nodeId Node ID of the lost peer
+   */
+  void ProcessPeerLost (std::string nodeId);
+  
+  /**
+   * \brief Attach a resolved connection to a peer and notify routing
+   * \param key Connection key, CLA and peer endpoint
+   * \param peer Peer information with the resolved node ID
+   */
+  void ConnectPeer (const std::string& key, const PeerInfo& peer);
+  
+  /**
+   * \brief Notify routing of a disappeared peer once no connection maps to it
+   * \param nodeId Peer node ID
+   */
+  void ReleasePeer (const NodeID& nodeId);
+  
+  /**
+   * \brief Deletion callback registered with the bundle store
+   *
+   * Deferred to its own event, so the report is not stored while the
+   * store is still making room.
+   * \param bundle Bundle the store deleted
+   * \param reasonCode Status report reason code
+   */
+  void HandleBundleDeleted (Ptr<Bundle> bundle, uint64_t reasonCode);
+  
+  /**
+   * \brief Storage callback registered with the bundle store
+   * \param bundle Stored bundle
+   * \param size Encoded size in bytes
+   */
+  void HandleBundleStored (Ptr<Bundle> bundle, uint64_t size);
+  
+  /**
+   * \brief Send callback registered with the routing algorithm
+   * \param bundle Sent bundle
+   * \param receiver Receiving peer
+   * \param size Encoded size of the sent copy
+   * \param sender Convergence layer the bundle was handed to
+   */
+  void HandleBundleTransmitted (Ptr<Bundle> bundle, const NodeID& receiver, uint64_t size,
+                                Ptr<ConvergenceSender> sender);
+  
+  /**
+   * \brief Fire the lifecycle trace if anything is connected to it
+   * \param event Event
+   * \param bundle Bundle
+   * \param bytes Encoded bytes for STORED and SENT, the payload size is
+   * reported for the other events
+   * \param cla Convergence layer type, empty if not known
+   */
+  void TraceLifecycle (BundleLifecycleEvent event, Ptr<Bundle> bundle, uint64_t bytes = 0,
+                       const std::string& cla = "");
+  
+  /**
+   * \brief Send a deletion status report if the bundle requested one
+   * \param bundle Deleted bundle
+   * \param reasonCode Status report reason code
+   */
+  void SendDeletionReport (Ptr<Bundle> bundle, uint64_t reasonCode);
+  
+  /**
+   * \brief Queue a status report for a bundle that requested it
+   * \param report Status report
+   * \param primary Primary block of the reported bundle
+   */
+  void QueueStatusReport (Ptr<BundleStatusReport> report, const PrimaryBlock& primary);
+  
+  /**
+   * \brief Send all waiting status reports
+   */
+  void FlushStatusReports ();
+  
+  /**
+   * \brief Send the status reports waiting for one report-to endpoint in one bundle
+   * \param reportTo Report-to endpoint
+   * \param pending Waiting reports
+   */
+  void SendStatusReports (const EndpointID& reportTo, const PendingReports& pending);
+  
+  /**
+   * \brief Unpack the status reports of an administrative record
+   * delivered to this node and pass each to the StatusReport trace
+   * \param bundle Delivered administrative record
+   */
+  void ReceiveStatusReports (Ptr<Bundle> bundle);
+  
   /**
    * \brief Check if a bundle is deliverable
    * \param bundle Bundle to check
    * \return true if bundle is deliverable to this node
    */
   bool IsDeliverable (Ptr<Bundle> bundle) const;
+  
+  /**
+   * \brief Add an endpoint registration
+   * \param endpoint Endpoint ID or service prefix
+   * \param registration Registration, its key is filled in
+   * \return Registration ID, 0 if the endpoint is invalid
+   */
+  uint32_t AddRegistration (const std::string& endpoint, Registration registration);
+  
+  /**
+   * \brief Find the registrations matching a destination
+   * \param destination Destination endpoint
+   * \param matches Receives the registration IDs
+   */
+  void FindRegistrations (const EndpointID& destination, std::vector<uint32_t>& matches) const;
+  
+  /**
+   * \brief Hand a delivered bundle to the matching registrations
+   * \param bundle Delivered bundle
+   * \param source Node the bundle came from
+   */
+  void DeliverLocally (Ptr<Bundle> bundle, const NodeID& source);
+  
+  /**
+   * \brief Pass the batches collected during an event to their callbacks
+   */
+  void FlushBatches ();
 };
 
 } // namespace dtn7
@@ -1,5 +1,6 @@
 #include "dtn-time.h"
 #include "ns3/simulator.h"
+#include <cctype>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
@@ -123,6 +124,47 @@ DtnTime::ToString() const
   return ss.str();
 }
 
+std::optional<DtnTime> 
+DtnTime::FromString(const std::string& str)
+{
+  std::istringstream ss(str);
+  struct tm timeinfo = {};
+  ss >> std::get_time(&timeinfo, "%Y-%m-%dT%H:%M:%S");
+  if (ss.fail())
+    {
+      return std::nullopt;
+    }
+  
+  // Optional nanoseconds, always written with nine digits
+  uint64_t nanoseconds = 0;
+  if (ss.peek() == '.')
+    {
+      ss.get();
+      std::string digits;
+      while (std::isdigit(ss.peek()))
+        {
+          digits.push_back(static_cast<char>(ss.get()));
+        }
+      if (digits.size() != 9)
+        {
+          return std::nullopt;
+        }
+      nanoseconds = std::stoull(digits);
+    }
+  
+  if (ss.get() != 'Z' || ss.peek() != std::char_traits<char>::eof())
+    {
+      return std::nullopt;
+    }
+  
+  time_t unixTime = timegm(&timeinfo);
+  if (unixTime < static_cast<time_t>(DTN_TIME_EPOCH))
+    {
+      return std::nullopt;
+    }
+  return DtnTime(static_cast<uint64_t>(unixTime - DTN_TIME_EPOCH), nanoseconds);
+}
+
 DtnTime 
 GetDtnNow()
 {
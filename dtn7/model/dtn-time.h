@@ -4,6 +4,7 @@
 #include "ns3/nstime.h"
 
 #include <cstdint>
+#include <optional>
 #include <string>
 
 namespace ns3 {
@@ -107,6 +108,13 @@ public:
    * \return Time string
    */
   std::string ToString () const;
+  
+  /**
+   * \brief Parse the string representation written by ToString
+   * \param str Time string
+   * \return DTN time, empty if the string is malformed
+   */
+  static std::optional<DtnTime> FromString (const std::string& str);
 
 private:
   uint64_t m_dtnTimeSeconds;      //!< DTN time seconds since DTN epoch
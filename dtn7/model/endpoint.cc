@@ -1,77 +1,78 @@
 #include "endpoint.h"
 #include "cbor.h"
+#include "optional-mutex.h"
+#include <deque>
+#include <mutex>
 #include <regex>
 #include <sstream>
+#include <unordered_map>
 
 namespace ns3 {
 
 namespace dtn7 {
 
 EndpointID::EndpointID()
-  : m_scheme("dtn"),
-    m_ssp("none"),
-    m_uri("dtn:none")
 {
+  static const Entry* none = Intern("dtn:none");
+  m_entry = none;
 }
 
 EndpointID::EndpointID(const std::string& eid)
-  : m_uri(eid)
+  : m_entry(Intern(eid))
 {
-  if (eid.empty())
-    {
-      // Default to dtn:none
-      m_scheme = "dtn";
-      m_ssp = "none";
-      m_uri = "dtn:none";
-      return;
-    }
+}
+
+const EndpointID::Entry* 
+EndpointID::Intern(const std::string& eid)
+{
+  // Never destroyed, so EIDs stay valid during static destruction
+  static OptionalMutex* mutex = new OptionalMutex;
+  static auto* table = new std::unordered_map<std::string, const Entry*>;
+  static auto* entries = new std::deque<Entry>;
   
-  size_t schemeEnd = eid.find(':');
-  if (schemeEnd == std::string::npos)
+  std::lock_guard<OptionalMutex> lock(*mutex);
+  auto it = table->find(eid);
+  if (it != table->end())
     {
-      // No scheme, assume malformed and default to dtn:none
-      m_scheme = "dtn";
-      m_ssp = "none";
-      m_uri = "dtn:none";
-      return;
+      return it->second;
     }
   
-  m_scheme = eid.substr(0, schemeEnd);
-  m_ssp = eid.substr(schemeEnd + 1);
-  
-  if (m_scheme == "dtn")
+  // Empty, malformed or unknown scheme: default to dtn:none
+  std::string uri = "dtn:none";
+  size_t schemeEnd = eid.find(':');
+  if (schemeEnd != std::string::npos)
     {
-      if (!ParseDtn(eid))
+      std::string scheme = eid.substr(0, schemeEnd);
+      if ((scheme == "dtn" && ParseDtn(eid)) || (scheme == "ipn" && ParseIpn(eid)))
         {
-          // Reset to dtn:none on parsing failure
-          m_scheme = "dtn";
-          m_ssp = "none";
-          m_uri = "dtn:none";
+          uri = eid;
         }
     }
-  else if (m_scheme == "ipn")
+  
+  const Entry* entry;
+  auto canonical = table->find(uri);
+  if (canonical != table->end())
     {
-      if (!ParseIpn(eid))
-        {
-          // Reset to dtn:none on parsing failure
-          m_scheme = "dtn";
-          m_ssp = "none";
-          m_uri = "dtn:none";
-        }
+      entry = canonical->second;
     }
   else
     {
-      // Unknown scheme, default to dtn:none
-      m_scheme = "dtn";
-      m_ssp = "none";
-      m_uri = "dtn:none";
+      size_t separator = uri.find(':');
+      entries->push_back({uri.substr(0, separator), uri.substr(separator + 1), uri,
+                          std::hash<std::string>{}(uri)});
+      entry = &entries->back();
+      table->emplace(uri, entry);
     }
+  
+  // Malformed input is not remembered, so EIDs received from the network
+  // cannot grow the table
+  return entry;
 }
 
 bool 
 EndpointID::operator==(const EndpointID& other) const
 {
-  return m_uri == other.m_uri;
+  return m_entry == other.m_entry;
 }
 
 bool 
@@ -83,7 +84,7 @@ EndpointID::operator!=(const EndpointID& other) const
 bool 
 EndpointID::operator<(const EndpointID& other) const
 {
-  return m_uri < other.m_uri;
+  return m_entry != other.m_entry && m_entry->uri < other.m_entry->uri;
 }
 
 bool 
@@ -128,21 +129,21 @@ EndpointID::Parse(const std::string& eid)
   return std::nullopt;
 }
 
-std::string 
+const std::string& 
 EndpointID::ToString() const
 {
-  return m_uri;
+  return m_entry->uri;
 }
 
 bool 
 EndpointID::IsSingleton() const
 {
-  if (m_scheme == "dtn")
+  if (m_entry->scheme == "dtn")
     {
       // DTN singleton: not a group EID (no '*' wildcard)
-      return m_ssp.find('*') == std::string::npos;
+      return m_entry->ssp.find('*') == std::string::npos;
     }
-  else if (m_scheme == "ipn")
+  else if (m_entry->scheme == "ipn")
     {
       // IPN EIDs are always singletons
       return true;
@@ -154,19 +155,19 @@ EndpointID::IsSingleton() const
 bool 
 EndpointID::IsNone() const
 {
-  return m_scheme == "dtn" && m_ssp == "none";
+  return m_entry->scheme == "dtn" && m_entry->ssp == "none";
 }
 
 bool 
 EndpointID::IsDtn() const
 {
-  return m_scheme == "dtn";
+  return m_entry->scheme == "dtn";
 }
 
 bool 
 EndpointID::IsIpn() const
 {
-  return m_scheme == "ipn";
+  return m_entry->scheme == "ipn";
 }
 
 std::string 
@@ -178,7 +179,7 @@ EndpointID::GetDtnHost() const
     }
   
   // Extract host part from DTN SSP
-  std::string host = m_ssp;
+  std::string host = m_entry->ssp;
   if (host.substr(0, 2) == "//")
     {
       host = host.substr(2);
@@ -202,7 +203,7 @@ EndpointID::GetDtnService() const
     }
   
   // Extract service part from DTN SSP
-  std::string ssp = m_ssp;
+  std::string ssp = m_entry->ssp;
   if (ssp.substr(0, 2) == "//")
     {
       ssp = ssp.substr(2);
@@ -226,12 +227,12 @@ EndpointID::GetIpnNode() const
     }
   
   // Extract node number from IPN SSP
-  size_t dotPos = m_ssp.find('.');
+  size_t dotPos = m_entry->ssp.find('.');
   if (dotPos != std::string::npos)
     {
       try
         {
-          return std::stoull(m_ssp.substr(0, dotPos));
+          return std::stoull(m_entry->ssp.substr(0, dotPos));
         }
       catch (const std::exception&)
         {
@@ -251,12 +252,12 @@ EndpointID::GetIpnService() const
     }
   
   // Extract service number from IPN SSP
-  size_t dotPos = m_ssp.find('.');
+  size_t dotPos = m_entry->ssp.find('.');
   if (dotPos != std::string::npos)
     {
       try
         {
-          return std::stoull(m_ssp.substr(dotPos + 1));
+          return std::stoull(m_entry->ssp.substr(dotPos + 1));
         }
       catch (const std::exception&)
         {
@@ -271,39 +272,42 @@ Buffer
 EndpointID::ToCbor() const
 {
   // Create a CBOR array with two elements: scheme and SSP
-  Cbor::CborArray array = {
-    Cbor::CborValue(m_scheme),
-    Cbor::CborValue(m_ssp)
-  };
+  Buffer buffer;
+  buffer.AddAtStart(1 + CborWriter::StringSize(m_entry->scheme.size()) + CborWriter::StringSize(m_entry->ssp.size()));
+  CborWriter writer(buffer.Begin());
+  writer.WriteArrayHeader(2);
+  writer.WriteTextString(m_entry->scheme);
+  writer.WriteTextString(m_entry->ssp);
   
-  return Cbor::Encode(Cbor::CborValue(array));
+  return buffer;
 }
 
 std::optional<EndpointID> 
 EndpointID::FromCbor(Buffer buffer)
 {
-  auto cborOpt = Cbor::Decode(buffer);
-  if (!cborOpt)
-    {
-      return std::nullopt;
-    }
-  
-  const auto& cbor = *cborOpt;
-  if (!cbor.IsArray())
-    {
-      return std::nullopt;
-    }
-  
-  const auto& array = cbor.GetArray();
-  if (array.size() != 2 || !array[0].IsTextString() || !array[1].IsTextString())
+  CborReader reader(buffer.PeekData(), buffer.GetSize());
+  return ReadCbor(reader);
+}
+
+std::optional<EndpointID> 
+EndpointID::ReadCbor(CborReader& reader)
+{
+  // A CBOR array with two text strings: scheme and SSP
+  uint64_t count;
+  const char* scheme;
+  size_t schemeLength;
+  const char* ssp;
+  size_t sspLength;
+  if (!reader.ReadArrayHeader(count) || count != 2 ||
+      !reader.ReadTextString(scheme, schemeLength) ||
+      !reader.ReadTextString(ssp, sspLength))
     {
       return std::nullopt;
     }
   
-  std::string scheme = array[0].GetTextString();
-  std::string ssp = array[1].GetTextString();
-  
-  std::string uri = scheme + ":" + ssp;
+  std::string uri;
+  uri.reserve(schemeLength + 1 + sspLength);
+  uri.append(scheme, schemeLength).append(1, ':').append(ssp, sspLength);
   return EndpointID(uri);
 }
 
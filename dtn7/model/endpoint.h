@@ -11,9 +11,18 @@ namespace ns3 {
 
 namespace dtn7 {
 
+class CborReader;
+
 /**
  * \ingroup dtn7
  * \brief Endpoint ID for DTN nodes
+ *
+ * EIDs are interned: every distinct URI is parsed once and stored in a
+ * process-wide table together with its hash, and an EndpointID is only
+ * a pointer into that table. Copying, comparing for equality and
+ * hashing never touch the strings. Malformed strings map to dtn:none
+ * and are not stored. The table is locked only when Dtn7ThreadSafe was
+ * set before the first EID was created.
  */
 class EndpointID
 {
@@ -68,7 +77,7 @@ public:
    * \brief Get string representation
    * \return EID as string
    */
-  std::string ToString () const;
+  const std::string& ToString () const;
   
   /**
    * \brief Check if EID is a singleton
@@ -130,33 +139,54 @@ public:
    * \return Deserialized endpoint ID
    */
   static std::optional<EndpointID> FromCbor (Buffer buffer);
+  
+  /**
+   * \brief Deserialize from a CBOR reader positioned at the endpoint ID
+   * \param reader CBOR reader, advanced past the endpoint ID on success
+   * \return Deserialized endpoint ID
+   */
+  static std::optional<EndpointID> ReadCbor (CborReader& reader);
 
   /**
    * \brief Calculate hash for this endpoint ID
    * \return Hash value
    */
-  size_t Hash() const {
-    return std::hash<std::string>{}(m_uri);
-  }
+  size_t Hash () const { return m_entry->hash; }
 
 private:
-  std::string m_scheme;     //!< Scheme part of EID (dtn or ipn)
-  std::string m_ssp;        //!< Scheme-specific part
-  std::string m_uri;        //!< Complete URI string
+  /**
+   * \brief Interned EID, immutable and never freed
+   */
+  struct Entry
+  {
+    std::string scheme;   //!< Scheme part of EID (dtn or ipn)
+    std::string ssp;      //!< Scheme-specific part
+    std::string uri;      //!< Complete URI string
+    size_t hash;          //!< Hash of the URI
+  };
+  
+  const Entry* m_entry;   //!< Interned EID, unique per URI
+  
+  /**
+   * \brief Find or create the interned entry for an EID string
+   * \param eid Endpoint ID string, malformed strings map to dtn:none
+   * \return Interned entry
+   */
+  static const Entry* Intern (const std::string& eid);
   
   /**
    * \brief Parse DTN scheme URI
    * \param uri URI string
    * \return true if successful
    */
-  bool ParseDtn (const std::string& uri);
+  static bool ParseDtn (const std::string& uri);
   
   /**
    * \brief Parse IPN scheme URI
    * \param uri URI string
    * \return true if successful
    */
-  bool ParseIpn (const std::string& uri);
+  static bool ParseIpn (const std::string& uri);
 };
 
 /**
@@ -1,5 +1,9 @@
 #include "epidemic-routing.h"
 #include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
 #include <sstream>
 #include <functional> // 添加这行来支持哈希函数
 namespace ns3 {
@@ -17,11 +21,38 @@ EpidemicRouting::GetTypeId ()
     .SetParent<RoutingAlgorithm> ()
     .SetGroupName ("Dtn7")
     .AddConstructor<EpidemicRouting> ()
+    .AddAttribute ("SummaryVector",
+                   "Whether to exchange summary vectors on contact and only send missing bundles",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&EpidemicRouting::m_summaryEnabled),
+                   MakeBooleanChecker ())
+    .AddAttribute ("SummaryTimeout",
+                   "How long to hold bundles for a new peer while waiting for its summary vector",
+                   TimeValue (Seconds (2)),
+                   MakeTimeAccessor (&EpidemicRouting::m_summaryTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("SummaryLifetime",
+                   "Lifetime of summary vector bundles",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&EpidemicRouting::m_summaryLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("BloomThreshold",
+                   "Number of stored bundles above which summaries are sent as Bloom filters",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&EpidemicRouting::m_bloomThreshold),
+                   MakeUintegerChecker<uint32_t> ())
   ;
   return tid;
 }
 
 EpidemicRouting::EpidemicRouting ()
+  : m_summaryEnabled (true),
+    m_summaryTimeout (Seconds (2)),
+    m_summaryLifetime (Seconds (60)),
+    m_bloomThreshold (1024),
+    m_summariesSent (0),
+    m_summariesReceived (0),
+    m_suppressedBundles (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -47,7 +78,7 @@ EpidemicRouting::NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source)
   BundleDescriptor& desc = UpdateBundleDescriptor (bundle);
   
   // Mark as sent to source node
-  desc.AddSentNode (source);
+  desc.AddSentNode (GetPeerIndex (source));
   
   NS_LOG_INFO ("Added new bundle from " << source.ToString () << " to store");
 }
@@ -58,13 +89,23 @@ EpidemicRouting::NotifyPeerAppeared (const PeerInfo& peer)
   NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
   
   // Store peer information
+  bool newContact = false;
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    newContact = m_peers.find (peer.nodeID) == m_peers.end ();
     m_peers[peer.nodeID] = peer;
   }
   
   NS_LOG_INFO ("Peer appeared: " << peer.nodeID.ToString ());
   
+  // Start the summary exchange; bundles wait for the peer's summary
+  if (m_summaryEnabled && newContact && SendSummary (peer))
+    {
+      std::lock_guard<OptionalMutex> lock (m_peersMutex);
+      PeerSummary& state = m_summaries[peer.nodeID];
+      state.requested = Simulator::Now ();
+    }
+  
   // Dispatch bundles to the new peer
   DispatchBundles ();
 }
@@ -76,75 +117,164 @@ EpidemicRouting::NotifyPeerDisappeared (const NodeID& peer)
   
   // Remove peer information
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
     m_peers.erase (peer);
+    m_peerQueues.erase (peer);
+    m_summaries.erase (peer);
   }
   
   NS_LOG_INFO ("Peer disappeared: " << peer.ToString ());
 }
 
-void 
-EpidemicRouting::DispatchBundles ()
+bool 
+EpidemicRouting::NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source)
 {
-  NS_LOG_FUNCTION (this);
+  Ptr<CanonicalBlock> block = bundle->GetBlockByType (BlockType::SUMMARY_VECTOR_BLOCK);
+  if (!block)
+    {
+      return false;
+    }
+  
+  // The summary comes from the node that created the bundle
+  NodeID peer = bundle->GetPrimaryBlock ().GetSourceNodeEID ();
+  const PayloadBuffer& data = block->GetData ();
+  std::optional<SummaryVector> summary = SummaryVector::Decode (data.data (), data.size ());
+  if (!summary)
+    {
+      NS_LOG_ERROR ("Malformed summary vector from " << peer.ToString ());
+      return true;
+    }
+  
+  NS_LOG_INFO ("Summary vector from " << peer.ToString () << " lists " << summary->GetCount ()
+               << " bundles" << (summary->IsExact () ? "" : " (Bloom filter)"));
+  
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    PeerSummary& state = m_summaries[peer];
+    state.summary = *summary;
+    state.received = true;
+  }
+  m_summariesReceived++;
+  
+  DispatchBundles ();
+  return true;
+}
+
+bool 
+EpidemicRouting::OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer)
+{
+  BundleID id = bundle->GetId ();
+  
+  // Skip expired bundles and peers the bundle was already sent to
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end () && it->second.IsExpired ())
+      {
+        NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
+        return true;
+      }
+    if (it != m_bundles.end () && it->second.SentTo (peer.index))
+      {
+        return true;
+      }
+  }
   
-  // Get all bundles from the store
-  std::vector<Ptr<Bundle>> bundles = m_store->GetAll ();
+  // Skip if destination is local
+  if (bundle->GetPrimaryBlock ().GetDestinationEID () == m_localNodeID)
+    {
+      return true;
+    }
   
-  NS_LOG_INFO ("Dispatching " << bundles.size () << " bundles to peers");
+  // Skip if destination is this peer and it's not the final destination
+  if (bundle->GetPrimaryBlock ().GetDestinationEID () != peer.nodeID &&
+      peer.nodeID == m_localNodeID)
+    {
+      return true;
+    }
   
-  // Get all active peers
-  std::vector<PeerInfo> activePeers;
+  // Hold bundles until the peer's summary arrives, skip those it has
+  bool known = false;
+  bool exact = false;
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
-    for (const auto& pair : m_peers)
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    auto state = m_summaries.find (peer.nodeID);
+    if (m_summaryEnabled && state != m_summaries.end ())
       {
-        if (pair.second.IsActive ())
+        if (!state->second.received)
           {
-            activePeers.push_back (pair.second);
+            if (Simulator::Now () - state->second.requested < m_summaryTimeout)
+              {
+                return false;
+              }
+          }
+        else
+          {
+            known = state->second.summary.MayContain (id);
+            exact = state->second.summary.IsExact ();
           }
       }
   }
   
-  // Try to send each bundle to each peer
-  for (const auto& bundle : bundles)
+  // A Bloom filter hit may be a false positive, so only an exact summary
+  // marks the bundle as sent; otherwise it is skipped for this contact only
+  if (known)
     {
-      BundleID id = bundle->GetId ();
-      
-      // Skip expired bundles
-      std::lock_guard<std::mutex> lock (m_bundlesMutex);
+      std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
       auto it = m_bundles.find (id);
-      if (it != m_bundles.end () && it->second.IsExpired ())
+      if (exact && it != m_bundles.end ())
         {
-          NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
-          continue;
+          it->second.AddSentNode (peer.index);
         }
-      
-      for (const auto& peer : activePeers)
+      m_suppressedBundles++;
+      return true;
+    }
+  
+  // Send the bundle to the peer
+  return SendBundle (bundle, peer.nodeID, peer.endpoint);
+}
+
+bool 
+EpidemicRouting::SendSummary (const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
+  
+  std::vector<BundleID> ids;
+  ids.reserve (m_store->Count ());
+  m_store->ForEachId ([&ids] (const BundleID& id, uint64_t) {
+    ids.push_back (id);
+    return true;
+  });
+  
+  // A fresh seed per summary moves Bloom filter false positives around
+  SummaryVector summary = SummaryVector::Build (ids, m_bloomThreshold,
+                                                m_localNodeID.Hash () ^ m_summariesSent);
+  
+  Bundle control = Bundle::MustNewBundle (m_localNodeID.ToString (), peer.nodeID.ToString (),
+                                          GetDtnNow (), m_summaryLifetime, {});
+  control.GetPrimaryBlock ().SetSequenceNumber (m_summariesSent);
+  control.AddBlock (Create<CanonicalBlock> (BlockType::SUMMARY_VECTOR_BLOCK, 0,
+                                            BlockControlFlags::DELETE_BUNDLE_IF_BLOCK_UNPROCESSABLE,
+                                            CRCType::NO_CRC, PayloadBuffer (summary.Encode ())));
+  control.AddBlock (Create<PreviousNodeBlock> (m_localNodeID));
+  control.CalculateCRC ();
+  
+  for (const auto& sender : m_senders)
+    {
+      if (sender->IsEndpointReachable (peer.endpoint))
         {
-          // Skip if destination is local
-          if (bundle->GetPrimaryBlock ().GetDestinationEID () == m_localNodeID)
-            {
-              continue;
-            }
-          
-          // Skip if destination is this peer and it's not the final destination
-          if (bundle->GetPrimaryBlock ().GetDestinationEID () != peer.nodeID &&
-              peer.nodeID == m_localNodeID)
+          if (!sender->Send (Create<Bundle> (control), peer.endpoint))
             {
-              continue;
+              break;
             }
-          
-          // Skip if already sent to this peer
-          if (it != m_bundles.end () && it->second.SentTo (peer.nodeID))
-            {
-              continue;
-            }
-          
-          // Send the bundle to the peer
-          SendBundle (bundle, peer.nodeID, peer.endpoint);
+          m_summariesSent++;
+          NS_LOG_INFO ("Sent summary vector of " << ids.size () << " bundles to " << peer.nodeID.ToString ());
+          return true;
         }
     }
+  
+  NS_LOG_WARN ("Cannot send summary vector to " << peer.nodeID.ToString ());
+  return false;
 }
 
 std::string 
@@ -163,6 +293,9 @@ EpidemicRouting::GetStats () const
   ss << ", bundles=" << m_bundles.size ();
   ss << ", sent=" << m_sentBundles;
   ss << ", failed=" << m_failedBundles;
+  ss << ", summariesSent=" << m_summariesSent;
+  ss << ", summariesReceived=" << m_summariesReceived;
+  ss << ", suppressed=" << m_suppressedBundles;
   ss << ")";
   
   return ss.str ();
@@ -2,6 +2,7 @@
 #define DTN7_EPIDEMIC_ROUTING_H
 
 #include "routing.h"
+#include "summary-vector.h"
 
 namespace ns3 {
 
@@ -10,6 +11,11 @@ namespace dtn7 {
 /**
  * \ingroup dtn7
  * \brief Epidemic routing algorithm implementation
+ *
+ * On contact both nodes send a summary vector of the bundles they store,
+ * and each then only forwards the bundles missing from the peer's
+ * summary. A peer that sends no summary within SummaryTimeout is
+ * flooded as in plain epidemic routing.
  */
 class EpidemicRouting : public RoutingAlgorithm
 {
@@ -32,6 +38,7 @@ public:
   
   // Inherited from RoutingAlgorithm
   void NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source) override;
+  bool NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source) override;
   void NotifyPeerAppeared (const PeerInfo& peer) override;
   void NotifyPeerDisappeared (const NodeID& peer) override;
   std::string GetName () const override;
@@ -39,7 +46,34 @@ public:
 
 protected:
   // Inherited from RoutingAlgorithm
-  void DispatchBundles () override;
+  bool OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer) override;
+
+private:
+  /**
+   * \brief Summary exchange state of one peer
+   */
+  struct PeerSummary
+  {
+    SummaryVector summary; //!< Bundles the peer reported
+    bool received;         //!< Whether the peer's summary arrived
+    Time requested;        //!< When our summary was sent to the peer
+  };
+  
+  /**
+   * \brief Send a summary of the stored bundles to a peer
+   * \param peer Peer
+   * \return true if the summary was sent
+   */
+  bool SendSummary (const PeerInfo& peer);
+  
+  std::unordered_map<NodeID, PeerSummary> m_summaries; //!< Summary state by peer, guarded by m_peersMutex
+  bool m_summaryEnabled;                                //!< Whether to exchange summary vectors
+  Time m_summaryTimeout;                                //!< How long to wait for a peer's summary
+  Time m_summaryLifetime;                               //!< Lifetime of summary bundles
+  uint32_t m_bloomThreshold;                            //!< Store size above which summaries are Bloom filters
+  uint64_t m_summariesSent;                             //!< Number of summaries sent
+  uint64_t m_summariesReceived;                         //!< Number of summaries received
+  uint64_t m_suppressedBundles;                         //!< Bundles not sent because the peer had them
 };
 
 } // namespace dtn7
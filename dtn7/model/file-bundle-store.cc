@@ -0,0 +1,796 @@
+#include "file-bundle-store.h"
+#include "administrative-record.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FileBundleStore");
+
+namespace dtn7 {
+
+namespace {
+
+const char LOG_MAGIC[8] = {'D', 'T', 'N', '7', 'L', 'O', 'G', '1'};
+const uint64_t FILE_HEADER_SIZE = 16;        // magic + end of last record
+const uint64_t RECORD_HEADER_SIZE = 8;       // length + state + reserved
+const uint64_t INITIAL_CAPACITY = 1 << 20;   // 1 MiB
+const uint64_t MIN_COMPACTION_BYTES = 64 * 1024;
+const uint8_t STATE_LIVE = 1;
+const uint8_t STATE_DEAD = 2;
+
+void 
+PutU32(uint8_t* p, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+      p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void 
+PutU64(uint8_t* p, uint64_t value)
+{
+  for (int i = 0; i < 8; ++i)
+    {
+      p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint32_t 
+GetU32(const uint8_t* p)
+{
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i)
+    {
+      value |= static_cast<uint32_t>(p[i]) << (8 * i);
+    }
+  return value;
+}
+
+uint64_t 
+GetU64(const uint8_t* p)
+{
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i)
+    {
+      value |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+  return value;
+}
+
+} // anonymous namespace
+
+NS_OBJECT_ENSURE_REGISTERED (FileBundleStore);
+
+TypeId 
+FileBundleStore::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::dtn7::FileBundleStore")
+    .SetParent<BundleStore> ()
+    .SetGroupName ("Dtn7")
+    .AddConstructor<FileBundleStore> ()
+    .AddAttribute ("FileName",
+                   "Path of the log file, empty for a temporary file removed on dispose",
+                   StringValue (""),
+                   MakeStringAccessor (&FileBundleStore::m_fileName),
+                   MakeStringChecker ())
+    .AddAttribute ("Persistent",
+                   "Reopen an existing log at FileName instead of truncating it",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&FileBundleStore::m_persistent),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxBundles",
+                   "Maximum number of bundles to store",
+                   UintegerValue (100000),
+                   MakeUintegerAccessor (&FileBundleStore::m_maxBundles),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("MaxBytes",
+                   "Maximum size of the log file, 0 for no limit",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&FileBundleStore::m_maxBytes),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("CompactionThreshold",
+                   "Fraction of the log held by removed bundles that triggers compaction",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&FileBundleStore::m_compactionThreshold),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+  ;
+  return tid;
+}
+
+FileBundleStore::FileBundleStore ()
+  : m_persistent (false),
+    m_temporary (false),
+    m_fd (-1),
+    m_map (nullptr),
+    m_capacity (0),
+    m_tail (FILE_HEADER_SIZE),
+    m_deadBytes (0),
+    m_generation (0),
+    m_maxBytes (0),
+    m_maxBundles (100000),
+    m_compactionThreshold (0.5),
+    m_pushCount (0),
+    m_getCount (0),
+    m_removeCount (0),
+    m_compactions (0)
+{
+}
+
+FileBundleStore::~FileBundleStore ()
+{
+  Close ();
+}
+
+void 
+FileBundleStore::DoDispose ()
+{
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    Close ();
+    m_index.clear ();
+    m_generations.clear ();
+    m_expiryQueue = std::priority_queue<ExpiryItem> ();
+  }
+  BundleStore::DoDispose ();
+}
+
+bool 
+FileBundleStore::Push (Ptr<Bundle> bundle)
+{
+  if (!bundle)
+    {
+      return false;
+    }
+  
+  BundleID id = bundle->GetId ();
+  Buffer encoded = bundle->ToCbor ();
+  uint32_t size = encoded.GetSize ();
+  uint64_t recordSize = GetRecordSize (size);
+  
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    
+    if (!EnsureOpen ())
+      {
+        return false;
+      }
+    
+    bool replacing = m_index.find (id) != m_index.end ();
+    if (!replacing && m_index.size () >= m_maxBundles)
+      {
+        return false;
+      }
+    
+    if (m_maxBytes > 0 && m_tail + recordSize > m_maxBytes)
+      {
+        if (m_deadBytes > 0)
+          {
+            CompactLocked ();
+          }
+        if (m_tail + recordSize > m_maxBytes)
+          {
+            NS_LOG_WARN ("Log full, rejecting bundle " << id.ToString ());
+            return false;
+          }
+      }
+    
+    if (!Reserve (m_tail + recordSize))
+      {
+        return false;
+      }
+    
+    // A new copy of a stored bundle supersedes the old record
+    if (replacing)
+      {
+        Kill (m_index.find (id));
+      }
+    
+    uint8_t* record = m_map + m_tail;
+    PutU32 (record, size);
+    record[4] = STATE_LIVE;
+    std::memset (record + 5, 0, 3);
+    encoded.CopyData (record + RECORD_HEADER_SIZE, size);
+    std::memset (record + RECORD_HEADER_SIZE + size, 0, recordSize - RECORD_HEADER_SIZE - size);
+    
+    AddRecord (id, m_tail, size, GetExpiration (*bundle));
+    
+    m_tail += recordSize;
+    WriteTail ();
+    m_pushCount++;
+  }
+  
+  NotifyStored (bundle, size);
+  return true;
+}
+
+std::optional<Ptr<Bundle>> 
+FileBundleStore::Get (const BundleID& id) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  if (!const_cast<FileBundleStore*>(this)->EnsureOpen ())
+    {
+      return std::nullopt;
+    }
+  
+  auto it = m_index.find (id);
+  if (it == m_index.end ())
+    {
+      return std::nullopt;
+    }
+  
+  Ptr<Bundle> bundle = Load (it->second);
+  if (!bundle)
+    {
+      return std::nullopt;
+    }
+  
+  m_getCount++;
+  return bundle;
+}
+
+bool 
+FileBundleStore::Has (const BundleID& id) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  const_cast<FileBundleStore*>(this)->EnsureOpen ();
+  return m_index.find (id) != m_index.end ();
+}
+
+bool 
+FileBundleStore::Remove (const BundleID& id)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  if (!EnsureOpen ())
+    {
+      return false;
+    }
+  
+  auto it = m_index.find (id);
+  if (it == m_index.end ())
+    {
+      return false;
+    }
+  
+  Kill (it);
+  m_removeCount++;
+  MaybeCompact ();
+  
+  return true;
+}
+
+std::vector<Ptr<Bundle>> 
+FileBundleStore::GetAll () const
+{
+  return Query ([] (Ptr<Bundle>) { return true; });
+}
+
+std::vector<Ptr<Bundle>> 
+FileBundleStore::Query (std::function<bool(Ptr<Bundle>)> predicate) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::vector<Ptr<Bundle>> result;
+  if (!const_cast<FileBundleStore*>(this)->EnsureOpen ())
+    {
+      return result;
+    }
+  
+  for (const auto& pair : m_index)
+    {
+      Ptr<Bundle> bundle = Load (pair.second);
+      if (bundle && predicate (bundle))
+        {
+          result.push_back (bundle);
+        }
+    }
+  
+  return result;
+}
+
+uint64_t 
+FileBundleStore::GetGeneration () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  return m_generation;
+}
+
+std::vector<StoredBundle> 
+FileBundleStore::GetPage (BundleCursor& cursor, size_t limit) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::vector<StoredBundle> page;
+  if (!const_cast<FileBundleStore*>(this)->EnsureOpen ())
+    {
+      return page;
+    }
+  
+  // 按索引条目分页，读取失败的记录只是不出现在页中
+  size_t covered = 0;
+  for (auto it = m_generations.upper_bound (cursor.generation);
+       it != m_generations.end () && covered < limit; ++it, ++covered)
+    {
+      cursor.generation = it->first;
+      Ptr<Bundle> bundle = Load (m_index.at (it->second));
+      if (bundle)
+        {
+          page.push_back (StoredBundle {bundle, it->first});
+        }
+    }
+  
+  return page;
+}
+
+std::vector<StoredBundleId> 
+FileBundleStore::GetIdPage (BundleCursor& cursor, size_t limit) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::vector<StoredBundleId> page;
+  if (!const_cast<FileBundleStore*>(this)->EnsureOpen ())
+    {
+      return page;
+    }
+  
+  // 只读索引，不解码日志中的记录
+  for (auto it = m_generations.upper_bound (cursor.generation);
+       it != m_generations.end () && page.size () < limit; ++it)
+    {
+      page.push_back (StoredBundleId {it->second, it->first});
+      cursor.generation = it->first;
+    }
+  
+  return page;
+}
+
+size_t 
+FileBundleStore::Count () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  const_cast<FileBundleStore*>(this)->EnsureOpen ();
+  return m_index.size ();
+}
+
+size_t 
+FileBundleStore::Cleanup ()
+{
+  std::vector<Ptr<Bundle>> expired;
+  size_t removedCount = 0;
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    
+    if (!EnsureOpen ())
+      {
+        return 0;
+      }
+    
+    Time now = Simulator::Now ();
+    
+    // Only the expired prefix of the heap is visited
+    while (!m_expiryQueue.empty () && now > m_expiryQueue.top ().expiration)
+      {
+        ExpiryItem item = m_expiryQueue.top ();
+        m_expiryQueue.pop ();
+        
+        // Skip items whose bundle was removed or replaced since
+        auto it = m_index.find (item.id);
+        if (it == m_index.end () || it->second.expiration != item.expiration)
+          {
+            continue;
+          }
+        
+        Ptr<Bundle> bundle = Load (it->second);
+        if (bundle)
+          {
+            expired.push_back (bundle);
+          }
+        Kill (it);
+        m_removeCount++;
+        removedCount++;
+      }
+    
+    MaybeCompact ();
+  }
+  
+  for (const Ptr<Bundle>& bundle : expired)
+    {
+      NotifyDeleted (bundle, static_cast<uint64_t> (ReasonCode::LIFETIME_EXPIRED));
+    }
+  
+  return removedCount;
+}
+
+std::string 
+FileBundleStore::GetStats () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::stringstream ss;
+  
+  ss << "FileBundleStore(";
+  ss << "count=" << m_index.size ();
+  ss << ", bytes=" << (m_tail - FILE_HEADER_SIZE);
+  ss << ", dead=" << m_deadBytes;
+  ss << ", capacity=" << m_capacity;
+  ss << ", pushed=" << m_pushCount;
+  ss << ", retrieved=" << m_getCount;
+  ss << ", removed=" << m_removeCount;
+  ss << ", compactions=" << m_compactions;
+  ss << ", path=" << m_path;
+  ss << ")";
+  
+  return ss.str ();
+}
+
+uint64_t 
+FileBundleStore::Compact ()
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  if (!EnsureOpen ())
+    {
+      return 0;
+    }
+  return CompactLocked ();
+}
+
+std::string 
+FileBundleStore::GetPath () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  return m_path;
+}
+
+bool 
+FileBundleStore::EnsureOpen ()
+{
+  if (m_map)
+    {
+      return true;
+    }
+  
+  if (m_fileName.empty ())
+    {
+      // Temporary log, unlinked again when the store goes away
+      const char* directory = std::getenv ("TMPDIR");
+      std::string pattern = std::string (directory ? directory : "/tmp") + "/dtn7-store-XXXXXX";
+      std::vector<char> path (pattern.begin (), pattern.end ());
+      path.push_back ('\0');
+      
+      m_fd = mkstemp (path.data ());
+      m_path = path.data ();
+      m_temporary = true;
+    }
+  else
+    {
+      int flags = O_RDWR | O_CREAT | (m_persistent ? 0 : O_TRUNC);
+      m_fd = open (m_fileName.c_str (), flags, 0644);
+      m_path = m_fileName;
+      m_temporary = false;
+    }
+  
+  if (m_fd < 0)
+    {
+      NS_LOG_ERROR ("Cannot open bundle log " << m_path << ": " << std::strerror (errno));
+      m_path.clear ();
+      return false;
+    }
+  
+  struct stat status;
+  if (fstat (m_fd, &status) != 0)
+    {
+      NS_LOG_ERROR ("Cannot stat bundle log " << m_path << ": " << std::strerror (errno));
+      Close ();
+      return false;
+    }
+  
+  uint64_t existing = static_cast<uint64_t> (status.st_size);
+  bool reopen = m_persistent && existing >= FILE_HEADER_SIZE;
+  
+  if (!Resize (reopen ? existing : INITIAL_CAPACITY))
+    {
+      Close ();
+      return false;
+    }
+  
+  if (reopen && std::memcmp (m_map, LOG_MAGIC, sizeof (LOG_MAGIC)) == 0)
+    {
+      if (Recover ())
+        {
+          NS_LOG_INFO ("Reopened bundle log " << m_path << " with " << m_index.size () << " bundles");
+          return true;
+        }
+      NS_LOG_WARN ("Bundle log " << m_path << " is damaged, keeping the readable records");
+      return true;
+    }
+  
+  // Fresh log
+  std::memcpy (m_map, LOG_MAGIC, sizeof (LOG_MAGIC));
+  m_tail = FILE_HEADER_SIZE;
+  m_deadBytes = 0;
+  WriteTail ();
+  return true;
+}
+
+void 
+FileBundleStore::Close ()
+{
+  if (m_map)
+    {
+      if (!m_temporary)
+        {
+          msync (m_map, m_capacity, MS_SYNC);
+        }
+      munmap (m_map, m_capacity);
+      m_map = nullptr;
+    }
+  
+  if (m_fd >= 0)
+    {
+      close (m_fd);
+      m_fd = -1;
+      if (m_temporary)
+        {
+          unlink (m_path.c_str ());
+        }
+    }
+  
+  m_capacity = 0;
+  m_path.clear ();
+}
+
+bool 
+FileBundleStore::Reserve (uint64_t required)
+{
+  if (required <= m_capacity)
+    {
+      return true;
+    }
+  
+  uint64_t capacity = std::max (m_capacity, INITIAL_CAPACITY);
+  while (capacity < required)
+    {
+      capacity *= 2;
+    }
+  if (m_maxBytes > 0)
+    {
+      capacity = std::max (required, std::min (capacity, m_maxBytes));
+    }
+  
+  return Resize (capacity);
+}
+
+bool 
+FileBundleStore::Resize (uint64_t capacity)
+{
+  if (m_map)
+    {
+      munmap (m_map, m_capacity);
+      m_map = nullptr;
+    }
+  
+  bool resized = ftruncate (m_fd, static_cast<off_t> (capacity)) == 0;
+  if (!resized)
+    {
+      NS_LOG_ERROR ("Cannot resize bundle log " << m_path << ": " << std::strerror (errno));
+      capacity = m_capacity;
+    }
+  
+  if (capacity == 0)
+    {
+      return false;
+    }
+  
+  void* map = mmap (nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (map == MAP_FAILED)
+    {
+      NS_LOG_ERROR ("Cannot map bundle log " << m_path << ": " << std::strerror (errno));
+      m_capacity = 0;
+      return false;
+    }
+  
+  m_map = static_cast<uint8_t*> (map);
+  m_capacity = capacity;
+  return resized;
+}
+
+bool 
+FileBundleStore::Recover ()
+{
+  m_index.clear ();
+  m_generations.clear ();
+  m_expiryQueue = std::priority_queue<ExpiryItem> ();
+  m_deadBytes = 0;
+  
+  uint64_t tail = GetU64 (m_map + sizeof (LOG_MAGIC));
+  bool intact = tail >= FILE_HEADER_SIZE && tail <= m_capacity;
+  if (!intact)
+    {
+      tail = m_capacity;
+    }
+  
+  uint64_t offset = FILE_HEADER_SIZE;
+  while (offset + RECORD_HEADER_SIZE <= tail)
+    {
+      const uint8_t* record = m_map + offset;
+      uint32_t size = GetU32 (record);
+      uint64_t recordSize = GetRecordSize (size);
+      uint8_t state = record[4];
+      
+      if ((state != STATE_LIVE && state != STATE_DEAD) || offset + recordSize > tail)
+        {
+          // Torn or unwritten record, the log ends here
+          intact = false;
+          break;
+        }
+      
+      if (state == STATE_LIVE)
+        {
+          std::optional<Bundle> bundle = Bundle::FromCbor (record + RECORD_HEADER_SIZE, size);
+          if (bundle)
+            {
+              BundleID id = bundle->GetId ();
+              auto previous = m_index.find (id);
+              if (previous != m_index.end ())
+                {
+                  Kill (previous);
+                }
+              AddRecord (id, offset, size, GetExpiration (*bundle));
+            }
+          else
+            {
+              m_map[offset + 4] = STATE_DEAD;
+              m_deadBytes += recordSize;
+            }
+        }
+      else
+        {
+          m_deadBytes += recordSize;
+        }
+      
+      offset += recordSize;
+    }
+  
+  m_tail = offset;
+  WriteTail ();
+  return intact;
+}
+
+void 
+FileBundleStore::WriteTail ()
+{
+  PutU64 (m_map + sizeof (LOG_MAGIC), m_tail);
+}
+
+void 
+FileBundleStore::Kill (std::unordered_map<BundleID, Record>::iterator it)
+{
+  m_map[it->second.offset + 4] = STATE_DEAD;
+  m_deadBytes += GetRecordSize (it->second.size);
+  m_generations.erase (it->second.generation);
+  m_index.erase (it);
+}
+
+void 
+FileBundleStore::AddRecord (const BundleID& id, uint64_t offset, uint32_t size, Time expiration)
+{
+  uint64_t generation = ++m_generation;
+  m_index[id] = Record {offset, size, expiration, generation};
+  m_generations[generation] = id;
+  m_expiryQueue.push (ExpiryItem {expiration, id});
+}
+
+void 
+FileBundleStore::MaybeCompact ()
+{
+  uint64_t used = m_tail - FILE_HEADER_SIZE;
+  if (used >= MIN_COMPACTION_BYTES && m_deadBytes > m_compactionThreshold * used)
+    {
+      CompactLocked ();
+    }
+}
+
+uint64_t 
+FileBundleStore::CompactLocked ()
+{
+  if (m_deadBytes == 0)
+    {
+      return 0;
+    }
+  
+  // Slide the live records down in log order; every move goes to a lower
+  // offset, so records that were not moved yet are never overwritten
+  std::vector<std::pair<uint64_t, Record*>> live;
+  live.reserve (m_index.size ());
+  for (auto& pair : m_index)
+    {
+      live.emplace_back (pair.second.offset, &pair.second);
+    }
+  std::sort (live.begin (), live.end (),
+             [] (const std::pair<uint64_t, Record*>& a, const std::pair<uint64_t, Record*>& b) {
+               return a.first < b.first;
+             });
+  
+  uint64_t write = FILE_HEADER_SIZE;
+  for (const auto& entry : live)
+    {
+      Record* record = entry.second;
+      uint64_t recordSize = GetRecordSize (record->size);
+      if (record->offset != write)
+        {
+          std::memmove (m_map + write, m_map + record->offset, recordSize);
+          record->offset = write;
+        }
+      write += recordSize;
+    }
+  
+  uint64_t reclaimed = m_tail - write;
+  m_tail = write;
+  m_deadBytes = 0;
+  WriteTail ();
+  m_compactions++;
+  
+  // Give the space back once the log uses less than a quarter of the file
+  if (m_capacity > INITIAL_CAPACITY && m_tail < m_capacity / 4)
+    {
+      uint64_t capacity = INITIAL_CAPACITY;
+      while (capacity < 2 * m_tail)
+        {
+          capacity *= 2;
+        }
+      Resize (capacity);
+    }
+  
+  NS_LOG_INFO ("Compacted bundle log " << m_path << ", reclaimed " << reclaimed << " bytes");
+  return reclaimed;
+}
+
+Ptr<Bundle> 
+FileBundleStore::Load (const Record& record) const
+{
+  std::optional<Bundle> bundle = Bundle::FromCbor (m_map + record.offset + RECORD_HEADER_SIZE, record.size);
+  if (!bundle)
+    {
+      NS_LOG_ERROR ("Cannot decode bundle at offset " << record.offset << " of " << m_path);
+      return nullptr;
+    }
+  return Create<Bundle> (std::move (*bundle));
+}
+
+Time 
+FileBundleStore::GetExpiration (const Bundle& bundle)
+{
+  return bundle.GetPrimaryBlock ().GetExpirationTime ();
+}
+
+uint64_t 
+FileBundleStore::GetRecordSize (uint32_t size)
+{
+  return RECORD_HEADER_SIZE + ((static_cast<uint64_t> (size) + 7) & ~static_cast<uint64_t> (7));
+}
+
+} // namespace dtn7
+
+} // namespace ns3
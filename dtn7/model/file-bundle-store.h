@@ -0,0 +1,219 @@
+#ifndef DTN7_FILE_BUNDLE_STORE_H
+#define DTN7_FILE_BUNDLE_STORE_H
+
+#include "bundle-store.h"
+#include "optional-mutex.h"
+
+#include <unordered_map>
+#include <map>
+#include <queue>
+#include <mutex>
+#include <string>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Bundle storage in a memory-mapped, append-only log file
+ *
+ * Bundles are appended to the log in their wire encoding, and only a
+ * compact index (bundle ID to offset, size and expiration) stays in
+ * memory. Get decodes a bundle from the mapping on demand, so buffered
+ * bundles cost page cache rather than heap. Removed records are only
+ * marked as dead; the log is compacted in place once dead records make
+ * up enough of it.
+ *
+ * Log layout, all integers little-endian:
+ * \verbatim
+   | magic "DTN7LOG1" (8) | end of last record (8) |
+   | length (4) | state (1) | reserved (3) | bundle (length), padded to 8 | ...
+   \endverbatim
+ * With Persistent set, an existing log at FileName is reopened and its
+ * live records indexed again.
+ */
+class FileBundleStore : public BundleStore
+{
+public:
+  /**
+   * \brief Get the type ID
+   * \return Type ID
+   */
+  static TypeId GetTypeId ();
+  
+  /**
+   * \brief Default constructor
+   */
+  FileBundleStore ();
+  
+  /**
+   * \brief Destructor
+   */
+  virtual ~FileBundleStore ();
+  
+  // Inherited from BundleStore
+  bool Push (Ptr<Bundle> bundle) override;
+  std::optional<Ptr<Bundle>> Get (const BundleID& id) const override;
+  bool Has (const BundleID& id) const override;
+  bool Remove (const BundleID& id) override;
+  std::vector<Ptr<Bundle>> GetAll () const override;
+  std::vector<Ptr<Bundle>> Query (std::function<bool(Ptr<Bundle>)> predicate) const override;
+  uint64_t GetGeneration () const override;
+  std::vector<StoredBundle> GetPage (BundleCursor& cursor, size_t limit) const override;
+  std::vector<StoredBundleId> GetIdPage (BundleCursor& cursor, size_t limit) const override;
+  size_t Count () const override;
+  size_t Cleanup () override;
+  std::string GetStats () const override;
+  
+  /**
+   * \brief Rewrite the log without its dead records
+   * \return Number of bytes reclaimed
+   */
+  uint64_t Compact ();
+  
+  /**
+   * \brief Get the path of the log file
+   * \return Path, empty if the log is not open
+   */
+  std::string GetPath () const;
+
+protected:
+  void DoDispose () override;
+
+private:
+  /**
+   * \brief Index entry of a live record
+   */
+  struct Record
+  {
+    uint64_t offset;     //!< Offset of the record header in the log
+    uint32_t size;       //!< Encoded bundle size
+    Time expiration;     //!< Creation time plus lifetime
+    uint64_t generation; //!< Store generation of the push that wrote it
+  };
+  
+  /**
+   * \brief Expiry heap element, ordered so the earliest expiration is on top
+   */
+  struct ExpiryItem
+  {
+    Time expiration; //!< Expiration time of the bundle when it was pushed
+    BundleID id;     //!< Bundle ID
+    
+    bool operator< (const ExpiryItem& other) const { return other.expiration < expiration; }
+  };
+  
+  std::unordered_map<BundleID, Record> m_index;  //!< Live records by bundle ID
+  std::priority_queue<ExpiryItem> m_expiryQueue; //!< Expiry heap, stale items are skipped lazily
+  std::map<uint64_t, BundleID> m_generations;    //!< Bundle IDs by generation, for cursors
+  mutable OptionalMutex m_mutex;                 //!< Mutex for thread safety
+  
+  std::string m_fileName;       //!< Configured log path, empty for a temporary file
+  std::string m_path;           //!< Path of the open log
+  bool m_persistent;            //!< Whether to reopen an existing log and keep it afterwards
+  bool m_temporary;             //!< Whether the log is removed when the store is disposed
+  int m_fd;                     //!< Log file descriptor, -1 if closed
+  uint8_t* m_map;               //!< Mapping of the whole log file
+  uint64_t m_capacity;          //!< Size of the file and the mapping
+  uint64_t m_tail;              //!< End of the last record
+  uint64_t m_deadBytes;         //!< Bytes held by removed records
+  uint64_t m_generation;        //!< Generation of the most recent push
+  uint64_t m_maxBytes;          //!< Maximum log size, 0 for no limit
+  uint32_t m_maxBundles;        //!< Maximum number of bundles to store
+  double m_compactionThreshold; //!< Fraction of dead bytes that triggers compaction
+  
+  size_t m_pushCount;           //!< Number of pushed bundles
+  mutable size_t m_getCount;    //!< Number of retrieved bundles
+  size_t m_removeCount;         //!< Number of removed bundles
+  size_t m_compactions;         //!< Number of compactions run
+  
+  /**
+   * \brief Open or create the log on first use
+   * \return true if the log is usable
+   */
+  bool EnsureOpen ();
+  
+  /**
+   * \brief Unmap and close the log, deleting it if temporary
+   */
+  void Close ();
+  
+  /**
+   * \brief Grow the file and the mapping
+   * \param required Minimum capacity
+   * \return true if the log now has the capacity
+   */
+  bool Reserve (uint64_t required);
+  
+  /**
+   * \brief Resize the file and map it again
+   * \param capacity New file size
+   * \return true on success
+   */
+  bool Resize (uint64_t capacity);
+  
+  /**
+   * \brief Index the live records of a reopened log
+   * \return true if the log is well formed
+   */
+  bool Recover ();
+  
+  /**
+   * \brief Record the end of the last record in the file header
+   */
+  void WriteTail ();
+  
+  /**
+   * \brief Mark a record as dead and drop it from the index
+   * \param it Record to remove
+   */
+  void Kill (std::unordered_map<BundleID, Record>::iterator it);
+  
+  /**
+   * \brief Compact the log if dead records exceed the threshold
+   */
+  void MaybeCompact ();
+  
+  /**
+   * \brief Compact the log, the caller holds the mutex
+   * \return Number of bytes reclaimed
+   */
+  uint64_t CompactLocked ();
+  
+  /**
+   * \brief Index a record written at the current generation
+   * \param id Bundle ID
+   * \param offset Offset of the record header
+   * \param size Encoded bundle size
+   * \param expiration Expiration time of the bundle
+   */
+  void AddRecord (const BundleID& id, uint64_t offset, uint32_t size, Time expiration);
+  
+  /**
+   * \brief Decode the bundle stored in a record
+   * \param record Index entry
+   * \return Bundle, null if the record does not decode
+   */
+  Ptr<Bundle> Load (const Record& record) const;
+  
+  /**
+   * \brief Get the time at which a bundle expires
+   * \param bundle Bundle
+   * \return Creation time plus lifetime
+   */
+  static Time GetExpiration (const Bundle& bundle);
+  
+  /**
+   * \brief Get the space a record takes in the log
+   * \param size Encoded bundle size
+   * \return Header plus padded payload size
+   */
+  static uint64_t GetRecordSize (uint32_t size);
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_FILE_BUNDLE_STORE_H */
@@ -2,6 +2,7 @@
 #include "ns3/simulator.h"
 #include <sstream>
 #include <algorithm>
+#include <iterator>
 
 namespace ns3 {
 
@@ -13,7 +14,9 @@ FragmentationManager::FragmentationManager ()
   : m_fragmentedBundles (0),
     m_createdFragments (0),
     m_reassembledBundles (0),
-    m_abandonedFragmentSets (0)
+    m_abandonedFragmentSets (0),
+    m_reassembledCounter (nullptr),
+    m_failureCounter (nullptr)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -61,29 +64,18 @@ FragmentationManager::FragmentBundle (Ptr<Bundle> bundle, size_t maxFragmentSize
       return fragments;
     }
   
-  std::vector<uint8_t> fullPayload = payloadBlock->GetData();
-  uint64_t totalLength = fullPayload.size();
+  uint64_t totalLength = payloadBlock->GetData().size();
   
-  // Calculate number of fragments needed
-  // Consider header overhead (primary block and other blocks that must be replicated)
-  size_t headerOverhead = 0;
-  Buffer primaryBuffer = bundle->GetPrimaryBlock().ToCbor();
-  headerOverhead += primaryBuffer.GetSize();
-  
-  // Add size of other blocks that must be replicated
-  for (const auto& block : bundle->GetCanonicalBlocks())
+  // Payload bytes per fragment, measured on a real fragment so that every
+  // fragment's encoding fits in maxFragmentSize
+  size_t maxPayloadPerFragment = GetMaxFragmentPayload(bundle, maxFragmentSize);
+  if (maxPayloadPerFragment == 0)
     {
-      if (block->GetBlockType() != BlockType::PAYLOAD_BLOCK && block->MustBeReplicated())
-        {
-          Buffer blockBuffer = block->ToCbor();
-          headerOverhead += blockBuffer.GetSize();
-        }
+      NS_LOG_WARN ("Fragment headers alone exceed max fragment size (" << maxFragmentSize 
+                   << " bytes), cannot fragment");
+      return fragments;
     }
   
-  // Adjust max payload per fragment considering header overhead
-  size_t maxPayloadPerFragment = (maxFragmentSize > headerOverhead) ? 
-                               maxFragmentSize - headerOverhead : maxFragmentSize / 2;
-  
   // Calculate number of fragments
   size_t numFragments = (totalLength + maxPayloadPerFragment - 1) / maxPayloadPerFragment;
   
@@ -93,64 +85,15 @@ FragmentationManager::FragmentBundle (Ptr<Bundle> bundle, size_t maxFragmentSize
   // Create fragments
   for (size_t i = 0; i < numFragments; ++i)
     {
-      // Calculate offset and size for this fragment
       size_t offset = i * maxPayloadPerFragment;
-      size_t payloadSize = CalculateFragmentPayloadSize(bundle, maxFragmentSize, i, numFragments);
-      
-      // Check for boundary conditions
-      if (offset >= totalLength)
-        {
-          NS_LOG_ERROR ("Fragment offset exceeds payload length, skipping fragment");
-          continue;
-        }
-      
-      if (offset + payloadSize > totalLength)
-        {
-          payloadSize = totalLength - offset;
-        }
-      
-      // Create fragment primary block
-      PrimaryBlock fragmentPrimary = bundle->GetPrimaryBlock();
-      fragmentPrimary.SetFragmentation(true);
-      fragmentPrimary.SetFragmentOffset(offset);
-      fragmentPrimary.SetTotalApplicationDataUnitLength(totalLength);
-      
-      // Create fragment bundle object
-      Ptr<Bundle> fragment = Create<Bundle>(fragmentPrimary);
-      
-      // Create payload block with fragment
-      std::vector<uint8_t> fragmentPayload(fullPayload.begin() + offset, 
-                                         fullPayload.begin() + offset + payloadSize);
-      
-      Ptr<PayloadBlock> fragmentPayloadBlock = Create<PayloadBlock>(fragmentPayload);
-      fragmentPayloadBlock->SetCRCType(payloadBlock->GetCRCType());
-      fragment->AddBlock(fragmentPayloadBlock);
-      
-      // Copy other blocks that must be replicated
-      for (const auto& block : bundle->GetCanonicalBlocks())
-        {
-          if (block->GetBlockType() != BlockType::PAYLOAD_BLOCK && block->MustBeReplicated())
-            {
-              Ptr<CanonicalBlock> copyBlock = Create<CanonicalBlock>(
-                  block->GetBlockType(),
-                  block->GetBlockNumber(),
-                  block->GetBlockControlFlags(),
-                  block->GetCRCType(),
-                  block->GetData());
-              fragment->AddBlock(copyBlock);
-            }
-        }
-      
-      // Calculate CRCs
-      fragment->CalculateCRC();
-      
-      fragments.push_back(fragment);
+      size_t payloadSize = std::min<uint64_t>(maxPayloadPerFragment, totalLength - offset);
+      fragments.push_back(BuildFragment(bundle, offset, payloadSize));
     }
   
   // Update statistics
   if (!fragments.empty())
     {
-      std::lock_guard<std::mutex> lock(m_mutex);
+      std::lock_guard<OptionalMutex> lock(m_mutex);
       m_fragmentedBundles++;
       m_createdFragments += fragments.size();
     }
@@ -158,6 +101,80 @@ FragmentationManager::FragmentBundle (Ptr<Bundle> bundle, size_t maxFragmentSize
   return fragments;
 }
 
+Ptr<Bundle> 
+FragmentationManager::CreateFragment (Ptr<Bundle> bundle, uint64_t offset, uint64_t length)
+{
+  NS_LOG_FUNCTION (this << bundle << offset << length);
+  
+  if (bundle->GetPrimaryBlock().MustNotFragment() || bundle->IsAdministrativeRecord())
+    {
+      NS_LOG_INFO ("Bundle must not be fragmented");
+      return nullptr;
+    }
+  
+  Ptr<CanonicalBlock> payloadBlock = bundle->GetPayloadBlock();
+  if (!payloadBlock || offset >= payloadBlock->GetData().size() || length == 0)
+    {
+      NS_LOG_ERROR ("Fragment range outside of the payload");
+      return nullptr;
+    }
+  
+  Ptr<Bundle> fragment = BuildFragment(bundle, offset, length);
+  
+  std::lock_guard<OptionalMutex> lock(m_mutex);
+  m_createdFragments++;
+  return fragment;
+}
+
+Ptr<Bundle> 
+FragmentationManager::BuildFragment (Ptr<Bundle> bundle, uint64_t offset, uint64_t length) const
+{
+  Ptr<CanonicalBlock> payloadBlock = bundle->GetPayloadBlock();
+  const PayloadBuffer& fullPayload = payloadBlock->GetData();
+  const PrimaryBlock& primary = bundle->GetPrimaryBlock();
+  
+  // Create fragment primary block; offsets always refer to the original ADU
+  PrimaryBlock fragmentPrimary = primary;
+  fragmentPrimary.SetFragmentation(true);
+  if (primary.IsFragment())
+    {
+      fragmentPrimary.SetFragmentOffset(primary.GetFragmentOffset() + offset);
+    }
+  else
+    {
+      fragmentPrimary.SetFragmentOffset(offset);
+      fragmentPrimary.SetTotalApplicationDataUnitLength(fullPayload.size());
+    }
+  
+  // Create fragment bundle object
+  Ptr<Bundle> fragment = Create<Bundle>(fragmentPrimary);
+  
+  // Create payload block with fragment; the slice shares the original storage
+  Ptr<PayloadBlock> fragmentPayloadBlock = Create<PayloadBlock>(fullPayload.Slice(offset, length));
+  fragmentPayloadBlock->SetCRCType(payloadBlock->GetCRCType());
+  fragment->AddBlock(fragmentPayloadBlock);
+  
+  // Copy other blocks that must be replicated
+  for (const auto& block : bundle->GetCanonicalBlocks())
+    {
+      if (block->GetBlockType() != BlockType::PAYLOAD_BLOCK && block->MustBeReplicated())
+        {
+          Ptr<CanonicalBlock> copyBlock = Create<CanonicalBlock>(
+              block->GetBlockType(),
+              block->GetBlockNumber(),
+              block->GetBlockControlFlags(),
+              block->GetCRCType(),
+              block->GetData());
+          fragment->AddBlock(copyBlock);
+        }
+    }
+  
+  // Calculate CRCs
+  fragment->CalculateCRC();
+  
+  return fragment;
+}
+
 Ptr<Bundle> 
 FragmentationManager::AddFragment (Ptr<Bundle> fragment)
 {
@@ -179,93 +196,103 @@ FragmentationManager::AddFragment (Ptr<Bundle> fragment)
   uint64_t totalLength = primary.GetTotalApplicationDataUnitLength();
   
   // Calculate fragment expiration time
-  Time creationTime = primary.GetCreationTimestamp().ToTime();
-  Time lifetime = primary.GetLifetime();
-  Time expirationTime = creationTime + lifetime;
+  Time expirationTime = primary.GetExpirationTime();
   
   // Add to fragment set
-  std::lock_guard<std::mutex> lock(m_mutex);
+  std::lock_guard<OptionalMutex> lock(m_mutex);
   
-  FragmentInfo& info = m_fragmentSets[originalId];
+  auto inserted = m_fragmentSets.try_emplace(originalId);
+  FragmentInfo& info = inserted.first->second;
   
   // Initialize fragment set if first fragment
-  if (info.fragments.empty())
+  if (inserted.second)
     {
       info.sourceId = originalId;
       info.totalLength = totalLength;
+      info.coveredLength = 0;
+      info.firstFragment = fragment;
       info.expirationTime = expirationTime;
       info.complete = false;
     }
   
-  // Check for duplicate fragments
-  for (const auto& existingFragment : info.fragments)
+  if (info.complete)
     {
-      if (existingFragment->GetPrimaryBlock().GetFragmentOffset() == fragmentOffset)
+      NS_LOG_INFO ("Fragment of an already reassembled bundle, ignoring");
+      return nullptr;
+    }
+  
+  if (totalLength != info.totalLength || fragmentOffset >= info.totalLength)
+    {
+      NS_LOG_ERROR ("Fragment does not fit the ADU of its fragment set, ignoring");
+      if (m_failureCounter)
         {
-          NS_LOG_INFO ("Duplicate fragment received, ignoring");
-          return nullptr;
+          m_failureCounter->Add();
         }
+      return nullptr;
+    }
+  
+  // Add only the bytes not covered yet
+  uint64_t added = InsertRange(info, fragmentOffset, fragment->GetPayload());
+  if (added == 0)
+    {
+      NS_LOG_INFO ("Duplicate fragment received, ignoring");
+      return nullptr;
     }
   
-  // Add fragment
-  info.fragments.push_back(fragment);
   NS_LOG_INFO ("Added fragment " << fragmentOffset << "/" << totalLength 
-              << " (" << info.fragments.size() << " fragments total)");
+              << " (" << info.coveredLength << " bytes covered in " << info.ranges.size() << " ranges)");
   
-  // Try to reassemble
-  return TryReassemble(info);
-}
-
-Ptr<Bundle> 
-FragmentationManager::TryReassemble (FragmentInfo& info)
-{
-  if (info.complete)
+  if (info.coveredLength < info.totalLength)
     {
-      NS_LOG_ERROR ("Fragment set already complete");
       return nullptr;
     }
   
-  // Sort fragments by offset
-  std::sort(info.fragments.begin(), info.fragments.end(), 
-           [](const Ptr<Bundle>& a, const Ptr<Bundle>& b) {
-             return a->GetPrimaryBlock().GetFragmentOffset() < b->GetPrimaryBlock().GetFragmentOffset();
-           });
+  return Reassemble(info);
+}
+
+uint64_t 
+FragmentationManager::InsertRange (FragmentInfo& info, uint64_t offset, const PayloadBuffer& payload)
+{
+  uint64_t end = std::min<uint64_t>(offset + payload.size(), info.totalLength);
+  uint64_t position = offset;
+  uint64_t added = 0;
   
-  // Check if we have all fragments
-  uint64_t coveredLength = 0;
-  for (const auto& frag : info.fragments)
+  // Skip what the range ending last before us already covers
+  auto it = info.ranges.upper_bound(position);
+  if (it != info.ranges.begin())
     {
-      uint64_t offset = frag->GetPrimaryBlock().GetFragmentOffset();
-      
-      // Check for gap
-      if (offset > coveredLength)
-        {
-          NS_LOG_INFO ("Gap detected in fragments, cannot reassemble yet");
-          return nullptr;
-        }
-      
-      // Get payload length
-      std::vector<uint8_t> payload = frag->GetPayload();
-      uint64_t length = payload.size();
-      
-      // Update covered length
-      coveredLength = std::max(coveredLength, offset + length);
+      auto previous = std::prev(it);
+      position = std::max(position, previous->first + previous->second.size());
     }
   
-  // Check if all data is covered
-  if (coveredLength < info.totalLength)
+  // Fill the gaps between the following ranges
+  while (position < end)
     {
-      NS_LOG_INFO ("Not all data covered (" << coveredLength << "/" << info.totalLength 
-                  << "), cannot reassemble yet");
-      return nullptr;
+      uint64_t gapEnd = (it != info.ranges.end()) ? std::min(end, it->first) : end;
+      if (gapEnd > position)
+        {
+          info.ranges.emplace_hint(it, position, payload.Slice(position - offset, gapEnd - position));
+          added += gapEnd - position;
+        }
+      if (it == info.ranges.end())
+        {
+          break;
+        }
+      position = std::max(position, it->first + it->second.size());
+      ++it;
     }
   
+  info.coveredLength += added;
+  return added;
+}
+
+Ptr<Bundle> 
+FragmentationManager::Reassemble (FragmentInfo& info)
+{
   NS_LOG_INFO ("All fragments received, reassembling");
   
-  // We have all fragments, reassemble the bundle
-  
   // Start with the primary block from the first fragment
-  PrimaryBlock reassembledPrimary = info.fragments[0]->GetPrimaryBlock();
+  PrimaryBlock reassembledPrimary = info.firstFragment->GetPrimaryBlock();
   
   // Remove fragmentation flags and information
   reassembledPrimary.SetFragmentation(false);
@@ -273,25 +300,21 @@ FragmentationManager::TryReassemble (FragmentInfo& info)
   // Create the reassembled bundle
   Ptr<Bundle> reassembled = Create<Bundle>(reassembledPrimary);
   
-  // Create payload by combining all fragments
-  std::vector<uint8_t> reassembledPayload(info.totalLength);
-  
-  for (const auto& frag : info.fragments)
+  // The ranges are disjoint and cover the ADU, so each is copied once
+  // into its place in a buffer of the final size
+  std::vector<uint8_t> data(info.totalLength);
+  for (const auto& range : info.ranges)
     {
-      uint64_t offset = frag->GetPrimaryBlock().GetFragmentOffset();
-      std::vector<uint8_t> fragPayload = frag->GetPayload();
-      
-      // Copy fragment payload to the correct position
-      std::copy(fragPayload.begin(), fragPayload.end(), reassembledPayload.begin() + offset);
+      range.second.CopyTo(data.data() + range.first);
     }
   
   // Add payload block
-  Ptr<PayloadBlock> payloadBlock = Create<PayloadBlock>(reassembledPayload);
+  Ptr<PayloadBlock> payloadBlock = Create<PayloadBlock>(PayloadBuffer(std::move(data)));
   reassembled->AddBlock(payloadBlock);
   
   // Copy other blocks that should be in the reassembled bundle
   // (We assume these are the same in all fragments, as per BP spec)
-  for (const auto& block : info.fragments[0]->GetCanonicalBlocks())
+  for (const auto& block : info.firstFragment->GetCanonicalBlocks())
     {
       if (block->GetBlockType() != BlockType::PAYLOAD_BLOCK)
         {
@@ -302,19 +325,35 @@ FragmentationManager::TryReassemble (FragmentInfo& info)
   // Calculate CRCs
   reassembled->CalculateCRC();
   
-  // Mark as complete
+  // Mark as complete; the set is kept until it expires so that late
+  // fragments are recognized, but its payload is released
   info.complete = true;
+  info.ranges.clear();
+  info.firstFragment = nullptr;
   m_reassembledBundles++;
+  if (m_reassembledCounter)
+    {
+      m_reassembledCounter->Add();
+    }
   
   return reassembled;
 }
 
+void 
+FragmentationManager::SetMetrics (Ptr<MetricsRegistry> metrics)
+{
+  std::lock_guard<OptionalMutex> lock(m_mutex);
+  m_metrics = metrics;
+  m_reassembledCounter = metrics ? metrics->GetCounter("fragments.reassembled") : nullptr;
+  m_failureCounter = metrics ? metrics->GetCounter("fragments.reassemblyFailures") : nullptr;
+}
+
 size_t 
 FragmentationManager::CleanupExpiredFragments ()
 {
   NS_LOG_FUNCTION (this);
   
-  std::lock_guard<std::mutex> lock(m_mutex);
+  std::lock_guard<OptionalMutex> lock(m_mutex);
   size_t removedCount = 0;
   
   Time now = Simulator::Now();
@@ -324,6 +363,10 @@ FragmentationManager::CleanupExpiredFragments ()
       if (now > it->second.expirationTime)
         {
           NS_LOG_INFO ("Removing expired fragment set for bundle " << it->first.ToString());
+          if (m_failureCounter && !it->second.complete)
+            {
+              m_failureCounter->Add();
+            }
           it = m_fragmentSets.erase(it);
           removedCount++;
           m_abandonedFragmentSets++;
@@ -340,7 +383,7 @@ FragmentationManager::CleanupExpiredFragments ()
 std::string 
 FragmentationManager::GetStats () const
 {
-  std::lock_guard<std::mutex> lock(m_mutex);
+  std::lock_guard<OptionalMutex> lock(m_mutex);
   
   std::stringstream ss;
   ss << "FragmentationManager(";
@@ -386,41 +429,40 @@ FragmentationManager::GetOriginalBundleId (Ptr<Bundle> fragment)
 }
 
 size_t 
-FragmentationManager::CalculateFragmentPayloadSize (Ptr<Bundle> bundle, size_t maxFragmentSize, 
-                                                 size_t fragmentIndex, size_t totalFragments)
+FragmentationManager::GetMaxFragmentPayload (Ptr<Bundle> bundle, size_t maxFragmentSize) const
 {
-  NS_LOG_FUNCTION (this << bundle << maxFragmentSize << fragmentIndex << totalFragments);
-  
-  std::vector<uint8_t> fullPayload = bundle->GetPayload();
-  uint64_t totalLength = fullPayload.size();
-  
-  // Calculate header overhead
-  size_t headerOverhead = 0;
-  Buffer primaryBuffer = bundle->GetPrimaryBlock().ToCbor();
-  headerOverhead += primaryBuffer.GetSize();
-  
-  // Add size of other blocks that must be replicated
-  for (const auto& block : bundle->GetCanonicalBlocks())
+  // An empty fragment at the largest offset has the largest headers of
+  // all fragments: fragment primary with offset and ADU length, replicated
+  // blocks, payload block with its CRC, and the bundle's array framing
+  uint64_t totalLength = bundle->GetPayload().size();
+  size_t overhead = BuildFragment(bundle, totalLength, 0)->ToCbor().GetSize();
+  if (overhead >= maxFragmentSize)
     {
-      if (block->GetBlockType() != BlockType::PAYLOAD_BLOCK && block->MustBeReplicated())
-        {
-          Buffer blockBuffer = block->ToCbor();
-          headerOverhead += blockBuffer.GetSize();
-        }
+      return 0;
     }
   
-  // Calculate max payload per fragment
-  size_t effectiveMaxSize = (maxFragmentSize > headerOverhead) ? 
-                          maxFragmentSize - headerOverhead : maxFragmentSize / 2;
+  // The payload byte string header grows with its length
+  size_t payload = maxFragmentSize - overhead;
+  size_t growth = CborWriter::HeaderSize(payload) - CborWriter::HeaderSize(0);
+  return payload > growth ? payload - growth : 0;
+}
+
+size_t 
+FragmentationManager::CalculateFragmentPayloadSize (Ptr<Bundle> bundle, size_t maxFragmentSize, 
+                                                 size_t fragmentIndex, size_t totalFragments)
+{
+  NS_LOG_FUNCTION (this << bundle << maxFragmentSize << fragmentIndex << totalFragments);
   
-  // For the last fragment, use remaining size
-  if (fragmentIndex == totalFragments - 1)
+  uint64_t totalLength = bundle->GetPayload().size();
+  size_t maxPayload = GetMaxFragmentPayload(bundle, maxFragmentSize);
+  uint64_t offset = static_cast<uint64_t>(fragmentIndex) * maxPayload;
+  if (maxPayload == 0 || offset >= totalLength)
     {
-      size_t remainingSize = totalLength - (fragmentIndex * effectiveMaxSize);
-      return remainingSize;
+      return 0;
     }
   
-  return effectiveMaxSize;
+  // The last fragment takes the remaining bytes
+  return std::min<uint64_t>(maxPayload, totalLength - offset);
 }
 
 } // namespace dtn7
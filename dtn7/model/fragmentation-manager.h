@@ -6,12 +6,15 @@
 #include "ns3/simple-ref-count.h"
 #include "ns3/log.h"
 
+#include <map>
 #include <unordered_map>
 #include <vector>
 #include <mutex>
 
 #include "bundle.h"
 #include "bundle-id.h"
+#include "metrics.h"
+#include "optional-mutex.h"
 
 namespace ns3 {
 
@@ -24,7 +27,9 @@ struct FragmentInfo
 {
   BundleID sourceId;                //!< Original bundle ID
   uint64_t totalLength;            //!< Total application data unit length
-  std::vector<Ptr<Bundle>> fragments; //!< Received fragments
+  std::map<uint64_t, PayloadBuffer> ranges; //!< Disjoint received payload ranges by ADU offset
+  uint64_t coveredLength;          //!< Number of ADU bytes in ranges
+  Ptr<Bundle> firstFragment;       //!< First fragment received, supplies the non-payload blocks
   Time expirationTime;             //!< When fragments expire
   bool complete;                   //!< Whether all fragments have been received
 };
@@ -54,6 +59,19 @@ public:
    */
   std::vector<Ptr<Bundle>> FragmentBundle (Ptr<Bundle> bundle, size_t maxFragmentSize);
   
+  /**
+   * \brief Create a single fragment covering part of a bundle's payload
+   *
+   * Used for reactive fragmentation, e.g. to forward the part of a bundle
+   * a peer has not acknowledged. Offsets are relative to the bundle's
+   * payload; fragments of fragments keep offsets into the original ADU.
+   * \param bundle Bundle to take the payload range from
+   * \param offset First payload byte of the fragment
+   * \param length Number of payload bytes
+   * \return Fragment, or nullptr if the bundle must not be fragmented
+   */
+  Ptr<Bundle> CreateFragment (Ptr<Bundle> bundle, uint64_t offset, uint64_t length);
+  
   /**
    * \brief Add a fragment to the reassembly process
    * \param fragment Fragment to add
@@ -73,6 +91,16 @@ public:
    */
   std::string GetStats () const;
   
+  /**
+   * \brief Count reassemblies in a node's metrics
+   *
+   * Counts "fragments.reassembled" and "fragments.reassemblyFailures",
+   * the fragment sets that expired incomplete plus fragments that did not
+   * fit their set.
+   * \param metrics Metrics of the node, nullptr to stop counting
+   */
+  void SetMetrics (Ptr<MetricsRegistry> metrics);
+  
   /**
    * \brief Check if a bundle is a fragment
    * \param bundle Bundle to check
@@ -89,18 +117,50 @@ public:
 
 private:
   std::unordered_map<BundleID, FragmentInfo> m_fragmentSets; //!< Fragment sets by original bundle ID
-  mutable std::mutex m_mutex;                          //!< Mutex for thread safety
+  mutable OptionalMutex m_mutex;                       //!< Mutex for thread safety
   uint64_t m_fragmentedBundles;                       //!< Number of bundles fragmented
   uint64_t m_createdFragments;                        //!< Number of fragments created
   uint64_t m_reassembledBundles;                      //!< Number of bundles reassembled
   uint64_t m_abandonedFragmentSets;                   //!< Number of abandoned fragment sets
+  Ptr<MetricsRegistry> m_metrics;                     //!< Metrics of the node
+  MetricCounter* m_reassembledCounter;                //!< Reassembled bundles, nullptr if not counted
+  MetricCounter* m_failureCounter;                    //!< Reassembly failures, nullptr if not counted
   
   /**
-   * \brief Try to reassemble fragments into a complete bundle
+   * \brief Add the part of a payload range not covered yet
+   *
+   * Parts overlapping ranges already received are trimmed off, so the
+   * ranges stay disjoint and coveredLength grows by the new bytes only.
    * \param info Fragment info struct
-   * \return Reassembled bundle if complete, nullptr otherwise
+   * \param offset ADU offset of the range
+   * \param payload Payload bytes of the range
+   * \return Number of new bytes
+   */
+  static uint64_t InsertRange (FragmentInfo& info, uint64_t offset, const PayloadBuffer& payload);
+  
+  /**
+   * \brief Reassemble a fully covered fragment set into one bundle
+   * \param info Fragment info struct
+   * \return Reassembled bundle
+   */
+  Ptr<Bundle> Reassemble (FragmentInfo& info);
+  
+  /**
+   * \brief Build a fragment for a checked payload range
+   * \param bundle Bundle to fragment
+   * \param offset First payload byte
+   * \param length Number of payload bytes
+   * \return Fragment
+   */
+  Ptr<Bundle> BuildFragment (Ptr<Bundle> bundle, uint64_t offset, uint64_t length) const;
+  
+  /**
+   * \brief Get the largest payload a fragment of a bundle can carry
+   * \param bundle Bundle to fragment
+   * \param maxFragmentSize Maximum encoded size of each fragment
+   * \return Payload bytes per fragment, 0 if the headers alone do not fit
    */
-  Ptr<Bundle> TryReassemble (FragmentInfo& info);
+  size_t GetMaxFragmentPayload (Ptr<Bundle> bundle, size_t maxFragmentSize) const;
   
   /**
    * \brief Calculate fragment payload size
@@ -1,7 +1,11 @@
 #include "memory-bundle-store.h"
+#include "administrative-record.h"
 #include "ns3/simulator.h"
 #include "ns3/uinteger.h"  // Added for UintegerValue
+#include "ns3/enum.h"
 #include "ns3/object.h"    // Added for type accessors and checkers
+#include "ns3/trace-source-accessor.h"
+#include <algorithm>
 #include <sstream>
 #include <functional> // For hash function support
 
@@ -23,6 +27,24 @@ MemoryBundleStore::GetTypeId ()
                    UintegerValue (1000),
                    MakeUintegerAccessor (&MemoryBundleStore::m_maxBundles),
                    MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("MaxBytes",
+                   "Maximum number of bytes of encoded bundles to store, 0 for no limit",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&MemoryBundleStore::m_maxBytes),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("EvictionPolicy",
+                   "Which stored bundles to drop when a new bundle does not fit",
+                   EnumValue (MemoryBundleStore::REJECT_NEW),
+                   MakeEnumAccessor<EvictionPolicy> (&MemoryBundleStore::m_evictionPolicy),
+                   MakeEnumChecker (MemoryBundleStore::REJECT_NEW, "RejectNew",
+                                    MemoryBundleStore::DROP_OLDEST, "DropOldest",
+                                    MemoryBundleStore::DROP_SOONEST_EXPIRING, "DropSoonestExpiring",
+                                    MemoryBundleStore::DROP_MOST_REPLICATED, "DropMostReplicated",
+                                    MemoryBundleStore::DROP_RANDOM, "DropRandom"))
+    .AddTraceSource ("BundleDeleted",
+                     "A bundle was evicted or expired; the second argument is the status report reason code",
+                     MakeTraceSourceAccessor (&MemoryBundleStore::m_deletedTrace),
+                     "ns3::dtn7::MemoryBundleStore::BundleDeletedTracedCallback")
   ;
   return tid;
 }
@@ -31,8 +53,16 @@ MemoryBundleStore::MemoryBundleStore ()
   : m_pushCount (0),
     m_getCount (0),
     m_removeCount (0),
+    m_evictCount (0),
+    m_rejectCount (0),
     m_creationTime (Simulator::Now ()),
-    m_maxBundles (1000)  // Added to initialize the new member variable
+    m_maxBundles (1000),  // Added to initialize the new member variable
+    m_maxBytes (0),
+    m_storedBytes (0),
+    m_nextSequence (0),
+    m_generation (0),
+    m_evictionPolicy (REJECT_NEW),
+    m_random (CreateObject<UniformRandomVariable> ())
 {
 }
 
@@ -50,33 +80,112 @@ MemoryBundleStore::Push (Ptr<Bundle> bundle)
   
   BundleID id = bundle->GetId ();
   
-  std::lock_guard<std::mutex> lock (m_mutex);
+  // The encoding is cached on the bundle and reused when it is sent
+  uint64_t size = bundle->ToCbor ().GetSize ();
   
-  // Check if we've reached the maximum number of bundles
-  if (m_bundles.size() >= m_maxBundles)
+  std::vector<Ptr<Bundle>> evicted;
+  {
+    std::unique_lock<OptionalMutex> lock (m_mutex);
+    
+    // A new copy of a stored bundle replaces it in place if it fits
+    bool replacing = false;
+    Entry previous;
+    auto existing = m_bundles.find (id);
+    if (existing != m_bundles.end ())
+      {
+        Entry& entry = existing->second;
+        if (m_maxBytes == 0 || m_storedBytes - entry.size + size <= m_maxBytes)
+          {
+            RemoveFromIndexes (id, entry.bundle);
+            m_storedBytes = m_storedBytes - entry.size + size;
+            entry.bundle = bundle;
+            entry.size = size;
+            m_generations.erase (entry.generation);
+            entry.generation = ++m_generation;
+            m_generations[entry.generation] = id;
+            if (entry.expiration != GetExpiration (bundle))
+              {
+                entry.expiration = GetExpiration (bundle);
+                m_expiryQueue.push (ExpiryItem {entry.expiration, id});
+              }
+            AddToIndexes (id, bundle);
+            m_pushCount++;
+            lock.unlock ();
+            NotifyStored (bundle, size);
+            return true;
+          }
+        
+        // A larger copy goes through admission like a new bundle; the old
+        // copy is put back if the new one is rejected
+        replacing = true;
+        previous = entry;
+        Erase (existing);
+      }
+    
+    bool admitted = m_maxBytes == 0 || size <= m_maxBytes;
+    
+    // Make room according to the eviction policy
+    while (admitted && !HasRoomFor (size))
+      {
+        EntryIterator victim = m_evictionPolicy == REJECT_NEW ? m_bundles.end () : SelectVictim ();
+        if (victim == m_bundles.end ())
+          {
+            break;
+          }
+        
+        evicted.push_back (victim->second.bundle);
+        Erase (victim);
+        m_evictCount++;
+      }
+    
+    if (admitted && HasRoomFor (size))
+      {
+        // Store the bundle; a replacement keeps its arrival order and replication count
+        Entry entry;
+        entry.bundle = bundle;
+        entry.expiration = GetExpiration (bundle);
+        entry.size = size;
+        entry.sequence = replacing ? previous.sequence : m_nextSequence++;
+        entry.generation = ++m_generation;
+        entry.replication = replacing ? previous.replication : 0;
+        Insert (id, entry);
+        m_pushCount++;
+      }
+    else
+      {
+        m_rejectCount++;
+        if (replacing)
+          {
+            Insert (id, previous);
+          }
+        bundle = nullptr;
+      }
+  }
+  
+  // Report evictions outside the lock, the callback may store a status report
+  for (const Ptr<Bundle>& victim : evicted)
     {
-      // Could implement bundle eviction policy here
-      // For now, just reject the new bundle
-      return false;
+      m_deletedTrace (victim, static_cast<uint64_t> (ReasonCode::DEPLETED_STORAGE));
+      NotifyDeleted (victim, static_cast<uint64_t> (ReasonCode::DEPLETED_STORAGE));
     }
   
-  // Store the bundle
-  m_bundles[id] = bundle;
-  m_pushCount++;
-  
-  return true;
+  if (bundle)
+    {
+      NotifyStored (bundle, size);
+    }
+  return bundle != nullptr;
 }
 
 std::optional<Ptr<Bundle>> 
 MemoryBundleStore::Get (const BundleID& id) const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   auto it = m_bundles.find (id);
   if (it != m_bundles.end ())
     {
       const_cast<MemoryBundleStore*>(this)->m_getCount++;
-      return it->second;
+      return it->second.bundle;
     }
   
   return std::nullopt;
@@ -85,7 +194,7 @@ MemoryBundleStore::Get (const BundleID& id) const
 bool 
 MemoryBundleStore::Has (const BundleID& id) const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   return m_bundles.find (id) != m_bundles.end ();
 }
@@ -93,30 +202,32 @@ MemoryBundleStore::Has (const BundleID& id) const
 bool 
 MemoryBundleStore::Remove (const BundleID& id)
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   auto it = m_bundles.find (id);
-  if (it != m_bundles.end ())
+  if (it == m_bundles.end ())
     {
-      m_bundles.erase (it);
-      m_removeCount++;
-      return true;
+      return false;
     }
   
-  return false;
+  Erase (it);
+  m_removeCount++;
+  CompactQueues ();
+  
+  return true;
 }
 
 std::vector<Ptr<Bundle>> 
 MemoryBundleStore::GetAll () const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   std::vector<Ptr<Bundle>> result;
   result.reserve (m_bundles.size ());
   
   for (const auto& pair : m_bundles)
     {
-      result.push_back (pair.second);
+      result.push_back (pair.second.bundle);
     }
   
   return result;
@@ -125,25 +236,85 @@ MemoryBundleStore::GetAll () const
 std::vector<Ptr<Bundle>> 
 MemoryBundleStore::Query (std::function<bool(Ptr<Bundle>)> predicate) const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   std::vector<Ptr<Bundle>> result;
   
   for (const auto& pair : m_bundles)
     {
-      if (predicate (pair.second))
+      if (predicate (pair.second.bundle))
         {
-          result.push_back (pair.second);
+          result.push_back (pair.second.bundle);
         }
     }
   
   return result;
 }
 
+std::vector<Ptr<Bundle>> 
+MemoryBundleStore::QueryByDestination (const EndpointID& destination) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  return Lookup (m_byDestination, destination);
+}
+
+std::vector<Ptr<Bundle>> 
+MemoryBundleStore::QueryBySource (const EndpointID& source) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  return Lookup (m_bySource, source);
+}
+
+uint64_t 
+MemoryBundleStore::GetGeneration () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  return m_generation;
+}
+
+std::vector<StoredBundle> 
+MemoryBundleStore::GetPage (BundleCursor& cursor, size_t limit) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::vector<StoredBundle> page;
+  page.reserve (std::min (limit, m_generations.size ()));
+  
+  for (auto it = m_generations.upper_bound (cursor.generation);
+       it != m_generations.end () && page.size () < limit; ++it)
+    {
+      page.push_back (StoredBundle {m_bundles.at (it->second).bundle, it->first});
+      cursor.generation = it->first;
+    }
+  
+  return page;
+}
+
+std::vector<StoredBundleId> 
+MemoryBundleStore::GetIdPage (BundleCursor& cursor, size_t limit) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  std::vector<StoredBundleId> page;
+  page.reserve (std::min (limit, m_generations.size ()));
+  
+  for (auto it = m_generations.upper_bound (cursor.generation);
+       it != m_generations.end () && page.size () < limit; ++it)
+    {
+      page.push_back (StoredBundleId {it->second, it->first});
+      cursor.generation = it->first;
+    }
+  
+  return page;
+}
+
 size_t 
 MemoryBundleStore::Count () const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   return m_bundles.size ();
 }
@@ -151,31 +322,46 @@ MemoryBundleStore::Count () const
 size_t 
 MemoryBundleStore::Cleanup ()
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::vector<Ptr<Bundle>> expired;
+  {
+    std::lock_guard<OptionalMutex> lock (m_mutex);
+    
+    Time now = Simulator::Now ();
+    
+    // Only the expired prefix of the heap is visited
+    while (!m_expiryQueue.empty () && now > m_expiryQueue.top ().expiration)
+      {
+        ExpiryItem item = m_expiryQueue.top ();
+        m_expiryQueue.pop ();
+        
+        // Skip items whose bundle was removed or replaced since
+        auto it = m_bundles.find (item.id);
+        if (it == m_bundles.end () || it->second.expiration != item.expiration)
+          {
+            continue;
+          }
+        
+        expired.push_back (it->second.bundle);
+        Erase (it);
+        m_removeCount++;
+      }
+    
+    CompactQueues ();
+  }
   
-  size_t removedCount = 0;
-  
-  for (auto it = m_bundles.begin (); it != m_bundles.end ();)
+  for (const Ptr<Bundle>& bundle : expired)
     {
-      if (IsExpired (it->second))
-        {
-          it = m_bundles.erase (it);
-          m_removeCount++;
-          removedCount++;
-        }
-      else
-        {
-          ++it;
-        }
+      m_deletedTrace (bundle, static_cast<uint64_t> (ReasonCode::LIFETIME_EXPIRED));
+      NotifyDeleted (bundle, static_cast<uint64_t> (ReasonCode::LIFETIME_EXPIRED));
     }
   
-  return removedCount;
+  return expired.size ();
 }
 
 std::string 
 MemoryBundleStore::GetStats () const
 {
-  std::lock_guard<std::mutex> lock (m_mutex);
+  std::lock_guard<OptionalMutex> lock (m_mutex);
   
   std::stringstream ss;
   
@@ -183,26 +369,235 @@ MemoryBundleStore::GetStats () const
   
   ss << "MemoryBundleStore(";
   ss << "count=" << m_bundles.size ();
+  ss << ", bytes=" << m_storedBytes;
   ss << ", pushed=" << m_pushCount;
   ss << ", retrieved=" << m_getCount;
   ss << ", removed=" << m_removeCount;
+  ss << ", evicted=" << m_evictCount;
+  ss << ", rejected=" << m_rejectCount;
   ss << ", maxBundles=" << m_maxBundles;
+  ss << ", maxBytes=" << m_maxBytes;
+  ss << ", destinations=" << m_byDestination.size ();
+  ss << ", sources=" << m_bySource.size ();
   ss << ", uptime=" << uptime.GetSeconds () << "s";
   ss << ")";
   
   return ss.str ();
 }
 
+void 
+MemoryBundleStore::SetReplicationHint (const BundleID& id, uint32_t copies)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  auto it = m_bundles.find (id);
+  if (it == m_bundles.end () || copies <= it->second.replication)
+    {
+      return;
+    }
+  
+  it->second.replication = copies;
+  m_replicationQueue.push (ReplicationItem {copies, it->second.sequence, id});
+}
+
+uint64_t 
+MemoryBundleStore::GetStoredBytes () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  return m_storedBytes;
+}
+
+int64_t 
+MemoryBundleStore::AssignStreams (int64_t stream)
+{
+  m_random->SetStream (stream);
+  return 1;
+}
+
+Time 
+MemoryBundleStore::GetExpiration (Ptr<Bundle> bundle)
+{
+  return bundle->GetPrimaryBlock ().GetExpirationTime ();
+}
+
+void 
+MemoryBundleStore::AddToIndexes (const BundleID& id, Ptr<Bundle> bundle)
+{
+  const PrimaryBlock& primary = bundle->GetPrimaryBlock ();
+  m_byDestination[primary.GetDestinationEID ()].insert (id);
+  m_bySource[primary.GetSourceNodeEID ()].insert (id);
+}
+
+void 
+MemoryBundleStore::RemoveFromIndexes (const BundleID& id, Ptr<Bundle> bundle)
+{
+  const PrimaryBlock& primary = bundle->GetPrimaryBlock ();
+  
+  auto destination = m_byDestination.find (primary.GetDestinationEID ());
+  if (destination != m_byDestination.end ())
+    {
+      destination->second.erase (id);
+      if (destination->second.empty ())
+        {
+          m_byDestination.erase (destination);
+        }
+    }
+  
+  auto source = m_bySource.find (primary.GetSourceNodeEID ());
+  if (source != m_bySource.end ())
+    {
+      source->second.erase (id);
+      if (source->second.empty ())
+        {
+          m_bySource.erase (source);
+        }
+    }
+}
+
+void 
+MemoryBundleStore::Insert (const BundleID& id, Entry entry)
+{
+  entry.slot = m_slots.size ();
+  m_bundles[id] = entry;
+  m_expiryQueue.push (ExpiryItem {entry.expiration, id});
+  m_replicationQueue.push (ReplicationItem {entry.replication, entry.sequence, id});
+  m_arrivals[entry.sequence] = id;
+  m_generations[entry.generation] = id;
+  m_slots.push_back (id);
+  m_storedBytes += entry.size;
+  AddToIndexes (id, entry.bundle);
+}
+
+void 
+MemoryBundleStore::Erase (EntryIterator it)
+{
+  const Entry& entry = it->second;
+  
+  RemoveFromIndexes (it->first, entry.bundle);
+  m_arrivals.erase (entry.sequence);
+  m_generations.erase (entry.generation);
+  m_storedBytes -= entry.size;
+  
+  // Fill the slot with the last bundle so the array stays dense
+  const BundleID& last = m_slots.back ();
+  if (entry.slot != m_slots.size () - 1)
+    {
+      m_bundles.at (last).slot = entry.slot;
+      m_slots[entry.slot] = last;
+    }
+  m_slots.pop_back ();
+  
+  m_bundles.erase (it);
+}
+
 bool 
-MemoryBundleStore::IsExpired (Ptr<Bundle> bundle) const
+MemoryBundleStore::HasRoomFor (uint64_t size) const
 {
-  Time creationTime = bundle->GetPrimaryBlock ().GetCreationTimestamp ().ToTime ();
-  Time lifetime = bundle->GetPrimaryBlock ().GetLifetime ();
-  Time expirationTime = creationTime + lifetime;
+  if (m_bundles.size () >= m_maxBundles)
+    {
+      return false;
+    }
+  return m_maxBytes == 0 || m_storedBytes + size <= m_maxBytes;
+}
+
+MemoryBundleStore::EntryIterator 
+MemoryBundleStore::SelectVictim ()
+{
+  if (m_bundles.empty ())
+    {
+      return m_bundles.end ();
+    }
+  
+  switch (m_evictionPolicy)
+    {
+      case DROP_OLDEST:
+        return m_bundles.find (m_arrivals.begin ()->second);
+      
+      case DROP_SOONEST_EXPIRING:
+        while (!m_expiryQueue.empty ())
+          {
+            ExpiryItem item = m_expiryQueue.top ();
+            m_expiryQueue.pop ();
+            auto it = m_bundles.find (item.id);
+            if (it != m_bundles.end () && it->second.expiration == item.expiration)
+              {
+                return it;
+              }
+          }
+        break;
+      
+      case DROP_MOST_REPLICATED:
+        while (!m_replicationQueue.empty ())
+          {
+            ReplicationItem item = m_replicationQueue.top ();
+            m_replicationQueue.pop ();
+            auto it = m_bundles.find (item.id);
+            if (it != m_bundles.end () && it->second.replication == item.replication &&
+                it->second.sequence == item.sequence)
+              {
+                return it;
+              }
+          }
+        break;
+      
+      case DROP_RANDOM:
+        return m_bundles.find (m_slots[m_random->GetInteger (0, m_slots.size () - 1)]);
+      
+      case REJECT_NEW:
+      default:
+        break;
+    }
+  
+  return m_bundles.end ();
+}
+
+void 
+MemoryBundleStore::CompactQueues ()
+{
+  // Removed bundles leave their heap items behind; rebuild a heap once
+  // those make up most of it
+  if (m_expiryQueue.size () > 2 * m_bundles.size () + 64)
+    {
+      std::priority_queue<ExpiryItem> rebuilt;
+      for (const auto& pair : m_bundles)
+        {
+          rebuilt.push (ExpiryItem {pair.second.expiration, pair.first});
+        }
+      m_expiryQueue.swap (rebuilt);
+    }
   
-  return Simulator::Now () > expirationTime;
+  if (m_replicationQueue.size () > 2 * m_bundles.size () + 64)
+    {
+      std::priority_queue<ReplicationItem> rebuilt;
+      for (const auto& pair : m_bundles)
+        {
+          rebuilt.push (ReplicationItem {pair.second.replication, pair.second.sequence, pair.first});
+        }
+      m_replicationQueue.swap (rebuilt);
+    }
+}
+
+std::vector<Ptr<Bundle>> 
+MemoryBundleStore::Lookup (const EndpointIndex& index, const EndpointID& eid) const
+{
+  std::vector<Ptr<Bundle>> result;
+  
+  auto it = index.find (eid);
+  if (it == index.end ())
+    {
+      return result;
+    }
+  
+  result.reserve (it->second.size ());
+  for (const BundleID& id : it->second)
+    {
+      result.push_back (m_bundles.at (id).bundle);
+    }
+  
+  return result;
 }
 
 } // namespace dtn7
 
-} // namespace ns3
\ No newline at end of file
+} // namespace ns3
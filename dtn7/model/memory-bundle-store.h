@@ -2,8 +2,14 @@
 #define DTN7_MEMORY_BUNDLE_STORE_H
 
 #include "bundle-store.h"
+#include "optional-mutex.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
 
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <queue>
 #include <mutex>
 #include <chrono>
 
@@ -14,10 +20,28 @@ namespace dtn7 {
 /**
  * \ingroup dtn7
  * \brief In-memory implementation of bundle storage
+ *
+ * Bundles are indexed by destination and source node, and a min-heap
+ * keyed on expiration time lets Cleanup visit only expired bundles.
+ * The store is bounded by a bundle count and a byte capacity; when a
+ * new bundle does not fit, the configured eviction policy picks which
+ * stored bundles make room for it.
  */
 class MemoryBundleStore : public BundleStore
 {
 public:
+  /**
+   * \brief Which bundles to drop when the store is full
+   */
+  enum EvictionPolicy
+  {
+    REJECT_NEW,             //!< Keep the stored bundles and reject the new one
+    DROP_OLDEST,            //!< Drop the bundle that was stored first
+    DROP_SOONEST_EXPIRING,  //!< Drop the bundle closest to its expiration
+    DROP_MOST_REPLICATED,   //!< Drop the bundle with the most copies elsewhere
+    DROP_RANDOM             //!< Drop a bundle chosen uniformly at random
+  };
+  
   /**
    * \brief Get the type ID
    * \return Type ID
@@ -41,29 +65,165 @@ public:
   bool Remove (const BundleID& id) override;
   std::vector<Ptr<Bundle>> GetAll () const override;
   std::vector<Ptr<Bundle>> Query (std::function<bool(Ptr<Bundle>)> predicate) const override;
+  std::vector<Ptr<Bundle>> QueryByDestination (const EndpointID& destination) const override;
+  std::vector<Ptr<Bundle>> QueryBySource (const EndpointID& source) const override;
+  uint64_t GetGeneration () const override;
+  std::vector<StoredBundle> GetPage (BundleCursor& cursor, size_t limit) const override;
+  std::vector<StoredBundleId> GetIdPage (BundleCursor& cursor, size_t limit) const override;
   size_t Count () const override;
   size_t Cleanup () override;
   std::string GetStats () const override;
+  void SetReplicationHint (const BundleID& id, uint32_t copies) override;
+  
+  /**
+   * \brief Get the number of bytes held by stored bundles
+   * \return Sum of the encoded bundle sizes
+   */
+  uint64_t GetStoredBytes () const;
+  
+  /**
+   * \brief Assign a fixed random variable stream number
+   * \param stream First stream index to use
+   * \return Number of streams assigned
+   */
+  int64_t AssignStreams (int64_t stream);
 
 private:
-  std::unordered_map<BundleID, Ptr<Bundle>> m_bundles;  //!< Stored bundles
-  mutable std::mutex m_mutex;                           //!< Mutex for thread safety
+  /**
+   * \brief A stored bundle and the bookkeeping used for eviction
+   */
+  struct Entry
+  {
+    Ptr<Bundle> bundle;   //!< Stored bundle
+    Time expiration;      //!< Creation time plus lifetime
+    uint64_t size;        //!< Encoded size in bytes
+    uint64_t sequence;    //!< Arrival order
+    uint64_t generation;  //!< Store generation of the push that stored it
+    uint32_t replication; //!< Copies known to exist elsewhere
+    size_t slot;          //!< Position in m_slots
+  };
+  
+  /**
+   * \brief Expiry heap element, ordered so the earliest expiration is on top
+   */
+  struct ExpiryItem
+  {
+    Time expiration; //!< Expiration time of the bundle when it was pushed
+    BundleID id;     //!< Bundle ID
+    
+    bool operator< (const ExpiryItem& other) const { return other.expiration < expiration; }
+  };
+  
+  /**
+   * \brief Replication heap element, the most replicated and then oldest bundle on top
+   */
+  struct ReplicationItem
+  {
+    uint32_t replication; //!< Replication hint when the item was pushed
+    uint64_t sequence;    //!< Arrival order of the bundle
+    BundleID id;          //!< Bundle ID
+    
+    bool operator< (const ReplicationItem& other) const
+    {
+      if (replication != other.replication)
+        {
+          return replication < other.replication;
+        }
+      return other.sequence < sequence;
+    }
+  };
+  
+  typedef std::unordered_map<EndpointID, std::unordered_set<BundleID>> EndpointIndex;
+  typedef std::unordered_map<BundleID, Entry>::iterator EntryIterator;
+  
+  std::unordered_map<BundleID, Entry> m_bundles;        //!< Stored bundles
+  std::priority_queue<ExpiryItem> m_expiryQueue;        //!< Expiry heap, items of removed bundles are skipped lazily
+  std::priority_queue<ReplicationItem> m_replicationQueue; //!< Replication heap, stale items are skipped lazily
+  std::map<uint64_t, BundleID> m_arrivals;              //!< Bundle IDs in arrival order
+  std::map<uint64_t, BundleID> m_generations;           //!< Bundle IDs by generation, for cursors
+  std::vector<BundleID> m_slots;                        //!< Bundle IDs in no particular order, for random picks
+  EndpointIndex m_byDestination;                        //!< Bundle IDs by destination EID
+  EndpointIndex m_bySource;                             //!< Bundle IDs by source node EID
+  mutable OptionalMutex m_mutex;                        //!< Mutex for thread safety
   size_t m_pushCount;                                   //!< Number of pushed bundles
   size_t m_getCount;                                    //!< Number of retrieved bundles
   size_t m_removeCount;                                 //!< Number of removed bundles
+  size_t m_evictCount;                                  //!< Number of bundles evicted to make room
+  size_t m_rejectCount;                                 //!< Number of bundles rejected for lack of room
   Time m_creationTime;                                  //!< Store creation time
   uint32_t m_maxBundles;                                //!< Maximum number of bundles to store
+  uint64_t m_maxBytes;                                  //!< Maximum number of bytes to store, 0 for no limit
+  uint64_t m_storedBytes;                               //!< Bytes held by stored bundles
+  uint64_t m_nextSequence;                              //!< Arrival order of the next pushed bundle
+  uint64_t m_generation;                                //!< Generation of the most recent push
+  EvictionPolicy m_evictionPolicy;                      //!< Eviction policy
+  Ptr<UniformRandomVariable> m_random;                  //!< Random source for DROP_RANDOM
+  
+  TracedCallback<Ptr<Bundle>, uint64_t> m_deletedTrace;       //!< Trace for evicted and expired bundles
+  
+  /**
+   * \brief Get the time at which a bundle expires
+   * \param bundle Bundle
+   * \return Creation time plus lifetime
+   */
+  static Time GetExpiration (Ptr<Bundle> bundle);
+  
+  /**
+   * \brief Add a bundle to the secondary indexes
+   * \param id Bundle ID
+   * \param bundle Bundle
+   */
+  void AddToIndexes (const BundleID& id, Ptr<Bundle> bundle);
+  
+  /**
+   * \brief Remove a bundle from the secondary indexes
+   * \param id Bundle ID
+   * \param bundle Bundle
+   */
+  void RemoveFromIndexes (const BundleID& id, Ptr<Bundle> bundle);
+  
+  /**
+   * \brief Store an entry and add all its bookkeeping
+   * \param id Bundle ID
+   * \param entry Entry to store, its slot is assigned here
+   */
+  void Insert (const BundleID& id, Entry entry);
+  
+  /**
+   * \brief Erase a stored bundle and all its bookkeeping
+   * \param it Bundle to erase
+   */
+  void Erase (EntryIterator it);
+  
+  /**
+   * \brief Check whether a bundle of the given size fits without evicting
+   * \param size Encoded size of the new bundle
+   * \return true if both the count and the byte limit allow it
+   */
+  bool HasRoomFor (uint64_t size) const;
+  
+  /**
+   * \brief Pick the bundle the eviction policy drops next
+   * \return Iterator to the victim, end if nothing can be evicted
+   */
+  EntryIterator SelectVictim ();
+  
+  /**
+   * \brief Rebuild the lazy heaps once stale items make up most of them
+   */
+  void CompactQueues ();
   
   /**
-   * \brief Check if a bundle is expired
-   * \param bundle Bundle to check
-   * \return true if bundle is expired
+   * \brief Collect the bundles listed under an endpoint in an index
+   * \param index Index to look in
+   * \param eid Endpoint
+   * \return Bundles
    */
-  bool IsExpired (Ptr<Bundle> bundle) const;
+  std::vector<Ptr<Bundle>> Lookup (const EndpointIndex& index, const EndpointID& eid) const;
 };
 
 } // namespace dtn7
 
 } // namespace ns3
 
-#endif /* DTN7_MEMORY_BUNDLE_STORE_H */
\ No newline at end of file
+#endif /* DTN7_MEMORY_BUNDLE_STORE_H */
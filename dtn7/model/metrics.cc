@@ -0,0 +1,171 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+LatencyHistogram::LatencyHistogram ()
+  : m_count (0),
+    m_sum (0),
+    m_max (0)
+{
+  for (auto& bucket : m_buckets)
+    {
+      bucket.store (0, std::memory_order_relaxed);
+    }
+}
+
+void 
+LatencyHistogram::Record (Time latency)
+{
+  int64_t signedMicroseconds = latency.GetMicroSeconds ();
+  uint64_t microseconds = signedMicroseconds > 0 ? static_cast<uint64_t> (signedMicroseconds) : 0;
+  
+  // Bucket index is the bit length of the latency in microseconds
+  size_t bucket = 0;
+  for (uint64_t value = microseconds; value != 0 && bucket < BUCKETS - 1; value >>= 1)
+    {
+      bucket++;
+    }
+  
+  m_buckets[bucket].fetch_add (1, std::memory_order_relaxed);
+  m_count.fetch_add (1, std::memory_order_relaxed);
+  m_sum.fetch_add (microseconds, std::memory_order_relaxed);
+  
+  uint64_t max = m_max.load (std::memory_order_relaxed);
+  while (microseconds > max && !m_max.compare_exchange_weak (max, microseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+Time 
+LatencyHistogram::GetMean () const
+{
+  uint64_t count = GetCount ();
+  if (count == 0)
+    {
+      return Time (0);
+    }
+  return MicroSeconds (m_sum.load (std::memory_order_relaxed) / count);
+}
+
+Time 
+LatencyHistogram::GetQuantile (double q) const
+{
+  uint64_t count = GetCount ();
+  if (count == 0)
+    {
+      return Time (0);
+    }
+  
+  uint64_t rank = static_cast<uint64_t> (std::ceil (std::clamp (q, 0.0, 1.0) * count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++)
+    {
+      seen += GetBucket (i);
+      if (seen >= std::max<uint64_t> (rank, 1))
+        {
+          return std::min (GetBucketLimit (i), GetMax ());
+        }
+    }
+  return GetMax ();
+}
+
+Time 
+LatencyHistogram::GetBucketLimit (size_t bucket)
+{
+  return MicroSeconds (uint64_t (1) << bucket);
+}
+
+MetricCounter* 
+MetricsRegistry::GetCounter (const std::string& name)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  return &m_counters.try_emplace (name).first->second;
+}
+
+LatencyHistogram* 
+MetricsRegistry::GetHistogram (const std::string& name)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  return &m_histograms.try_emplace (name).first->second;
+}
+
+std::string 
+MetricsRegistry::GetCsvHeader ()
+{
+  return "node,metric,statistic,value";
+}
+
+void 
+MetricsRegistry::WriteCsv (std::ostream& os, const std::string& node) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  for (const auto& pair : m_counters)
+    {
+      os << node << "," << pair.first << ",value," << pair.second.Get () << "\n";
+    }
+  
+  for (const auto& pair : m_histograms)
+    {
+      const LatencyHistogram& histogram = pair.second;
+      os << node << "," << pair.first << ",count," << histogram.GetCount () << "\n";
+      os << node << "," << pair.first << ",mean_us," << histogram.GetMean ().GetMicroSeconds () << "\n";
+      os << node << "," << pair.first << ",p50_us," << histogram.GetQuantile (0.5).GetMicroSeconds () << "\n";
+      os << node << "," << pair.first << ",p90_us," << histogram.GetQuantile (0.9).GetMicroSeconds () << "\n";
+      os << node << "," << pair.first << ",p99_us," << histogram.GetQuantile (0.99).GetMicroSeconds () << "\n";
+      os << node << "," << pair.first << ",max_us," << histogram.GetMax ().GetMicroSeconds () << "\n";
+    }
+}
+
+void 
+MetricsRegistry::WriteJson (std::ostream& os) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  os << "{\"counters\":{";
+  bool first = true;
+  for (const auto& pair : m_counters)
+    {
+      os << (first ? "" : ",") << "\"" << pair.first << "\":" << pair.second.Get ();
+      first = false;
+    }
+  
+  os << "},\"histograms\":{";
+  first = true;
+  for (const auto& pair : m_histograms)
+    {
+      const LatencyHistogram& histogram = pair.second;
+      os << (first ? "" : ",") << "\"" << pair.first << "\":{"
+         << "\"count\":" << histogram.GetCount ()
+         << ",\"mean_us\":" << histogram.GetMean ().GetMicroSeconds ()
+         << ",\"p50_us\":" << histogram.GetQuantile (0.5).GetMicroSeconds ()
+         << ",\"p90_us\":" << histogram.GetQuantile (0.9).GetMicroSeconds ()
+         << ",\"p99_us\":" << histogram.GetQuantile (0.99).GetMicroSeconds ()
+         << ",\"max_us\":" << histogram.GetMax ().GetMicroSeconds ()
+         << ",\"buckets\":[";
+  
+      // Trailing empty buckets are left out
+      size_t used = LatencyHistogram::BUCKETS;
+      while (used > 0 && histogram.GetBucket (used - 1) == 0)
+        {
+          used--;
+        }
+      for (size_t i = 0; i < used; i++)
+        {
+          os << (i ? "," : "") << histogram.GetBucket (i);
+        }
+      os << "]}";
+      first = false;
+    }
+  os << "}}";
+}
+
+} // namespace dtn7
+
+} // namespace ns3
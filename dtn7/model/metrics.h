@@ -0,0 +1,185 @@
+#ifndef DTN7_METRICS_H
+#define DTN7_METRICS_H
+
+#include "ns3/nstime.h"
+#include "ns3/simple-ref-count.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "optional-mutex.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Monotonic counter updated on hot paths
+ *
+ * Adding is a single relaxed atomic increment.
+ */
+class MetricCounter
+{
+public:
+  MetricCounter () : m_value (0) {}
+  
+  MetricCounter (const MetricCounter&) = delete;
+  MetricCounter& operator= (const MetricCounter&) = delete;
+  
+  /**
+   * \brief Add to the counter
+   * \param amount Amount to add
+   */
+  void Add (uint64_t amount = 1) { m_value.fetch_add (amount, std::memory_order_relaxed); }
+  
+  /**
+   * \brief Get the counter value
+   * \return Value
+   */
+  uint64_t Get () const { return m_value.load (std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> m_value; //!< Counter value
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Fixed-size histogram of latencies
+ *
+ * Latencies are counted in power-of-two buckets of microseconds: bucket 0
+ * holds latencies below 1 us and bucket i those in [2^(i-1), 2^i) us, up
+ * to about 4 years. Recording is a few relaxed atomic updates; quantiles
+ * are reported as the upper bound of their bucket, so within a factor of 2.
+ */
+class LatencyHistogram
+{
+public:
+  static constexpr size_t BUCKETS = 48; //!< Number of buckets
+  
+  LatencyHistogram ();
+  
+  LatencyHistogram (const LatencyHistogram&) = delete;
+  LatencyHistogram& operator= (const LatencyHistogram&) = delete;
+  
+  /**
+   * \brief Record a latency, negative latencies count as 0
+   * \param latency Latency
+   */
+  void Record (Time latency);
+  
+  /**
+   * \brief Get the number of recorded latencies
+   * \return Count
+   */
+  uint64_t GetCount () const { return m_count.load (std::memory_order_relaxed); }
+  
+  /**
+   * \brief Get the mean latency
+   * \return Mean, zero if nothing was recorded
+   */
+  Time GetMean () const;
+  
+  /**
+   * \brief Get the largest latency
+   * \return Maximum
+   */
+  Time GetMax () const { return MicroSeconds (m_max.load (std::memory_order_relaxed)); }
+  
+  /**
+   * \brief Get a quantile
+   * \param q Quantile in [0, 1]
+   * \return Upper bound of the bucket holding the quantile
+   */
+  Time GetQuantile (double q) const;
+  
+  /**
+   * \brief Get the count of one bucket
+   * \param bucket Bucket index
+   * \return Count
+   */
+  uint64_t GetBucket (size_t bucket) const { return m_buckets[bucket].load (std::memory_order_relaxed); }
+  
+  /**
+   * \brief Get the exclusive upper bound of a bucket
+   * \param bucket Bucket index
+   * \return Upper bound
+   */
+  static Time GetBucketLimit (size_t bucket);
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKETS> m_buckets; //!< Counts per bucket
+  std::atomic<uint64_t> m_count;                        //!< Number of latencies
+  std::atomic<uint64_t> m_sum;                          //!< Sum in microseconds
+  std::atomic<uint64_t> m_max;                          //!< Maximum in microseconds
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Named counters and latency histograms of one node
+ *
+ * Components look their metrics up once, when they are wired to the
+ * node, and keep the returned pointers, which stay valid for the life of
+ * the registry. The hot paths then only touch the atomics; names are
+ * used again only for the export at the end of a simulation.
+ *
+ * CSV exports have one row per value:
+ * \verbatim
+   node,metric,statistic,value
+   \endverbatim
+ * where counters have the statistic "value" and histograms "count",
+ * "mean_us", "p50_us", "p90_us", "p99_us" and "max_us". JSON exports
+ * hold the counters and, per histogram, the same statistics and the
+ * bucket counts.
+ */
+class MetricsRegistry : public SimpleRefCount<MetricsRegistry>
+{
+public:
+  /**
+   * \brief Get a counter, creating it on first use
+   * \param name Counter name
+   * \return Counter, valid for the life of the registry
+   */
+  MetricCounter* GetCounter (const std::string& name);
+  
+  /**
+   * \brief Get a histogram, creating it on first use
+   * \param name Histogram name
+   * \return Histogram, valid for the life of the registry
+   */
+  LatencyHistogram* GetHistogram (const std::string& name);
+  
+  /**
+   * \brief Write all metrics as CSV rows without a header line
+   * \param os Output stream
+   * \param node Value of the node column
+   */
+  void WriteCsv (std::ostream& os, const std::string& node) const;
+  
+  /**
+   * \brief Write all metrics as one JSON object
+   * \param os Output stream
+   */
+  void WriteJson (std::ostream& os) const;
+  
+  /**
+   * \brief Get the CSV header line
+   * \return Header, without line break
+   */
+  static std::string GetCsvHeader ();
+
+private:
+  std::map<std::string, MetricCounter> m_counters;      //!< Counters by name, guarded by m_mutex
+  std::map<std::string, LatencyHistogram> m_histograms; //!< Histograms by name, guarded by m_mutex
+  mutable OptionalMutex m_mutex;                        //!< Mutex for looking up and exporting metrics
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_METRICS_H */
@@ -0,0 +1,209 @@
+#ifndef DTN7_OBJECT_POOL_H
+#define DTN7_OBJECT_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#include "optional-mutex.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Class-level allocation from per-type free lists
+ *
+ * Deriving T from PoolAllocated<T> routes new and delete of T and of its
+ * subclasses through free lists of recycled memory, one list per 16 byte
+ * size class. Every received bundle creates a Bundle and a block object
+ * per canonical block, and forwarding or expiry destroys them again, so
+ * in long runs most of these allocations are served from the lists
+ * instead of the global heap.
+ *
+ * Each type keeps at most GetMaxFree blocks per size class and returns
+ * the rest to the global heap, so the lists follow the working set
+ * rather than its peak. Objects larger than MAX_POOLED_SIZE always use
+ * the global heap. Subclasses must be destroyed through a virtual
+ * destructor, which passes their size to operator delete.
+ */
+template <typename T>
+class PoolAllocated
+{
+public:
+  static const std::size_t GRANULARITY = 16;      //!< Size class width in bytes
+  static const std::size_t MAX_POOLED_SIZE = 512; //!< Largest pooled object size
+  
+  /**
+   * \brief Allocate an object, from the free list of its size class if possible
+   * \param size Object size
+   * \return Memory for the object
+   */
+  static void* operator new (std::size_t size)
+  {
+    if (size == 0 || size > MAX_POOLED_SIZE)
+      {
+        return ::operator new (size);
+      }
+    
+    Pool& pool = GetPool ();
+    std::size_t sizeClass = GetSizeClass (size);
+    {
+      std::lock_guard<OptionalMutex> lock (pool.mutex);
+      FreeBlock* block = pool.heads[sizeClass];
+      if (block)
+        {
+          pool.heads[sizeClass] = block->next;
+          pool.counts[sizeClass]--;
+          return block;
+        }
+    }
+    return ::operator new ((sizeClass + 1) * GRANULARITY);
+  }
+  
+  /**
+   * \brief Release an object, keeping its memory for the next allocation
+   * \param pointer Object memory
+   * \param size Object size
+   */
+  static void operator delete (void* pointer, std::size_t size)
+  {
+    if (!pointer)
+      {
+        return;
+      }
+    if (size == 0 || size > MAX_POOLED_SIZE)
+      {
+        ::operator delete (pointer);
+        return;
+      }
+    
+    Pool& pool = GetPool ();
+    std::size_t sizeClass = GetSizeClass (size);
+    {
+      std::lock_guard<OptionalMutex> lock (pool.mutex);
+      if (pool.counts[sizeClass] < pool.maxFree)
+        {
+          FreeBlock* block = static_cast<FreeBlock*> (pointer);
+          block->next = pool.heads[sizeClass];
+          pool.heads[sizeClass] = block;
+          pool.counts[sizeClass]++;
+          return;
+        }
+    }
+    ::operator delete (pointer);
+  }
+  
+  /**
+   * \brief Set how many free blocks each size class keeps
+   * \param maxFree Maximum number of blocks, 0 disables pooling
+   */
+  static void SetMaxFree (std::size_t maxFree)
+  {
+    Pool& pool = GetPool ();
+    {
+      std::lock_guard<OptionalMutex> lock (pool.mutex);
+      pool.maxFree = maxFree;
+    }
+    Trim (maxFree);
+  }
+  
+  /**
+   * \brief Get how many free blocks each size class keeps
+   * \return Maximum number of blocks
+   */
+  static std::size_t GetMaxFree ()
+  {
+    Pool& pool = GetPool ();
+    std::lock_guard<OptionalMutex> lock (pool.mutex);
+    return pool.maxFree;
+  }
+  
+  /**
+   * \brief Get the number of free blocks held
+   * \return Number of blocks over all size classes
+   */
+  static std::size_t GetFreeCount ()
+  {
+    Pool& pool = GetPool ();
+    std::lock_guard<OptionalMutex> lock (pool.mutex);
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < SIZE_CLASSES; i++)
+      {
+        count += pool.counts[i];
+      }
+    return count;
+  }
+  
+  /**
+   * \brief Return free blocks to the global heap
+   * \param keep Number of blocks to keep per size class
+   */
+  static void Trim (std::size_t keep = 0)
+  {
+    Pool& pool = GetPool ();
+    std::lock_guard<OptionalMutex> lock (pool.mutex);
+    for (std::size_t i = 0; i < SIZE_CLASSES; i++)
+      {
+        while (pool.counts[i] > keep)
+          {
+            FreeBlock* block = pool.heads[i];
+            pool.heads[i] = block->next;
+            pool.counts[i]--;
+            ::operator delete (block);
+          }
+      }
+  }
+
+private:
+  static const std::size_t SIZE_CLASSES = MAX_POOLED_SIZE / GRANULARITY; //!< Number of free lists
+  
+  /**
+   * \brief Free memory block, linked through its first bytes
+   */
+  struct FreeBlock
+  {
+    FreeBlock* next; //!< Next free block of the same size class
+  };
+  
+  /**
+   * \brief Free lists of one type
+   */
+  struct Pool
+  {
+    OptionalMutex mutex;                       //!< Mutex for the lists
+    FreeBlock* heads[SIZE_CLASSES] = {};       //!< First free block per size class
+    std::size_t counts[SIZE_CLASSES] = {};     //!< Free blocks per size class
+    std::size_t maxFree = 4096;                //!< Maximum free blocks per size class
+  };
+  
+  /**
+   * \brief Get the size class of an object size
+   * \param size Object size, 1 to MAX_POOLED_SIZE
+   * \return Size class index
+   */
+  static std::size_t GetSizeClass (std::size_t size)
+  {
+    return (size - 1) / GRANULARITY;
+  }
+  
+  /**
+   * \brief Get the free lists of T
+   *
+   * The pool is never destroyed, since objects held by static variables
+   * may be deleted after static destructors have run.
+   * \return Pool
+   */
+  static Pool& GetPool ()
+  {
+    static Pool* pool = new Pool ();
+    return *pool;
+  }
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_OBJECT_POOL_H */
@@ -0,0 +1,29 @@
+#include "optional-mutex.h"
+#include "ns3/global-value.h"
+#include "ns3/boolean.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+namespace {
+
+GlobalValue g_threadSafe ("Dtn7ThreadSafe",
+                          "Whether dtn7 stores, routing and convergence layers lock their state "
+                          "for use from several threads",
+                          BooleanValue (false),
+                          MakeBooleanChecker ());
+
+} // anonymous namespace
+
+bool 
+OptionalMutex::IsThreadSafe ()
+{
+  BooleanValue value;
+  g_threadSafe.GetValue (value);
+  return value.Get ();
+}
+
+} // namespace dtn7
+
+} // namespace ns3
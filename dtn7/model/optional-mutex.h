@@ -0,0 +1,78 @@
+#ifndef DTN7_OPTIONAL_MUTEX_H
+#define DTN7_OPTIONAL_MUTEX_H
+
+#include <mutex>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Mutex that only locks when the model is configured thread-safe
+ *
+ * ns-3 runs all dtn7 handlers on the simulator thread, so by default
+ * lock and unlock reduce to a predictable branch. Deployments that call
+ * into the model from other threads, e.g. emulation, enable real locking
+ * with the Dtn7ThreadSafe global value before creating any dtn7 objects:
+ * \code
+ *   GlobalValue::Bind ("Dtn7ThreadSafe", BooleanValue (true));
+ * \endcode
+ * The setting is read once, when the mutex is constructed. The class
+ * meets the Lockable requirements, so std::lock_guard and
+ * std::unique_lock work with it.
+ */
+class OptionalMutex
+{
+public:
+  /**
+   * \brief Construct with locking set by Dtn7ThreadSafe
+   */
+  OptionalMutex () : m_enabled (IsThreadSafe ()) {}
+  
+  OptionalMutex (const OptionalMutex&) = delete;
+  OptionalMutex& operator= (const OptionalMutex&) = delete;
+  
+  void lock ()
+  {
+    if (m_enabled)
+      {
+        m_mutex.lock ();
+      }
+  }
+  
+  void unlock ()
+  {
+    if (m_enabled)
+      {
+        m_mutex.unlock ();
+      }
+  }
+  
+  bool try_lock ()
+  {
+    return !m_enabled || m_mutex.try_lock ();
+  }
+  
+  /**
+   * \brief Check whether this mutex really locks
+   * \return true if locking is enabled
+   */
+  bool IsEnabled () const { return m_enabled; }
+  
+  /**
+   * \brief Get the value of the Dtn7ThreadSafe global value
+   * \return true if new mutexes lock
+   */
+  static bool IsThreadSafe ();
+
+private:
+  std::mutex m_mutex; //!< Underlying mutex, unused unless enabled
+  bool m_enabled;     //!< Whether lock and unlock use m_mutex
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_OPTIONAL_MUTEX_H */
@@ -0,0 +1,174 @@
+#include "payload-buffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+PayloadBuffer::PayloadBuffer()
+  : m_size(0)
+{
+}
+
+PayloadBuffer::PayloadBuffer(std::vector<uint8_t> data)
+  : m_size(data.size())
+{
+  if (!data.empty())
+    {
+      Ptr<Storage> storage = Create<Storage>();
+      storage->bytes = std::move(data);
+      m_segments.push_back({storage, 0, m_size});
+    }
+}
+
+PayloadBuffer::PayloadBuffer(const uint8_t* data, size_t size)
+  : PayloadBuffer(std::vector<uint8_t>(data, data + size))
+{
+}
+
+const uint8_t* 
+PayloadBuffer::data() const
+{
+  if (m_segments.empty())
+    {
+      return nullptr;
+    }
+  
+  if (m_segments.size() > 1)
+    {
+      Flatten();
+    }
+  
+  const Segment& segment = m_segments[0];
+  return segment.storage->bytes.data() + segment.offset;
+}
+
+PayloadBuffer 
+PayloadBuffer::Slice(size_t offset, size_t length) const
+{
+  PayloadBuffer slice;
+  if (offset >= m_size)
+    {
+      return slice;
+    }
+  
+  length = std::min(length, m_size - offset);
+  slice.m_size = length;
+  
+  // Pick the slices that overlap [offset, offset + length)
+  for (const Segment& segment : m_segments)
+    {
+      if (length == 0)
+        {
+          break;
+        }
+      if (offset >= segment.length)
+        {
+          offset -= segment.length;
+          continue;
+        }
+      
+      size_t take = std::min(length, segment.length - offset);
+      slice.m_segments.push_back({segment.storage, segment.offset + offset, take});
+      length -= take;
+      offset = 0;
+    }
+  
+  return slice;
+}
+
+void 
+PayloadBuffer::Append(const PayloadBuffer& other)
+{
+  for (const Segment& segment : other.m_segments)
+    {
+      // Merge with the previous slice when they are adjacent in one store
+      if (!m_segments.empty())
+        {
+          Segment& last = m_segments.back();
+          if (last.storage == segment.storage && last.offset + last.length == segment.offset)
+            {
+              last.length += segment.length;
+              continue;
+            }
+        }
+      m_segments.push_back(segment);
+    }
+  
+  m_size += other.m_size;
+}
+
+const uint8_t* 
+PayloadBuffer::GetSegment(size_t index, size_t& length) const
+{
+  const Segment& segment = m_segments[index];
+  length = segment.length;
+  return segment.storage->bytes.data() + segment.offset;
+}
+
+void 
+PayloadBuffer::CopyTo(uint8_t* output) const
+{
+  for (const Segment& segment : m_segments)
+    {
+      std::memcpy(output, segment.storage->bytes.data() + segment.offset, segment.length);
+      output += segment.length;
+    }
+}
+
+std::vector<uint8_t> 
+PayloadBuffer::ToVector() const
+{
+  std::vector<uint8_t> result(m_size);
+  if (m_size > 0)
+    {
+      CopyTo(result.data());
+    }
+  return result;
+}
+
+bool 
+PayloadBuffer::SharesStorageWith(const PayloadBuffer& other) const
+{
+  for (const Segment& segment : m_segments)
+    {
+      for (const Segment& otherSegment : other.m_segments)
+        {
+          if (segment.storage == otherSegment.storage)
+            {
+              return true;
+            }
+        }
+    }
+  return false;
+}
+
+bool 
+PayloadBuffer::operator==(const PayloadBuffer& other) const
+{
+  if (m_size != other.m_size)
+    {
+      return false;
+    }
+  if (m_size == 0)
+    {
+      return true;
+    }
+  return std::memcmp(data(), other.data(), m_size) == 0;
+}
+
+void 
+PayloadBuffer::Flatten() const
+{
+  Ptr<Storage> storage = Create<Storage>();
+  storage->bytes.resize(m_size);
+  CopyTo(storage->bytes.data());
+  
+  m_segments.clear();
+  m_segments.push_back({storage, 0, m_size});
+}
+
+} // namespace dtn7
+
+} // namespace ns3
@@ -0,0 +1,156 @@
+#ifndef DTN7_PAYLOAD_BUFFER_H
+#define DTN7_PAYLOAD_BUFFER_H
+
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Immutable, reference-counted block data with cheap slicing
+ *
+ * Copies and slices share the underlying storage, so replicas and
+ * fragments of a bundle do not duplicate its payload. A buffer may be
+ * made of several slices (e.g. a reassembled payload); those are only
+ * stitched into one contiguous array when data() is first called.
+ */
+class PayloadBuffer
+{
+public:
+  /**
+   * \brief Construct an empty buffer
+   */
+  PayloadBuffer ();
+  
+  /**
+   * \brief Construct from a vector, taking over its storage when moved in
+   * \param data Data
+   */
+  PayloadBuffer (std::vector<uint8_t> data);
+  
+  /**
+   * \brief Construct by copying raw bytes
+   * \param data Pointer to data
+   * \param size Number of bytes
+   */
+  PayloadBuffer (const uint8_t* data, size_t size);
+  
+  /**
+   * \brief Get the size
+   * \return Number of bytes
+   */
+  size_t size () const { return m_size; }
+  
+  /**
+   * \brief Check whether the buffer is empty
+   * \return true if there are no bytes
+   */
+  bool empty () const { return m_size == 0; }
+  
+  /**
+   * \brief Get contiguous access to the bytes
+   *
+   * Stitches a multi-slice buffer together on first use.
+   * \return Pointer to the first byte, nullptr if empty
+   */
+  const uint8_t* data () const;
+  
+  const uint8_t* begin () const { return data (); }
+  const uint8_t* end () const { return data () + m_size; }
+  uint8_t operator[] (size_t index) const { return data ()[index]; }
+  
+  /**
+   * \brief Get a view of part of the buffer, sharing its storage
+   * \param offset First byte of the slice
+   * \param length Number of bytes, clamped to the end of the buffer
+   * \return Slice
+   */
+  PayloadBuffer Slice (size_t offset, size_t length) const;
+  
+  /**
+   * \brief Append another buffer without copying its bytes
+   * \param other Buffer to append
+   */
+  void Append (const PayloadBuffer& other);
+  
+  /**
+   * \brief Get the number of contiguous slices
+   * \return Number of slices
+   */
+  size_t GetSegmentCount () const { return m_segments.size (); }
+  
+  /**
+   * \brief Get one contiguous slice
+   * \param index Slice index
+   * \param length Receives the slice length
+   * \return Pointer to the slice
+   */
+  const uint8_t* GetSegment (size_t index, size_t& length) const;
+  
+  /**
+   * \brief Copy all bytes out
+   * \param output Destination, at least size() bytes
+   */
+  void CopyTo (uint8_t* output) const;
+  
+  /**
+   * \brief Copy the bytes into a vector
+   * \return Vector with the data
+   */
+  std::vector<uint8_t> ToVector () const;
+  
+  /**
+   * \brief Conversion for code that still expects a vector
+   */
+  operator std::vector<uint8_t> () const { return ToVector (); }
+  
+  /**
+   * \brief Check whether another buffer shares this buffer's storage
+   * \param other Other buffer
+   * \return true if both reference the same storage
+   */
+  bool SharesStorageWith (const PayloadBuffer& other) const;
+  
+  bool operator== (const PayloadBuffer& other) const;
+  bool operator!= (const PayloadBuffer& other) const { return !(*this == other); }
+  
+private:
+  /**
+   * \brief Shared backing store
+   */
+  struct Storage : public SimpleRefCount<Storage>
+  {
+    std::vector<uint8_t> bytes; //!< Stored bytes, never modified once shared
+  };
+  
+  /**
+   * \brief A contiguous range within a storage
+   */
+  struct Segment
+  {
+    Ptr<Storage> storage; //!< Backing store
+    size_t offset;        //!< First byte in the store
+    size_t length;        //!< Number of bytes
+  };
+  
+  /**
+   * \brief Replace multiple slices by one contiguous copy
+   */
+  void Flatten () const;
+  
+  mutable std::vector<Segment> m_segments; //!< Slices in order
+  size_t m_size;                           //!< Total number of bytes
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_PAYLOAD_BUFFER_H */
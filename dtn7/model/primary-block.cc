@@ -1,6 +1,8 @@
 #include "primary-block.h"
 #include "cbor.h"
 #include "crc.h"
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <vector>
 
@@ -8,6 +10,19 @@ namespace ns3 {
 
 namespace dtn7 {
 
+namespace {
+
+/**
+ * \brief 生存时间的编码值，RFC 9171中为无符号毫秒数
+ */
+uint64_t 
+LifetimeMilliSeconds(Time lifetime)
+{
+  return static_cast<uint64_t>(std::max<int64_t>(0, lifetime.GetMilliSeconds()));
+}
+
+} // anonymous namespace
+
 PrimaryBlock::PrimaryBlock()
   : m_version(DEFAULT_VERSION),
     m_bundleControlFlags(BundleControlFlags::NO_FLAGS),
@@ -18,8 +33,11 @@ PrimaryBlock::PrimaryBlock()
     m_sequenceNumber(0),
     m_lifetime(Seconds(3600)), // Default lifetime: 1 hour
     m_fragmentOffset(0),
-    m_totalApplicationDataUnitLength(0)
+    m_totalApplicationDataUnitLength(0),
+    m_idGeneration(0),
+    m_encodedGeneration(0)
 {
+  Touch();
 }
 
 PrimaryBlock::PrimaryBlock(uint64_t version,
@@ -43,8 +61,34 @@ PrimaryBlock::PrimaryBlock(uint64_t version,
     m_sequenceNumber(sequenceNumber),
     m_lifetime(lifetime),
     m_fragmentOffset(fragmentOffset),
-    m_totalApplicationDataUnitLength(totalApplicationDataUnitLength)
+    m_totalApplicationDataUnitLength(totalApplicationDataUnitLength),
+    m_idGeneration(0),
+    m_encodedGeneration(0)
 {
+  Touch();
+}
+
+void 
+PrimaryBlock::Touch()
+{
+  // 每次修改分配一个新的代号，所有主要区块之间唯一
+  static std::atomic<uint64_t> generations(0);
+  m_generation = ++generations;
+  
+  // 过期时间随修改更新，缓存的ID和编码按代号失效
+  m_expiration = m_creationTimestamp.ToTime() + m_lifetime;
+}
+
+const BundleID& 
+PrimaryBlock::GetId() const
+{
+  if (m_idGeneration != m_generation)
+    {
+      m_id = BundleID(m_sourceNodeEID, m_creationTimestamp, m_sequenceNumber,
+                      IsFragment(), m_fragmentOffset);
+      m_idGeneration = m_generation;
+    }
+  return m_id;
 }
 
 bool 
@@ -115,6 +159,8 @@ PrimaryBlock::SetBundleDeletionStatusReport(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_DELETION_STATUS_REPORTS_REQUESTED));
     }
+  
+  Touch();
 }
 
 void 
@@ -130,6 +176,8 @@ PrimaryBlock::SetBundleDeliveryStatusReport(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_DELIVERY_STATUS_REPORTS_REQUESTED));
     }
+  
+  Touch();
 }
 
 void 
@@ -145,6 +193,8 @@ PrimaryBlock::SetBundleForwardingStatusReport(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_FORWARDING_STATUS_REPORTS_REQUESTED));
     }
+  
+  Touch();
 }
 
 void 
@@ -160,6 +210,8 @@ PrimaryBlock::SetBundleReceptionStatusReport(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_RECEPTION_STATUS_REPORTS_REQUESTED));
     }
+  
+  Touch();
 }
 
 void 
@@ -175,6 +227,8 @@ PrimaryBlock::SetFragmentation(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_IS_A_FRAGMENT));
     }
+  
+  Touch();
 }
 
 void 
@@ -190,6 +244,8 @@ PrimaryBlock::SetAdministrativeRecord(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::PAYLOAD_IS_AN_ADMINISTRATIVE_RECORD));
     }
+  
+  Touch();
 }
 
 void 
@@ -205,196 +261,266 @@ PrimaryBlock::SetMustNotFragment(bool enable)
           static_cast<uint64_t>(m_bundleControlFlags) & 
           ~static_cast<uint64_t>(BundleControlFlags::BUNDLE_MUST_NOT_BE_FRAGMENTED));
     }
+  
+  Touch();
 }
 
 void 
 PrimaryBlock::CalculateCRC()
 {
-  if (m_crcType == CRCType::NO_CRC)
+  if (CrcState::GetValueSize(m_crcType) == 0)
     {
       m_crcValue.clear();
       return;
     }
   
-  // 创建不带CRC值的区块CBOR表示
-  std::vector<uint8_t> crcValue;
-  m_crcValue = crcValue; // 临时清除CRC值
-  
-  Buffer buffer = ToCbor();
-  
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
-  
-  // 计算CRC
-  if (m_crcType == CRCType::CRC_16)
-  {
-      uint16_t crc = CalculateCRC16(data);
-      m_crcValue.clear();
-      m_crcValue.push_back((crc >> 8) & 0xFF);  // 高字节
-      m_crcValue.push_back(crc & 0xFF);         // 低字节
-  }
-  else if (m_crcType == CRCType::CRC_32)
-  {
-      uint32_t crc = CalculateCRC32(data);
-      m_crcValue.clear();
-      m_crcValue.push_back((crc >> 24) & 0xFF); // 最高字节
-      m_crcValue.push_back((crc >> 16) & 0xFF);
-      m_crcValue.push_back((crc >> 8) & 0xFF);
-      m_crcValue.push_back(crc & 0xFF);         // 最低字节
-  }
-  else
-  {
-      // NO_CRC的情况
-      m_crcValue.clear();
-  }
+  // 只计算校验和，不生成编码数据
+  CborWriter sink;
+  uint8_t crc[4];
+  size_t crcSize = EncodeCbor(sink, crc);
+  m_crcValue.assign(crc, crc + crcSize);
 }
 
 bool 
 PrimaryBlock::CheckCRC() const
 {
-  if (m_crcType == CRCType::NO_CRC)
+  if (CrcState::GetValueSize(m_crcType) == 0)
     {
       return true;
     }
   
-  // 创建不带CRC值的区块CBOR表示
-  PrimaryBlock tempBlock = *this;
-  tempBlock.m_crcValue.clear();
+  CborWriter sink;
+  uint8_t crc[4];
+  size_t crcSize = EncodeCbor(sink, crc);
+  return m_crcValue.size() == crcSize && std::equal(crc, crc + crcSize, m_crcValue.begin());
+}
+
+Buffer 
+PrimaryBlock::ToCbor() const
+{
+  if (m_encodedGeneration == m_generation)
+    {
+      return m_encoded;
+    }
   
-  Buffer buffer = tempBlock.ToCbor();
+  Buffer buffer;
+  buffer.AddAtStart(GetCborSize());
   
-  // 修复代码：使用std::vector而不是VLA
-  std::vector<uint8_t> data(buffer.GetSize());
-  buffer.CopyData(data.data(), buffer.GetSize());
+  CborWriter writer(buffer.Begin());
+  uint8_t crc[4];
+  EncodeCbor(writer, crc);
   
-  // 验证CRC
-  return VerifyCRC(m_crcType, data, m_crcValue);
+  m_encoded = buffer;
+  m_encodedGeneration = m_generation;
+  return buffer;
 }
 
-Buffer 
-PrimaryBlock::ToCbor() const
+void 
+PrimaryBlock::WriteCbor(CborWriter& writer) const
+{
+  // 编码只依赖字段（CRC在编码时计算），首次编码后缓存，未修改时直接复制
+  Buffer encoded = ToCbor();
+  writer.WriteRaw(encoded.PeekData(), encoded.GetSize());
+}
+
+size_t 
+PrimaryBlock::EncodeCbor(CborWriter& writer, uint8_t* crcValue) const
 {
-  // 创建CBOR数组
-  Cbor::CborArray array;
+  size_t crcSize = CrcState::GetValueSize(m_crcType);
+  CrcState crc(m_crcType);
+  if (crcSize > 0)
+    {
+      writer.SetCrc(&crc);
+    }
+  
+  // 数组头：8个基本字段，分片时加2个，存在CRC时加1个
+  writer.WriteArrayHeader(8 + (IsFragment() ? 2 : 0) + (crcSize > 0 ? 1 : 0));
   
   // 添加主要区块元素
-  array.push_back(Cbor::CborValue(m_version));
-  array.push_back(Cbor::CborValue(static_cast<uint64_t>(m_bundleControlFlags)));
-  array.push_back(Cbor::CborValue(static_cast<uint64_t>(m_crcType)));
-  array.push_back(Cbor::CborValue(m_destinationEID.ToString()));
-  array.push_back(Cbor::CborValue(m_sourceNodeEID.ToString()));
-  array.push_back(Cbor::CborValue(m_reportToEID.ToString()));
+  writer.WriteUnsigned(m_version);
+  writer.WriteUnsigned(static_cast<uint64_t>(m_bundleControlFlags));
+  writer.WriteUnsigned(static_cast<uint64_t>(m_crcType));
+  writer.WriteTextString(m_destinationEID.ToString());
+  writer.WriteTextString(m_sourceNodeEID.ToString());
+  writer.WriteTextString(m_reportToEID.ToString());
   
   // 时间戳数组
-  Cbor::CborArray timestampArray = {
-    Cbor::CborValue(m_creationTimestamp.GetSeconds()),
-    Cbor::CborValue(m_sequenceNumber)
-  };
-  array.push_back(Cbor::CborValue(timestampArray));
+  writer.WriteArrayHeader(2);
+  writer.WriteUnsigned(m_creationTimestamp.GetSeconds());
+  writer.WriteUnsigned(m_sequenceNumber);
   
   // 生存时间（毫秒）
-  array.push_back(Cbor::CborValue(m_lifetime.GetMilliSeconds()));
+  writer.WriteUnsigned(LifetimeMilliSeconds(m_lifetime));
   
   // 如果是分片则添加分片字段
   if (IsFragment())
     {
-      array.push_back(Cbor::CborValue(m_fragmentOffset));
-      array.push_back(Cbor::CborValue(m_totalApplicationDataUnitLength));
+      writer.WriteUnsigned(m_fragmentOffset);
+      writer.WriteUnsigned(m_totalApplicationDataUnitLength);
     }
   
-  // 添加CRC值（如果存在）
-  if (m_crcType != CRCType::NO_CRC && !m_crcValue.empty())
+  // 添加CRC值（如果存在）：CRC覆盖整个区块，其中CRC字段按全零计算（RFC 9171 4.2.1）
+  if (crcSize > 0)
     {
-      array.push_back(Cbor::CborValue(m_crcValue));
+      writer.WriteHeader(2, crcSize);
+      crc.UpdateZeros(crcSize);
+      writer.SetCrc(nullptr);
+      crc.Finalize(crcValue);
+      writer.WriteRaw(crcValue, crcSize);
     }
   
-  return Cbor::Encode(Cbor::CborValue(array));
+  return crcSize;
 }
 
-std::optional<PrimaryBlock> 
-PrimaryBlock::FromCbor(Buffer buffer)
+size_t 
+PrimaryBlock::GetCborSize() const
 {
-  auto cborOpt = Cbor::Decode(buffer);
-  if (!cborOpt)
+  if (m_encodedGeneration == m_generation)
     {
-      return std::nullopt;
+      return m_encoded.GetSize();
     }
   
-  const auto& cbor = *cborOpt;
-  if (!cbor.IsArray())
+  size_t crcSize = CrcState::GetValueSize(m_crcType);
+  
+  size_t size = CborWriter::HeaderSize(8 + (IsFragment() ? 2 : 0) + (crcSize > 0 ? 1 : 0));
+  size += CborWriter::HeaderSize(m_version);
+  size += CborWriter::HeaderSize(static_cast<uint64_t>(m_bundleControlFlags));
+  size += CborWriter::HeaderSize(static_cast<uint64_t>(m_crcType));
+  size += CborWriter::StringSize(m_destinationEID.ToString().size());
+  size += CborWriter::StringSize(m_sourceNodeEID.ToString().size());
+  size += CborWriter::StringSize(m_reportToEID.ToString().size());
+  size += CborWriter::HeaderSize(2);
+  size += CborWriter::HeaderSize(m_creationTimestamp.GetSeconds());
+  size += CborWriter::HeaderSize(m_sequenceNumber);
+  size += CborWriter::HeaderSize(LifetimeMilliSeconds(m_lifetime));
+  
+  if (IsFragment())
     {
-      return std::nullopt;
+      size += CborWriter::HeaderSize(m_fragmentOffset);
+      size += CborWriter::HeaderSize(m_totalApplicationDataUnitLength);
     }
   
-  const auto& array = cbor.GetArray();
-  if (array.size() < 8) // 至少需要8个元素（不带CRC的非分片）
+  if (crcSize > 0)
+    {
+      size += CborWriter::StringSize(crcSize);
+    }
+  
+  return size;
+}
+
+std::optional<PrimaryBlock> 
+PrimaryBlock::FromCbor(Buffer buffer)
+{
+  CborReader reader(buffer.PeekData(), buffer.GetSize());
+  return ReadCbor(reader);
+}
+
+std::optional<PrimaryBlock> 
+PrimaryBlock::ReadCbor(CborReader& reader)
+{
+  const uint8_t* blockStart = reader.GetCurrent();
+  
+  uint64_t count;
+  if (!reader.ReadArrayHeader(count) || count < 8) // 至少需要8个元素（不带CRC的非分片）
     {
       return std::nullopt;
     }
   
   // 提取字段
-  uint64_t version = array[0].GetUnsignedInteger();
-  BundleControlFlags bundleControlFlags = static_cast<BundleControlFlags>(array[1].GetUnsignedInteger());
-  CRCType crcType = static_cast<CRCType>(array[2].GetUnsignedInteger());
-  EndpointID destinationEID(array[3].GetTextString());
-  EndpointID sourceNodeEID(array[4].GetTextString());
-  EndpointID reportToEID(array[5].GetTextString());
+  uint64_t version;
+  uint64_t flags;
+  uint64_t crc;
+  const char* eid[3];
+  size_t eidLength[3];
+  if (!reader.ReadUnsigned(version) ||
+      !reader.ReadUnsigned(flags) ||
+      !reader.ReadUnsigned(crc) ||
+      !reader.ReadTextString(eid[0], eidLength[0]) ||
+      !reader.ReadTextString(eid[1], eidLength[1]) ||
+      !reader.ReadTextString(eid[2], eidLength[2]))
+    {
+      return std::nullopt;
+    }
+  
+  BundleControlFlags bundleControlFlags = static_cast<BundleControlFlags>(flags);
+  CRCType crcType = static_cast<CRCType>(crc);
   
   // 提取时间戳
-  if (!array[6].IsArray() || array[6].GetArray().size() != 2)
+  uint64_t timestampCount;
+  uint64_t seconds;
+  uint64_t sequenceNumber;
+  if (!reader.ReadArrayHeader(timestampCount) || timestampCount != 2 ||
+      !reader.ReadUnsigned(seconds) ||
+      !reader.ReadUnsigned(sequenceNumber))
     {
       return std::nullopt;
     }
   
-  DtnTime creationTimestamp(array[6].GetArray()[0].GetUnsignedInteger(), 0);
-  uint64_t sequenceNumber = array[6].GetArray()[1].GetUnsignedInteger();
-  
   // 提取生存时间
-  Time lifetime = MilliSeconds(array[7].GetUnsignedInteger());
+  uint64_t lifetime;
+  if (!reader.ReadUnsigned(lifetime))
+    {
+      return std::nullopt;
+    }
   
   // 创建主要区块
   PrimaryBlock block(
       version,
       bundleControlFlags,
       crcType,
-      destinationEID,
-      sourceNodeEID,
-      reportToEID,
-      creationTimestamp,
+      EndpointID(std::string(eid[0], eidLength[0])),
+      EndpointID(std::string(eid[1], eidLength[1])),
+      EndpointID(std::string(eid[2], eidLength[2])),
+      DtnTime(seconds, 0),
       sequenceNumber,
-      lifetime);
+      MilliSeconds(lifetime));
   
-  // 如果存在分片字段则提取
-  bool isFragment = (static_cast<uint64_t>(bundleControlFlags) & 
-                     static_cast<uint64_t>(BundleControlFlags::BUNDLE_IS_A_FRAGMENT)) != 0;
+  uint64_t consumed = 8;
   
-  if (isFragment)
+  // 如果存在分片字段则提取
+  if (block.IsFragment())
     {
-      if (array.size() < 10) // 分片至少需要10个元素
+      uint64_t fragmentOffset;
+      uint64_t totalLength;
+      if (count < 10 || // 分片至少需要10个元素
+          !reader.ReadUnsigned(fragmentOffset) ||
+          !reader.ReadUnsigned(totalLength))
         {
           return std::nullopt;
         }
       
-      block.SetFragmentOffset(array[8].GetUnsignedInteger());
-      block.SetTotalApplicationDataUnitLength(array[9].GetUnsignedInteger());
+      block.SetFragmentOffset(fragmentOffset);
+      block.SetTotalApplicationDataUnitLength(totalLength);
+      consumed += 2;
     }
   
   // 如果存在CRC则提取
+  const uint8_t* crcData = nullptr;
+  size_t crcLength = 0;
   if (crcType != CRCType::NO_CRC)
     {
-      size_t crcIndex = isFragment ? 10 : 8;
-      if (array.size() <= crcIndex)
+      if (count <= consumed || !reader.ReadByteString(crcData, crcLength))
         {
           return std::nullopt;
         }
       
-      if (!array[crcIndex].IsByteString())
+      block.m_crcValue.assign(crcData, crcData + crcLength);
+      consumed += 1;
+    }
+  
+  // 跳过未知的附加元素
+  for (; consumed < count; ++consumed)
+    {
+      if (!reader.Skip())
         {
           return std::nullopt;
         }
-      
-      block.m_crcValue = array[crcIndex].GetByteString();
+    }
+  
+  // 直接在接收到的字节上校验CRC
+  if (crcData && !VerifyBlockCRC(crcType, blockStart, reader.GetCurrent(), crcData, crcLength))
+    {
+      return std::nullopt;
     }
   
   return block;
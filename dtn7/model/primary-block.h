@@ -10,12 +10,16 @@
 
 #include "endpoint.h"
 #include "dtn-time.h"
+#include "bundle-id.h"
 #include "block-type-codes.h"
 
 namespace ns3 {
 
 namespace dtn7 {
 
+class CborWriter;
+class CborReader;
+
 /**
  * \brief Bundle control flags as defined in RFC 9171
  */
@@ -100,17 +104,49 @@ public:
   uint64_t GetTotalApplicationDataUnitLength () const { return m_totalApplicationDataUnitLength; }
   
   // Setters
-  void SetVersion (uint64_t version) { m_version = version; }
-  void SetBundleControlFlags (BundleControlFlags flags) { m_bundleControlFlags = flags; }
-  void SetCRCType (CRCType crcType) { m_crcType = crcType; }
-  void SetDestinationEID (const EndpointID& eid) { m_destinationEID = eid; }
-  void SetSourceNodeEID (const EndpointID& eid) { m_sourceNodeEID = eid; }
-  void SetReportToEID (const EndpointID& eid) { m_reportToEID = eid; }
-  void SetCreationTimestamp (DtnTime timestamp) { m_creationTimestamp = timestamp; }
-  void SetSequenceNumber (uint64_t seqNum) { m_sequenceNumber = seqNum; }
-  void SetLifetime (Time lifetime) { m_lifetime = lifetime; }
-  void SetFragmentOffset (uint64_t offset) { m_fragmentOffset = offset; }
-  void SetTotalApplicationDataUnitLength (uint64_t length) { m_totalApplicationDataUnitLength = length; }
+  void SetVersion (uint64_t version) { m_version = version; Touch (); }
+  void SetBundleControlFlags (BundleControlFlags flags) { m_bundleControlFlags = flags; Touch (); }
+  void SetCRCType (CRCType crcType) { m_crcType = crcType; Touch (); }
+  void SetDestinationEID (const EndpointID& eid) { m_destinationEID = eid; Touch (); }
+  void SetSourceNodeEID (const EndpointID& eid) { m_sourceNodeEID = eid; Touch (); }
+  void SetReportToEID (const EndpointID& eid) { m_reportToEID = eid; Touch (); }
+  void SetCreationTimestamp (DtnTime timestamp) { m_creationTimestamp = timestamp; Touch (); }
+  void SetSequenceNumber (uint64_t seqNum) { m_sequenceNumber = seqNum; Touch (); }
+  void SetLifetime (Time lifetime) { m_lifetime = lifetime; Touch (); }
+  void SetFragmentOffset (uint64_t offset) { m_fragmentOffset = offset; Touch (); }
+  void SetTotalApplicationDataUnitLength (uint64_t length) { m_totalApplicationDataUnitLength = length; Touch (); }
+  
+  /**
+   * \brief Get the generation of the block contents
+   *
+   * The generation changes on every modification that affects the encoded
+   * form, which lets cached encodings detect a stale primary block.
+   * \return Generation number
+   */
+  uint64_t GetGeneration () const { return m_generation; }
+  
+  /**
+   * \brief Get the absolute expiration time, creation time plus lifetime
+   *
+   * Kept up to date by the setters, so expiry checks cost a comparison.
+   * \return Expiration time
+   */
+  Time GetExpirationTime () const { return m_expiration; }
+  
+  /**
+   * \brief Check if the bundle has expired
+   * \param now Current time
+   * \return true if the expiration time has passed
+   */
+  bool IsExpired (Time now) const { return now > m_expiration; }
+  
+  /**
+   * \brief Get the ID of the bundle this block belongs to
+   *
+   * Built once per generation and then reused.
+   * \return Bundle ID
+   */
+  const BundleID& GetId () const;
   
   /**
    * \brief Check if bundle has fragmentation fields
@@ -215,10 +251,27 @@ public:
   
   /**
    * \brief Serialize to CBOR format
+   *
+   * The encoding is kept until the block is modified, later calls and
+   * WriteCbor copy it instead of encoding again.
    * \return CBOR encoded data
    */
   Buffer ToCbor () const;
   
+  /**
+   * \brief Serialize to CBOR format into an existing writer
+   *
+   * Encodes through ToCbor, so the encoding is cached for later calls.
+   * \param writer CBOR writer
+   */
+  void WriteCbor (CborWriter& writer) const;
+  
+  /**
+   * \brief Get the size of the CBOR encoding
+   * \return Encoded size in bytes
+   */
+  size_t GetCborSize () const;
+  
   /**
    * \brief Deserialize from CBOR format
    * \param buffer CBOR encoded data
@@ -226,6 +279,15 @@ public:
    */
   static std::optional<PrimaryBlock> FromCbor (Buffer buffer);
   
+  /**
+   * \brief Deserialize from a CBOR reader positioned at the block
+   *
+   * The block CRC, if any, is verified against the input bytes.
+   * \param reader CBOR reader, advanced past the block on success
+   * \return Deserialized primary block
+   */
+  static std::optional<PrimaryBlock> ReadCbor (CborReader& reader);
+  
   /**
    * \brief Get string representation
    * \return String representation of primary block
@@ -233,6 +295,19 @@ public:
   std::string ToString () const;
 
 private:
+  /**
+   * \brief Serialize, computing the CRC on the fly
+   * \param writer CBOR writer
+   * \param crcValue Receives the CRC value (up to 4 bytes)
+   * \return Size of the CRC value, 0 if the block has none
+   */
+  size_t EncodeCbor (CborWriter& writer, uint8_t* crcValue) const;
+  
+  /**
+   * \brief Assign a new generation after a modification
+   */
+  void Touch ();
+  
   uint64_t m_version;                               //!< BP version number
   BundleControlFlags m_bundleControlFlags;          //!< Bundle control flags
   CRCType m_crcType;                                //!< CRC type
@@ -245,6 +320,12 @@ private:
   uint64_t m_fragmentOffset;                        //!< Fragment offset
   uint64_t m_totalApplicationDataUnitLength;        //!< Total ADU length
   std::vector<uint8_t> m_crcValue;                  //!< CRC value
+  uint64_t m_generation;                            //!< Generation of the encoded contents
+  Time m_expiration;                                //!< Creation time plus lifetime
+  mutable BundleID m_id;                            //!< Cached bundle ID
+  mutable uint64_t m_idGeneration;                  //!< Generation m_id was built for, 0 if none
+  mutable Buffer m_encoded;                         //!< Cached encoding
+  mutable uint64_t m_encodedGeneration;             //!< Generation m_encoded was built for, 0 if none
 };
 
 } // namespace dtn7
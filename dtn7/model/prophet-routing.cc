@@ -0,0 +1,444 @@
+#include "prophet-routing.h"
+#include "cbor.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/nstime.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("ProphetRouting");
+
+namespace dtn7 {
+
+namespace {
+
+const double PREDICTABILITY_SCALE = 1000000.0;
+
+} // anonymous namespace
+
+NS_OBJECT_ENSURE_REGISTERED (ProphetRouting);
+
+TypeId 
+ProphetRouting::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::dtn7::ProphetRouting")
+    .SetParent<RoutingAlgorithm> ()
+    .SetGroupName ("Dtn7")
+    .AddConstructor<ProphetRouting> ()
+    .AddAttribute ("PInit",
+                   "Predictability increment on each encounter",
+                   DoubleValue (0.75),
+                   MakeDoubleAccessor (&ProphetRouting::m_pInit),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("Beta",
+                   "Scaling of transitive predictabilities",
+                   DoubleValue (0.25),
+                   MakeDoubleAccessor (&ProphetRouting::m_beta),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("Gamma",
+                   "Aging factor applied once per aging unit",
+                   DoubleValue (0.98),
+                   MakeDoubleAccessor (&ProphetRouting::m_gamma),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("PMin",
+                   "Predictabilities below this value are forgotten",
+                   DoubleValue (0.0001),
+                   MakeDoubleAccessor (&ProphetRouting::m_pMin),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("AgingUnit",
+                   "Time unit after which predictabilities decay by Gamma",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&ProphetRouting::m_agingUnit),
+                   MakeTimeChecker ())
+    .AddAttribute ("TableTimeout",
+                   "How long to hold bundles for a new peer while waiting for its predictability table",
+                   TimeValue (Seconds (2)),
+                   MakeTimeAccessor (&ProphetRouting::m_tableTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("TableLifetime",
+                   "Lifetime of predictability table bundles",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&ProphetRouting::m_tableLifetime),
+                   MakeTimeChecker ())
+  ;
+  return tid;
+}
+
+ProphetRouting::ProphetRouting ()
+  : m_pInit (0.75),
+    m_beta (0.25),
+    m_gamma (0.98),
+    m_pMin (0.0001),
+    m_agingUnit (Seconds (30)),
+    m_tableTimeout (Seconds (2)),
+    m_tableLifetime (Seconds (60)),
+    m_tablesSent (0),
+    m_tablesReceived (0),
+    m_declined (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+ProphetRouting::~ProphetRouting ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void 
+ProphetRouting::NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source)
+{
+  NS_LOG_FUNCTION (this << bundle << source.ToString ());
+  
+  // Store the bundle
+  if (!m_store->Push (bundle))
+    {
+      NS_LOG_ERROR ("Failed to store bundle");
+      return;
+    }
+  
+  // Update bundle descriptor
+  BundleDescriptor& desc = UpdateBundleDescriptor (bundle);
+  
+  // Mark as sent to source node
+  desc.AddSentNode (GetPeerIndex (source));
+  
+  NS_LOG_INFO ("Added new bundle from " << source.ToString () << " to store");
+}
+
+void 
+ProphetRouting::NotifyPeerAppeared (const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
+  
+  // Store peer information
+  bool newContact = false;
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    newContact = m_peers.find (peer.nodeID) == m_peers.end ();
+    m_peers[peer.nodeID] = peer;
+  }
+  
+  NS_LOG_INFO ("Peer appeared: " << peer.nodeID.ToString ());
+  
+  if (newContact)
+    {
+      // Encounter: P(a,b) = P(a,b)_old + (1 - P(a,b)_old) * P_init
+      {
+        std::lock_guard<OptionalMutex> lock (m_tableMutex);
+        AgeLocked ();
+        double& p = m_predictabilities[peer.nodeID];
+        p += (1 - p) * m_pInit;
+      }
+  
+      // Bundles wait for the peer's table, see OfferBundle
+      if (SendTable (peer))
+        {
+          std::lock_guard<OptionalMutex> lock (m_peersMutex);
+          m_peerTables[peer.nodeID].requested = Simulator::Now ();
+        }
+    }
+  
+  // Dispatch bundles to the new peer
+  DispatchBundles ();
+}
+
+void 
+ProphetRouting::NotifyPeerDisappeared (const NodeID& peer)
+{
+  NS_LOG_FUNCTION (this << peer.ToString ());
+  
+  // Remove peer information; our predictabilities are kept and age
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    m_peers.erase (peer);
+    m_peerQueues.erase (peer);
+    m_peerTables.erase (peer);
+  }
+  
+  NS_LOG_INFO ("Peer disappeared: " << peer.ToString ());
+}
+
+bool 
+ProphetRouting::NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source)
+{
+  Ptr<CanonicalBlock> block = bundle->GetBlockByType (BlockType::PROPHET_VECTOR_BLOCK);
+  if (!block)
+    {
+      return false;
+    }
+  
+  // The table comes from the node that created the bundle
+  NodeID peer = bundle->GetPrimaryBlock ().GetSourceNodeEID ();
+  std::unordered_map<NodeID, double> table;
+  if (!DecodeTable (block->GetData ().data (), block->GetData ().size (), table))
+    {
+      NS_LOG_ERROR ("Malformed predictability table from " << peer.ToString ());
+      return true;
+    }
+  
+  NS_LOG_INFO ("Predictability table from " << peer.ToString () << " lists " << table.size () << " nodes");
+  
+  // Transitivity: P(a,c) = max(P(a,c)_old, P(a,b) * P(b,c) * beta)
+  {
+    std::lock_guard<OptionalMutex> lock (m_tableMutex);
+    AgeLocked ();
+    auto self = m_predictabilities.find (peer);
+    double pPeer = self != m_predictabilities.end () ? self->second : 0;
+    for (const auto& entry : table)
+      {
+        if (entry.first == m_localNodeID || entry.first == peer)
+          {
+            continue;
+          }
+        double transitive = pPeer * entry.second * m_beta;
+        if (transitive >= m_pMin)
+          {
+            double& p = m_predictabilities[entry.first];
+            p = std::max (p, transitive);
+          }
+      }
+  }
+  
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    PeerTable& state = m_peerTables[peer];
+    state.predictabilities = std::move (table);
+    state.received = true;
+  }
+  m_tablesReceived++;
+  
+  DispatchBundles ();
+  return true;
+}
+
+bool 
+ProphetRouting::OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer)
+{
+  BundleID id = bundle->GetId ();
+  const EndpointID& destinationEID = bundle->GetPrimaryBlock ().GetDestinationEID ();
+  
+  // Skip expired bundles and peers the bundle was already sent to
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end () && it->second.IsExpired ())
+      {
+        NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
+        return true;
+      }
+    if (it != m_bundles.end () && it->second.SentTo (peer.index))
+      {
+        return true;
+      }
+  }
+  
+  // Skip if destination is local
+  if (destinationEID == m_localNodeID)
+    {
+      return true;
+    }
+  
+  // Always deliver to the destination itself
+  if (destinationEID == peer.nodeID)
+    {
+      return SendBundle (bundle, peer.nodeID, peer.endpoint);
+    }
+  
+  // Hold bundles until the peer's table arrives; without one the peer
+  // is treated as knowing no route
+  double peerP = 0;
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    auto state = m_peerTables.find (peer.nodeID);
+    if (state != m_peerTables.end ())
+      {
+        if (!state->second.received)
+          {
+            if (Simulator::Now () - state->second.requested < m_tableTimeout)
+              {
+                return false;
+              }
+          }
+        else
+          {
+            auto entry = state->second.predictabilities.find (destinationEID);
+            if (entry != state->second.predictabilities.end ())
+              {
+                peerP = entry->second;
+              }
+          }
+      }
+  }
+  
+  // GRTR: forward only to peers more likely to meet the destination
+  if (peerP <= GetPredictability (destinationEID))
+    {
+      m_declined++;
+      return true;
+    }
+  
+  NS_LOG_INFO ("Forwarding bundle " << id.ToString () << " to " << peer.nodeID.ToString ()
+               << " (P=" << peerP << ")");
+  return SendBundle (bundle, peer.nodeID, peer.endpoint);
+}
+
+double 
+ProphetRouting::GetPredictability (const NodeID& node)
+{
+  std::lock_guard<OptionalMutex> lock (m_tableMutex);
+  AgeLocked ();
+  auto it = m_predictabilities.find (node);
+  return it != m_predictabilities.end () ? it->second : 0;
+}
+
+void 
+ProphetRouting::AgeLocked ()
+{
+  // P(a,b) = P(a,b)_old * gamma^k for k elapsed aging units
+  Time now = Simulator::Now ();
+  if (m_agingUnit.IsZero () || now - m_lastAged < m_agingUnit)
+    {
+      return;
+    }
+  
+  int64_t units = (now - m_lastAged).GetTimeStep () / m_agingUnit.GetTimeStep ();
+  m_lastAged += TimeStep (m_agingUnit.GetTimeStep () * units);
+  double factor = std::pow (m_gamma, static_cast<double> (units));
+  
+  for (auto it = m_predictabilities.begin (); it != m_predictabilities.end (); )
+    {
+      it->second *= factor;
+      if (it->second < m_pMin)
+        {
+          it = m_predictabilities.erase (it);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+}
+
+bool 
+ProphetRouting::SendTable (const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
+  
+  std::vector<uint8_t> encoded;
+  size_t entries;
+  {
+    std::lock_guard<OptionalMutex> lock (m_tableMutex);
+    AgeLocked ();
+    encoded = EncodeTable (m_predictabilities);
+    entries = m_predictabilities.size ();
+  }
+  
+  Bundle control = Bundle::MustNewBundle (m_localNodeID.ToString (), peer.nodeID.ToString (),
+                                          GetDtnNow (), m_tableLifetime, {});
+  control.GetPrimaryBlock ().SetSequenceNumber (m_tablesSent);
+  control.AddBlock (Create<CanonicalBlock> (BlockType::PROPHET_VECTOR_BLOCK, 0,
+                                            BlockControlFlags::DELETE_BUNDLE_IF_BLOCK_UNPROCESSABLE,
+                                            CRCType::NO_CRC, PayloadBuffer (std::move (encoded))));
+  control.AddBlock (Create<PreviousNodeBlock> (m_localNodeID));
+  control.CalculateCRC ();
+  
+  for (const auto& sender : m_senders)
+    {
+      if (sender->IsEndpointReachable (peer.endpoint))
+        {
+          if (!sender->Send (Create<Bundle> (control), peer.endpoint))
+            {
+              break;
+            }
+          m_tablesSent++;
+          NS_LOG_INFO ("Sent predictability table of " << entries << " nodes to " << peer.nodeID.ToString ());
+          return true;
+        }
+    }
+  
+  NS_LOG_WARN ("Cannot send predictability table to " << peer.nodeID.ToString ());
+  return false;
+}
+
+std::vector<uint8_t> 
+ProphetRouting::EncodeTable (const std::unordered_map<NodeID, double>& table)
+{
+  // [node, scaled predictability, node, scaled predictability, ...]
+  size_t size = CborWriter::HeaderSize (table.size () * 2);
+  for (const auto& entry : table)
+    {
+      size += CborWriter::StringSize (entry.first.ToString ().size ());
+      size += CborWriter::HeaderSize (static_cast<uint64_t> (PREDICTABILITY_SCALE));
+    }
+  
+  std::vector<uint8_t> data;
+  data.reserve (size);
+  CborWriter writer (data);
+  writer.WriteArrayHeader (table.size () * 2);
+  for (const auto& entry : table)
+    {
+      writer.WriteTextString (entry.first.ToString ());
+      writer.WriteUnsigned (static_cast<uint64_t> (std::lround (entry.second * PREDICTABILITY_SCALE)));
+    }
+  
+  return data;
+}
+
+bool 
+ProphetRouting::DecodeTable (const uint8_t* data, size_t size, std::unordered_map<NodeID, double>& table)
+{
+  uint64_t count;
+  CborReader reader (data, size);
+  if (!reader.ReadArrayHeader (count) || count % 2 != 0)
+    {
+      return false;
+    }
+  
+  for (uint64_t i = 0; i < count / 2; i++)
+    {
+      const char* node;
+      size_t nodeLength;
+      uint64_t scaled;
+      if (!reader.ReadTextString (node, nodeLength) || !reader.ReadUnsigned (scaled))
+        {
+          return false;
+        }
+      double p = std::min (1.0, scaled / PREDICTABILITY_SCALE);
+      table[EndpointID (std::string (node, nodeLength))] = p;
+    }
+  
+  return true;
+}
+
+std::string 
+ProphetRouting::GetName () const
+{
+  return "ProphetRouting";
+}
+
+std::string 
+ProphetRouting::GetStats () const
+{
+  std::stringstream ss;
+  
+  ss << "ProphetRouting(";
+  ss << "peers=" << m_peers.size ();
+  ss << ", bundles=" << m_bundles.size ();
+  ss << ", known=" << m_predictabilities.size ();
+  ss << ", sent=" << m_sentBundles;
+  ss << ", failed=" << m_failedBundles;
+  ss << ", tablesSent=" << m_tablesSent;
+  ss << ", tablesReceived=" << m_tablesReceived;
+  ss << ", declined=" << m_declined;
+  ss << ")";
+  
+  return ss.str ();
+}
+
+} // namespace dtn7
+
+} // namespace ns3
@@ -0,0 +1,123 @@
+#ifndef DTN7_PROPHET_ROUTING_H
+#define DTN7_PROPHET_ROUTING_H
+
+#include "routing.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief PRoPHET routing algorithm implementation (RFC 6693)
+ *
+ * Every node keeps a delivery predictability P(a,b) for the nodes it has
+ * met. An encounter raises it, it decays by Gamma per AgingUnit, and the
+ * tables exchanged on contact add transitive estimates. A bundle is only
+ * forwarded to its destination or to a peer whose predictability for the
+ * destination is higher than our own (the GRTR strategy).
+ *
+ * Tables travel as control bundles with a PROPHET_VECTOR_BLOCK holding a
+ * CBOR array of alternating node IDs and predictabilities scaled to
+ * [0, 1000000].
+ */
+class ProphetRouting : public RoutingAlgorithm
+{
+public:
+  /**
+   * \brief Get the type ID
+   * \return Type ID
+   */
+  static TypeId GetTypeId ();
+  
+  /**
+   * \brief Default constructor
+   */
+  ProphetRouting ();
+  
+  /**
+   * \brief Destructor
+   */
+  virtual ~ProphetRouting ();
+  
+  // Inherited from RoutingAlgorithm
+  void NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source) override;
+  bool NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source) override;
+  void NotifyPeerAppeared (const PeerInfo& peer) override;
+  void NotifyPeerDisappeared (const NodeID& peer) override;
+  std::string GetName () const override;
+  std::string GetStats () const override;
+  
+  /**
+   * \brief Get the delivery predictability for a node
+   * \param node Node ID
+   * \return Predictability in [0, 1]
+   */
+  double GetPredictability (const NodeID& node);
+  
+protected:
+  // Inherited from RoutingAlgorithm
+  bool OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer) override;
+  
+private:
+  /**
+   * \brief Predictability table exchange state of one peer
+   */
+  struct PeerTable
+  {
+    std::unordered_map<NodeID, double> predictabilities; //!< Predictabilities the peer reported
+    bool received = false;                               //!< Whether the peer's table arrived
+    Time requested;                                      //!< When our table was sent to the peer
+  };
+  
+  /**
+   * \brief Decay all predictabilities for the time since the last aging,
+   * the caller holds m_tableMutex
+   */
+  void AgeLocked ();
+  
+  /**
+   * \brief Send our predictability table to a peer
+   * \param peer Peer
+   * \return true if the table was sent
+   */
+  bool SendTable (const PeerInfo& peer);
+  
+  /**
+   * \brief Encode a predictability table
+   * \param table Predictabilities by node
+   * \return CBOR encoding
+   */
+  static std::vector<uint8_t> EncodeTable (const std::unordered_map<NodeID, double>& table);
+  
+  /**
+   * \brief Decode a predictability table
+   * \param data Pointer to the encoding
+   * \param size Size of the encoding
+   * \param table Receives the predictabilities by node
+   * \return true if the encoding is well formed
+   */
+  static bool DecodeTable (const uint8_t* data, size_t size, std::unordered_map<NodeID, double>& table);
+  
+  std::unordered_map<NodeID, double> m_predictabilities; //!< Our predictabilities, guarded by m_tableMutex
+  Time m_lastAged;                                       //!< When the table was last aged, guarded by m_tableMutex
+  mutable OptionalMutex m_tableMutex;                    //!< Mutex for our predictability table
+  std::unordered_map<NodeID, PeerTable> m_peerTables;    //!< Tables of the current peers, guarded by m_peersMutex
+  
+  double m_pInit;            //!< Encounter predictability increment
+  double m_beta;             //!< Transitivity scaling
+  double m_gamma;            //!< Aging factor per aging unit
+  double m_pMin;             //!< Predictabilities below this are dropped
+  Time m_agingUnit;          //!< Time unit for aging
+  Time m_tableTimeout;       //!< How long to wait for a peer's table
+  Time m_tableLifetime;      //!< Lifetime of table bundles
+  uint64_t m_tablesSent;     //!< Number of tables sent
+  uint64_t m_tablesReceived; //!< Number of tables received
+  uint64_t m_declined;       //!< Bundles not sent because the peer was no better
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_PROPHET_ROUTING_H */
@@ -1,5 +1,12 @@
 #include "routing.h"
+#include "administrative-record.h"
+#include "cbor.h"
+#include "trace-events.h"
 #include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/enum.h"
+#include "ns3/uinteger.h"
+#include <algorithm>
 #include <sstream>
 #include <functional> // 添加这行来支持哈希函数
 namespace ns3 {
@@ -8,29 +15,32 @@ NS_LOG_COMPONENT_DEFINE ("RoutingAlgorithm");
 
 namespace dtn7 {
 
-// BundleDescriptor implementation
+// PeerSet and BundleDescriptor implementation
 
 bool 
-BundleDescriptor::SentTo (const NodeID& node) const
+PeerSet::Insert (uint32_t index)
 {
-  for (const auto& sentNode : sentNodes)
+  if (Contains (index))
     {
-      if (sentNode == node)
-        {
-          return true;
-        }
+      return false;
     }
   
-  return false;
-}
-
-void 
-BundleDescriptor::AddSentNode (const NodeID& node)
-{
-  if (!SentTo (node))
+  if (index < 64)
     {
-      sentNodes.push_back (node);
+      m_word |= uint64_t (1) << index;
     }
+  else
+    {
+      size_t word = index / 64 - 1;
+      if (word >= m_overflow.size ())
+        {
+          m_overflow.resize (word + 1, 0);
+        }
+      m_overflow[word] |= uint64_t (1) << (index % 64);
+    }
+  
+  m_count++;
+  return true;
 }
 
 bool 
@@ -44,8 +54,9 @@ BundleDescriptor::IsExpired () const
 bool 
 PeerInfo::IsActive () const
 {
-  // Consider a peer active if it's reachable and was seen recently
-  return reachable && (Simulator::Now () - lastSeen < Time (Minutes (5)));
+  // Disappearance is reported explicitly when the connection goes down,
+  // so a reachable peer stays active however long ago it appeared
+  return reachable;
 }
 
 // RoutingAlgorithm implementation
@@ -58,6 +69,35 @@ RoutingAlgorithm::GetTypeId ()
   static TypeId tid = TypeId ("ns3::dtn7::RoutingAlgorithm")
     .SetParent<Object> ()
     .SetGroupName ("Dtn7")
+    .AddAttribute ("SchedulingPolicy",
+                   "Order in which the bundles queued for a peer are offered to it",
+                   EnumValue (RoutingAlgorithm::FIFO),
+                   MakeEnumAccessor<SchedulingPolicy> (&RoutingAlgorithm::m_schedulingPolicy),
+                   MakeEnumChecker (RoutingAlgorithm::FIFO, "Fifo",
+                                    RoutingAlgorithm::PRIORITY, "Priority",
+                                    RoutingAlgorithm::SHORTEST_LIFETIME_FIRST, "ShortestLifetimeFirst",
+                                    RoutingAlgorithm::SMALLEST_FIRST, "SmallestFirst",
+                                    RoutingAlgorithm::FAIR_SHARE, "FairShare"))
+    .AddAttribute ("ContactByteBudget",
+                   "Maximum number of bytes to send to a peer per contact, 0 for no limit",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&RoutingAlgorithm::m_contactByteBudget),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("AntiPackets",
+                   "Whether to hand delivery acknowledgements to peers and purge delivered bundles",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&RoutingAlgorithm::m_antiPacketsEnabled),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AntiPacketLifetime",
+                   "How long to keep an anti-packet for a bundle whose lifetime is unknown",
+                   TimeValue (Seconds (3600)),
+                   MakeTimeAccessor (&RoutingAlgorithm::m_antiPacketLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("ProactiveFragmentation",
+                   "Whether to fragment bundles larger than the MTU of the convergence layer sending them",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&RoutingAlgorithm::m_proactiveFragmentation),
+                   MakeBooleanChecker ())
     .AddTraceSource ("BundleSent",
                      "Trace source for sent bundles",
                      MakeTraceSourceAccessor (&RoutingAlgorithm::m_bundleSentTrace),
@@ -68,7 +108,15 @@ RoutingAlgorithm::GetTypeId ()
 
 RoutingAlgorithm::RoutingAlgorithm ()
   : m_sentBundles (0),
-    m_failedBundles (0)
+    m_failedBundles (0),
+    m_schedulingPolicy (FIFO),
+    m_contactByteBudget (0),
+    m_antiPacketsEnabled (true),
+    m_antiPacketLifetime (Seconds (3600)),
+    m_purgedBundles (0),
+    m_antiPacketsSent (0),
+    m_proactiveFragmentation (true),
+    m_fragmentedBundles (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -90,66 +138,498 @@ RoutingAlgorithm::Initialize (Ptr<BundleStore> store,
   m_localNodeID = localNodeID;
 }
 
-void
-RoutingAlgorithm::DispatchBundles ()
+void 
+RoutingAlgorithm::SetFragmentationManager (Ptr<FragmentationManager> manager)
 {
-  NS_LOG_FUNCTION (this);
-  NS_LOG_INFO ("Default implementation of DispatchBundles - should be overridden by subclasses");
-  // This default implementation doesn't do anything
-  // Subclasses should override this with their specific dispatch logic
+  NS_LOG_FUNCTION (this << manager);
+  m_fragmentationManager = manager;
 }
 
-bool 
-RoutingAlgorithm::SendBundle (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint)
+void 
+RoutingAlgorithm::SetMetrics (Ptr<MetricsRegistry> metrics)
 {
-  NS_LOG_FUNCTION (this << bundle << receiver.ToString () << endpoint);
+  NS_LOG_FUNCTION (this << metrics);
+  m_metrics = metrics;
+  m_queueLatency = metrics ? metrics->GetHistogram ("routing.queueLatency") : nullptr;
+}
+
+void 
+RoutingAlgorithm::RegisterTransmittedCallback (BundleTransmittedCallback callback)
+{
+  m_transmittedCallback = callback;
+}
+
+void 
+RoutingAlgorithm::DispatchBundles ()
+{
+  NS_LOG_FUNCTION (this);
   
-  // Find a suitable convergence layer sender
-  for (const auto& sender : m_senders)
+  if (!m_store)
     {
-      if (sender->IsEndpointReachable (endpoint))
+      return;
+    }
+  
+  // Get all active peers and how far their queues were filled; a new
+  // peer starts at generation 0 and gets one queue of the whole store
+  std::vector<PeerInfo> activePeers;
+  std::vector<uint64_t> queued;
+  std::vector<PeerInfo> newPeers;
+  {
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
+    for (const auto& pair : m_peers)
+      {
+        if (pair.second.IsActive ())
+          {
+            if (m_peerQueues.find (pair.first) == m_peerQueues.end ())
+              {
+                newPeers.push_back (pair.second);
+              }
+            activePeers.push_back (pair.second);
+            activePeers.back ().index = GetPeerIndexLocked (pair.first);
+            queued.push_back (m_peerQueues[pair.first].generation);
+          }
+      }
+  }
+  
+  if (activePeers.empty ())
+    {
+      return;
+    }
+  
+  // A new contact first learns which bundles were delivered
+  if (m_antiPacketsEnabled)
+    {
+      for (const PeerInfo& peer : newPeers)
         {
-          NS_LOG_INFO ("Sending bundle to " << receiver.ToString () << " via " << endpoint);
-          
-          // Update previous node block
-          Ptr<PreviousNodeBlock> prevNode = DynamicCast<PreviousNodeBlock> (bundle->GetBlockByType (BlockType::PREVIOUS_NODE_BLOCK));
-          if (!prevNode)
+          SendAntiPackets (peer);
+        }
+    }
+  
+  // Append the bundles stored since each queue was last filled
+  uint64_t generation = m_store->GetGeneration ();
+  uint64_t since = *std::min_element (queued.begin (), queued.end ());
+  if (since < generation)
+    {
+      std::vector<std::vector<BundleID>> fresh (activePeers.size ());
+      // Only the IDs are queued, the bundles are loaded once when offered
+      m_store->ForEachId ([&] (const BundleID& id, uint64_t bundleGeneration) {
+        if (bundleGeneration > generation)
+          {
+            return false;
+          }
+        for (size_t i = 0; i < activePeers.size (); i++)
+          {
+            if (bundleGeneration > queued[i])
+              {
+                fresh[i].push_back (id);
+              }
+          }
+        return true;
+      }, since);
+      
+      std::lock_guard<OptionalMutex> lock (m_peersMutex);
+      for (size_t i = 0; i < activePeers.size (); i++)
+        {
+          auto it = m_peerQueues.find (activePeers[i].nodeID);
+          if (it != m_peerQueues.end ())
             {
-              prevNode = Create<PreviousNodeBlock> (m_localNodeID);
-              bundle->AddBlock (prevNode);
+              it->second.pending.insert (it->second.pending.end (), fresh[i].begin (), fresh[i].end ());
+              it->second.generation = generation;
             }
-          else
+        }
+    }
+  
+  // Drain the queues; bundles whose offer failed stay queued in order
+  size_t offered = 0;
+  for (const PeerInfo& peer : activePeers)
+    {
+      std::deque<BundleID> pending;
+      {
+        std::lock_guard<OptionalMutex> lock (m_peersMutex);
+        auto it = m_peerQueues.find (peer.nodeID);
+        if (it == m_peerQueues.end ())
+          {
+            continue;
+          }
+        pending.swap (it->second.pending);
+      }
+      
+      // Bundles removed from the store since they were queued are dropped
+      std::vector<Ptr<Bundle>> bundles;
+      bundles.reserve (pending.size ());
+      for (const BundleID& id : pending)
+        {
+          std::optional<Ptr<Bundle>> bundle = m_store->Get (id);
+          if (bundle)
             {
-              prevNode->SetPreviousNode (m_localNodeID);
+              bundles.push_back (*bundle);
             }
-          
-          // Send the bundle
-          bool success = sender->Send (bundle, endpoint);
-          
-          if (success)
+        }
+      ScheduleBundles (bundles, peer);
+      
+      std::deque<BundleID> retry;
+      for (const Ptr<Bundle>& bundle : bundles)
+        {
+          // Bundles that do not fit in the contact's budget wait for the next contact
+          if (m_contactByteBudget > 0)
             {
-              // Update bundle descriptor
+              uint64_t sentBytes = 0;
               {
-                std::lock_guard<std::mutex> lock (m_bundlesMutex);
-                BundleID id = bundle->GetId ();
-                auto it = m_bundles.find (id);
-                if (it != m_bundles.end ())
+                std::lock_guard<OptionalMutex> lock (m_peersMutex);
+                auto it = m_peerQueues.find (peer.nodeID);
+                if (it != m_peerQueues.end ())
                   {
-                    it->second.AddSentNode (receiver);
+                    sentBytes = it->second.sentBytes;
                   }
               }
-              
-              m_sentBundles++;
-              m_bundleSentTrace (bundle, receiver);
-              return true;
+              if (sentBytes + bundle->ToCbor ().GetSize () > m_contactByteBudget)
+                {
+                  retry.push_back (bundle->GetId ());
+                  continue;
+                }
+            }
+          
+          offered++;
+          if (!OfferBundle (bundle, peer))
+            {
+              retry.push_back (bundle->GetId ());
+            }
+        }
+      
+      if (!retry.empty ())
+        {
+          std::lock_guard<OptionalMutex> lock (m_peersMutex);
+          auto it = m_peerQueues.find (peer.nodeID);
+          if (it != m_peerQueues.end ())
+            {
+              it->second.pending.insert (it->second.pending.begin (), retry.begin (), retry.end ());
+            }
+        }
+    }
+  
+  NS_LOG_INFO ("Offered " << offered << " queued bundles to " << activePeers.size () << " peers");
+}
+
+void 
+RoutingAlgorithm::ScheduleBundles (std::vector<Ptr<Bundle>>& bundles, const PeerInfo& peer) const
+{
+  // Stable sorts keep the storage order among equal bundles
+  switch (m_schedulingPolicy)
+    {
+      case PRIORITY:
+        {
+          auto priorityClass = [&peer] (const Ptr<Bundle>& bundle) {
+            if (bundle->IsAdministrativeRecord ())
+              {
+                return 0;
+              }
+            return bundle->GetPrimaryBlock ().GetDestinationEID () == peer.nodeID ? 1 : 2;
+          };
+          std::stable_sort (bundles.begin (), bundles.end (),
+                            [&] (const Ptr<Bundle>& a, const Ptr<Bundle>& b) {
+                              return priorityClass (a) < priorityClass (b);
+                            });
+          break;
+        }
+      
+      case SHORTEST_LIFETIME_FIRST:
+        {
+          std::vector<std::pair<Time, Ptr<Bundle>>> keyed;
+          keyed.reserve (bundles.size ());
+          for (const Ptr<Bundle>& bundle : bundles)
+            {
+              keyed.emplace_back (CalculateExpirationTime (bundle), bundle);
+            }
+          std::stable_sort (keyed.begin (), keyed.end (),
+                            [] (const std::pair<Time, Ptr<Bundle>>& a, const std::pair<Time, Ptr<Bundle>>& b) {
+                              return a.first < b.first;
+                            });
+          for (size_t i = 0; i < keyed.size (); i++)
+            {
+              bundles[i] = keyed[i].second;
+            }
+          break;
+        }
+      
+      case SMALLEST_FIRST:
+        {
+          // Encodings are cached on the bundles, so sizes are cheap
+          std::stable_sort (bundles.begin (), bundles.end (),
+                            [] (const Ptr<Bundle>& a, const Ptr<Bundle>& b) {
+                              return a->ToCbor ().GetSize () < b->ToCbor ().GetSize ();
+                            });
+          break;
+        }
+      
+      case FAIR_SHARE:
+        {
+          // Take one bundle per source in turn
+          std::unordered_map<EndpointID, std::deque<Ptr<Bundle>>> bySource;
+          std::vector<EndpointID> sources;
+          for (const Ptr<Bundle>& bundle : bundles)
+            {
+              const EndpointID& source = bundle->GetPrimaryBlock ().GetSourceNodeEID ();
+              std::deque<Ptr<Bundle>>& queue = bySource[source];
+              if (queue.empty ())
+                {
+                  sources.push_back (source);
+                }
+              queue.push_back (bundle);
+            }
+          
+          size_t next = 0;
+          while (next < bundles.size ())
+            {
+              for (const EndpointID& source : sources)
+                {
+                  std::deque<Ptr<Bundle>>& queue = bySource[source];
+                  if (!queue.empty ())
+                    {
+                      bundles[next++] = queue.front ();
+                      queue.pop_front ();
+                    }
+                }
+            }
+          break;
+        }
+      
+      case FIFO:
+      default:
+        break;
+    }
+}
+
+bool 
+RoutingAlgorithm::NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source)
+{
+  return false;
+}
+
+bool 
+RoutingAlgorithm::ReceiveControlBundle (Ptr<Bundle> bundle, const NodeID& source)
+{
+  Ptr<CanonicalBlock> block = bundle->GetBlockByType (BlockType::ANTI_PACKET_BLOCK);
+  if (block)
+    {
+      // A CBOR array of encoded delivered status reports
+      uint64_t count;
+      size_t purged = 0;
+      CborReader reader (block->GetData ().data (), block->GetData ().size ());
+      if (!reader.ReadArrayHeader (count))
+        {
+          NS_LOG_ERROR ("Malformed anti-packets from " << source.ToString ());
+          return true;
+        }
+      for (uint64_t i = 0; i < count; i++)
+        {
+          const uint8_t* data;
+          size_t size;
+          if (!reader.ReadByteString (data, size))
+            {
+              NS_LOG_ERROR ("Malformed anti-packets from " << source.ToString ());
+              break;
+            }
+          
+          Buffer encoded;
+          encoded.AddAtStart (size);
+          encoded.Begin ().Write (data, size);
+          std::optional<BundleStatusReport> report = BundleStatusReport::FromCbor (encoded);
+          if (!report || !report->HasStatusFlag (BundleStatusFlag::BUNDLE_DELIVERED))
+            {
+              continue;
             }
-          else
+          
+          // Keep the anti-packet as long as the bundle could still be around
+          const BundleID& id = report->GetRefBundle ();
+          Time expiration = Simulator::Now () + m_antiPacketLifetime;
+          std::optional<Ptr<Bundle>> stored = m_store ? m_store->Get (id) : std::nullopt;
+          if (stored)
+            {
+              expiration = CalculateExpirationTime (*stored);
+            }
+          if (Purge (id, encoded, expiration))
             {
-              NS_LOG_ERROR ("Failed to send bundle to " << receiver.ToString () << " via " << endpoint);
-              m_failedBundles++;
-              return false;
+              purged++;
             }
         }
+      
+      NS_LOG_INFO ("Received " << count << " anti-packets from " << source.ToString ()
+                   << ", " << purged << " new");
+      return true;
+    }
+  
+  // Replicas of delivered bundles are dropped on arrival
+  if (m_antiPacketsEnabled && !bundle->IsAdministrativeRecord () && IsDelivered (bundle->GetId ()))
+    {
+      NS_LOG_INFO ("Dropping delivered bundle " << bundle->GetId ().ToString ());
+      return true;
+    }
+  
+  return NotifyControlBundle (bundle, source);
+}
+
+void 
+RoutingAlgorithm::NotifyDelivered (Ptr<Bundle> bundle)
+{
+  NS_LOG_FUNCTION (this << bundle);
+  
+  if (!m_antiPacketsEnabled || bundle->IsAdministrativeRecord ())
+    {
+      return;
+    }
+  
+  Ptr<BundleStatusReport> report = BundleStatusReport::CreateDeliveredReport (bundle, m_localNodeID);
+  Purge (bundle->GetId (), report->ToCbor (), CalculateExpirationTime (bundle));
+}
+
+bool 
+RoutingAlgorithm::IsDelivered (const BundleID& id) const
+{
+  std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+  return m_antiPackets.find (id) != m_antiPackets.end ();
+}
+
+bool 
+RoutingAlgorithm::IsKnownBundle (const BundleID& id) const
+{
+  return (m_antiPacketsEnabled && IsDelivered (id)) || (m_store && m_store->Has (id));
+}
+
+bool 
+RoutingAlgorithm::Purge (const BundleID& id, const Buffer& report, Time expiration)
+{
+  NS_LOG_FUNCTION (this << id.ToString ());
+  
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    if (!m_antiPackets.emplace (id, AntiPacket {report, expiration}).second)
+      {
+        return false;
+      }
+    m_bundles.erase (id);
+  }
+  
+  // Queued copies are skipped once the bundle is gone from the store
+  if (m_store && m_store->Remove (id))
+    {
+      m_purgedBundles++;
+      NS_LOG_INFO ("Purged delivered bundle " << id.ToString ());
+    }
+  return true;
+}
+
+void 
+RoutingAlgorithm::SendAntiPackets (const PeerInfo& peer)
+{
+  NS_LOG_FUNCTION (this << peer.nodeID.ToString ());
+  
+  // Forget anti-packets whose bundles have expired everywhere
+  std::vector<Buffer> reports;
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    Time now = Simulator::Now ();
+    for (auto it = m_antiPackets.begin (); it != m_antiPackets.end (); )
+      {
+        if (it->second.expiration < now)
+          {
+            it = m_antiPackets.erase (it);
+            continue;
+          }
+        reports.push_back (it->second.report);
+        ++it;
+      }
+  }
+  
+  if (reports.empty ())
+    {
+      return;
+    }
+  
+  size_t size = CborWriter::HeaderSize (reports.size ());
+  for (const Buffer& report : reports)
+    {
+      size += CborWriter::StringSize (report.GetSize ());
+    }
+  std::vector<uint8_t> data;
+  data.reserve (size);
+  CborWriter writer (data);
+  writer.WriteArrayHeader (reports.size ());
+  for (const Buffer& report : reports)
+    {
+      writer.WriteByteString (report.PeekData (), report.GetSize ());
+    }
+  
+  Bundle control = Bundle::MustNewBundle (m_localNodeID.ToString (), peer.nodeID.ToString (),
+                                          GetDtnNow (), m_antiPacketLifetime, {});
+  control.GetPrimaryBlock ().SetSequenceNumber (m_antiPacketsSent);
+  control.AddBlock (Create<CanonicalBlock> (BlockType::ANTI_PACKET_BLOCK, 0,
+                                            BlockControlFlags::DELETE_BUNDLE_IF_BLOCK_UNPROCESSABLE,
+                                            CRCType::NO_CRC, PayloadBuffer (std::move (data))));
+  control.AddBlock (Create<PreviousNodeBlock> (m_localNodeID));
+  control.CalculateCRC ();
+  
+  for (const auto& sender : m_senders)
+    {
+      if (sender->IsEndpointReachable (peer.endpoint))
+        {
+          if (sender->Send (Create<Bundle> (control), peer.endpoint))
+            {
+              m_antiPacketsSent++;
+              NS_LOG_INFO ("Sent " << reports.size () << " anti-packets to " << peer.nodeID.ToString ());
+            }
+          return;
+        }
+    }
+  
+  NS_LOG_WARN ("Cannot send anti-packets to " << peer.nodeID.ToString ());
+}
+
+bool 
+RoutingAlgorithm::OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer)
+{
+  return true;
+}
+
+uint32_t 
+RoutingAlgorithm::GetPeerIndex (const NodeID& node)
+{
+  std::lock_guard<OptionalMutex> lock (m_peersMutex);
+  return GetPeerIndexLocked (node);
+}
+
+uint32_t 
+RoutingAlgorithm::GetPeerIndexLocked (const NodeID& node)
+{
+  auto it = m_peerIndices.find (node);
+  if (it != m_peerIndices.end ())
+    {
+      return it->second;
+    }
+  
+  uint32_t index = static_cast<uint32_t> (m_peerIndices.size ());
+  m_peerIndices.emplace (node, index);
+  return index;
+}
+
+bool 
+RoutingAlgorithm::SendBundle (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint)
+{
+  NS_LOG_FUNCTION (this << bundle << receiver.ToString () << endpoint);
+  
+  // Find a suitable convergence layer sender
+  for (const auto& sender : m_senders)
+    {
+      if (sender->IsEndpointReachable (endpoint))
+        {
+          // Bundles too large for the sender go out as fragments of the bundle layer
+          uint64_t mtu = sender->GetMtu (endpoint);
+          if (mtu > 0 && m_proactiveFragmentation && m_fragmentationManager &&
+              bundle->ToCbor ().GetSize () > mtu)
+            {
+              return SendFragments (bundle, receiver, endpoint, sender, mtu);
+            }
+          return TransmitBundle (bundle, receiver, endpoint, sender);
+        }
     }
   
   NS_LOG_ERROR ("No reachable convergence layer for endpoint " << endpoint);
@@ -157,6 +637,148 @@ RoutingAlgorithm::SendBundle (Ptr<Bundle> bundle, const NodeID& receiver, const
   return false;
 }
 
+bool 
+RoutingAlgorithm::TransmitBundle (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint,
+                                  Ptr<ConvergenceSender> sender)
+{
+  NS_LOG_INFO ("Sending bundle to " << receiver.ToString () << " via " << endpoint);
+  
+  BundleID id = bundle->GetId ();
+  Time arrival = Simulator::Now ();
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end ())
+      {
+        arrival = it->second.arrivalTime;
+      }
+  }
+  
+  // The hop-local blocks go out on a copy, so the stored bundle and its
+  // cached encoding stay untouched and only those blocks are encoded
+  Ptr<Bundle> outgoing = bundle->ForwardCopy (m_localNodeID, Simulator::Now () - arrival);
+  PrepareForward (outgoing, receiver);
+  
+  // Send the bundle
+  bool success = sender->Send (outgoing, endpoint);
+  
+  if (!success)
+    {
+      NS_LOG_ERROR ("Failed to send bundle to " << receiver.ToString () << " via " << endpoint);
+      m_failedBundles++;
+      return false;
+    }
+  
+  // Update bundle descriptor
+  uint32_t receiverIndex = GetPeerIndex (receiver);
+  size_t copies = 0;
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end ())
+      {
+        it->second.AddSentNode (receiverIndex);
+        copies = it->second.GetSentCount ();
+      }
+  }
+  
+  // Charge the bundle to the contact's byte budget
+  if (m_contactByteBudget > 0)
+    {
+      std::lock_guard<OptionalMutex> lock (m_peersMutex);
+      auto queue = m_peerQueues.find (receiver);
+      if (queue != m_peerQueues.end ())
+        {
+          queue->second.sentBytes += outgoing->ToCbor ().GetSize ();
+        }
+    }
+  
+  // Let the store prefer well replicated bundles for eviction
+  if (m_store && copies > 0)
+    {
+      m_store->SetReplicationHint (id, static_cast<uint32_t> (copies));
+    }
+  
+  if (m_queueLatency)
+    {
+      m_queueLatency->Record (Simulator::Now () - arrival);
+    }
+  
+  m_sentBundles++;
+  m_bundleSentTrace (bundle, receiver);
+  DTN7_TRACE_EVENT (TraceEventType::BUNDLE_SENT, id.Hash (), outgoing->ToCbor ().GetSize (), receiverIndex);
+  if (!m_transmittedCallback.IsNull ())
+    {
+      m_transmittedCallback (bundle, receiver, outgoing->ToCbor ().GetSize (), sender);
+    }
+  return true;
+}
+
+void 
+RoutingAlgorithm::PrepareForward (Ptr<Bundle> outgoing, const NodeID& receiver)
+{
+}
+
+bool 
+RoutingAlgorithm::SendFragments (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint,
+                                 Ptr<ConvergenceSender> sender, uint64_t mtu)
+{
+  NS_LOG_FUNCTION (this << bundle << receiver.ToString () << mtu);
+  
+  // The previous node block is not replicated into fragments but added
+  // again when each is sent, so leave room for it
+  uint64_t reserved = Create<PreviousNodeBlock> (m_localNodeID)->GetCborSize ();
+  
+  std::vector<Ptr<Bundle>> fragments;
+  if (mtu > reserved)
+    {
+      fragments = m_fragmentationManager->FragmentBundle (bundle, mtu - reserved);
+    }
+  if (fragments.empty ())
+    {
+      NS_LOG_INFO ("Bundle above the MTU of " << endpoint << " cannot be fragmented, sending it whole");
+      return TransmitBundle (bundle, receiver, endpoint, sender);
+    }
+  
+  // The fragments take the bundle's place, so later contacts forward them
+  // independently instead of the whole bundle
+  BundleID id = bundle->GetId ();
+  PeerSet sentNodes;
+  {
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end ())
+      {
+        sentNodes = it->second.sentNodes;
+        m_bundles.erase (it);
+      }
+  }
+  if (m_store)
+    {
+      m_store->Remove (id);
+    }
+  m_fragmentedBundles++;
+  
+  NS_LOG_INFO ("Replaced bundle " << id.ToString () << " by " << fragments.size ()
+               << " fragments for the MTU of " << endpoint);
+  
+  bool success = true;
+  for (const Ptr<Bundle>& fragment : fragments)
+    {
+      NotifyNewBundle (fragment, m_localNodeID);
+      {
+        std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+        auto it = m_bundles.find (fragment->GetId ());
+        if (it != m_bundles.end ())
+          {
+            it->second.sentNodes = sentNodes;
+          }
+      }
+      success = TransmitBundle (fragment, receiver, endpoint, sender) && success;
+    }
+  return success;
+}
+
 BundleDescriptor& 
 RoutingAlgorithm::UpdateBundleDescriptor (Ptr<Bundle> bundle)
 {
@@ -164,7 +786,7 @@ RoutingAlgorithm::UpdateBundleDescriptor (Ptr<Bundle> bundle)
   
   BundleID id = bundle->GetId ();
   
-  std::lock_guard<std::mutex> lock (m_bundlesMutex);
+  std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
   auto it = m_bundles.find (id);
   
   if (it != m_bundles.end ())
@@ -175,8 +797,8 @@ RoutingAlgorithm::UpdateBundleDescriptor (Ptr<Bundle> bundle)
   // Create new descriptor
   BundleDescriptor desc;
   desc.id = id;
-  desc.receiver = bundle->GetPrimaryBlock ().GetDestinationEID ();
   desc.expirationTime = CalculateExpirationTime (bundle);
+  desc.arrivalTime = Simulator::Now ();
   
   m_bundles[id] = desc;
   return m_bundles[id];
@@ -187,11 +809,7 @@ RoutingAlgorithm::CalculateExpirationTime (Ptr<Bundle> bundle) const
 {
   NS_LOG_FUNCTION (this << bundle);
   
-  const PrimaryBlock& primary = bundle->GetPrimaryBlock ();
-  Time creationTime = primary.GetCreationTimestamp ().ToTime ();
-  Time lifetime = primary.GetLifetime ();
-  
-  return creationTime + lifetime;
+  return bundle->GetPrimaryBlock ().GetExpirationTime ();
 }
 
 } // namespace dtn7
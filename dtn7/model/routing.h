@@ -8,6 +8,7 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <mutex>
 #include <functional> // 添加这行
@@ -16,11 +17,68 @@
 #include "endpoint.h"
 #include "convergence-layer.h"
 #include "bundle-store.h"
+#include "fragmentation-manager.h"
+#include "optional-mutex.h"
 
 namespace ns3 {
 
 namespace dtn7 {
 
+/**
+ * \brief Callback for bundles handed to a convergence layer
+ *
+ * Arguments are the stored bundle, the receiving peer, the encoded size
+ * of the copy that was sent, and the sender it was handed to.
+ */
+typedef Callback<void, Ptr<Bundle>, const NodeID&, uint64_t, Ptr<ConvergenceSender>> BundleTransmittedCallback;
+
+/**
+ * \ingroup dtn7
+ * \brief Set of dense peer indices
+ *
+ * Indices below 64 live in an inline word, so the common case needs no
+ * allocation; higher indices spill into a heap bitmap. Membership tests
+ * are a shift and a mask.
+ */
+class PeerSet
+{
+public:
+  PeerSet () : m_word (0), m_count (0) {}
+  
+  /**
+   * \brief Check whether an index is in the set
+   * \param index Peer index
+   * \return true if the index was inserted before
+   */
+  bool Contains (uint32_t index) const
+  {
+    if (index < 64)
+      {
+        return (m_word >> index) & 1;
+      }
+    size_t word = index / 64 - 1;
+    return word < m_overflow.size () && ((m_overflow[word] >> (index % 64)) & 1);
+  }
+  
+  /**
+   * \brief Add an index to the set
+   * \param index Peer index
+   * \return true if the index was not in the set yet
+   */
+  bool Insert (uint32_t index);
+  
+  /**
+   * \brief Get the number of indices in the set
+   * \return Number of indices
+   */
+  size_t Size () const { return m_count; }
+
+private:
+  uint64_t m_word;                  //!< Bits of indices 0 to 63
+  std::vector<uint64_t> m_overflow; //!< Bits of indices from 64 on, empty for small sets
+  uint32_t m_count;                 //!< Number of bits set
+};
+
 /**
  * \ingroup dtn7
  * \brief Bundle descriptor for routing decisions
@@ -28,22 +86,28 @@ namespace dtn7 {
 struct BundleDescriptor
 {
   BundleID id;              //!< Bundle ID
-  EndpointID receiver;      //!< Receiver endpoint
-  std::vector<NodeID> sentNodes; //!< Nodes the bundle was sent to
+  PeerSet sentNodes;        //!< Peers the bundle was sent to, by peer index
   Time expirationTime;      //!< Time when the bundle expires
+  Time arrivalTime;         //!< Time the bundle arrived at this node, for its age on the next hop
+  
+  /**
+   * \brief Check if bundle was sent to a peer
+   * \param peer Peer index, see RoutingAlgorithm::GetPeerIndex
+   * \return true if bundle was sent to the peer
+   */
+  bool SentTo (uint32_t peer) const { return sentNodes.Contains (peer); }
   
   /**
-   * \brief Check if bundle was sent to a node
-   * \param node Node to check
-   * \return true if bundle was sent to the node
+   * \brief Add a peer to the set of peers the bundle was sent to
+   * \param peer Peer index, see RoutingAlgorithm::GetPeerIndex
    */
-  bool SentTo (const NodeID& node) const;
+  void AddSentNode (uint32_t peer) { sentNodes.Insert (peer); }
   
   /**
-   * \brief Add a node to the list of nodes the bundle was sent to
-   * \param node Node to add
+   * \brief Get the number of peers the bundle was sent to
+   * \return Number of peers
    */
-  void AddSentNode (const NodeID& node);
+  size_t GetSentCount () const { return sentNodes.Size (); }
   
   /**
    * \brief Check if bundle is expired
@@ -64,6 +128,7 @@ struct PeerInfo
   bool reachable;         //!< Whether the peer is reachable
   std::string cla;        //!< Convergence layer used for the peer
   std::string endpoint;   //!< Endpoint address
+  uint32_t index = 0;     //!< Dense peer index, set by RoutingAlgorithm::DispatchBundles
   
   /**
    * \brief Check if peer is active
@@ -79,6 +144,18 @@ struct PeerInfo
 class RoutingAlgorithm : public Object
 {
 public:
+  /**
+   * \brief Order in which queued bundles are offered to a peer
+   */
+  enum SchedulingPolicy
+  {
+    FIFO,                     //!< Order in which the bundles were stored
+    PRIORITY,                 //!< Administrative records, then bundles for the peer, then the rest
+    SHORTEST_LIFETIME_FIRST,  //!< Bundles closest to their expiration first
+    SMALLEST_FIRST,           //!< Smallest encoded bundles first
+    FAIR_SHARE                //!< Round robin over the bundle sources
+  };
+  
   /**
    * \brief Get the type ID
    * \return Type ID
@@ -112,6 +189,59 @@ public:
    */
   virtual void NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source) = 0;
   
+  /**
+   * \brief Let the algorithm consume a routing control bundle
+   *
+   * Called for every received bundle before it is delivered or routed,
+   * so algorithms can exchange their own signalling with peers. The
+   * default implementation consumes nothing.
+   * \param bundle Received bundle
+   * \param source Previous hop
+   * \return true if the bundle was consumed and must not be processed further
+   */
+  virtual bool NotifyControlBundle (Ptr<Bundle> bundle, const NodeID& source);
+  
+  /**
+   * \brief Consume anti-packets and routing control bundles
+   *
+   * Called for every received bundle before it is delivered or routed.
+   * Anti-packet bundles purge the acknowledged bundles and are consumed,
+   * as are bundles already known to be delivered; everything else is
+   * passed to NotifyControlBundle.
+   * \param bundle Received bundle
+   * \param source Previous hop
+   * \return true if the bundle was consumed and must not be processed further
+   */
+  bool ReceiveControlBundle (Ptr<Bundle> bundle, const NodeID& source);
+  
+  /**
+   * \brief Record that a bundle was delivered to the local node
+   *
+   * The delivery becomes an anti-packet: a delivered status report that
+   * is handed to every new peer, so replicas of the bundle are purged
+   * from stores and routing state across the network.
+   * \param bundle Delivered bundle
+   */
+  void NotifyDelivered (Ptr<Bundle> bundle);
+  
+  /**
+   * \brief Check whether a bundle is known to be delivered
+   * \param id Bundle ID
+   * \return true if an anti-packet for the bundle is held
+   */
+  bool IsDelivered (const BundleID& id) const;
+  
+  /**
+   * \brief Check whether a received bundle can be dropped as a duplicate
+   *
+   * Asked by the convergence layers with only the primary block decoded.
+   * The default treats stored and delivered bundles as known; algorithms
+   * that learn from extra copies of a bundle override this.
+   * \param id Bundle ID
+   * \return true if the bundle is already stored or delivered
+   */
+  virtual bool IsKnownBundle (const BundleID& id) const;
+  
   /**
    * \brief Update routing information for a peer
    * \param peer Peer information
@@ -124,8 +254,45 @@ public:
    */
   virtual void NotifyPeerDisappeared (const NodeID& peer) = 0;
   
+  /**
+   * \brief Set the manager used to fragment bundles for small MTUs
+   *
+   * With ProactiveFragmentation enabled, a bundle larger than the MTU the
+   * chosen convergence layer advertises for a peer is replaced by BPv7
+   * fragments that fit it. The fragments are stored and routed as bundles
+   * of their own, so they can reach the destination over different
+   * contacts and paths.
+   * \param manager Fragmentation manager, nullptr to disable
+   */
+  void SetFragmentationManager (Ptr<FragmentationManager> manager);
+  
+  /**
+   * \brief Record routing latencies in a node's metrics
+   *
+   * "routing.queueLatency" holds the time from a bundle's arrival at the
+   * routing algorithm to each successful send.
+   * \param metrics Metrics of the node, nullptr to stop recording
+   */
+  void SetMetrics (Ptr<MetricsRegistry> metrics);
+  
+  /**
+   * \brief Register a callback for every successful send of a bundle
+   * \param callback Function to call on each send
+   */
+  void RegisterTransmittedCallback (BundleTransmittedCallback callback);
+  
   /**
    * \brief Dispatch bundles to be sent
+   *
+   * The default implementation keeps a queue of bundles per peer. A new
+   * peer's queue is filled once from the whole store; afterwards each
+   * dispatch only appends the bundles stored since, then drains the
+   * queues through OfferBundle. The cost follows the new work rather
+   * than the store size times the number of peers.
+   *
+   * Each queue is ordered by the SchedulingPolicy before it is drained,
+   * and bundles that would exceed the ContactByteBudget of the current
+   * contact stay queued.
    */
   virtual void DispatchBundles ();
   
@@ -142,18 +309,69 @@ public:
   virtual std::string GetStats () const = 0;
 
 protected:
+  /**
+   * \brief Delivery acknowledgement held for a bundle
+   */
+  struct AntiPacket
+  {
+    Buffer report;      //!< Encoded delivered status report
+    Time expiration;    //!< When the acknowledged bundle expires
+  };
+  
+  /**
+   * \brief Bundles waiting to be offered to one peer
+   */
+  struct PeerQueue
+  {
+    std::deque<BundleID> pending; //!< Bundles not offered successfully yet, oldest first
+    uint64_t generation = 0;      //!< Store generation up to which bundles were queued
+    uint64_t sentBytes = 0;       //!< Bytes sent to the peer during the current contact
+  };
+  
   NodeID m_localNodeID;                                  //!< Local node ID
   Ptr<BundleStore> m_store;                              //!< Bundle store
   std::vector<Ptr<ConvergenceSender>> m_senders;         //!< Convergence layer senders
   std::unordered_map<NodeID, PeerInfo> m_peers;          //!< Known peers
   std::unordered_map<BundleID, BundleDescriptor> m_bundles; //!< Bundle descriptors
-  mutable std::mutex m_peersMutex;                       //!< Mutex for peers
-  mutable std::mutex m_bundlesMutex;                     //!< Mutex for bundles
+  mutable OptionalMutex m_peersMutex;                    //!< Mutex for peers
+  mutable OptionalMutex m_bundlesMutex;                  //!< Mutex for bundles
+  std::unordered_map<NodeID, PeerQueue> m_peerQueues;    //!< Dispatch queues by peer, guarded by m_peersMutex
+  std::unordered_map<NodeID, uint32_t> m_peerIndices;    //!< Dense index of every peer seen, guarded by m_peersMutex
   
   uint64_t m_sentBundles;                                //!< Number of sent bundles
   uint64_t m_failedBundles;                              //!< Number of failed sendings
+  SchedulingPolicy m_schedulingPolicy;                   //!< Order of queued bundles
+  uint64_t m_contactByteBudget;                          //!< Bytes to send per contact, 0 for no limit
+  std::unordered_map<BundleID, AntiPacket> m_antiPackets; //!< Delivered bundles, guarded by m_bundlesMutex
+  bool m_antiPacketsEnabled;                             //!< Whether to exchange anti-packets
+  Time m_antiPacketLifetime;                             //!< How long to keep anti-packets of unknown bundles
+  uint64_t m_purgedBundles;                              //!< Bundles purged by anti-packets
+  uint64_t m_antiPacketsSent;                            //!< Number of anti-packet bundles sent
+  Ptr<FragmentationManager> m_fragmentationManager;      //!< Fragmentation for small MTUs
+  bool m_proactiveFragmentation;                         //!< Whether to fragment bundles above the MTU
+  uint64_t m_fragmentedBundles;                          //!< Bundles replaced by fragments
+  Ptr<MetricsRegistry> m_metrics;                        //!< Metrics of the node
+  LatencyHistogram* m_queueLatency = nullptr;            //!< Arrival to send latency, nullptr if not recorded
   
   TracedCallback<Ptr<Bundle>, NodeID> m_bundleSentTrace; //!< Trace for sent bundles
+  BundleTransmittedCallback m_transmittedCallback;       //!< Callback for sent bundles
+  
+  /**
+   * \brief Get the dense index of a peer, assigning one on first use
+   *
+   * Indices are never reused, so sent-sets stay valid when a peer
+   * leaves and comes back.
+   * \param node Peer node ID
+   * \return Peer index
+   */
+  uint32_t GetPeerIndex (const NodeID& node);
+  
+  /**
+   * \brief Get the dense index of a peer, the caller holds m_peersMutex
+   * \param node Peer node ID
+   * \return Peer index
+   */
+  uint32_t GetPeerIndexLocked (const NodeID& node);
   
   /**
    * \brief Send a bundle to a receiver
@@ -164,6 +382,77 @@ protected:
    */
   bool SendBundle (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint);
   
+  /**
+   * \brief Hand a bundle to a convergence layer sender and record it
+   * \param bundle Bundle to send
+   * \param receiver Receiver node ID
+   * \param endpoint Endpoint address
+   * \param sender Convergence layer sender that reaches the endpoint
+   * \return true if bundle was sent
+   */
+  bool TransmitBundle (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint,
+                       Ptr<ConvergenceSender> sender);
+  
+  /**
+   * \brief Adjust the outgoing copy of a bundle before it is sent
+   *
+   * Called with the hop-local copy made for each transmission, so
+   * routing-specific blocks can be set for one receiver without touching
+   * the stored bundle. The default does nothing.
+   * \param outgoing Outgoing copy, or a fragment of the stored bundle
+   * \param receiver Receiver node ID
+   */
+  virtual void PrepareForward (Ptr<Bundle> outgoing, const NodeID& receiver);
+  
+  /**
+   * \brief Replace a stored bundle by fragments that fit an MTU and send them
+   *
+   * The fragments take over the bundle's place in the store and its
+   * sent-set. Bundles that must not be fragmented are sent whole.
+   * \param bundle Bundle to fragment
+   * \param receiver Receiver node ID
+   * \param endpoint Endpoint address
+   * \param sender Convergence layer sender that reaches the endpoint
+   * \param mtu Maximum encoded size of a fragment
+   * \return true if all fragments were sent
+   */
+  bool SendFragments (Ptr<Bundle> bundle, const NodeID& receiver, const std::string& endpoint,
+                      Ptr<ConvergenceSender> sender, uint64_t mtu);
+  
+  /**
+   * \brief Decide whether to forward a bundle to a peer and send it
+   *
+   * Called by DispatchBundles for each bundle in an active peer's queue.
+   * The default implementation sends nothing.
+   * \param bundle Stored bundle
+   * \param peer Active peer
+   * \return false if sending failed and the bundle should be offered again
+   */
+  virtual bool OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer);
+  
+  /**
+   * \brief Drop a delivered bundle from the store and routing state and
+   * keep an anti-packet for it
+   * \param id Bundle ID
+   * \param report Encoded delivered status report
+   * \param expiration When the anti-packet may be forgotten
+   * \return true if the anti-packet is new
+   */
+  bool Purge (const BundleID& id, const Buffer& report, Time expiration);
+  
+  /**
+   * \brief Send the held anti-packets to a new peer
+   * \param peer Peer
+   */
+  void SendAntiPackets (const PeerInfo& peer);
+  
+  /**
+   * \brief Order bundles queued for a peer by the scheduling policy
+   * \param bundles Queued bundles, reordered in place
+   * \param peer Peer the bundles are offered to
+   */
+  void ScheduleBundles (std::vector<Ptr<Bundle>>& bundles, const PeerInfo& peer) const;
+  
   /**
    * \brief Update or create a bundle descriptor
    * \param bundle Bundle
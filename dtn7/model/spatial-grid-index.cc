@@ -0,0 +1,256 @@
+#include "spatial-grid-index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+namespace {
+
+double 
+GetDistance (const Vector& a, const Vector& b)
+{
+  double dx = a.x - b.x;
+  double dy = a.y - b.y;
+  double dz = a.z - b.z;
+  return std::sqrt (dx * dx + dy * dy + dz * dz);
+}
+
+} // anonymous namespace
+
+SpatialGridIndex::SpatialGridIndex (double cellSize)
+  : m_cellSize (cellSize > 0 ? cellSize : 1.0),
+    m_minX (std::numeric_limits<int32_t>::max ()),
+    m_maxX (std::numeric_limits<int32_t>::min ()),
+    m_minY (std::numeric_limits<int32_t>::max ()),
+    m_maxY (std::numeric_limits<int32_t>::min ())
+{
+}
+
+double 
+SpatialGridIndex::GetCellSize () const
+{
+  return m_cellSize;
+}
+
+int32_t 
+SpatialGridIndex::GetCellCoordinate (double value) const
+{
+  return static_cast<int32_t> (std::floor (value / m_cellSize));
+}
+
+uint64_t 
+SpatialGridIndex::GetCellKey (int32_t x, int32_t y)
+{
+  return (static_cast<uint64_t> (static_cast<uint32_t> (x)) << 32) | static_cast<uint32_t> (y);
+}
+
+void 
+SpatialGridIndex::Update (uint32_t id, const Vector& position)
+{
+  int32_t x = GetCellCoordinate (position.x);
+  int32_t y = GetCellCoordinate (position.y);
+  uint64_t cell = GetCellKey (x, y);
+  
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  auto inserted = m_entries.try_emplace (id, Entry {position, cell});
+  Entry& entry = inserted.first->second;
+  if (!inserted.second)
+    {
+      entry.position = position;
+      if (entry.cell == cell)
+        {
+          return;
+        }
+      
+      // Moved to another cell
+      std::vector<uint32_t>& old = m_cells[entry.cell];
+      auto it = std::find (old.begin (), old.end (), id);
+      if (it != old.end ())
+        {
+          *it = old.back ();
+          old.pop_back ();
+        }
+      if (old.empty ())
+        {
+          m_cells.erase (entry.cell);
+        }
+      entry.cell = cell;
+    }
+  
+  m_cells[cell].push_back (id);
+  m_minX = std::min (m_minX, x);
+  m_maxX = std::max (m_maxX, x);
+  m_minY = std::min (m_minY, y);
+  m_maxY = std::max (m_maxY, y);
+}
+
+void 
+SpatialGridIndex::Remove (uint32_t id)
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  
+  auto entry = m_entries.find (id);
+  if (entry == m_entries.end ())
+    {
+      return;
+    }
+  
+  auto cell = m_cells.find (entry->second.cell);
+  if (cell != m_cells.end ())
+    {
+      std::vector<uint32_t>& ids = cell->second;
+      auto it = std::find (ids.begin (), ids.end (), id);
+      if (it != ids.end ())
+        {
+          *it = ids.back ();
+          ids.pop_back ();
+        }
+      if (ids.empty ())
+        {
+          m_cells.erase (cell);
+        }
+    }
+  m_entries.erase (entry);
+}
+
+std::optional<Vector> 
+SpatialGridIndex::GetPosition (uint32_t id) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  auto it = m_entries.find (id);
+  if (it == m_entries.end ())
+    {
+      return std::nullopt;
+    }
+  return it->second.position;
+}
+
+size_t 
+SpatialGridIndex::GetSize () const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  return m_entries.size ();
+}
+
+void 
+SpatialGridIndex::VisitCell (int32_t x, int32_t y, const std::function<void (uint32_t, const Entry&)>& visit) const
+{
+  auto cell = m_cells.find (GetCellKey (x, y));
+  if (cell == m_cells.end ())
+    {
+      return;
+    }
+  for (uint32_t id : cell->second)
+    {
+      visit (id, m_entries.at (id));
+    }
+}
+
+std::vector<uint32_t> 
+SpatialGridIndex::GetInRange (const Vector& center, double range) const
+{
+  std::vector<uint32_t> result;
+  if (range < 0)
+    {
+      return result;
+    }
+  
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  if (m_entries.empty ())
+    {
+      return result;
+    }
+  
+  // Only the cells overlapping the bounding square of the range, clipped
+  // to the part of the grid in use
+  int32_t minX = std::max (m_minX, GetCellCoordinate (center.x - range));
+  int32_t maxX = std::min (m_maxX, GetCellCoordinate (center.x + range));
+  int32_t minY = std::max (m_minY, GetCellCoordinate (center.y - range));
+  int32_t maxY = std::min (m_maxY, GetCellCoordinate (center.y + range));
+  
+  for (int32_t x = minX; x <= maxX; x++)
+    {
+      for (int32_t y = minY; y <= maxY; y++)
+        {
+          VisitCell (x, y, [&] (uint32_t id, const Entry& entry) {
+            if (GetDistance (center, entry.position) <= range)
+              {
+                result.push_back (id);
+              }
+          });
+        }
+    }
+  
+  std::sort (result.begin (), result.end ());
+  return result;
+}
+
+std::optional<uint32_t> 
+SpatialGridIndex::GetNearest (const Vector& position, const CostFunction& cost) const
+{
+  std::lock_guard<OptionalMutex> lock (m_mutex);
+  if (m_entries.empty ())
+    {
+      return std::nullopt;
+    }
+  
+  int32_t centerX = GetCellCoordinate (position.x);
+  int32_t centerY = GetCellCoordinate (position.y);
+  
+  // Rings needed to cover the whole grid from the query cell
+  int64_t maxRing = std::max ({int64_t (centerX) - m_minX, int64_t (m_maxX) - centerX,
+                               int64_t (centerY) - m_minY, int64_t (m_maxY) - centerY, int64_t (0)});
+  
+  double best = std::numeric_limits<double>::infinity ();
+  std::optional<uint32_t> nearest;
+  auto visit = [&] (uint32_t id, const Entry& entry) {
+    double distance = GetDistance (position, entry.position);
+    double value = cost ? cost (id, distance) : distance;
+    // Ties go to the lower ID, as in a scan over all nodes
+    if (value < best || (value == best && nearest && id < *nearest))
+      {
+        best = value;
+        nearest = id;
+      }
+  };
+  
+  for (int64_t ring = 0; ring <= maxRing; ring++)
+    {
+      // Nodes in this ring or beyond are at least ring - 1 cells away,
+      // and costs are never below distances
+      if (ring > 0 && (ring - 1) * m_cellSize > best)
+        {
+          break;
+        }
+      
+      for (int64_t x = centerX - ring; x <= centerX + ring; x++)
+        {
+          if (x < m_minX || x > m_maxX)
+            {
+              continue;
+            }
+          for (int64_t y = centerY - ring; y <= centerY + ring; y++)
+            {
+              // Only the border of the ring, the inside was visited before
+              if (y < m_minY || y > m_maxY ||
+                  (x != centerX - ring && x != centerX + ring && y != centerY - ring && y != centerY + ring))
+                {
+                  continue;
+                }
+              VisitCell (static_cast<int32_t> (x), static_cast<int32_t> (y), visit);
+            }
+        }
+    }
+  
+  return nearest;
+}
+
+} // namespace dtn7
+
+} // namespace ns3
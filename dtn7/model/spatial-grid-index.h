@@ -0,0 +1,147 @@
+#ifndef DTN7_SPATIAL_GRID_INDEX_H
+#define DTN7_SPATIAL_GRID_INDEX_H
+
+#include "ns3/simple-ref-count.h"
+#include "ns3/vector.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "optional-mutex.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Uniform grid of node positions for range and nearest-node queries
+ *
+ * Nodes are bucketed by their x/y position into square cells. With the
+ * cell size set to the communication range, a range query only visits
+ * the cell of the query point and its neighbours, and a nearest-node
+ * query searches rings of cells outwards until no closer node can
+ * exist. Distances are Euclidean in three dimensions.
+ *
+ * The index holds the positions it was last given; callers refresh it
+ * from their position-update events, e.g. from a MobilityModel's
+ * CourseChange trace or a periodic sampling event. Node IDs are
+ * arbitrary, usually ns-3 node IDs, so the same index serves the
+ * simulation scripts as well as position-aware discovery and routing.
+ */
+class SpatialGridIndex : public SimpleRefCount<SpatialGridIndex>
+{
+public:
+  /**
+   * \brief Cost of a candidate for GetNearest, infinity to skip it
+   *
+   * Arguments are the node ID and its distance to the query point; the
+   * cost must not be smaller than the distance.
+   */
+  typedef std::function<double (uint32_t, double)> CostFunction;
+  
+  /**
+   * \brief Constructor
+   * \param cellSize Edge length of a cell, typically the communication range
+   */
+  explicit SpatialGridIndex (double cellSize);
+  
+  /**
+   * \brief Get the cell size
+   * \return Edge length of a cell
+   */
+  double GetCellSize () const;
+  
+  /**
+   * \brief Insert a node or move it to a new position
+   * \param id Node ID
+   * \param position Position
+   */
+  void Update (uint32_t id, const Vector& position);
+  
+  /**
+   * \brief Remove a node
+   * \param id Node ID
+   */
+  void Remove (uint32_t id);
+  
+  /**
+   * \brief Get the indexed position of a node
+   * \param id Node ID
+   * \return Position, empty if the node is not indexed
+   */
+  std::optional<Vector> GetPosition (uint32_t id) const;
+  
+  /**
+   * \brief Get the number of indexed nodes
+   * \return Count
+   */
+  size_t GetSize () const;
+  
+  /**
+   * \brief Get the nodes within a distance of a point
+   * \param center Query point
+   * \param range Maximum distance, inclusive
+   * \return Node IDs in ascending order
+   */
+  std::vector<uint32_t> GetInRange (const Vector& center, double range) const;
+  
+  /**
+   * \brief Get the node with the lowest cost, by default the closest one
+   * \param position Query point
+   * \param cost Cost of each candidate, the distance if empty
+   * \return Node ID, empty if no node has a finite cost
+   */
+  std::optional<uint32_t> GetNearest (const Vector& position, const CostFunction& cost = CostFunction ()) const;
+
+private:
+  /**
+   * \brief Indexed node
+   */
+  struct Entry
+  {
+    Vector position; //!< Last position
+    uint64_t cell;   //!< Key of the cell holding the node
+  };
+  
+  /**
+   * \brief Get the cell coordinate of a position component
+   * \param value Position component
+   * \return Cell coordinate
+   */
+  int32_t GetCellCoordinate (double value) const;
+  
+  /**
+   * \brief Pack cell coordinates into a key
+   * \param x Cell column
+   * \param y Cell row
+   * \return Key
+   */
+  static uint64_t GetCellKey (int32_t x, int32_t y);
+  
+  /**
+   * \brief Add the nodes of one cell to a query, the caller holds m_mutex
+   * \param x Cell column
+   * \param y Cell row
+   * \param visit Function called with each node and its entry
+   */
+  void VisitCell (int32_t x, int32_t y, const std::function<void (uint32_t, const Entry&)>& visit) const;
+  
+  double m_cellSize;                                          //!< Edge length of a cell
+  std::unordered_map<uint64_t, std::vector<uint32_t>> m_cells; //!< Node IDs by cell, guarded by m_mutex
+  std::unordered_map<uint32_t, Entry> m_entries;               //!< Nodes by ID, guarded by m_mutex
+  int32_t m_minX;                                              //!< Lowest cell column ever used
+  int32_t m_maxX;                                              //!< Highest cell column ever used
+  int32_t m_minY;                                              //!< Lowest cell row ever used
+  int32_t m_maxY;                                              //!< Highest cell row ever used
+  mutable OptionalMutex m_mutex;                               //!< Mutex for the grid
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_SPATIAL_GRID_INDEX_H */
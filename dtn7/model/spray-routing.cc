@@ -1,8 +1,10 @@
 #include "spray-routing.h"
+#include "cbor.h"
 #include "ns3/log.h"
 #include "ns3/uinteger.h" // Add this for UintegerValue
 #include "ns3/object.h"   // Add this for type accessors and checkers
 #include <sstream>
+#include <algorithm>
 #include <functional> // 添加这行来支持哈希函数
 namespace ns3 {
 
@@ -55,25 +57,32 @@ SprayAndWaitRouting::NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source)
   BundleDescriptor& desc = UpdateBundleDescriptor (bundle);
   
   // Mark as sent to source node
-  desc.AddSentNode (source);
+  desc.AddSentNode (GetPeerIndex (source));
   
-  // Set initial copy count
+  // Take over the copy tokens the previous hop handed us. Bundles from
+  // peers that do not carry tokens are only delivered, never sprayed
   BundleID id = bundle->GetId ();
-  uint32_t count = m_maxCopies;
-  
-  // If this node is the source, use max copies
-  if (bundle->GetPrimaryBlock ().GetSourceNodeEID () == m_localNodeID)
+  uint32_t count = 1;
+  if (ReadCopyTokens (bundle, count))
     {
-      NS_LOG_INFO ("Local node is source, setting max copies: " << count);
+      NS_LOG_INFO ("Received " << count << " copy tokens");
     }
-  else
+  else if (bundle->GetPrimaryBlock ().GetSourceNodeEID () == m_localNodeID)
     {
-      // If this is a received bundle, use half the copies from source
-      count = std::max(1U, count / 2);
-      NS_LOG_INFO ("Received from remote, setting half copies: " << count);
+      count = m_maxCopies;
+      NS_LOG_INFO ("Local node is source, setting max copies: " << count);
     }
   
-  SetCopyCount (id, count);
+  // Tokens of a second copy of the same bundle add up
+  {
+    std::lock_guard<OptionalMutex> lock (m_copiesMutex);
+    auto it = m_copies.find (id);
+    if (it != m_copies.end ())
+      {
+        count = std::min (m_maxCopies, it->second + count);
+      }
+    m_copies[id] = std::max (1U, count);
+  }
   
   NS_LOG_INFO ("Added new bundle from " << source.ToString () << " to store with " << count << " copies");
 }
@@ -85,7 +94,7 @@ SprayAndWaitRouting::NotifyPeerAppeared (const PeerInfo& peer)
   
   // Store peer information
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
     m_peers[peer.nodeID] = peer;
   }
   
@@ -102,125 +111,87 @@ SprayAndWaitRouting::NotifyPeerDisappeared (const NodeID& peer)
   
   // Remove peer information
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
+    std::lock_guard<OptionalMutex> lock (m_peersMutex);
     m_peers.erase (peer);
+    m_peerQueues.erase (peer);
   }
   
   NS_LOG_INFO ("Peer disappeared: " << peer.ToString ());
 }
 
-void 
-SprayAndWaitRouting::DispatchBundles ()
+bool 
+SprayAndWaitRouting::OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer)
 {
-  NS_LOG_FUNCTION (this);
-  
-  // Get all bundles from the store
-  std::vector<Ptr<Bundle>> bundles = m_store->GetAll ();
-  
-  NS_LOG_INFO ("Dispatching " << bundles.size () << " bundles to peers");
+  BundleID id = bundle->GetId ();
+  const EndpointID& destinationEID = bundle->GetPrimaryBlock ().GetDestinationEID ();
   
-  // Get all active peers
-  std::vector<PeerInfo> activePeers;
+  // Skip expired bundles
+  bool known = false;
+  bool sent = false;
   {
-    std::lock_guard<std::mutex> lock (m_peersMutex);
-    for (const auto& pair : m_peers)
+    std::lock_guard<OptionalMutex> lock (m_bundlesMutex);
+    auto it = m_bundles.find (id);
+    if (it != m_bundles.end () && it->second.IsExpired ())
       {
-        if (pair.second.IsActive ())
-          {
-            activePeers.push_back (pair.second);
-          }
+        NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
+        return true;
       }
+    known = it != m_bundles.end ();
+    sent = known && it->second.SentTo (peer.index);
   }
   
-  // Try to send each bundle to each peer
-  for (const auto& bundle : bundles)
+  uint32_t copyCount = GetCopyCount (id);
+  
+  if (copyCount <= 1)
     {
-      BundleID id = bundle->GetId ();
-      
-      // Skip expired bundles
-      std::lock_guard<std::mutex> lock (m_bundlesMutex);
-      auto it = m_bundles.find (id);
-      if (it != m_bundles.end () && it->second.IsExpired ())
-        {
-          NS_LOG_INFO ("Skipping expired bundle: " << id.ToString ());
-          continue;
-        }
-      
-      uint32_t copyCount = GetCopyCount (id);
-      
-      if (copyCount <= 1)
-        {
-          // Wait phase: only forward directly to destination
-          const EndpointID& destinationEID = bundle->GetPrimaryBlock ().GetDestinationEID ();
-          
-          for (const auto& peer : activePeers)
-            {
-              // Only send to final destination
-              if (peer.nodeID == destinationEID)
-                {
-                  if (it != m_bundles.end () && !it->second.SentTo (peer.nodeID))
-                    {
-                      NS_LOG_INFO ("Sending bundle directly to destination: " << peer.nodeID.ToString ());
-                      SendBundle (bundle, peer.nodeID, peer.endpoint);
-                    }
-                }
-            }
-        }
-      else
+      // Wait phase: only forward directly to destination
+      if (peer.nodeID == destinationEID && known && !sent)
         {
-          // Spray phase: forward to peers we haven't sent to yet
-          for (const auto& peer : activePeers)
-            {
-              // Skip if destination is local
-              if (bundle->GetPrimaryBlock ().GetDestinationEID () == m_localNodeID)
-                {
-                  continue;
-                }
-              
-              // Skip if destination is this peer and it's not the final destination
-              if (bundle->GetPrimaryBlock ().GetDestinationEID () != peer.nodeID &&
-                  peer.nodeID == m_localNodeID)
-                {
-                  continue;
-                }
-              
-              // Skip if already sent to this peer
-              if (it != m_bundles.end () && it->second.SentTo (peer.nodeID))
-                {
-                  continue;
-                }
-              
-              // Decrease copy count
-              uint32_t newCount = DecreaseCopyCount (id);
-              
-              // Split the remaining copies
-              uint32_t peerCopies = newCount / 2;
-              uint32_t localCopies = newCount - peerCopies;
-              
-              NS_LOG_INFO ("Spraying bundle to " << peer.nodeID.ToString () 
-                          << ", copies: local=" << localCopies 
-                          << ", peer=" << peerCopies);
-              
-              // Send the bundle to the peer
-              if (SendBundle (bundle, peer.nodeID, peer.endpoint))
-                {
-                  // Update local copy count
-                  SetCopyCount (id, localCopies);
-                  
-                  // If we're out of copies, break
-                  if (localCopies <= 1)
-                    {
-                      break;
-                    }
-                }
-              else
-                {
-                  // Failed to send, restore copy count
-                  SetCopyCount (id, newCount);
-                }
-            }
+          NS_LOG_INFO ("Sending bundle directly to destination: " << peer.nodeID.ToString ());
+          return SendBundle (bundle, peer.nodeID, peer.endpoint);
         }
+      return true;
     }
+  
+  // Spray phase: forward to peers we haven't sent to yet, skipping
+  // bundles destined for the local node
+  if (destinationEID == m_localNodeID)
+    {
+      return true;
+    }
+  
+  // Skip if destination is this peer and it's not the final destination
+  if (destinationEID != peer.nodeID && peer.nodeID == m_localNodeID)
+    {
+      return true;
+    }
+  
+  // Skip if already sent to this peer
+  if (sent)
+    {
+      return true;
+    }
+  
+  // Hand half of the tokens to the peer and keep the rest
+  uint32_t peerCopies = copyCount / 2;
+  uint32_t localCopies = copyCount - peerCopies;
+  
+  NS_LOG_INFO ("Spraying bundle to " << peer.nodeID.ToString () 
+              << ", copies: local=" << localCopies 
+              << ", peer=" << peerCopies);
+  
+  // PrepareForward writes the peer's share on the outgoing copy; the
+  // stored bundle keeps its blocks and the local count lives in m_copies
+  if (!SendBundle (bundle, peer.nodeID, peer.endpoint))
+    {
+      return false;
+    }
+  
+  // Update local copy count; once it reaches one, the remaining peers
+  // only get the bundle if they are its destination
+  SetCopyCount (id, localCopies);
+  m_store->SetReplicationHint (id, m_maxCopies - std::min (localCopies, m_maxCopies));
+  return true;
 }
 
 void 
@@ -228,7 +199,7 @@ SprayAndWaitRouting::SetCopyCount (const BundleID& id, uint32_t count)
 {
   NS_LOG_FUNCTION (this << id.ToString () << count);
   
-  std::lock_guard<std::mutex> lock (m_copiesMutex);
+  std::lock_guard<OptionalMutex> lock (m_copiesMutex);
   m_copies[id] = count;
 }
 
@@ -237,7 +208,7 @@ SprayAndWaitRouting::GetCopyCount (const BundleID& id) const
 {
   NS_LOG_FUNCTION (this << id.ToString ());
   
-  std::lock_guard<std::mutex> lock (m_copiesMutex);
+  std::lock_guard<OptionalMutex> lock (m_copiesMutex);
   auto it = m_copies.find (id);
   if (it != m_copies.end ())
     {
@@ -252,7 +223,7 @@ SprayAndWaitRouting::DecreaseCopyCount (const BundleID& id)
 {
   NS_LOG_FUNCTION (this << id.ToString ());
   
-  std::lock_guard<std::mutex> lock (m_copiesMutex);
+  std::lock_guard<OptionalMutex> lock (m_copiesMutex);
   
   auto it = m_copies.find (id);
   if (it != m_copies.end () && it->second > 1)
@@ -264,6 +235,85 @@ SprayAndWaitRouting::DecreaseCopyCount (const BundleID& id)
   return 1; // Minimum is 1 copy
 }
 
+bool 
+SprayAndWaitRouting::ReadCopyTokens (Ptr<Bundle> bundle, uint32_t& tokens)
+{
+  Ptr<CanonicalBlock> block = bundle->GetBlockByType (BlockType::SPRAY_COPIES_BLOCK);
+  if (!block)
+    {
+      return false;
+    }
+  
+  uint64_t value;
+  CborReader reader (block->GetData ().data (), block->GetData ().size ());
+  if (!reader.ReadUnsigned (value) || value == 0)
+    {
+      return false;
+    }
+  
+  tokens = static_cast<uint32_t> (std::min<uint64_t> (value, UINT32_MAX));
+  return true;
+}
+
+void 
+SprayAndWaitRouting::WriteCopyTokens (Ptr<Bundle> bundle, uint32_t tokens)
+{
+  std::vector<uint8_t> data;
+  data.reserve (CborWriter::HeaderSize (tokens));
+  CborWriter writer (data);
+  writer.WriteUnsigned (tokens);
+  
+  for (Ptr<CanonicalBlock>& block : bundle->GetCanonicalBlocks ())
+    {
+      if (block->GetBlockType () == BlockType::SPRAY_COPIES_BLOCK)
+        {
+          block = Create<CanonicalBlock> (BlockType::SPRAY_COPIES_BLOCK, block->GetBlockNumber (),
+                                          block->GetBlockControlFlags (), block->GetCRCType (),
+                                          PayloadBuffer (std::move (data)));
+          return;
+        }
+    }
+  
+  // Nodes without spray-and-wait just drop the block
+  bundle->AddBlock (Create<CanonicalBlock> (BlockType::SPRAY_COPIES_BLOCK, 0,
+                                            BlockControlFlags::REMOVE_BLOCK_IF_UNPROCESSABLE,
+                                            CRCType::NO_CRC, PayloadBuffer (std::move (data))));
+}
+
+void 
+SprayAndWaitRouting::PrepareForward (Ptr<Bundle> outgoing, const NodeID& receiver)
+{
+  NS_LOG_FUNCTION (this << receiver.ToString ());
+  
+  // Fragments made for this transmission count against the original bundle
+  BundleID id = outgoing->GetId ();
+  uint32_t copyCount = 1;
+  {
+    std::lock_guard<OptionalMutex> lock (m_copiesMutex);
+    auto it = m_copies.find (id);
+    if (it == m_copies.end () && outgoing->IsFragment ())
+      {
+        const PrimaryBlock& primary = outgoing->GetPrimaryBlock ();
+        it = m_copies.find (BundleID (primary.GetSourceNodeEID (), primary.GetCreationTimestamp (),
+                                      primary.GetSequenceNumber (), false, 0));
+      }
+    if (it != m_copies.end ())
+      {
+        copyCount = it->second;
+      }
+  }
+  
+  WriteCopyTokens (outgoing, copyCount <= 1 ? 1 : copyCount / 2);
+}
+
+bool 
+SprayAndWaitRouting::IsKnownBundle (const BundleID& id) const
+{
+  // Further copies of a stored bundle bring copy tokens, so only
+  // delivered bundles are dropped early
+  return m_antiPacketsEnabled && IsDelivered (id);
+}
+
 std::string 
 SprayAndWaitRouting::GetName () const
 {
@@ -11,7 +11,13 @@ namespace dtn7 {
 
 /**
  * \ingroup dtn7
- * \brief Spray and Wait routing algorithm implementation
+ * \brief Binary Spray and Wait routing algorithm implementation
+ *
+ * Each bundle carries copy tokens. A node holding n > 1 tokens hands
+ * floor(n/2) of them to every new peer and keeps the rest; with a single
+ * token it only delivers to the destination. The tokens handed over
+ * travel in a SPRAY_COPIES_BLOCK, so at most MaxCopies replicas of a
+ * bundle ever exist in the network.
  */
 class SprayAndWaitRouting : public RoutingAlgorithm
 {
@@ -36,12 +42,13 @@ public:
   void NotifyNewBundle (Ptr<Bundle> bundle, const NodeID& source) override;
   void NotifyPeerAppeared (const PeerInfo& peer) override;
   void NotifyPeerDisappeared (const NodeID& peer) override;
+  bool IsKnownBundle (const BundleID& id) const override;
   std::string GetName () const override;
   std::string GetStats () const override;
 
 protected:
   // Inherited from RoutingAlgorithm
-  void DispatchBundles () override;
+  bool OfferBundle (Ptr<Bundle> bundle, const PeerInfo& peer) override;
   
   /**
    * \brief Set copy count for a bundle
@@ -64,8 +71,36 @@ protected:
    */
   uint32_t DecreaseCopyCount (const BundleID& id);
   
+  /**
+   * \brief Read the copy tokens carried by a bundle
+   * \param bundle Bundle
+   * \param tokens Receives the number of tokens
+   * \return true if the bundle has a valid SPRAY_COPIES_BLOCK
+   */
+  static bool ReadCopyTokens (Ptr<Bundle> bundle, uint32_t& tokens);
+  
+  /**
+   * \brief Set the copy tokens handed over with a bundle
+   *
+   * Puts a new SPRAY_COPIES_BLOCK in place of an existing one, since
+   * blocks may be shared with the stored bundle.
+   * \param bundle Outgoing bundle
+   * \param tokens Number of tokens
+   */
+  static void WriteCopyTokens (Ptr<Bundle> bundle, uint32_t tokens);
+  
+  /**
+   * \brief Hand the receiver its share of the copy tokens
+   *
+   * The share follows from the local count, which OfferBundle lowers
+   * only after the send: half of it while spraying, one in the wait phase.
+   * \param outgoing Outgoing copy or fragment
+   * \param receiver Receiver node ID
+   */
+  void PrepareForward (Ptr<Bundle> outgoing, const NodeID& receiver) override;
+  
   std::unordered_map<BundleID, uint32_t> m_copies; //!< Bundle copy counts
-  mutable std::mutex m_copiesMutex;                //!< Bundle copy counts mutex
+  mutable OptionalMutex m_copiesMutex;             //!< Bundle copy counts mutex
   uint32_t m_maxCopies;                            //!< Maximum copies per bundle
 };
 
@@ -0,0 +1,208 @@
+#include "summary-vector.h"
+#include "cbor.h"
+
+#include <algorithm>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+namespace {
+
+const uint64_t KIND_LIST = 0;
+const uint64_t KIND_BLOOM = 1;
+const uint64_t BLOOM_BITS_PER_ENTRY = 10;  // about 1% false positives
+const uint32_t BLOOM_HASH_COUNT = 7;
+
+uint64_t 
+Mix (uint64_t value)
+{
+  // splitmix64 finalizer
+  value += 0x9e3779b97f4a7c15ULL;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+} // anonymous namespace
+
+SummaryVector::SummaryVector ()
+  : m_seed (0),
+    m_count (0),
+    m_hashCount (0)
+{
+}
+
+SummaryVector 
+SummaryVector::Build (const std::vector<BundleID>& ids, size_t bloomThreshold, uint64_t seed)
+{
+  SummaryVector summary;
+  summary.m_seed = seed;
+  summary.m_count = ids.size ();
+  
+  if (ids.size () <= bloomThreshold)
+    {
+      summary.m_digests.reserve (ids.size ());
+      for (const BundleID& id : ids)
+        {
+          summary.m_digests.push_back (Digest (id, seed));
+        }
+      std::sort (summary.m_digests.begin (), summary.m_digests.end ());
+      summary.m_digests.erase (std::unique (summary.m_digests.begin (), summary.m_digests.end ()),
+                               summary.m_digests.end ());
+      return summary;
+    }
+  
+  summary.m_hashCount = BLOOM_HASH_COUNT;
+  summary.m_bits.assign ((ids.size () * BLOOM_BITS_PER_ENTRY + 7) / 8, 0);
+  for (const BundleID& id : ids)
+    {
+      uint64_t digest = Digest (id, seed);
+      for (uint32_t i = 0; i < summary.m_hashCount; i++)
+        {
+          uint64_t bit = summary.GetBit (digest, i);
+          summary.m_bits[bit / 8] |= static_cast<uint8_t> (1 << (bit % 8));
+        }
+    }
+  
+  return summary;
+}
+
+bool 
+SummaryVector::MayContain (const BundleID& id) const
+{
+  uint64_t digest = Digest (id, m_seed);
+  
+  if (IsExact ())
+    {
+      return std::binary_search (m_digests.begin (), m_digests.end (), digest);
+    }
+  
+  if (m_bits.empty ())
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < m_hashCount; i++)
+    {
+      uint64_t bit = GetBit (digest, i);
+      if ((m_bits[bit / 8] & (1 << (bit % 8))) == 0)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+std::vector<uint8_t> 
+SummaryVector::Encode () const
+{
+  std::vector<uint8_t> bytes;
+  if (IsExact ())
+    {
+      bytes.reserve (m_digests.size () * 8);
+      for (uint64_t digest : m_digests)
+        {
+          for (int shift = 56; shift >= 0; shift -= 8)
+            {
+              bytes.push_back (static_cast<uint8_t> (digest >> shift));
+            }
+        }
+    }
+  
+  const std::vector<uint8_t>& data = IsExact () ? bytes : m_bits;
+  
+  std::vector<uint8_t> output;
+  output.reserve (data.size () + 32);
+  CborWriter writer (output);
+  writer.WriteArrayHeader (5);
+  writer.WriteUnsigned (IsExact () ? KIND_LIST : KIND_BLOOM);
+  writer.WriteUnsigned (m_count);
+  writer.WriteUnsigned (m_seed);
+  writer.WriteUnsigned (m_hashCount);
+  writer.WriteByteString (data);
+  
+  return output;
+}
+
+std::optional<SummaryVector> 
+SummaryVector::Decode (const uint8_t* data, size_t size)
+{
+  CborReader reader (data, size);
+  
+  uint64_t items = 0;
+  uint64_t kind = 0;
+  uint64_t hashCount = 0;
+  const uint8_t* bytes = nullptr;
+  size_t length = 0;
+  SummaryVector summary;
+  
+  if (!reader.ReadArrayHeader (items) || items != 5 ||
+      !reader.ReadUnsigned (kind) ||
+      !reader.ReadUnsigned (summary.m_count) ||
+      !reader.ReadUnsigned (summary.m_seed) ||
+      !reader.ReadUnsigned (hashCount) ||
+      !reader.ReadByteString (bytes, length))
+    {
+      return std::nullopt;
+    }
+  
+  if (kind == KIND_LIST && hashCount == 0 && length % 8 == 0)
+    {
+      summary.m_digests.reserve (length / 8);
+      for (size_t offset = 0; offset < length; offset += 8)
+        {
+          uint64_t digest = 0;
+          for (size_t i = 0; i < 8; i++)
+            {
+              digest = (digest << 8) | bytes[offset + i];
+            }
+          summary.m_digests.push_back (digest);
+        }
+      if (!std::is_sorted (summary.m_digests.begin (), summary.m_digests.end ()))
+        {
+          return std::nullopt;
+        }
+      return summary;
+    }
+  
+  if (kind == KIND_BLOOM && hashCount > 0 && hashCount <= 32)
+    {
+      summary.m_hashCount = static_cast<uint32_t> (hashCount);
+      summary.m_bits.assign (bytes, bytes + length);
+      return summary;
+    }
+  
+  return std::nullopt;
+}
+
+uint64_t 
+SummaryVector::Digest (const BundleID& id, uint64_t seed)
+{
+  // FNV-1a over the source, so peers agree regardless of std::hash
+  uint64_t hash = 0xcbf29ce484222325ULL ^ Mix (seed);
+  for (char c : id.GetSource ().ToString ())
+    {
+      hash = (hash ^ static_cast<uint8_t> (c)) * 0x100000001b3ULL;
+    }
+  
+  // Only whole seconds of the creation time survive the wire encoding
+  hash = Mix (hash ^ id.GetTimestamp ().GetSeconds ());
+  hash = Mix (hash ^ id.GetSequenceNumber ());
+  if (id.IsFragment ())
+    {
+      hash = Mix (hash ^ (id.GetFragmentOffset () + 1));
+    }
+  return hash;
+}
+
+uint64_t 
+SummaryVector::GetBit (uint64_t digest, uint32_t index) const
+{
+  // Double hashing: h1 + i * h2 over the filter size
+  uint64_t h2 = Mix (digest) | 1;
+  return (digest + index * h2) % (m_bits.size () * 8);
+}
+
+} // namespace dtn7
+
+} // namespace ns3
@@ -0,0 +1,109 @@
+#ifndef DTN7_SUMMARY_VECTOR_H
+#define DTN7_SUMMARY_VECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "bundle-id.h"
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Compact set of bundle IDs exchanged by epidemic routing on contact
+ *
+ * Small sets are sent as a sorted list of 64-bit digests, which answers
+ * membership exactly up to digest collisions. Sets above a threshold are
+ * sent as a Bloom filter with about one percent false positives; each
+ * summary uses its own seed, so a bundle hidden by a false positive on
+ * one contact is found missing on the next.
+ *
+ * Encoding, as a CBOR array:
+ * \verbatim
+   [kind (0 = list, 1 = bloom), count, seed, hash count, bytes]
+   \endverbatim
+ * where bytes hold the big-endian digests or the filter bits.
+ */
+class SummaryVector
+{
+public:
+  /**
+   * \brief Construct an empty summary
+   */
+  SummaryVector ();
+  
+  /**
+   * \brief Build a summary of a set of bundles
+   * \param ids Bundle IDs
+   * \param bloomThreshold Number of IDs above which a Bloom filter is used
+   * \param seed Seed for the digests
+   * \return Summary
+   */
+  static SummaryVector Build (const std::vector<BundleID>& ids, size_t bloomThreshold, uint64_t seed);
+  
+  /**
+   * \brief Check whether a bundle may be in the summarized set
+   * \param id Bundle ID
+   * \return false if the bundle is certainly not in the set
+   */
+  bool MayContain (const BundleID& id) const;
+  
+  /**
+   * \brief Check whether the summary is an exact list
+   * \return true for a list, false for a Bloom filter
+   */
+  bool IsExact () const { return m_hashCount == 0; }
+  
+  /**
+   * \brief Get the number of summarized bundles
+   * \return Number of bundle IDs
+   */
+  size_t GetCount () const { return m_count; }
+  
+  /**
+   * \brief Encode the summary
+   * \return CBOR encoding
+   */
+  std::vector<uint8_t> Encode () const;
+  
+  /**
+   * \brief Decode a summary
+   * \param data Pointer to the encoding
+   * \param size Size of the encoding
+   * \return Summary, empty if the encoding is malformed
+   */
+  static std::optional<SummaryVector> Decode (const uint8_t* data, size_t size);
+
+private:
+  /**
+   * \brief Get a stable 64-bit digest of a bundle ID
+   * \param id Bundle ID
+   * \param seed Seed
+   * \return Digest
+   */
+  static uint64_t Digest (const BundleID& id, uint64_t seed);
+  
+  /**
+   * \brief Get the filter bit for one of the Bloom filter hashes
+   * \param digest Digest of the bundle ID
+   * \param index Hash index
+   * \return Bit position
+   */
+  uint64_t GetBit (uint64_t digest, uint32_t index) const;
+  
+  uint64_t m_seed;                 //!< Digest seed
+  uint64_t m_count;                //!< Number of summarized bundles
+  uint32_t m_hashCount;            //!< Bloom filter hashes, 0 for an exact list
+  std::vector<uint64_t> m_digests; //!< Sorted digests of an exact list
+  std::vector<uint8_t> m_bits;     //!< Bloom filter bits
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#endif /* DTN7_SUMMARY_VECTOR_H */
@@ -15,6 +15,9 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <deque>
+#include <algorithm>
+#include <cstring>
 
 namespace ns3 {
 
@@ -22,8 +25,264 @@ NS_LOG_COMPONENT_DEFINE ("TcpConvergenceLayer");
 
 namespace dtn7 {
 
+namespace {
+
+// 联系头："dtn!" + 版本号 + 标志
+const uint8_t CONTACT_MAGIC[4] = {'d', 't', 'n', '!'};
+const uint8_t TCPCL_VERSION = 4;
+const size_t CONTACT_HEADER_SIZE = 6;
+
+// 传输扩展项类型；0xFFxx为私有扩展
+const uint16_t EXT_TRANSFER_LENGTH = 0x0001;
+const uint16_t EXT_BUNDLE_KEY = 0xFF01;
+const uint16_t EXT_RESUME_OFFSET = 0xFF02;
+
+// XFER_REFUSE原因码
+const uint8_t REFUSE_COMPLETED = 0x01;
+const uint8_t REFUSE_NO_RESOURCES = 0x02;
+const uint8_t REFUSE_RETRANSMIT = 0x03;
+
+// SESS_TERM标志和原因码
+const uint8_t TERM_FLAG_REPLY = 0x01;
+const uint8_t TERM_UNKNOWN = 0x00;
+const uint8_t TERM_IDLE_TIMEOUT = 0x01;
+const uint8_t TERM_VERSION_MISMATCH = 0x02;
+
+// 记住的中断传输数量上限
+const size_t MAX_REMEMBERED_TRANSFERS = 32;
+
+// SESS_INIT中会话扩展项的总长度上限
+const uint32_t MAX_SESSION_EXTENSIONS_LENGTH = 65536;
+
+void 
+PutU16(std::vector<uint8_t>& out, uint16_t value)
+{
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+void 
+PutU32(std::vector<uint8_t>& out, uint32_t value)
+{
+  PutU16(out, static_cast<uint16_t>(value >> 16));
+  PutU16(out, static_cast<uint16_t>(value));
+}
+
+void 
+PutU64(std::vector<uint8_t>& out, uint64_t value)
+{
+  PutU32(out, static_cast<uint32_t>(value >> 32));
+  PutU32(out, static_cast<uint32_t>(value));
+}
+
+uint16_t 
+GetU16(const uint8_t* p)
+{
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t 
+GetU32(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(GetU16(p)) << 16) | GetU16(p + 2);
+}
+
+uint64_t 
+GetU64(const uint8_t* p)
+{
+  return (static_cast<uint64_t>(GetU32(p)) << 32) | GetU32(p + 4);
+}
+
+/**
+ * \brief 计算缓冲区开头一条TCPCL消息的总长度
+ * \param message 消息起始位置
+ * \param available 可用字节数
+ * \param segmentMru 本地可接收的最大段长度
+ * \param valid 消息类型未知或长度字段超限时置为false
+ * \return 消息长度；头部尚不完整时返回0
+ */
+size_t 
+MessageLength(const uint8_t* message, size_t available, uint64_t segmentMru, bool& valid)
+{
+  valid = true;
+  if (available < 1)
+    {
+      return 0;
+    }
+  
+  switch (static_cast<TcpclMessageType>(message[0]))
+    {
+      case TcpclMessageType::XFER_SEGMENT:
+        {
+          if (available < 2)
+            {
+              return 0;
+            }
+          size_t header = 10;
+          if (message[1] & TcpclSegmentHeader::FLAG_START)
+            {
+              if (available < header + 4)
+                {
+                  return 0;
+                }
+              header += 4 + static_cast<size_t>(GetU32(message + header));
+            }
+          // 头部长度已知即检查，避免为超长的扩展项等待数据
+          if (header > segmentMru)
+            {
+              valid = false;
+              return 0;
+            }
+          if (available < header + 8)
+            {
+              return 0;
+            }
+          uint64_t dataLength = GetU64(message + header);
+          if (dataLength > segmentMru)
+            {
+              valid = false;
+              return 0;
+            }
+          return header + 8 + dataLength;
+        }
+      case TcpclMessageType::XFER_ACK:
+        return 18;
+      case TcpclMessageType::XFER_REFUSE:
+        return 10;
+      case TcpclMessageType::KEEPALIVE:
+        return 1;
+      case TcpclMessageType::SESS_TERM:
+      case TcpclMessageType::MSG_REJECT:
+        return 3;
+      case TcpclMessageType::SESS_INIT:
+        {
+          if (available < 21)
+            {
+              return 0;
+            }
+          size_t length = 21 + GetU16(message + 19);
+          if (available < length + 4)
+            {
+              return 0;
+            }
+          uint32_t extensionsLength = GetU32(message + length);
+          if (extensionsLength > MAX_SESSION_EXTENSIONS_LENGTH)
+            {
+              valid = false;
+              return 0;
+            }
+          return length + 4 + extensionsLength;
+        }
+      default:
+        valid = false;
+        return 0;
+    }
+}
+
+/**
+ * \brief 编码一个传输扩展项
+ */
+void 
+PutExtension(std::vector<uint8_t>& out, uint16_t type, const uint8_t* value, uint16_t length)
+{
+  out.push_back(0); // 标志：非关键
+  PutU16(out, type);
+  PutU16(out, length);
+  out.insert(out.end(), value, value + length);
+}
+
+/**
+ * \brief 记住一个键，超过上限时从映射中删除最旧的
+ */
+template <typename Map>
+void 
+Remember(Map& map, std::deque<std::string>& order, const std::string& key)
+{
+  order.push_back(key);
+  while (order.size() > MAX_REMEMBERED_TRANSFERS)
+    {
+      map.erase(order.front());
+      order.pop_front();
+    }
+}
+
+} // anonymous namespace
+
+NS_OBJECT_ENSURE_REGISTERED (TcpclSegmentHeader);
 NS_OBJECT_ENSURE_REGISTERED (TcpConvergenceLayer);
 
+TypeId 
+TcpclSegmentHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::dtn7::TcpclSegmentHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Dtn7")
+    .AddConstructor<TcpclSegmentHeader> ();
+  return tid;
+}
+
+TypeId 
+TcpclSegmentHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+TcpclSegmentHeader::TcpclSegmentHeader()
+  : m_flags(0),
+    m_transferId(0),
+    m_dataLength(0)
+{
+}
+
+uint32_t 
+TcpclSegmentHeader::GetSerializedSize () const
+{
+  uint32_t size = 1 + 1 + 8 + 8;
+  if (m_flags & FLAG_START)
+    {
+      size += 4 + m_extensions.size();
+    }
+  return size;
+}
+
+void 
+TcpclSegmentHeader::Serialize (Buffer::Iterator start) const
+{
+  // 网络字节序
+  start.WriteU8 (static_cast<uint8_t> (TcpclMessageType::XFER_SEGMENT));
+  start.WriteU8 (m_flags);
+  start.WriteHtonU64 (m_transferId);
+  if (m_flags & FLAG_START)
+    {
+      start.WriteHtonU32 (m_extensions.size ());
+      start.Write (m_extensions.data (), m_extensions.size ());
+    }
+  start.WriteHtonU64 (m_dataLength);
+}
+
+uint32_t 
+TcpclSegmentHeader::Deserialize (Buffer::Iterator start)
+{
+  start.ReadU8 (); // 消息类型
+  m_flags = start.ReadU8 ();
+  m_transferId = start.ReadNtohU64 ();
+  m_extensions.clear ();
+  if (m_flags & FLAG_START)
+    {
+      m_extensions.resize (start.ReadNtohU32 ());
+      start.Read (m_extensions.data (), m_extensions.size ());
+    }
+  m_dataLength = start.ReadNtohU64 ();
+  return GetSerializedSize ();
+}
+
+void 
+TcpclSegmentHeader::Print (std::ostream &os) const
+{
+  os << "XFER_SEGMENT id=" << m_transferId << " flags=" << static_cast<uint32_t> (m_flags) 
+     << " length=" << m_dataLength;
+}
+
 TypeId 
 TcpConvergenceLayer::GetTypeId ()
 {
@@ -46,6 +305,26 @@ TcpConvergenceLayer::GetTypeId ()
                    BooleanValue (false),
                    MakeBooleanAccessor (&TcpConvergenceLayer::m_permanent),
                    MakeBooleanChecker ())
+    .AddAttribute ("SendQueueLimit",
+                   "Maximum number of bytes queued per connection before Send fails",
+                   UintegerValue (16 * 1024 * 1024),
+                   MakeUintegerAccessor (&TcpConvergenceLayer::m_maxQueuedBytes),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("MaxBundleSize",
+                   "Largest bundle accepted from a peer (transfer MRU announced in SESS_INIT)",
+                   UintegerValue (64 * 1024 * 1024),
+                   MakeUintegerAccessor (&TcpConvergenceLayer::m_maxBundleSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("SegmentMru",
+                   "Largest XFER_SEGMENT accepted from a peer and sent to it",
+                   UintegerValue (64 * 1024),
+                   MakeUintegerAccessor (&TcpConvergenceLayer::m_segmentMru),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("KeepaliveInterval",
+                   "Proposed session keepalive interval in seconds, 0 disables keepalives",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&TcpConvergenceLayer::m_keepaliveInterval),
+                   MakeUintegerChecker<uint16_t> ())
     .AddTraceSource ("SentBundle",
                      "Trace source for sent bundles",
                      MakeTraceSourceAccessor (&TcpConvergenceLayer::m_sentTrace),
@@ -62,11 +341,19 @@ TcpConvergenceLayer::TcpConvergenceLayer()
   : m_address(Ipv4Address::GetAny()),
     m_port(4556),
     m_permanent(false),
+    m_maxQueuedBytes(16 * 1024 * 1024),
+    m_maxBundleSize(64 * 1024 * 1024),
+    m_segmentMru(64 * 1024),
+    m_keepaliveInterval(10),
+    m_fragmentationManager(Create<FragmentationManager>()),
     m_running(false),
     m_listenerSocket(nullptr),
     m_sentBundles(0),
     m_receivedBundles(0),
-    m_failedSends(0)
+    m_failedSends(0),
+    m_resumedTransfers(0),
+    m_reactiveFragments(0),
+    m_knownBundles(0)
 {
   NS_LOG_FUNCTION(this);
 }
@@ -76,11 +363,19 @@ TcpConvergenceLayer::TcpConvergenceLayer(Ptr<Node> node, Ipv4Address address, ui
     m_address(address),
     m_port(port),
     m_permanent(permanent),
+    m_maxQueuedBytes(16 * 1024 * 1024),
+    m_maxBundleSize(64 * 1024 * 1024),
+    m_segmentMru(64 * 1024),
+    m_keepaliveInterval(10),
+    m_fragmentationManager(Create<FragmentationManager>()),
     m_running(false),
     m_listenerSocket(nullptr),
     m_sentBundles(0),
     m_receivedBundles(0),
-    m_failedSends(0)
+    m_failedSends(0),
+    m_resumedTransfers(0),
+    m_reactiveFragments(0),
+    m_knownBundles(0)
 {
   NS_LOG_FUNCTION(this << node << address << port << permanent);
 }
@@ -103,6 +398,13 @@ TcpConvergenceLayer::SetNode(Ptr<Node> node)
   NS_LOG_FUNCTION(this << node);
   m_node = node;
 }
+
+void 
+TcpConvergenceLayer::SetLocalNodeId(const NodeID& nodeId)
+{
+  NS_LOG_FUNCTION(this << nodeId.ToString());
+  m_localNodeId = nodeId;
+}
 bool 
 TcpConvergenceLayer::Start()
 {
@@ -150,9 +452,14 @@ TcpConvergenceLayer::Stop()
     }
   
   // 关闭所有连接
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   for (auto& pair : m_connections)
     {
+      if (pair.second)
+        {
+          pair.second->active = false;
+          Simulator::Cancel(pair.second->keepaliveEvent);
+        }
       if (pair.second && pair.second->socket)
         {
           pair.second->socket->Close();
@@ -201,25 +508,27 @@ TcpConvergenceLayer::Send(Ptr<Bundle> bundle, const std::string& endpoint)
       return false;
     }
   
-  // 通过连接发送bundle
-  bool result = SendBundle(bundle, conn);
-  
-  // 如果非永久，则关闭连接
+  // 如果非永久，则在发送队列清空后关闭连接
   if (!m_permanent)
     {
-      CleanupConnection(endpoint);
+      conn->closeWhenDrained = true;
     }
   
+  // 将bundle加入连接的发送队列；发送计数和追踪在对端确认全部字节时更新
+  bool result = SendBundle(bundle, conn);
+  
   if (result)
     {
-      m_sentBundles++;
-      m_sentTrace(bundle, endpoint);
-      NS_LOG_INFO("Sent bundle to " << endpoint);
+      NS_LOG_INFO("Queued bundle for " << endpoint);
     }
   else
     {
       m_failedSends++;
       NS_LOG_ERROR("Failed to send bundle to " << endpoint);
+      if (conn->closeWhenDrained && conn->transfers.empty())
+        {
+          CleanupConnection(endpoint);
+        }
     }
   
   return result;
@@ -236,7 +545,7 @@ TcpConvergenceLayer::IsEndpointReachable(const std::string& endpoint) const
     }
   
   // 检查连接是否已建立
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   auto it = m_connections.find(endpoint);
   if (it != m_connections.end() && it->second && it->second->active && it->second->socket)
     {
@@ -268,6 +577,9 @@ TcpConvergenceLayer::GetStats() const
   ss << ", sent=" << m_sentBundles;
   ss << ", recv=" << m_receivedBundles;
   ss << ", failed=" << m_failedSends;
+  ss << ", resumed=" << m_resumedTransfers;
+  ss << ", reactive=" << m_reactiveFragments;
+  ss << ", known=" << m_knownBundles;
   ss << ", conn=" << m_connections.size();
   ss << ", perm=" << m_permanent;
   ss << ")";
@@ -280,7 +592,7 @@ TcpConvergenceLayer::GetActiveConnections() const
 {
   NS_LOG_FUNCTION(this);
   
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   std::vector<std::string> result;
   
   for (const auto& pair : m_connections)
@@ -294,12 +606,27 @@ TcpConvergenceLayer::GetActiveConnections() const
   return result;
 }
 
+uint64_t 
+TcpConvergenceLayer::GetMtu(const std::string& endpoint) const
+{
+  NS_LOG_FUNCTION(this << endpoint);
+  
+  // 会话建立后按对端的传输MRU分片；会话建立前未知，由发送时的主动分片兜底
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
+  auto it = m_connections.find(endpoint);
+  if (it != m_connections.end() && it->second && it->second->established)
+    {
+      return it->second->peerTransferMru;
+    }
+  return 0;
+}
+
 bool 
 TcpConvergenceLayer::HasActiveConnection(const std::string& endpoint) const
 {
   NS_LOG_FUNCTION(this << endpoint);
   
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   auto it = m_connections.find(endpoint);
   return it != m_connections.end() && it->second && it->second->active;
 }
@@ -378,6 +705,8 @@ TcpConvergenceLayer::CreateConnectionSocket(Ipv4Address address, uint16_t port)
       MakeCallback(&TcpConvergenceLayer::HandleClose, this));
   socket->SetRecvCallback(
       MakeCallback(&TcpConvergenceLayer::HandleRecv, this));
+  socket->SetSendCallback(
+      MakeCallback(&TcpConvergenceLayer::HandleSend, this));
   socket->SetCloseCallbacks(
       MakeCallback(&TcpConvergenceLayer::HandleClose, this),
       MakeCallback(&TcpConvergenceLayer::HandleClose, this));
@@ -466,14 +795,17 @@ TcpConvergenceLayer::HandleAccept(Ptr<Socket> socket, const Address& from)
   // 设置socket回调
   connectionSocket->SetRecvCallback(
       MakeCallback(&TcpConvergenceLayer::HandleRecv, this));
+  connectionSocket->SetSendCallback(
+      MakeCallback(&TcpConvergenceLayer::HandleSend, this));
   connectionSocket->SetCloseCallbacks(
       MakeCallback(&TcpConvergenceLayer::HandleClose, this),
       MakeCallback(&TcpConvergenceLayer::HandleClose, this));
   
-  // 存储连接
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  // 存储连接；被动方等待对端的联系头
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   Ptr<TcpConnection> conn = Create<TcpConnection>(connectionSocket, endpoint);
   if (conn) {
+    conn->lastReceived = Simulator::Now();
     m_connections[endpoint] = conn;
   } else {
     NS_LOG_ERROR("Failed to create TcpConnection");
@@ -516,7 +848,7 @@ TcpConvergenceLayer::HandleClose(Ptr<Socket> socket)
   // 找到此socket的连接
   std::string endpoint;
   {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
     for (const auto& pair : m_connections)
       {
         if (pair.second && pair.second->socket == socket)
@@ -545,45 +877,48 @@ TcpConvergenceLayer::HandleRecv(Ptr<Socket> socket)
   }
   
   // 找到此socket的连接
-  std::string endpoint;
-  {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
-    for (const auto& pair : m_connections)
-      {
-        if (pair.second && pair.second->socket == socket)
-          {
-            endpoint = pair.first;
-            break;
-          }
-      }
-  }
-  
-  if (endpoint.empty())
+  Ptr<TcpConnection> conn = FindConnection(socket);
+  if (!conn)
     {
       NS_LOG_ERROR("Received data on unknown socket");
       return;
     }
+  std::string endpoint = conn->endpoint;
   
-  // 接收bundle
-  Ptr<Bundle> bundle = ReceiveBundle(socket);
-  if (!bundle)
+  // 读取socket中所有可用数据，追加到连接的接收缓冲区
+  Ptr<Packet> packet;
+  while ((packet = socket->Recv()) && packet->GetSize() > 0)
     {
-      NS_LOG_ERROR("Failed to receive bundle from " << endpoint);
-      return;
+      size_t oldSize = conn->rxBuffer.size();
+      CountReceived(packet->GetSize());
+      conn->rxBuffer.resize(oldSize + packet->GetSize());
+      packet->CopyData(conn->rxBuffer.data() + oldSize, packet->GetSize());
     }
+  conn->lastReceived = Simulator::Now();
   
-  NS_LOG_INFO("Received bundle from " << endpoint);
-  m_receivedBundles++;
-  m_receivedTrace(bundle, endpoint);
+  // 处理所有完整的消息，不完整的部分留待下一次接收
+  std::vector<Ptr<Bundle>> bundles;
+  if (!ProcessReceivedData(conn, bundles))
+    {
+      NS_LOG_ERROR("Invalid TCPCL stream from " << endpoint << ", closing connection");
+      if (conn->active)
+        {
+          CleanupConnection(endpoint);
+        }
+    }
   
-  // 解析源节点从端点
-  Ipv4Address address;
-  uint16_t port;
-  if (!ParseEndpoint(endpoint, address, port))
+  for (const Ptr<Bundle>& bundle : bundles)
     {
-      NS_LOG_ERROR("Invalid endpoint format: " << endpoint);
-      return;
+      DeliverBundle(bundle, endpoint);
     }
+}
+
+void 
+TcpConvergenceLayer::DeliverBundle(Ptr<Bundle> bundle, const std::string& endpoint)
+{
+  NS_LOG_INFO("Received bundle from " << endpoint);
+  m_receivedBundles++;
+  m_receivedTrace(bundle, endpoint);
   
   // 通知bundle回调
   if (!m_bundleCallback.IsNull())
@@ -598,22 +933,565 @@ TcpConvergenceLayer::HandleRecv(Ptr<Socket> socket)
     }
 }
 
+bool 
+TcpConvergenceLayer::ProcessReceivedData(Ptr<TcpConnection> conn, std::vector<Ptr<Bundle>>& bundles)
+{
+  NS_LOG_FUNCTION(this << conn);
+  
+  std::vector<uint8_t>& rx = conn->rxBuffer;
+  size_t offset = 0;
+  size_t pendingLength = 0;
+  
+  while (offset < rx.size() && conn->active)
+    {
+      const uint8_t* message = rx.data() + offset;
+      size_t available = rx.size() - offset;
+      
+      // 会话开始时先交换联系头
+      if (conn->state == TcpConnection::WAIT_CONTACT_HEADER)
+        {
+          if (available < CONTACT_HEADER_SIZE)
+            {
+              break;
+            }
+          if (std::memcmp(message, CONTACT_MAGIC, sizeof(CONTACT_MAGIC)) != 0)
+            {
+              NS_LOG_ERROR("Bad contact header from " << conn->endpoint);
+              rx.clear();
+              return false;
+            }
+          offset += CONTACT_HEADER_SIZE;
+          if (message[4] != TCPCL_VERSION)
+            {
+              NS_LOG_ERROR("Unsupported TCPCL version " << static_cast<uint32_t>(message[4]) 
+                           << " from " << conn->endpoint);
+              if (!conn->initiator)
+                {
+                  SendContactHeader(conn);
+                }
+              TerminateSession(conn, TERM_VERSION_MISMATCH);
+              break;
+            }
+          
+          // 被动方收到联系头后回复自己的联系头，然后双方发送SESS_INIT
+          if (!conn->initiator)
+            {
+              SendContactHeader(conn);
+            }
+          conn->state = TcpConnection::WAIT_SESS_INIT;
+          SendSessionInit(conn);
+          continue;
+        }
+      
+      bool valid;
+      size_t length = MessageLength(message, available, m_segmentMru, valid);
+      if (!valid)
+        {
+          NS_LOG_ERROR("Unknown or oversized TCPCL message (type " 
+                       << static_cast<uint32_t>(message[0]) << ") from " << conn->endpoint);
+          rx.clear();
+          return false;
+        }
+      if (length == 0 || length > available)
+        {
+          pendingLength = length;
+          break; // 消息不完整
+        }
+      
+      if (!HandleMessage(conn, message, length, bundles))
+        {
+          rx.clear();
+          return false;
+        }
+      offset += length;
+    }
+  
+  // 丢弃已处理的字节，只移动剩余的不完整消息
+  if (offset > 0)
+    {
+      rx.erase(rx.begin(), rx.begin() + std::min(offset, rx.size()));
+    }
+  
+  // 为不完整的消息预留空间，避免后续追加时反复重新分配
+  if (pendingLength > 0)
+    {
+      rx.reserve(pendingLength);
+    }
+  
+  return true;
+}
+
+bool 
+TcpConvergenceLayer::HandleMessage(Ptr<TcpConnection> conn, const uint8_t* message, size_t length,
+                                   std::vector<Ptr<Bundle>>& bundles)
+{
+  TcpclMessageType type = static_cast<TcpclMessageType>(message[0]);
+  
+  // 会话建立之前只接受SESS_INIT和SESS_TERM
+  if (conn->state == TcpConnection::WAIT_SESS_INIT && 
+      type != TcpclMessageType::SESS_INIT && type != TcpclMessageType::SESS_TERM)
+    {
+      NS_LOG_ERROR("Unexpected message before SESS_INIT from " << conn->endpoint);
+      return false;
+    }
+  
+  switch (type)
+    {
+      case TcpclMessageType::SESS_INIT:
+        {
+          if (conn->state != TcpConnection::WAIT_SESS_INIT)
+            {
+              NS_LOG_ERROR("Duplicate SESS_INIT from " << conn->endpoint);
+              return false;
+            }
+          
+          // 保活间隔取双方的较小值，0表示关闭
+          uint16_t keepalive = GetU16(message + 1);
+          conn->keepaliveInterval = std::min(keepalive, m_keepaliveInterval);
+          conn->peerSegmentMru = GetU64(message + 3);
+          conn->peerTransferMru = GetU64(message + 11);
+          conn->peerNodeId.assign(reinterpret_cast<const char*>(message + 21), GetU16(message + 19));
+          if (conn->peerNodeId.empty() || conn->peerSegmentMru == 0 || conn->peerTransferMru == 0)
+            {
+              NS_LOG_ERROR("Invalid SESS_INIT from " << conn->endpoint);
+              return false;
+            }
+          
+          conn->state = TcpConnection::ESTABLISHED;
+          conn->established = true;
+          NS_LOG_INFO("TCPCL session with " << conn->peerNodeId << " (" << conn->endpoint 
+                      << ") established, keepalive " << conn->keepaliveInterval << "s");
+          
+          if (conn->keepaliveInterval > 0)
+            {
+              conn->keepaliveEvent = Simulator::Schedule(Seconds(conn->keepaliveInterval),
+                                                         &TcpConvergenceLayer::KeepaliveTimeout,
+                                                         this, conn);
+            }
+          
+          // 开始发送等待会话建立的传输
+          DrainSendQueue(conn);
+          
+          NotifyConnectionChanged(conn->endpoint, conn->peerNodeId, true);
+          return true;
+        }
+      case TcpclMessageType::XFER_SEGMENT:
+        return HandleSegment(conn, message, length, bundles);
+      case TcpclMessageType::XFER_ACK:
+        HandleAck(conn, GetU64(message + 2), GetU64(message + 10));
+        return true;
+      case TcpclMessageType::XFER_REFUSE:
+        HandleRefuse(conn, GetU64(message + 2), message[1]);
+        return true;
+      case TcpclMessageType::KEEPALIVE:
+        return true;
+      case TcpclMessageType::SESS_TERM:
+        {
+          NS_LOG_INFO("Session terminated by " << conn->endpoint << " (reason " 
+                      << static_cast<uint32_t>(message[2]) << ")");
+          if (conn->state != TcpConnection::TERMINATING)
+            {
+              // 回复SESS_TERM，发送完毕后关闭连接
+              std::vector<uint8_t> reply = {static_cast<uint8_t>(TcpclMessageType::SESS_TERM),
+                                            TERM_FLAG_REPLY, message[2]};
+              conn->state = TcpConnection::TERMINATING;
+              SendControl(conn, reply);
+            }
+          else if (message[1] & TERM_FLAG_REPLY)
+            {
+              CleanupConnection(conn->endpoint);
+            }
+          return true;
+        }
+      case TcpclMessageType::MSG_REJECT:
+        NS_LOG_WARN("Peer " << conn->endpoint << " rejected message type " 
+                    << static_cast<uint32_t>(message[2]));
+        return true;
+      default:
+        return false;
+    }
+}
+
+bool 
+TcpConvergenceLayer::HandleSegment(Ptr<TcpConnection> conn, const uint8_t* message, size_t length,
+                                   std::vector<Ptr<Bundle>>& bundles)
+{
+  uint8_t flags = message[1];
+  uint64_t transferId = GetU64(message + 2);
+  TcpConnection::IncomingTransfer& incoming = conn->incoming;
+  
+  size_t position = 10;
+  uint64_t transferLength = 0;
+  uint64_t resumeOffset = 0;
+  std::string key;
+  
+  if (flags & TcpclSegmentHeader::FLAG_START)
+    {
+      // 解析传输扩展项
+      size_t extensionsEnd = position + 4 + GetU32(message + position);
+      position += 4;
+      while (position + 5 <= extensionsEnd)
+        {
+          uint16_t itemType = GetU16(message + position + 1);
+          uint16_t itemLength = GetU16(message + position + 3);
+          const uint8_t* value = message + position + 5;
+          if (position + 5 + itemLength > extensionsEnd)
+            {
+              NS_LOG_ERROR("Truncated transfer extension from " << conn->endpoint);
+              return false;
+            }
+          if (itemType == EXT_TRANSFER_LENGTH && itemLength == 8)
+            {
+              transferLength = GetU64(value);
+            }
+          else if (itemType == EXT_RESUME_OFFSET && itemLength == 8)
+            {
+              resumeOffset = GetU64(value);
+            }
+          else if (itemType == EXT_BUNDLE_KEY)
+            {
+              key.assign(reinterpret_cast<const char*>(value), itemLength);
+            }
+          position += 5 + itemLength;
+        }
+      position = extensionsEnd;
+      
+      incoming.id = transferId;
+      incoming.key = key;
+      incoming.data.clear();
+      incoming.active = true;
+      incoming.refused = false;
+    }
+  else if (!incoming.active || incoming.id != transferId)
+    {
+      NS_LOG_WARN("Segment for unknown transfer " << transferId << " from " << conn->endpoint);
+      return true;
+    }
+  
+  if (incoming.refused)
+    {
+      return true; // 已拒绝的传输的剩余段
+    }
+  
+  uint64_t dataLength = GetU64(message + position);
+  const uint8_t* data = message + position + 8;
+  
+  std::vector<uint8_t> refuse = {static_cast<uint8_t>(TcpclMessageType::XFER_REFUSE), 0};
+  PutU64(refuse, transferId);
+  
+  if (flags & TcpclSegmentHeader::FLAG_START)
+    {
+      if (transferLength > m_maxBundleSize)
+        {
+          NS_LOG_WARN("Refusing transfer of " << transferLength << " bytes from " << conn->endpoint);
+          refuse[1] = REFUSE_NO_RESOURCES;
+          incoming.refused = true;
+          SendControl(conn, refuse);
+          return true;
+        }
+      
+      // 第一段通常含有主区块：节点已有的bundle立即拒绝，不再接收其余的段
+      if (resumeOffset == 0 && IsKnownBundle(data, dataLength))
+        {
+          NS_LOG_INFO("Refusing transfer " << transferId << " of a known bundle from " << conn->endpoint);
+          m_knownBundles++;
+          refuse[1] = REFUSE_COMPLETED;
+          incoming.refused = true;
+          SendControl(conn, refuse);
+          return true;
+        }
+      
+      // 只有一段的传输直接在接收缓冲区上解码
+      if ((flags & TcpclSegmentHeader::FLAG_END) && resumeOffset == 0)
+        {
+          std::vector<uint8_t> ack = {static_cast<uint8_t>(TcpclMessageType::XFER_ACK), flags};
+          PutU64(ack, transferId);
+          PutU64(ack, dataLength);
+          SendControl(conn, ack);
+          
+          incoming.active = false;
+          Ptr<Bundle> bundle = ReceiveBundle(data, dataLength);
+          if (bundle)
+            {
+              bundles.push_back(bundle);
+            }
+          return true;
+        }
+      
+      if (resumeOffset > 0)
+        {
+          // 从上次中断的位置继续：需要保存的前缀至少有这么长
+          auto it = m_partialTransfers.find(conn->peerNodeId + "/" + key);
+          if (it == m_partialTransfers.end() || it->second.size() < resumeOffset)
+            {
+              NS_LOG_INFO("Cannot resume transfer " << key << " at " << resumeOffset 
+                          << ", asking for retransmission");
+              refuse[1] = REFUSE_RETRANSMIT;
+              incoming.refused = true;
+              SendControl(conn, refuse);
+              return true;
+            }
+          incoming.data = std::move(it->second);
+          incoming.data.resize(resumeOffset);
+          m_partialTransfers.erase(it);
+          NS_LOG_INFO("Resuming transfer " << key << " from " << conn->endpoint << " at " << resumeOffset);
+        }
+      
+      if (transferLength > 0)
+        {
+          incoming.data.reserve(transferLength);
+        }
+    }
+  
+  if (incoming.data.size() + dataLength > m_maxBundleSize)
+    {
+      NS_LOG_WARN("Transfer " << transferId << " from " << conn->endpoint << " exceeds the transfer MRU");
+      refuse[1] = REFUSE_NO_RESOURCES;
+      incoming.refused = true;
+      SendControl(conn, refuse);
+      return true;
+    }
+  
+  incoming.data.insert(incoming.data.end(), data, data + dataLength);
+  
+  // 确认到目前为止收到的字节数
+  std::vector<uint8_t> ack = {static_cast<uint8_t>(TcpclMessageType::XFER_ACK), flags};
+  PutU64(ack, transferId);
+  PutU64(ack, incoming.data.size());
+  SendControl(conn, ack);
+  
+  if (flags & TcpclSegmentHeader::FLAG_END)
+    {
+      incoming.active = false;
+      Ptr<Bundle> bundle = ReceiveBundle(incoming.data.data(), incoming.data.size());
+      if (bundle)
+        {
+          bundles.push_back(bundle);
+        }
+      std::vector<uint8_t>().swap(incoming.data);
+    }
+  
+  return true;
+}
+
+void 
+TcpConvergenceLayer::HandleAck(Ptr<TcpConnection> conn, uint64_t transferId, uint64_t length)
+{
+  for (auto it = conn->transfers.begin(); it != conn->transfers.end(); ++it)
+    {
+      if (!it->started || it->id != transferId)
+        {
+          continue;
+        }
+      
+      it->acked = std::max(it->acked, length);
+      if (it->acked < it->encoded.GetSize())
+        {
+          return;
+        }
+      
+      // 对端已确认全部字节
+      Ptr<Bundle> bundle = it->bundle;
+      conn->transfers.erase(it);
+      m_sentBundles++;
+      m_sentTrace(bundle, conn->endpoint);
+      NS_LOG_INFO("Sent bundle to " << conn->endpoint);
+      
+      if (conn->closeWhenDrained && conn->transfers.empty())
+        {
+          TerminateSession(conn, TERM_UNKNOWN);
+        }
+      return;
+    }
+}
+
+void 
+TcpConvergenceLayer::HandleRefuse(Ptr<TcpConnection> conn, uint64_t transferId, uint8_t reason)
+{
+  for (auto it = conn->transfers.begin(); it != conn->transfers.end(); ++it)
+    {
+      if (!it->started || it->id != transferId)
+        {
+          continue;
+        }
+      
+      TcpConnection::OutgoingTransfer transfer = *it;
+      conn->transfers.erase(it);
+      
+      if (reason == REFUSE_RETRANSMIT)
+        {
+          // 对端没有可续传的前缀：作为新传输从头发送
+          NS_LOG_INFO("Peer " << conn->endpoint << " asked to retransmit " << transfer.key);
+          transfer.started = false;
+          transfer.resumeOffset = 0;
+          transfer.sent = 0;
+          transfer.acked = 0;
+          conn->transfers.push_back(transfer);
+          DrainSendQueue(conn);
+        }
+      else if (reason == REFUSE_COMPLETED)
+        {
+          m_sentBundles++;
+          m_sentTrace(transfer.bundle, conn->endpoint);
+        }
+      else
+        {
+          NS_LOG_WARN("Peer " << conn->endpoint << " refused " << transfer.key 
+                      << " (reason " << static_cast<uint32_t>(reason) << ")");
+          m_failedSends++;
+        }
+      
+      if (conn->closeWhenDrained && conn->transfers.empty())
+        {
+          TerminateSession(conn, TERM_UNKNOWN);
+        }
+      return;
+    }
+}
+
+Ptr<TcpConnection> 
+TcpConvergenceLayer::FindConnection(Ptr<Socket> socket) const
+{
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
+  for (const auto& pair : m_connections)
+    {
+      if (pair.second && pair.second->socket == socket)
+        {
+          return pair.second;
+        }
+    }
+  return nullptr;
+}
+
+void 
+TcpConvergenceLayer::HandleSend(Ptr<Socket> socket, uint32_t available)
+{
+  NS_LOG_FUNCTION(this << socket << available);
+  
+  // 找到此socket的连接
+  Ptr<TcpConnection> conn = FindConnection(socket);
+  
+  // 发送缓冲区有空间了，继续写出队列
+  if (conn)
+    {
+      DrainSendQueue(conn);
+    }
+}
+
 void 
 TcpConvergenceLayer::CleanupConnection(const std::string& endpoint)
 {
   NS_LOG_FUNCTION(this << endpoint);
   
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
-  auto it = m_connections.find(endpoint);
-  if (it != m_connections.end() && it->second)
+  Ptr<TcpConnection> conn;
+  {
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
+    auto it = m_connections.find(endpoint);
+    if (it == m_connections.end() || !it->second)
+      {
+        return;
+      }
+    conn = it->second;
+    m_connections.erase(it);
+  }
+  
+  conn->active = false;
+  Simulator::Cancel(conn->keepaliveEvent);
+  
+  // 处理未完成的传输：发送方记住确认偏移，接收方把收到的前缀作为分片交付
+  std::vector<Ptr<Bundle>> fragments;
+  HandleInterruptedTransfers(conn, fragments);
+  
+  if (conn->socket)
+    {
+      conn->socket->Close();
+    }
+  NS_LOG_INFO("Cleaned up connection to " << endpoint);
+  
+  for (const Ptr<Bundle>& fragment : fragments)
     {
-      if (it->second->socket)
+      DeliverBundle(fragment, endpoint);
+    }
+  
+  if (conn->established)
+    {
+      NotifyConnectionChanged(endpoint, conn->peerNodeId, false);
+    }
+}
+
+void 
+TcpConvergenceLayer::HandleInterruptedTransfers(Ptr<TcpConnection> conn, std::vector<Ptr<Bundle>>& bundles)
+{
+  NS_LOG_FUNCTION(this << conn);
+  
+  // 发送方：对端已确认部分字节的传输，下次连接到该对端时只发送剩余部分
+  for (const TcpConnection::OutgoingTransfer& transfer : conn->transfers)
+    {
+      uint64_t size = transfer.encoded.GetSize();
+      if (!transfer.started || transfer.acked == 0 || transfer.acked >= size || 
+          conn->peerNodeId.empty())
         {
-          it->second->socket->Close();
+          continue;
+        }
+      
+      InterruptedTransfer interrupted = {conn->peerNodeId, transfer.acked, nullptr};
+      
+      // 对端收到的前缀会变成一个分片，这里生成与之衔接的剩余分片
+      auto head = Bundle::FromCborPrefix(transfer.encoded.PeekData(), transfer.acked);
+      if (head)
+        {
+          uint64_t headLength = head->GetPayload().size();
+          uint64_t payloadLength = transfer.bundle->GetPayload().size();
+          interrupted.remainder = m_fragmentationManager->CreateFragment(
+              transfer.bundle, headLength, payloadLength - headLength);
+          if (interrupted.remainder)
+            {
+              m_reactiveFragments++;
+            }
+        }
+      
+      NS_LOG_INFO("Transfer of " << transfer.key << " to " << conn->peerNodeId 
+                  << " interrupted at " << transfer.acked << "/" << size);
+      if (m_interruptedTransfers.find(transfer.key) == m_interruptedTransfers.end())
+        {
+          Remember(m_interruptedTransfers, m_interruptedOrder, transfer.key);
+        }
+      m_interruptedTransfers[transfer.key] = interrupted;
+    }
+  
+  // 仍在队列中的bundle无法在本次会话中发送
+  if (!conn->transfers.empty())
+    {
+      NS_LOG_WARN("Dropping " << conn->transfers.size() 
+                  << " queued bundles to " << conn->endpoint);
+      m_failedSends += conn->transfers.size();
+      conn->transfers.clear();
+    }
+  
+  // 接收方：把收到的前缀作为分片交付；不可分片时保存下来以便续传
+  TcpConnection::IncomingTransfer& incoming = conn->incoming;
+  if (incoming.active && !incoming.refused && !incoming.data.empty())
+    {
+      auto head = Bundle::FromCborPrefix(incoming.data.data(), incoming.data.size());
+      if (head)
+        {
+          NS_LOG_INFO("Delivering the " << incoming.data.size() << " bytes received of " 
+                      << incoming.key << " as a fragment");
+          bundles.push_back(Create<Bundle>(std::move(*head)));
+          m_reactiveFragments++;
+        }
+      else if (!conn->peerNodeId.empty() && !incoming.key.empty())
+        {
+          std::string partialKey = conn->peerNodeId + "/" + incoming.key;
+          if (m_partialTransfers.find(partialKey) == m_partialTransfers.end())
+            {
+              Remember(m_partialTransfers, m_partialOrder, partialKey);
+            }
+          m_partialTransfers[partialKey] = std::move(incoming.data);
         }
-      m_connections.erase(it);
-      NS_LOG_INFO("Cleaned up connection to " << endpoint);
     }
+  incoming.active = false;
+  std::vector<uint8_t>().swap(incoming.data);
 }
 
 Ptr<TcpConnection> 
@@ -623,7 +1501,7 @@ TcpConvergenceLayer::GetConnection(const std::string& endpoint)
   
   // 检查连接是否已存在
   {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
     auto it = m_connections.find(endpoint);
     if (it != m_connections.end() && it->second && it->second->active && it->second->socket)
       {
@@ -655,13 +1533,19 @@ TcpConvergenceLayer::GetConnection(const std::string& endpoint)
     return nullptr;
   }
   
+  conn->initiator = true;
+  conn->lastReceived = Simulator::Now();
+  
   {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
     m_connections[endpoint] = conn;
   }
   
   NS_LOG_INFO("Created connection to " << endpoint);
   
+  // 主动方先发送联系头；连接建立之前数据留在socket的发送缓冲区
+  SendContactHeader(conn);
+  
   return conn;
 }
 
@@ -681,85 +1565,337 @@ TcpConvergenceLayer::SendBundle(Ptr<Bundle> bundle, Ptr<TcpConnection> conn)
       return false;
     }
   
-  // 将bundle序列化为CBOR
-  Buffer buffer = bundle->ToCbor();
-  uint32_t size = buffer.GetSize();
-  
-  // 先发送bundle大小(4字节，网络字节序)
-  uint8_t sizeBytes[4];
-  sizeBytes[0] = (size >> 24) & 0xFF;
-  sizeBytes[1] = (size >> 16) & 0xFF;
-  sizeBytes[2] = (size >> 8) & 0xFF;
-  sizeBytes[3] = size & 0xFF;
-  
-  int sent = conn->socket->Send(sizeBytes, 4, 0);
-  if (sent != 4)
+  // 将bundle序列化为CBOR；数据段直接引用编码缓冲区
+  TcpConnection::OutgoingTransfer transfer;
+  transfer.bundle = bundle;
+  transfer.key = bundle->GetId().ToString();
+  transfer.encoded = bundle->ToCbor();
+  transfer.id = 0;
+  transfer.sent = 0;
+  transfer.acked = 0;
+  transfer.resumeOffset = 0;
+  transfer.started = false;
+  
+  uint64_t queuedBytes = 0;
+  for (const TcpConnection::OutgoingTransfer& queued : conn->transfers)
     {
-      NS_LOG_ERROR("Failed to send bundle size: " << sent);
+      queuedBytes += queued.encoded.GetSize() - queued.sent;
+    }
+  if (queuedBytes + transfer.encoded.GetSize() > m_maxQueuedBytes)
+    {
+      NS_LOG_ERROR("Send queue to " << conn->endpoint << " is full (" 
+                   << queuedBytes << " bytes queued)");
       return false;
     }
   
-  // 为缓冲区数据创建向量
-  std::vector<uint8_t> data(size);
-  buffer.CopyData(data.data(), size);
+  conn->transfers.push_back(transfer);
   
-  // 发送bundle数据
-  sent = conn->socket->Send(data.data(), size, 0);
-  if (sent != static_cast<int>(size))
+  // 会话建立之前只排队，收到SESS_INIT后开始发送
+  DrainSendQueue(conn);
+  return true;
+}
+
+bool 
+TcpConvergenceLayer::StartTransfer(Ptr<TcpConnection> conn, size_t index)
+{
+  TcpConnection::OutgoingTransfer& transfer = conn->transfers[index];
+  
+  // 之前发往该对端的传输被中断过：只发送剩余部分，或从确认偏移续传
+  auto it = m_interruptedTransfers.find(transfer.key);
+  if (it != m_interruptedTransfers.end() && it->second.peerNodeId == conn->peerNodeId)
     {
-      NS_LOG_ERROR("Failed to send bundle data: " << sent << "/" << size);
-      return false;
+      if (it->second.remainder)
+        {
+          NS_LOG_INFO("Sending the unacknowledged remainder of " << transfer.key 
+                      << " to " << conn->peerNodeId);
+          transfer.bundle = it->second.remainder;
+          transfer.encoded = transfer.bundle->ToCbor();
+        }
+      else if (it->second.acked < transfer.encoded.GetSize())
+        {
+          NS_LOG_INFO("Resuming " << transfer.key << " to " << conn->peerNodeId 
+                      << " at " << it->second.acked);
+          transfer.resumeOffset = it->second.acked;
+          m_resumedTransfers++;
+        }
+      m_interruptedTransfers.erase(it);
     }
   
+  // 超过对端传输MRU的bundle先主动分片，每个分片作为单独的传输
+  if (transfer.encoded.GetSize() > conn->peerTransferMru)
+    {
+      std::vector<Ptr<Bundle>> fragments = 
+          m_fragmentationManager->FragmentBundle(transfer.bundle, conn->peerTransferMru);
+      if (fragments.empty())
+        {
+          NS_LOG_ERROR("Bundle " << transfer.key << " exceeds the transfer MRU of " 
+                       << conn->peerNodeId << " and cannot be fragmented");
+          return false;
+        }
+      
+      // 每个分片都必须符合MRU，否则整个传输失败，不再重复分片
+      std::vector<TcpConnection::OutgoingTransfer> fragmentTransfers;
+      for (const Ptr<Bundle>& fragment : fragments)
+        {
+          TcpConnection::OutgoingTransfer fragmentTransfer = transfer;
+          fragmentTransfer.bundle = fragment;
+          fragmentTransfer.key = fragment->GetId().ToString();
+          fragmentTransfer.encoded = fragment->ToCbor();
+          fragmentTransfer.resumeOffset = 0;
+          if (fragmentTransfer.encoded.GetSize() > conn->peerTransferMru)
+            {
+              NS_LOG_ERROR("Fragment of " << transfer.key << " still exceeds the transfer MRU of " 
+                           << conn->peerNodeId);
+              return false;
+            }
+          fragmentTransfers.push_back(fragmentTransfer);
+        }
+      
+      conn->transfers.erase(conn->transfers.begin() + index);
+      conn->transfers.insert(conn->transfers.begin() + index, 
+                             fragmentTransfers.begin(), fragmentTransfers.end());
+    }
+  
+  TcpConnection::OutgoingTransfer& next = conn->transfers[index];
+  next.id = conn->nextTransferId++;
+  next.sent = next.resumeOffset;
+  next.acked = next.resumeOffset;
+  next.started = true;
   return true;
 }
 
-Ptr<Bundle> 
-TcpConvergenceLayer::ReceiveBundle(Ptr<Socket> socket)
+Ptr<Packet> 
+TcpConvergenceLayer::NextSegment(Ptr<TcpConnection> conn)
 {
-  NS_LOG_FUNCTION(this << socket);
+  // 传输按顺序进行：跳过已全部写出、等待确认的传输
+  for (size_t i = 0; i < conn->transfers.size(); ++i)
+    {
+      if (!conn->transfers[i].started && !StartTransfer(conn, i))
+        {
+          conn->transfers.erase(conn->transfers.begin() + i);
+          m_failedSends++;
+          --i;
+          continue;
+        }
+      
+      TcpConnection::OutgoingTransfer& transfer = conn->transfers[i];
+      uint64_t size = transfer.encoded.GetSize();
+      if (transfer.sent >= size)
+        {
+          continue;
+        }
+      
+      uint64_t segmentSize = std::min<uint64_t>(conn->peerSegmentMru, m_segmentMru);
+      uint64_t length = std::min<uint64_t>(segmentSize, size - transfer.sent);
+      Ptr<Packet> packet = Create<Packet>(transfer.encoded.PeekData() + transfer.sent, length);
+      
+      TcpclSegmentHeader header;
+      uint8_t flags = 0;
+      if (transfer.sent == transfer.resumeOffset)
+        {
+          flags |= TcpclSegmentHeader::FLAG_START;
+          
+          // 扩展项：传输长度、bundle标识，以及续传偏移
+          std::vector<uint8_t> extensions;
+          std::vector<uint8_t> value;
+          PutU64(value, size);
+          PutExtension(extensions, EXT_TRANSFER_LENGTH, value.data(), value.size());
+          PutExtension(extensions, EXT_BUNDLE_KEY, 
+                       reinterpret_cast<const uint8_t*>(transfer.key.data()), transfer.key.size());
+          if (transfer.resumeOffset > 0)
+            {
+              value.clear();
+              PutU64(value, transfer.resumeOffset);
+              PutExtension(extensions, EXT_RESUME_OFFSET, value.data(), value.size());
+            }
+          header.SetExtensions(std::move(extensions));
+        }
+      if (transfer.sent + length == size)
+        {
+          flags |= TcpclSegmentHeader::FLAG_END;
+        }
+      header.SetFlags(flags);
+      header.SetTransferId(transfer.id);
+      header.SetDataLength(length);
+      packet->AddHeader(header);
+      
+      transfer.sent += length;
+      return packet;
+    }
   
-  if (!socket) {
-    NS_LOG_ERROR("Receiving from null socket");
-    return nullptr;
-  }
+  return nullptr;
+}
+
+void 
+TcpConvergenceLayer::DrainSendQueue(Ptr<TcpConnection> conn)
+{
+  NS_LOG_FUNCTION(this << conn);
   
-  // 先接收bundle大小(4字节，网络字节序)
-  uint8_t sizeBytes[4];
-  int received = socket->Recv(sizeBytes, 4, 0);
-  if (received != 4)
+  if (!conn || !conn->active || !conn->socket)
     {
-      NS_LOG_ERROR("Failed to receive bundle size: " << received);
-      return nullptr;
+      return;
+    }
+  
+  // 按发送缓冲区的可用空间写出，其余部分等待SetSendCallback通知；
+  // 消息不能交错，所以先写完部分写入的消息，再发控制消息，最后发数据段
+  while (true)
+    {
+      if (!conn->txPending)
+        {
+          if (!conn->controlQueue.empty())
+            {
+              conn->txPending = conn->controlQueue.front();
+              conn->controlQueue.pop_front();
+            }
+          else if (conn->state == TcpConnection::ESTABLISHED)
+            {
+              conn->txPending = NextSegment(conn);
+            }
+          if (!conn->txPending)
+            {
+              break;
+            }
+        }
+      
+      uint32_t available = conn->socket->GetTxAvailable();
+      if (available == 0)
+        {
+          break;
+        }
+      
+      uint32_t remaining = conn->txPending->GetSize();
+      Ptr<Packet> chunk = remaining <= available 
+                          ? conn->txPending 
+                          : conn->txPending->CreateFragment(0, available);
+      
+      int sent = conn->socket->Send(chunk);
+      if (sent <= 0)
+        {
+          NS_LOG_LOGIC("Socket to " << conn->endpoint << " did not accept data, waiting");
+          break;
+        }
+      
+      conn->lastSent = Simulator::Now();
+      CountSent(sent);
+      if (static_cast<uint32_t>(sent) < remaining)
+        {
+          conn->txPending->RemoveAtStart(sent);
+          continue;
+        }
+      conn->txPending = nullptr;
     }
   
-  uint32_t size = (sizeBytes[0] << 24) | (sizeBytes[1] << 16) | (sizeBytes[2] << 8) | sizeBytes[3];
+  // SESS_TERM已写出，关闭连接
+  if (conn->state == TcpConnection::TERMINATING && !conn->txPending && conn->controlQueue.empty())
+    {
+      CleanupConnection(conn->endpoint);
+    }
+}
+
+void 
+TcpConvergenceLayer::SendContactHeader(Ptr<TcpConnection> conn)
+{
+  std::vector<uint8_t> header(CONTACT_MAGIC, CONTACT_MAGIC + sizeof(CONTACT_MAGIC));
+  header.push_back(TCPCL_VERSION);
+  header.push_back(0); // 标志：不使用TLS
+  SendControl(conn, header);
+}
+
+void 
+TcpConvergenceLayer::SendSessionInit(Ptr<TcpConnection> conn)
+{
+  std::string nodeId = m_localNodeId.ToString();
+  
+  std::vector<uint8_t> message = {static_cast<uint8_t>(TcpclMessageType::SESS_INIT)};
+  PutU16(message, m_keepaliveInterval);
+  PutU64(message, m_segmentMru);
+  PutU64(message, m_maxBundleSize);
+  PutU16(message, nodeId.size());
+  message.insert(message.end(), nodeId.begin(), nodeId.end());
+  PutU32(message, 0); // 无会话扩展项
+  SendControl(conn, message);
+}
+
+void 
+TcpConvergenceLayer::SendControl(Ptr<TcpConnection> conn, const std::vector<uint8_t>& message)
+{
+  conn->controlQueue.push_back(Create<Packet>(message.data(), message.size()));
+  DrainSendQueue(conn);
+}
+
+void 
+TcpConvergenceLayer::TerminateSession(Ptr<TcpConnection> conn, uint8_t reason)
+{
+  NS_LOG_FUNCTION(this << conn << static_cast<uint32_t>(reason));
   
-  // 为bundle数据分配向量
-  std::vector<uint8_t> data(size);
+  if (!conn->active || conn->state == TcpConnection::TERMINATING)
+    {
+      return;
+    }
   
-  // 接收bundle数据
-  received = socket->Recv(data.data(), size, 0);
-  if (received != static_cast<int>(size))
+  // 未完成的传输在连接关闭时处理
+  conn->state = TcpConnection::TERMINATING;
+  std::vector<uint8_t> message = {static_cast<uint8_t>(TcpclMessageType::SESS_TERM), 0, reason};
+  SendControl(conn, message);
+}
+
+void 
+TcpConvergenceLayer::KeepaliveTimeout(Ptr<TcpConnection> conn)
+{
+  NS_LOG_FUNCTION(this << conn);
+  
+  if (!conn->active || conn->keepaliveInterval == 0)
     {
-      NS_LOG_ERROR("Failed to receive bundle data: " << received << "/" << size);
-      return nullptr;
+      return;
     }
   
-  // 从接收的数据创建缓冲区
-  Buffer buffer;
-  buffer.AddAtStart(size);
-  buffer.Begin().Write(data.data(), size);
+  Time interval = Seconds(conn->keepaliveInterval);
+  Time now = Simulator::Now();
+  
+  // 两个间隔内没有收到任何数据：认为接触已中断
+  if (now - conn->lastReceived > interval + interval)
+    {
+      NS_LOG_WARN("No data from " << conn->endpoint << " for " 
+                  << (now - conn->lastReceived).GetSeconds() << "s, closing session");
+      CleanupConnection(conn->endpoint);
+      return;
+    }
+  
+  if (now - conn->lastSent >= interval)
+    {
+      std::vector<uint8_t> keepalive = {static_cast<uint8_t>(TcpclMessageType::KEEPALIVE)};
+      SendControl(conn, keepalive);
+    }
+  
+  if (conn->active)
+    {
+      conn->keepaliveEvent = Simulator::Schedule(interval, &TcpConvergenceLayer::KeepaliveTimeout, 
+                                                 this, conn);
+    }
+}
+
+Ptr<Bundle> 
+TcpConvergenceLayer::ReceiveBundle(const uint8_t* data, uint32_t size)
+{
+  NS_LOG_FUNCTION(this << size);
+  
+  // 长传输期间节点可能已从别处收到该bundle
+  if (IsKnownBundle(data, size))
+    {
+      NS_LOG_INFO("Dropping known bundle");
+      m_knownBundles++;
+      return nullptr;
+    }
   
-  // 从CBOR反序列化bundle
-  auto bundleOpt = Bundle::FromCbor(buffer);
+  // 直接从接收的数据反序列化bundle
+  auto bundleOpt = Bundle::FromCbor(data, size);
   if (!bundleOpt)
     {
       NS_LOG_ERROR("Failed to deserialize bundle");
       return nullptr;
     }
   
-  Ptr<Bundle> bundle = Create<Bundle>(*bundleOpt);
+  Ptr<Bundle> bundle = Create<Bundle>(std::move(*bundleOpt));
   if (!bundle) {
     NS_LOG_ERROR("Failed to create Bundle object");
     return nullptr;
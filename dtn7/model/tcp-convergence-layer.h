@@ -3,31 +3,144 @@
 
 #include "convergence-layer.h"
 #include "bundle.h"
+#include "fragmentation-manager.h"
+#include "optional-mutex.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/socket.h"
+#include "ns3/packet.h"
+#include "ns3/header.h"
 #include "ns3/callback.h"
 #include "ns3/node.h"
 #include "ns3/traced-callback.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
 
 #include <string>
 #include <mutex>
 #include <map>
 #include <vector>
+#include <deque>
 
 namespace ns3 {
 
 namespace dtn7 {
 
+/**
+ * \brief TCPCLv4 (RFC 9174) 消息类型
+ */
+enum class TcpclMessageType : uint8_t
+{
+  XFER_SEGMENT = 0x01,
+  XFER_ACK = 0x02,
+  XFER_REFUSE = 0x03,
+  KEEPALIVE = 0x04,
+  SESS_TERM = 0x05,
+  MSG_REJECT = 0x06,
+  SESS_INIT = 0x07
+};
+
+/**
+ * \brief XFER_SEGMENT消息头，后面跟随本段的bundle数据
+ */
+class TcpclSegmentHeader : public Header
+{
+public:
+  static const uint8_t FLAG_END = 0x01;   //!< 传输的最后一段
+  static const uint8_t FLAG_START = 0x02; //!< 传输的第一段，带扩展项
+
+  static TypeId GetTypeId (void);
+  TypeId GetInstanceTypeId (void) const override;
+
+  TcpclSegmentHeader ();
+
+  void SetFlags (uint8_t flags) { m_flags = flags; }
+  uint8_t GetFlags () const { return m_flags; }
+  void SetTransferId (uint64_t id) { m_transferId = id; }
+  uint64_t GetTransferId () const { return m_transferId; }
+  void SetExtensions (std::vector<uint8_t> extensions) { m_extensions = std::move (extensions); }
+  const std::vector<uint8_t>& GetExtensions () const { return m_extensions; }
+  void SetDataLength (uint64_t length) { m_dataLength = length; }
+  uint64_t GetDataLength () const { return m_dataLength; }
+
+  uint32_t GetSerializedSize (void) const override;
+  void Serialize (Buffer::Iterator start) const override;
+  uint32_t Deserialize (Buffer::Iterator start) override;
+  void Print (std::ostream &os) const override;
+
+private:
+  uint8_t m_flags;                   //!< START/END标志
+  uint64_t m_transferId;             //!< 会话内的传输ID
+  std::vector<uint8_t> m_extensions; //!< 编码后的传输扩展项（仅START段）
+  uint64_t m_dataLength;             //!< 本段数据长度
+};
+
 // 定义TcpConnection类
 class TcpConnection : public SimpleRefCount<TcpConnection>
 {
 public:
+  /**
+   * \brief 会话状态
+   */
+  enum SessionState
+  {
+    WAIT_CONTACT_HEADER, //!< 等待对端的联系头
+    WAIT_SESS_INIT,      //!< 等待对端的SESS_INIT
+    ESTABLISHED,         //!< 会话已建立，可以传输bundle
+    TERMINATING          //!< 已发送SESS_TERM
+  };
+
+  /**
+   * \brief 发往对端的一次bundle传输
+   */
+  struct OutgoingTransfer
+  {
+    Ptr<Bundle> bundle;     //!< 要传输的bundle（可能被替换为剩余部分的分片）
+    std::string key;        //!< 原始bundle的标识，用于续传
+    Buffer encoded;         //!< bundle编码，开始传输时生成
+    uint64_t id;            //!< 传输ID
+    uint64_t sent;          //!< 已写入的字节数
+    uint64_t acked;         //!< 对端确认的字节数
+    uint64_t resumeOffset;  //!< 从该偏移续传（0表示从头开始）
+    bool started;           //!< 已发送START段
+  };
+
+  /**
+   * \brief 从对端接收中的传输
+   */
+  struct IncomingTransfer
+  {
+    uint64_t id;               //!< 传输ID
+    std::string key;           //!< 原始bundle的标识
+    std::vector<uint8_t> data; //!< 已接收的bundle字节
+    bool active;               //!< 正在接收
+    bool refused;              //!< 已拒绝，丢弃其余段
+  };
+
   Ptr<Socket> socket;
   std::string endpoint;
   bool active;
+  bool initiator;                           //!< 主动发起连接的一方
+  SessionState state;                       //!< 会话状态
+  bool established;                         //!< 会话曾经建立，已上报连接建立
+  std::string peerNodeId;                   //!< 对端在SESS_INIT中声明的节点ID
+  uint16_t keepaliveInterval;               //!< 协商后的保活间隔（秒），0表示关闭
+  uint64_t peerSegmentMru;                  //!< 对端可接收的最大段长度
+  uint64_t peerTransferMru;                 //!< 对端可接收的最大传输长度
+  uint64_t nextTransferId;                  //!< 下一个传输ID
+  std::deque<OutgoingTransfer> transfers;   //!< 等待发送或确认的传输
+  std::deque<Ptr<Packet>> controlQueue;     //!< 等待发送的控制消息，优先于数据段
+  Ptr<Packet> txPending;                    //!< 部分写入socket的消息的剩余字节
+  bool closeWhenDrained;                    //!< 传输全部确认后关闭会话（非永久连接）
+  IncomingTransfer incoming;                //!< 当前接收中的传输
+  std::vector<uint8_t> rxBuffer;            //!< 已接收但尚未处理的字节（可能是不完整的消息）
+  Time lastReceived;                        //!< 最近一次收到数据的时间
+  Time lastSent;                            //!< 最近一次写出消息的时间
+  EventId keepaliveEvent;                   //!< 保活定时器
 
   TcpConnection(Ptr<Socket> s, const std::string& ep)
-    : socket(s), endpoint(ep), active(true) {}
+    : socket(s), endpoint(ep), active(true), initiator(false), state(WAIT_CONTACT_HEADER),
+      established(false), keepaliveInterval(0), peerSegmentMru(0), peerTransferMru(0), nextTransferId(0),
+      closeWhenDrained(false), incoming{0, std::string(), {}, false, false} {}
 };
 
 /**
@@ -62,6 +175,12 @@ public:
    */
   void SetNode (Ptr<Node> node);
 
+  /**
+   * \brief Set the node ID announced in SESS_INIT
+   * \param nodeId Node ID of the DTN node using this layer
+   */
+  void SetLocalNodeId (const NodeID& nodeId);
+
   // 从ConvergenceReceiver继承
   void RegisterBundleCallback (Callback<void, Ptr<Bundle>, NodeID> callback) override;
   bool Start () override;
@@ -71,6 +190,7 @@ public:
   // 从ConvergenceSender继承
   bool Send (Ptr<Bundle> bundle, const std::string& endpoint) override;
   bool IsEndpointReachable (const std::string& endpoint) const override;
+  uint64_t GetMtu (const std::string& endpoint) const override;
 
   // 从ConvergenceLayer继承
   std::string GetStats () const override;
@@ -86,24 +206,68 @@ protected:
   void HandleConnect (Ptr<Socket> socket);
   void HandleClose (Ptr<Socket> socket);
   void HandleRecv (Ptr<Socket> socket);
+  void HandleSend (Ptr<Socket> socket, uint32_t available);
   void CleanupConnection (const std::string& endpoint);
   Ptr<TcpConnection> GetConnection (const std::string& endpoint);
+  Ptr<TcpConnection> FindConnection (Ptr<Socket> socket) const;
   bool SendBundle (Ptr<Bundle> bundle, Ptr<TcpConnection> conn);
-  Ptr<Bundle> ReceiveBundle (Ptr<Socket> socket);
+  void DrainSendQueue (Ptr<TcpConnection> conn);
+  Ptr<Bundle> ReceiveBundle (const uint8_t* data, uint32_t size);
+
+  // TCPCL会话
+  void SendContactHeader (Ptr<TcpConnection> conn);
+  void SendSessionInit (Ptr<TcpConnection> conn);
+  void SendControl (Ptr<TcpConnection> conn, const std::vector<uint8_t>& message);
+  void TerminateSession (Ptr<TcpConnection> conn, uint8_t reason);
+  bool ProcessReceivedData (Ptr<TcpConnection> conn, std::vector<Ptr<Bundle>>& bundles);
+  bool HandleMessage (Ptr<TcpConnection> conn, const uint8_t* message, size_t length,
+                      std::vector<Ptr<Bundle>>& bundles);
+  bool HandleSegment (Ptr<TcpConnection> conn, const uint8_t* message, size_t length,
+                      std::vector<Ptr<Bundle>>& bundles);
+  void HandleAck (Ptr<TcpConnection> conn, uint64_t transferId, uint64_t length);
+  void HandleRefuse (Ptr<TcpConnection> conn, uint64_t transferId, uint8_t reason);
+  bool StartTransfer (Ptr<TcpConnection> conn, size_t index);
+  Ptr<Packet> NextSegment (Ptr<TcpConnection> conn);
+  void KeepaliveTimeout (Ptr<TcpConnection> conn);
+  void HandleInterruptedTransfers (Ptr<TcpConnection> conn, std::vector<Ptr<Bundle>>& bundles);
+  void DeliverBundle (Ptr<Bundle> bundle, const std::string& endpoint);
 
 private:
   Ptr<Node> m_node;                            //!< 节点
   Ipv4Address m_address;                       //!< 本地地址
   uint16_t m_port;                             //!< 本地端口
   bool m_permanent;                            //!< 保持连接开启
+  uint32_t m_maxQueuedBytes;                   //!< 每个连接发送队列的字节上限
+  uint32_t m_maxBundleSize;                    //!< 接收时允许的最大bundle长度（本地传输MRU）
+  uint32_t m_segmentMru;                       //!< 本地可接收的最大段长度
+  uint16_t m_keepaliveInterval;                //!< 本地建议的保活间隔（秒）
+  NodeID m_localNodeId;                        //!< 在SESS_INIT中声明的节点ID
+  Ptr<FragmentationManager> m_fragmentationManager; //!< 用于中断传输的反应式分片
   bool m_running;                              //!< 运行标志
   Ptr<Socket> m_listenerSocket;                //!< 监听套接字
   std::map<std::string, Ptr<TcpConnection>> m_connections; //!< 活跃连接
-  mutable std::mutex m_connectionsMutex;       //!< 连接互斥锁
+  mutable OptionalMutex m_connectionsMutex;    //!< 连接互斥锁
   Callback<void, Ptr<Bundle>, NodeID> m_bundleCallback; //!< Bundle回调
   uint32_t m_sentBundles;                      //!< 已发送Bundle计数器
   uint32_t m_receivedBundles;                  //!< 已接收Bundle计数器
   uint32_t m_failedSends;                      //!< 发送失败计数器
+  uint32_t m_resumedTransfers;                 //!< 从确认偏移续传的次数
+  uint32_t m_reactiveFragments;                //!< 中断传输产生的分片数
+  uint32_t m_knownBundles;                     //!< 节点已有而拒绝或丢弃的bundle数
+
+  /**
+   * \brief 一次被中断的发送传输，下次连接到同一对端时续传
+   */
+  struct InterruptedTransfer
+  {
+    std::string peerNodeId; //!< 对端节点ID
+    uint64_t acked;         //!< 对端已确认的字节数
+    Ptr<Bundle> remainder;  //!< 尚未确认部分的分片；不可分片时为空，按字节续传
+  };
+  std::map<std::string, InterruptedTransfer> m_interruptedTransfers; //!< 按bundle标识索引
+  std::deque<std::string> m_interruptedOrder;  //!< 插入顺序，超过上限时丢弃最旧的
+  std::map<std::string, std::vector<uint8_t>> m_partialTransfers; //!< 接收到一半的不可分片bundle，按"对端/标识"索引
+  std::deque<std::string> m_partialOrder;      //!< 插入顺序，超过上限时丢弃最旧的
   TracedCallback<Ptr<Bundle>, std::string> m_sentTrace;        //!< 发送Bundle追踪源
   TracedCallback<Ptr<Bundle>, std::string> m_receivedTrace;    //!< 接收Bundle追踪源
 };
@@ -0,0 +1,165 @@
+#include "trace-events.h"
+#include "ns3/simulator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+namespace {
+
+const char TRACE_MAGIC[8] = {'D', 'T', 'N', '7', 'T', 'R', 'C', '1'};
+
+} // anonymous namespace
+
+std::atomic<bool> TraceEventRing::s_enabled (false);
+std::vector<TraceEvent> TraceEventRing::s_ring;
+std::atomic<uint64_t> TraceEventRing::s_next (0);
+
+void 
+TraceEventRing::Enable (size_t capacity)
+{
+  size_t size = 1;
+  while (size < capacity)
+    {
+      size <<= 1;
+    }
+  
+  s_enabled.store (false, std::memory_order_relaxed);
+  s_ring.assign (size, TraceEvent ());
+  s_next.store (0, std::memory_order_relaxed);
+  s_enabled.store (true, std::memory_order_release);
+}
+
+void 
+TraceEventRing::Disable ()
+{
+  s_enabled.store (false, std::memory_order_relaxed);
+  s_ring.clear ();
+  s_ring.shrink_to_fit ();
+  s_next.store (0, std::memory_order_relaxed);
+}
+
+void 
+TraceEventRing::Record (TraceEventType type, uint64_t bundle, uint64_t arg, uint16_t extra)
+{
+  // The ring size is a power of two, so the slot is a mask away
+  uint64_t index = s_next.fetch_add (1, std::memory_order_relaxed);
+  TraceEvent& event = s_ring[index & (s_ring.size () - 1)];
+  event.time = Simulator::Now ().GetNanoSeconds ();
+  event.bundle = bundle;
+  event.arg = arg;
+  event.node = Simulator::GetContext ();
+  event.type = static_cast<uint16_t> (type);
+  event.extra = extra;
+}
+
+std::vector<TraceEvent> 
+TraceEventRing::GetEvents ()
+{
+  std::vector<TraceEvent> events;
+  uint64_t next = s_next.load (std::memory_order_acquire);
+  if (s_ring.empty () || next == 0)
+    {
+      return events;
+    }
+  
+  uint64_t count = std::min<uint64_t> (next, s_ring.size ());
+  events.reserve (count);
+  for (uint64_t i = next - count; i < next; i++)
+    {
+      events.push_back (s_ring[i & (s_ring.size () - 1)]);
+    }
+  return events;
+}
+
+bool 
+TraceEventRing::Dump (const std::string& fileName)
+{
+  std::ofstream file (fileName, std::ios::binary);
+  if (!file)
+    {
+      return false;
+    }
+  
+  std::vector<TraceEvent> events = GetEvents ();
+  uint32_t eventSize = sizeof (TraceEvent);
+  uint64_t count = events.size ();
+  uint64_t overwritten = s_next.load (std::memory_order_relaxed) - count;
+  
+  file.write (TRACE_MAGIC, sizeof (TRACE_MAGIC));
+  file.write (reinterpret_cast<const char*> (&eventSize), sizeof (eventSize));
+  file.write (reinterpret_cast<const char*> (&count), sizeof (count));
+  file.write (reinterpret_cast<const char*> (&overwritten), sizeof (overwritten));
+  file.write (reinterpret_cast<const char*> (events.data ()), count * sizeof (TraceEvent));
+  return file.good ();
+}
+
+bool 
+TraceEventRing::Decode (const std::string& fileName, std::ostream& os)
+{
+  std::ifstream file (fileName, std::ios::binary);
+  char magic[sizeof (TRACE_MAGIC)];
+  uint32_t eventSize;
+  uint64_t count;
+  uint64_t overwritten;
+  if (!file.read (magic, sizeof (magic)) || std::memcmp (magic, TRACE_MAGIC, sizeof (magic)) != 0 ||
+      !file.read (reinterpret_cast<char*> (&eventSize), sizeof (eventSize)) ||
+      eventSize != sizeof (TraceEvent) ||
+      !file.read (reinterpret_cast<char*> (&count), sizeof (count)) ||
+      !file.read (reinterpret_cast<char*> (&overwritten), sizeof (overwritten)))
+    {
+      return false;
+    }
+  
+  os << "time_ns,node,event,bundle,arg,extra\n";
+  TraceEvent event;
+  for (uint64_t i = 0; i < count; i++)
+    {
+      if (!file.read (reinterpret_cast<char*> (&event), sizeof (event)))
+        {
+          return false;
+        }
+      os << event.time << "," << event.node << "," << GetTypeName (event.type) << ","
+         << std::hex << std::setw (16) << std::setfill ('0') << event.bundle << std::dec << ","
+         << event.arg << "," << event.extra << "\n";
+    }
+  return true;
+}
+
+std::string 
+TraceEventRing::GetTypeName (uint16_t type)
+{
+  switch (static_cast<TraceEventType> (type))
+    {
+    case TraceEventType::BUNDLE_CREATED:
+      return "BUNDLE_CREATED";
+    case TraceEventType::BUNDLE_STORED:
+      return "BUNDLE_STORED";
+    case TraceEventType::BUNDLE_SENT:
+      return "BUNDLE_SENT";
+    case TraceEventType::BUNDLE_RECEIVED:
+      return "BUNDLE_RECEIVED";
+    case TraceEventType::BUNDLE_DUPLICATE:
+      return "BUNDLE_DUPLICATE";
+    case TraceEventType::BUNDLE_DELIVERED:
+      return "BUNDLE_DELIVERED";
+    case TraceEventType::BUNDLE_EXPIRED:
+      return "BUNDLE_EXPIRED";
+    case TraceEventType::BUNDLE_EVICTED:
+      return "BUNDLE_EVICTED";
+    case TraceEventType::DATAGRAM_RECEIVED:
+      return "DATAGRAM_RECEIVED";
+    case TraceEventType::DATAGRAM_SENT:
+      return "DATAGRAM_SENT";
+    }
+  return "UNKNOWN_" + std::to_string (type);
+}
+
+} // namespace dtn7
+
+} // namespace ns3
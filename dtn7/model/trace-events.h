@@ -0,0 +1,154 @@
+#ifndef DTN7_TRACE_EVENTS_H
+#define DTN7_TRACE_EVENTS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+namespace dtn7 {
+
+/**
+ * \ingroup dtn7
+ * \brief Kinds of binary trace events
+ */
+enum class TraceEventType : uint16_t {
+  BUNDLE_CREATED = 1,     //!< Bundle created by a local application, arg = payload bytes
+  BUNDLE_STORED = 2,      //!< Bundle accepted by the store, arg = encoded bytes
+  BUNDLE_SENT = 3,        //!< Bundle handed to a convergence layer, arg = encoded bytes
+  BUNDLE_RECEIVED = 4,    //!< Bundle received from a peer, arg = payload bytes
+  BUNDLE_DUPLICATE = 5,   //!< Received bundle dropped as already known
+  BUNDLE_DELIVERED = 6,   //!< Bundle delivered to a local endpoint, arg = payload bytes
+  BUNDLE_EXPIRED = 7,     //!< Bundle deleted from the store after its lifetime
+  BUNDLE_EVICTED = 8,     //!< Bundle deleted from the store for space
+  DATAGRAM_RECEIVED = 9,  //!< Convergence layer datagram or segment, arg = bytes
+  DATAGRAM_SENT = 10      //!< Convergence layer datagram or segment, arg = bytes
+};
+
+/**
+ * \ingroup dtn7
+ * \brief One binary trace event, 32 bytes
+ */
+struct TraceEvent
+{
+  int64_t time;     //!< Simulation time in nanoseconds
+  uint64_t bundle;  //!< BundleID::Hash of the bundle, 0 if none
+  uint64_t arg;     //!< Event argument, see TraceEventType
+  uint32_t node;    //!< ns-3 node ID from the simulation context
+  uint16_t type;    //!< TraceEventType
+  uint16_t extra;   //!< Event specific, e.g. the receiving peer index
+};
+
+/**
+ * \ingroup dtn7
+ * \brief Module-wide ring buffer of binary trace events
+ *
+ * Per-bundle tracing through NS_LOG formats strings for every event.
+ * Trace events instead store fixed-size records, stamped with the
+ * simulation time and the node of the current simulation context, in a
+ * preallocated ring; once full, the oldest events are overwritten. The
+ * ring is written out with Dump() and turned into CSV offline with
+ * Decode(), e.g. by the dtn7-trace-decode example.
+ *
+ * Events are recorded through DTN7_TRACE_EVENT, which evaluates its
+ * arguments only while the ring is enabled. Defining DTN7_NO_TRACE_EVENTS
+ * at compile time removes the call sites entirely.
+ *
+ * Dump files start with the 8-byte magic "DTN7TRC1", the event size, the
+ * number of events and the number of overwritten events as 32 and 64-bit
+ * integers, followed by the events, oldest first, in host byte order.
+ */
+class TraceEventRing
+{
+public:
+  /**
+   * \brief Start recording events
+   * \param capacity Number of events kept, rounded up to a power of two
+   */
+  static void Enable (size_t capacity = 1 << 20);
+  
+  /**
+   * \brief Stop recording and release the ring
+   */
+  static void Disable ();
+  
+  /**
+   * \brief Check whether events are recorded
+   * \return true if enabled
+   */
+  static bool IsEnabled () { return s_enabled.load (std::memory_order_relaxed); }
+  
+  /**
+   * \brief Record an event at the current simulation time and context
+   * \param type Event type
+   * \param bundle Bundle hash, 0 if none
+   * \param arg Event argument
+   * \param extra Event specific value
+   */
+  static void Record (TraceEventType type, uint64_t bundle, uint64_t arg = 0, uint16_t extra = 0);
+  
+  /**
+   * \brief Get the recorded events, oldest first
+   * \return Events
+   */
+  static std::vector<TraceEvent> GetEvents ();
+  
+  /**
+   * \brief Write the recorded events to a binary file
+   * \param fileName Output file
+   * \return true if the file was written
+   */
+  static bool Dump (const std::string& fileName);
+  
+  /**
+   * \brief Convert a binary trace file to CSV
+   *
+   * Writes "time_ns,node,event,bundle,arg,extra" rows with the bundle
+   * hash in hex; BundleID::Hash maps a known bundle to its hash.
+   * \param fileName Binary trace file
+   * \param os Output stream
+   * \return true if the file was well formed
+   */
+  static bool Decode (const std::string& fileName, std::ostream& os);
+  
+  /**
+   * \brief Get the name of an event type
+   * \param type Event type
+   * \return Name, e.g. "BUNDLE_SENT"
+   */
+  static std::string GetTypeName (uint16_t type);
+
+private:
+  static std::atomic<bool> s_enabled;  //!< Whether events are recorded
+  static std::vector<TraceEvent> s_ring; //!< Event ring
+  static std::atomic<uint64_t> s_next; //!< Number of events recorded since enabled
+};
+
+} // namespace dtn7
+
+} // namespace ns3
+
+#ifdef DTN7_NO_TRACE_EVENTS
+#define DTN7_TRACE_EVENT(type, bundle, ...) do { } while (false)
+#else
+/**
+ * \ingroup dtn7
+ * \brief Record a binary trace event if the ring is enabled
+ *
+ * The arguments are not evaluated while the ring is disabled.
+ */
+#define DTN7_TRACE_EVENT(type, bundle, ...)                                         \
+  do                                                                                \
+    {                                                                               \
+      if (::ns3::dtn7::TraceEventRing::IsEnabled ())                                \
+        {                                                                           \
+          ::ns3::dtn7::TraceEventRing::Record (type, bundle, ##__VA_ARGS__);        \
+        }                                                                           \
+    }                                                                               \
+  while (false)
+#endif
+
+#endif /* DTN7_TRACE_EVENTS_H */
@@ -8,6 +8,7 @@
 #include "ns3/uinteger.h"
 #include "ns3/boolean.h"
 #include "ns3/trace-source-accessor.h"
+#include "ns3/data-rate.h"
 #include <sstream>
 #include <algorithm>
 
@@ -17,6 +18,58 @@ NS_LOG_COMPONENT_DEFINE ("UdpConvergenceLayer");
 
 namespace dtn7 {
 
+namespace {
+
+const uint8_t BUNDLE_MARKER = 0xBB;   // 完整Bundle
+const uint8_t FRAGMENT_MARKER = 0x1B; // Bundle分片
+const uint8_t NACK_MARKER = 0x1D;     // 缺失分片请求
+
+// 分片头 (17 bytes)
+// | 0x1B (1) | bundleId (4) | fragmentId (2) | numFragments (2) | totalSize (4) | offset (4) |
+const uint32_t FRAGMENT_HEADER_SIZE = 17;
+
+// 记住的最近完成重组数
+const size_t MAX_COMPLETED_BUNDLES = 64;
+
+// 保留的回收重组缓冲区数及单个缓冲区的最大容量
+const size_t MAX_FREE_REASSEMBLY_BUFFERS = 8;
+const size_t MAX_FREE_REASSEMBLY_CAPACITY = 1 << 20;
+
+// NACK (7 + 2 * count bytes)
+// | 0x1D (1) | bundleId (4) | count (2) | fragmentId (2) ... |
+const uint32_t NACK_HEADER_SIZE = 7;
+
+void 
+PutU16(uint8_t* p, uint16_t value)
+{
+  p[0] = (value >> 8) & 0xFF;
+  p[1] = value & 0xFF;
+}
+
+void 
+PutU32(uint8_t* p, uint32_t value)
+{
+  p[0] = (value >> 24) & 0xFF;
+  p[1] = (value >> 16) & 0xFF;
+  p[2] = (value >> 8) & 0xFF;
+  p[3] = value & 0xFF;
+}
+
+uint16_t 
+GetU16(const uint8_t* p)
+{
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t 
+GetU32(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+} // anonymous namespace
+
 // UDP连接实现
 
 UdpConnection::UdpConnection()
@@ -58,6 +111,47 @@ UdpConvergenceLayer::GetTypeId ()
                    TimeValue (Minutes (1)),
                    MakeTimeAccessor (&UdpConvergenceLayer::m_cleanupInterval),
                    MakeTimeChecker ())
+    .AddAttribute ("ReassemblyBudget",
+                   "所有分片重组缓冲区的内存上限（字节），超出时淘汰最旧的重组",
+                   UintegerValue (16 * 1024 * 1024),
+                   MakeUintegerAccessor (&UdpConvergenceLayer::m_reassemblyBudget),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("ReassemblyTimeout",
+                   "在此时间内没有收到新分片时放弃重组",
+                   TimeValue (Seconds (60)),
+                   MakeTimeAccessor (&UdpConvergenceLayer::m_reassemblyTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxSendRate",
+                   "发送数据报的令牌桶速率，0表示不限速",
+                   DataRateValue (DataRate ("5Mbps")),
+                   MakeDataRateAccessor (&UdpConvergenceLayer::m_maxSendRate),
+                   MakeDataRateChecker ())
+    .AddAttribute ("MaxBurstSize",
+                   "令牌桶容量（字节），至少容纳一个最大数据报",
+                   UintegerValue (2 * MAX_FRAGMENT_SIZE),
+                   MakeUintegerAccessor (&UdpConvergenceLayer::m_maxBurstSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("NackDelay",
+                   "没有新分片多久后向发送方请求缺失的分片",
+                   TimeValue (MilliSeconds (200)),
+                   MakeTimeAccessor (&UdpConvergenceLayer::m_nackDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxNacks",
+                   "每个Bundle最多发送的NACK数",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&UdpConvergenceLayer::m_maxNacks),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("RetransmitHoldTime",
+                   "发送完成后为响应NACK保留Bundle的时间",
+                   TimeValue (Seconds (5)),
+                   MakeTimeAccessor (&UdpConvergenceLayer::m_retransmitHold),
+                   MakeTimeChecker ())
+    .AddAttribute ("BundleMtu",
+                   "单个数据报可发送的最大bundle（字节），更大的bundle由节点在bundle层分片；"
+                   "0表示不限制，由数据报分片承载",
+                   UintegerValue (MAX_FRAGMENT_SIZE - 1),
+                   MakeUintegerAccessor (&UdpConvergenceLayer::m_bundleMtu),
+                   MakeUintegerChecker<uint64_t> ())
     .AddTraceSource ("SentBundle",
                      "发送Bundle跟踪源",
                      MakeTraceSourceAccessor (&UdpConvergenceLayer::m_sentTrace),
@@ -73,11 +167,25 @@ UdpConvergenceLayer::UdpConvergenceLayer()
   : m_address(Ipv4Address::GetAny()),
     m_port(4557),
     m_running(false),
+    m_pendingBytes(0),
+    m_reassemblyBudget(16 * 1024 * 1024),
+    m_reassemblyTimeout(Seconds(60)),
+    m_evictedBundles(0),
     m_nextBundleId(1),
+    m_maxSendRate(DataRate("5Mbps")),
+    m_maxBurstSize(2 * MAX_FRAGMENT_SIZE),
+    m_tokens(2 * MAX_FRAGMENT_SIZE),
+    m_nackDelay(MilliSeconds(200)),
+    m_maxNacks(3),
+    m_retransmitHold(Seconds(5)),
+    m_bundleMtu(MAX_FRAGMENT_SIZE - 1),
+    m_sentNacks(0),
+    m_retransmittedFragments(0),
     m_cleanupInterval(Minutes(1)),
     m_sentBundles(0),
     m_receivedBundles(0),
-    m_failedSends(0)
+    m_failedSends(0),
+    m_knownBundles(0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -87,11 +195,25 @@ UdpConvergenceLayer::UdpConvergenceLayer(Ptr<Node> node, Ipv4Address address, ui
     m_address(address),
     m_port(port),
     m_running(false),
+    m_pendingBytes(0),
+    m_reassemblyBudget(16 * 1024 * 1024),
+    m_reassemblyTimeout(Seconds(60)),
+    m_evictedBundles(0),
     m_nextBundleId(1),
+    m_maxSendRate(DataRate("5Mbps")),
+    m_maxBurstSize(2 * MAX_FRAGMENT_SIZE),
+    m_tokens(2 * MAX_FRAGMENT_SIZE),
+    m_nackDelay(MilliSeconds(200)),
+    m_maxNacks(3),
+    m_retransmitHold(Seconds(5)),
+    m_bundleMtu(MAX_FRAGMENT_SIZE - 1),
+    m_sentNacks(0),
+    m_retransmittedFragments(0),
     m_cleanupInterval(Minutes(1)),
     m_sentBundles(0),
     m_receivedBundles(0),
-    m_failedSends(0)
+    m_failedSends(0),
+    m_knownBundles(0)
 {
   NS_LOG_FUNCTION (this << node << address << port);
 }
@@ -163,6 +285,26 @@ UdpConvergenceLayer::Stop()
       Simulator::Cancel(m_cleanupEvent);
     }
   
+  // 丢弃未发出的数据报与为重传保留的Bundle
+  {
+    std::lock_guard<OptionalMutex> lock(m_sendMutex);
+    Simulator::Cancel(m_sendEvent);
+    for (auto& pair : m_outgoing)
+      {
+        Simulator::Cancel(pair.second.releaseEvent);
+      }
+    m_outgoing.clear();
+    m_sendQueue.clear();
+  }
+  
+  {
+    std::lock_guard<OptionalMutex> lock(m_pendingBundlesMutex);
+    for (auto& pair : m_pendingBundles)
+      {
+        Simulator::Cancel(pair.second.nackEvent);
+      }
+  }
+  
   // 关闭套接字
   if (m_socket)
     {
@@ -205,26 +347,15 @@ UdpConvergenceLayer::Send(Ptr<Bundle> bundle, const std::string& endpoint)
       return false;
     }
   
-  // 发送Bundle
+  // 加入发送队列，由令牌桶按速率发出
   bool success = SendBundle(bundle, destAddress, destPort);
   
   if (success)
     {
-      m_sentBundles++;
-      m_sentTrace(bundle, endpoint);
-      NS_LOG_INFO ("已发送Bundle到 " << endpoint);
+      NS_LOG_INFO ("Bundle已加入发送队列，目标 " << endpoint);
       
       // 更新连接状态
-      std::lock_guard<std::mutex> lock(m_connectionsMutex);
-      auto it = m_connections.find(endpoint);
-      if (it == m_connections.end())
-        {
-          m_connections[endpoint] = Create<UdpConnection>(endpoint);
-        }
-      else
-        {
-          it->second->UpdateLastSeen();
-        }
+      TouchConnection(endpoint);
     }
   else
     {
@@ -241,11 +372,18 @@ UdpConvergenceLayer::IsEndpointReachable(const std::string& endpoint) const
   NS_LOG_FUNCTION (this << endpoint);
   
   // 在UDP中，我们不能确定端点是否可达，只能基于之前的通信
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   auto it = m_connections.find(endpoint);
   return it != m_connections.end() && it->second->IsActive();
 }
 
+uint64_t 
+UdpConvergenceLayer::GetMtu(const std::string& endpoint) const
+{
+  // 完整bundle连同标记字节放入一个数据报；只有不能分片的bundle才走数据报分片
+  return m_bundleMtu;
+}
+
 std::string 
 UdpConvergenceLayer::GetStats() const
 {
@@ -258,8 +396,14 @@ UdpConvergenceLayer::GetStats() const
   ss << ", sent=" << m_sentBundles;
   ss << ", recv=" << m_receivedBundles;
   ss << ", failed=" << m_failedSends;
+  ss << ", known=" << m_knownBundles;
   ss << ", conn=" << m_connections.size();
   ss << ", pending=" << m_pendingBundles.size();
+  ss << ", pendingBytes=" << m_pendingBytes;
+  ss << ", evicted=" << m_evictedBundles;
+  ss << ", queued=" << m_sendQueue.size();
+  ss << ", nacks=" << m_sentNacks;
+  ss << ", retransmitted=" << m_retransmittedFragments;
   ss << ")";
   
   return ss.str();
@@ -272,7 +416,7 @@ UdpConvergenceLayer::GetActiveConnections() const
   
   std::vector<std::string> result;
   
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   for (const auto& pair : m_connections)
     {
       if (pair.second->IsActive())
@@ -289,11 +433,46 @@ UdpConvergenceLayer::HasActiveConnection(const std::string& endpoint) const
 {
   NS_LOG_FUNCTION (this << endpoint);
   
-  std::lock_guard<std::mutex> lock(m_connectionsMutex);
+  std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
   auto it = m_connections.find(endpoint);
   return it != m_connections.end() && it->second->IsActive();
 }
 
+void 
+UdpConvergenceLayer::TouchConnection(const std::string& endpoint)
+{
+  {
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
+    auto it = m_connections.find(endpoint);
+    if (it != m_connections.end())
+      {
+        it->second->UpdateLastSeen();
+        return;
+      }
+    m_connections[endpoint] = Create<UdpConnection>(endpoint);
+  }
+  
+  // 新的对端，在锁外通知
+  NotifyConnectionChanged(endpoint, std::string(), true);
+}
+
+void 
+UdpConvergenceLayer::SetPeerNodeId(const std::string& endpoint, const std::string& nodeId)
+{
+  {
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
+    auto it = m_connections.find(endpoint);
+    if (it == m_connections.end() || it->second->peerNodeId == nodeId)
+      {
+        return;
+      }
+    it->second->peerNodeId = nodeId;
+  }
+  
+  NS_LOG_INFO ("端点 " << endpoint << " 属于节点 " << nodeId);
+  NotifyConnectionChanged(endpoint, nodeId, true);
+}
+
 void 
 UdpConvergenceLayer::SetNode(Ptr<Node> node)
 {
@@ -358,15 +537,17 @@ UdpConvergenceLayer::HandleReceive(Ptr<Socket> socket)
       NS_LOG_INFO ("收到数据包从 " << address.GetIpv4() << ":" << address.GetPort() 
                    << " (" << packet->GetSize() << " bytes)");
       
-      // 读取数据
+      // 读取数据到复用的接收缓冲区
       uint32_t size = packet->GetSize();
-      uint8_t *data = new uint8_t[size];
-      packet->CopyData(data, size);
+      CountReceived(size);
+      if (m_receiveBuffer.size() < size)
+        {
+          m_receiveBuffer.resize(size);
+        }
+      packet->CopyData(m_receiveBuffer.data(), size);
       
       // 处理分片
-      HandleFragment(data, size, from);
-      
-      delete[] data;
+      HandleFragment(m_receiveBuffer.data(), size, from);
     }
 }
 
@@ -423,88 +604,367 @@ UdpConvergenceLayer::SendBundle(Ptr<Bundle> bundle, Ipv4Address destAddress, uin
       return false;
     }
   
-  // 序列化Bundle为CBOR
-  Buffer buffer = bundle->ToCbor();
-  uint32_t totalSize = buffer.GetSize();
+  OutgoingBundle outgoing;
+  outgoing.bundle = bundle;
+  outgoing.encoded = bundle->ToCbor();
+  outgoing.endpoint = FormatEndpoint(destAddress, destPort);
+  outgoing.destAddress = destAddress;
+  outgoing.destPort = destPort;
+  outgoing.numFragments = 0;
+  outgoing.fragmentPayload = 0;
+  outgoing.unsent = 1;
+  uint32_t totalSize = outgoing.encoded.GetSize();
   
   // 如果大小超过最大UDP载荷，需要分片
-  if (totalSize > MAX_FRAGMENT_SIZE)
+  if (totalSize + 1 > MAX_FRAGMENT_SIZE)
     {
       NS_LOG_INFO ("Bundle大小超过UDP最大载荷，需要分片");
       
-      // 分配Bundle ID
-      uint32_t bundleId;
+      // 计算分片数，每个分片连同分片头不超过最大UDP载荷
+      outgoing.fragmentPayload = MAX_FRAGMENT_SIZE - FRAGMENT_HEADER_SIZE;
+      uint32_t numFragments = (totalSize + outgoing.fragmentPayload - 1) / outgoing.fragmentPayload;
+      if (numFragments > 0xFFFF)
+        {
+          NS_LOG_ERROR ("Bundle太大，无法通过UDP分片发送: " << totalSize << " bytes");
+          return false;
+        }
+      NS_LOG_INFO ("将Bundle分为 " << numFragments << " 个分片");
+      outgoing.numFragments = static_cast<uint16_t>(numFragments);
+      outgoing.unsent = numFragments;
+    }
+  
+  {
+    std::lock_guard<OptionalMutex> lock(m_sendMutex);
+    
+    // 分配Bundle ID
+    uint32_t bundleId = m_nextBundleId++;
+    
+    for (uint32_t i = 0; i < outgoing.unsent; i++)
       {
-        std::lock_guard<std::mutex> lock(m_pendingBundlesMutex);
-        bundleId = m_nextBundleId++;
+        m_sendQueue.push_back({bundleId, static_cast<uint16_t>(i), false});
       }
+    m_outgoing[bundleId] = outgoing;
+  }
+  
+  SendPending();
+  return true;
+}
+
+Ptr<Packet> 
+UdpConvergenceLayer::BuildDatagram(uint32_t bundleId, const OutgoingBundle& outgoing, uint16_t fragmentId) const
+{
+  const uint8_t* data = outgoing.encoded.PeekData();
+  uint32_t totalSize = outgoing.encoded.GetSize();
+  
+  // 数据报在复用的缓冲区中组装，每个分片只分配Packet本身
+  std::vector<uint8_t>& datagram = m_sendBuffer;
+  if (outgoing.numFragments == 0)
+    {
+      // 不需要分片，添加0xBB标记表示完整Bundle
+      datagram.resize(totalSize + 1);
+      datagram[0] = BUNDLE_MARKER;
+      std::copy(data, data + totalSize, datagram.begin() + 1);
+      return Create<Packet>(datagram.data(), datagram.size());
+    }
+  
+  // 计算分片偏移量和大小
+  uint32_t offset = fragmentId * outgoing.fragmentPayload;
+  uint32_t fragmentSize = std::min(outgoing.fragmentPayload, totalSize - offset);
+  
+  datagram.resize(FRAGMENT_HEADER_SIZE + fragmentSize);
+  uint8_t* header = datagram.data();
+  header[0] = FRAGMENT_MARKER;
+  PutU32(header + 1, bundleId);
+  PutU16(header + 5, fragmentId);
+  PutU16(header + 7, outgoing.numFragments);
+  PutU32(header + 9, totalSize);
+  PutU32(header + 13, offset);
+  std::copy(data + offset, data + offset + fragmentSize, datagram.begin() + FRAGMENT_HEADER_SIZE);
+  
+  return Create<Packet>(datagram.data(), datagram.size());
+}
+
+void 
+UdpConvergenceLayer::SendPending()
+{
+  NS_LOG_FUNCTION (this);
+  
+  if (!m_socket)
+    {
+      return;
+    }
+  
+  const double rate = m_maxSendRate.GetBitRate() / 8.0; // 字节/秒
+  const double capacity = std::max(m_maxBurstSize, static_cast<uint32_t>(MAX_FRAGMENT_SIZE));
+  
+  while (true)
+    {
+      Ptr<Packet> packet;
+      InetSocketAddress dest(Ipv4Address::GetAny(), 0);
+      Ptr<Bundle> completed;
+      std::string endpoint;
+      bool whole = false;
       
-      // 准备数据
-      std::vector<uint8_t> data(totalSize);
-      buffer.CopyData(data.data(), totalSize);
-      
-      // 计算分片数
-      uint32_t numFragments = (totalSize + MAX_FRAGMENT_SIZE - 1) / MAX_FRAGMENT_SIZE;
-      NS_LOG_INFO ("将Bundle分为 " << numFragments << " 个分片");
+      {
+        std::lock_guard<OptionalMutex> lock(m_sendMutex);
+        
+        // 补充令牌
+        Time now = Simulator::Now();
+        if (rate > 0)
+          {
+            m_tokens = std::min(capacity, m_tokens + (now - m_lastRefill).GetSeconds() * rate);
+          }
+        m_lastRefill = now;
+        
+        if (m_sendQueue.empty())
+          {
+            return;
+          }
+        
+        QueuedDatagram next = m_sendQueue.front();
+        auto it = m_outgoing.find(next.bundleId);
+        if (it == m_outgoing.end())
+          {
+            // Bundle已释放，丢弃剩余的重传
+            m_sendQueue.pop_front();
+            continue;
+          }
+        OutgoingBundle& outgoing = it->second;
+        
+        uint32_t totalSize = outgoing.encoded.GetSize();
+        whole = outgoing.numFragments == 0;
+        uint32_t size = whole ? totalSize + 1
+                              : FRAGMENT_HEADER_SIZE + std::min(outgoing.fragmentPayload,
+                                                                totalSize - next.fragmentId * outgoing.fragmentPayload);
+        
+        // 令牌不足时等到足够再发，已有等待中的事件时交给它处理
+        if (rate > 0 && m_tokens < size)
+          {
+            if (!m_sendEvent.IsPending())
+              {
+                m_sendEvent = Simulator::Schedule(Seconds((size - m_tokens) / rate),
+                                                  &UdpConvergenceLayer::SendPending,
+                                                  this);
+              }
+            return;
+          }
+        if (rate > 0)
+          {
+            m_tokens -= size;
+          }
+        
+        m_sendQueue.pop_front();
+        packet = BuildDatagram(next.bundleId, outgoing, next.fragmentId);
+        dest = InetSocketAddress(outgoing.destAddress, outgoing.destPort);
+        
+        // 首轮发送结束，分片的Bundle保留一段时间以响应NACK
+        if (!next.retransmit && --outgoing.unsent == 0)
+          {
+            completed = outgoing.bundle;
+            endpoint = outgoing.endpoint;
+            if (whole)
+              {
+                m_outgoing.erase(it);
+              }
+            else
+              {
+                outgoing.releaseEvent = Simulator::Schedule(m_retransmitHold,
+                                                            &UdpConvergenceLayer::ReleaseOutgoing,
+                                                            this,
+                                                            next.bundleId);
+              }
+          }
+      }
       
-      // 为每个分片创建数据包
-      for (uint32_t i = 0; i < numFragments; i++)
+      int sent = m_socket->SendTo(packet, 0, dest);
+      if (sent > 0)
         {
-          // 计算分片偏移量和大小
-          uint32_t offset = i * MAX_FRAGMENT_SIZE;
-          uint32_t fragmentSize = std::min(MAX_FRAGMENT_SIZE, totalSize - offset);
-          
-          // 创建分片头 (8 bytes)
-          // | 0x1B (1 byte) | bundleId (4 bytes) | fragmentId (2 bytes) | numFragments (1 byte) |
-          uint8_t header[8];
-          header[0] = 0x1B; // 分片标记
-          header[1] = (bundleId >> 24) & 0xFF;
-          header[2] = (bundleId >> 16) & 0xFF;
-          header[3] = (bundleId >> 8) & 0xFF;
-          header[4] = bundleId & 0xFF;
-          header[5] = (i >> 8) & 0xFF;
-          header[6] = i & 0xFF;
-          header[7] = numFragments;
-          
-          // 创建分片数据包
-          Ptr<Packet> fragment = Create<Packet>(header, 8);
-          fragment->AddAtEnd(Create<Packet>(data.data() + offset, fragmentSize));
-          
-          // 发送分片
-          InetSocketAddress dest(destAddress, destPort);
-          int sent = m_socket->SendTo(fragment, 0, dest);
-          
-          if (sent != static_cast<int>(fragment->GetSize()))
+          CountSent(sent);
+        }
+      if (sent != static_cast<int>(packet->GetSize()))
+        {
+          NS_LOG_ERROR ("数据报发送失败: " << sent << "/" << packet->GetSize());
+          if (whole)
             {
-              NS_LOG_ERROR ("分片发送失败: " << sent << "/" << fragment->GetSize());
-              return false;
+              // 未分片的Bundle没有NACK可以恢复
+              m_failedSends++;
+              completed = nullptr;
             }
         }
-    }
-  else
-    {
-      // 不需要分片，直接发送
-      // 准备数据
-      std::vector<uint8_t> data(totalSize);
-      buffer.CopyData(data.data(), totalSize);
-      
-      // 创建数据包，添加0xBB标记表示完整Bundle
-      uint8_t header = 0xBB;
-      Ptr<Packet> packet = Create<Packet>(&header, 1);
-      packet->AddAtEnd(Create<Packet>(data.data(), totalSize));
-      
-      // 发送Bundle
-      InetSocketAddress dest(destAddress, destPort);
-      int sent = m_socket->SendTo(packet, 0, dest);
       
-      if (sent != static_cast<int>(packet->GetSize()))
+      if (completed)
         {
-          NS_LOG_ERROR ("Bundle发送失败: " << sent << "/" << packet->GetSize());
-          return false;
+          m_sentBundles++;
+          m_sentTrace(completed, endpoint);
+          NS_LOG_INFO ("已发送Bundle到 " << endpoint);
         }
     }
+}
+
+void 
+UdpConvergenceLayer::ReleaseOutgoing(uint32_t bundleId)
+{
+  NS_LOG_FUNCTION (this << bundleId);
   
-  return true;
+  std::lock_guard<OptionalMutex> lock(m_sendMutex);
+  m_outgoing.erase(bundleId);
+}
+
+void 
+UdpConvergenceLayer::HandleNack(const uint8_t* data, uint32_t size, const InetSocketAddress& address)
+{
+  NS_LOG_FUNCTION (this << size);
+  
+  if (size < NACK_HEADER_SIZE)
+    {
+      NS_LOG_WARN ("NACK太短");
+      return;
+    }
+  
+  uint32_t bundleId = GetU32(data + 1);
+  uint16_t count = GetU16(data + 5);
+  if (size < NACK_HEADER_SIZE + 2u * count)
+    {
+      NS_LOG_WARN ("NACK长度与分片数不符");
+      return;
+    }
+  
+  {
+    std::lock_guard<OptionalMutex> lock(m_sendMutex);
+    
+    // 对端从其接收套接字发送NACK，地址和端口都须与发送目标一致
+    auto it = m_outgoing.find(bundleId);
+    if (it == m_outgoing.end() || it->second.destAddress != address.GetIpv4() ||
+        it->second.destPort != address.GetPort())
+      {
+        NS_LOG_DEBUG ("NACK对应的Bundle已不再保留: " << bundleId);
+        return;
+      }
+    OutgoingBundle& outgoing = it->second;
+    
+    // 未分片的Bundle没有可重传的分片
+    if (outgoing.numFragments == 0)
+      {
+        NS_LOG_DEBUG ("NACK对应的Bundle未分片: " << bundleId);
+        return;
+      }
+    
+    // 只重传首轮中已经发出的分片，其余的仍在队列中
+    uint32_t firstUnsent = outgoing.numFragments - outgoing.unsent;
+    
+    // 缺失的分片放到队首，先于新的Bundle重传
+    for (uint32_t i = count; i-- > 0;)
+      {
+        uint16_t fragmentId = GetU16(data + NACK_HEADER_SIZE + 2 * i);
+        if (fragmentId < firstUnsent)
+          {
+            m_sendQueue.push_front({bundleId, fragmentId, true});
+            m_retransmittedFragments++;
+          }
+      }
+    
+    // 延长保留时间，以便响应后续的NACK
+    if (outgoing.unsent == 0)
+      {
+        Simulator::Cancel(outgoing.releaseEvent);
+        outgoing.releaseEvent = Simulator::Schedule(m_retransmitHold,
+                                                    &UdpConvergenceLayer::ReleaseOutgoing,
+                                                    this,
+                                                    bundleId);
+      }
+    
+    NS_LOG_INFO ("收到NACK，重传Bundle " << bundleId << " 的 " << count << " 个分片");
+  }
+  
+  SendPending();
+}
+
+void 
+UdpConvergenceLayer::CheckMissingFragments(PendingBundleKey key)
+{
+  NS_LOG_FUNCTION (this << key.bundleId);
+  
+  Ptr<Packet> nack;
+  
+  {
+    std::lock_guard<OptionalMutex> lock(m_pendingBundlesMutex);
+    
+    auto it = m_pendingBundles.find(key);
+    if (it == m_pendingBundles.end())
+      {
+        return;
+      }
+    PendingBundle& pending = it->second;
+    
+    // 仍有分片在陆续到达时推迟检查
+    Time now = Simulator::Now();
+    Time idle = now - std::max(pending.lastActivity, pending.lastNack);
+    if (idle < m_nackDelay)
+      {
+        pending.nackEvent = Simulator::Schedule(m_nackDelay - idle,
+                                                &UdpConvergenceLayer::CheckMissingFragments,
+                                                this,
+                                                key);
+        return;
+      }
+    
+    // NACK次数用完后交给ReassemblyTimeout清理
+    if (pending.nacksSent >= m_maxNacks)
+      {
+        return;
+      }
+    
+    // 按位图列出缺失的分片，跳过已经收满的字
+    const uint32_t maxCount = (MAX_FRAGMENT_SIZE - NACK_HEADER_SIZE) / 2;
+    std::vector<uint8_t> datagram(NACK_HEADER_SIZE);
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < pending.receivedMap.size() && count < maxCount; w++)
+      {
+        uint64_t word = pending.receivedMap[w];
+        if (word == ~uint64_t(0))
+          {
+            continue;
+          }
+        for (uint32_t bit = 0; bit < 64 && count < maxCount; bit++)
+          {
+            uint32_t fragmentId = w * 64 + bit;
+            if (fragmentId >= pending.numFragments)
+              {
+                break;
+              }
+            if (!(word & (uint64_t(1) << bit)))
+              {
+                datagram.push_back((fragmentId >> 8) & 0xFF);
+                datagram.push_back(fragmentId & 0xFF);
+                count++;
+              }
+          }
+      }
+    
+    datagram[0] = NACK_MARKER;
+    PutU32(datagram.data() + 1, key.bundleId);
+    PutU16(datagram.data() + 5, static_cast<uint16_t>(count));
+    nack = Create<Packet>(datagram.data(), datagram.size());
+    
+    pending.nacksSent++;
+    pending.lastNack = now;
+    pending.nackEvent = Simulator::Schedule(m_nackDelay,
+                                            &UdpConvergenceLayer::CheckMissingFragments,
+                                            this,
+                                            key);
+    m_sentNacks++;
+    
+    NS_LOG_INFO ("请求重传Bundle " << key.bundleId << " 的 " << count << " 个缺失分片");
+  }
+  
+  if (m_socket)
+    {
+      int sent = m_socket->SendTo(nack, 0, InetSocketAddress(key.address, key.port));
+      if (sent > 0)
+        {
+          CountSent(sent);
+        }
+    }
 }
 
 void 
@@ -516,14 +976,16 @@ UdpConvergenceLayer::CleanupExpired()
   Time connectionTimeout = Seconds(60);
   
   // 清理过期连接
+  std::vector<std::pair<std::string, std::string>> expired; // 端点与节点ID
   {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    std::lock_guard<OptionalMutex> lock(m_connectionsMutex);
     
     for (auto it = m_connections.begin(); it != m_connections.end();)
       {
         if (now - it->second->lastSeen > connectionTimeout)
           {
             NS_LOG_INFO ("清理过期连接: " << it->first);
+            expired.push_back(std::make_pair(it->first, it->second->peerNodeId));
             it = m_connections.erase(it);
           }
         else
@@ -533,16 +995,23 @@ UdpConvergenceLayer::CleanupExpired()
       }
   }
   
-  // 清理过期的待接收Bundle
+  for (const auto& connection : expired)
+    {
+      NotifyConnectionChanged(connection.first, connection.second, false);
+    }
+  
+  // 清理长时间没有新分片的待接收Bundle
   {
-    std::lock_guard<std::mutex> lock(m_pendingBundlesMutex);
+    std::lock_guard<OptionalMutex> lock(m_pendingBundlesMutex);
     
     for (auto it = m_pendingBundles.begin(); it != m_pendingBundles.end();)
       {
-        if (now > it->second.expiryTime)
+        if (now - it->second.lastActivity > m_reassemblyTimeout)
           {
-            NS_LOG_INFO ("清理过期待接收Bundle: " << it->first);
-            it = m_pendingBundles.erase(it);
+            NS_LOG_INFO ("清理过期待接收Bundle: " << it->first.address << ":" << it->first.port
+                         << "/" << it->first.bundleId);
+            m_evictedBundles++;
+            RemovePending(it++);
           }
         else
           {
@@ -557,6 +1026,120 @@ UdpConvergenceLayer::CleanupExpired()
                                      this);
 }
 
+void 
+UdpConvergenceLayer::RemovePending(std::map<PendingBundleKey, PendingBundle>::iterator it)
+{
+  Simulator::Cancel(it->second.nackEvent);
+  m_pendingBytes -= it->second.data.size();
+  m_pendingOrder.erase(it->second.order);
+  ReleaseReassemblyBuffer(std::move(it->second.data));
+  m_pendingBundles.erase(it);
+}
+
+std::vector<uint8_t> 
+UdpConvergenceLayer::AcquireReassemblyBuffer(size_t size)
+{
+  std::vector<uint8_t> buffer;
+  if (!m_freeReassemblyBuffers.empty())
+    {
+      // 最小的足够大的缓冲区，没有时取最大的一个再扩容
+      auto best = m_freeReassemblyBuffers.end();
+      auto largest = m_freeReassemblyBuffers.begin();
+      for (auto it = m_freeReassemblyBuffers.begin(); it != m_freeReassemblyBuffers.end(); ++it)
+        {
+          if (it->capacity() >= size &&
+              (best == m_freeReassemblyBuffers.end() || it->capacity() < best->capacity()))
+            {
+              best = it;
+            }
+          if (it->capacity() > largest->capacity())
+            {
+              largest = it;
+            }
+        }
+      std::swap(best != m_freeReassemblyBuffers.end() ? *best : *largest, m_freeReassemblyBuffers.back());
+      buffer = std::move(m_freeReassemblyBuffers.back());
+      m_freeReassemblyBuffers.pop_back();
+    }
+  buffer.resize(size);
+  return buffer;
+}
+
+void 
+UdpConvergenceLayer::ReleaseReassemblyBuffer(std::vector<uint8_t>&& buffer)
+{
+  if (buffer.capacity() == 0 || buffer.capacity() > MAX_FREE_REASSEMBLY_CAPACITY ||
+      m_freeReassemblyBuffers.size() >= MAX_FREE_REASSEMBLY_BUFFERS)
+    {
+      return;
+    }
+  buffer.clear();
+  m_freeReassemblyBuffers.push_back(std::move(buffer));
+}
+
+bool 
+UdpConvergenceLayer::ReserveReassembly(uint64_t size)
+{
+  if (size > m_reassemblyBudget)
+    {
+      return false;
+    }
+  
+  // 最旧优先淘汰，直到新的重组能放进内存上限
+  while (m_pendingBytes + size > m_reassemblyBudget && !m_pendingOrder.empty())
+    {
+      auto it = m_pendingBundles.find(m_pendingOrder.front());
+      NS_LOG_INFO ("内存不足，淘汰最旧的待接收Bundle: " << it->first.address << ":"
+                   << it->first.port << "/" << it->first.bundleId);
+      m_evictedBundles++;
+      RemovePending(it);
+    }
+  
+  return true;
+}
+
+void 
+UdpConvergenceLayer::DeliverBundle(const uint8_t* data, uint32_t size, const std::string& endpoint)
+{
+  // 先只解码主区块，节点已有的Bundle不再解码其余区块和载荷
+  if (IsKnownBundle(data, size))
+    {
+      NS_LOG_INFO ("丢弃节点已有的Bundle");
+      m_knownBundles++;
+      return;
+    }
+  
+  // 直接从接收数据反序列化Bundle
+  auto bundleOpt = Bundle::FromCbor(data, size);
+  if (!bundleOpt)
+    {
+      NS_LOG_ERROR ("无法反序列化Bundle");
+      return;
+    }
+  
+  // 移出解码结果创建Bundle对象，不复制主区块与区块列表
+  Ptr<Bundle> bundle = Create<Bundle>(std::move(*bundleOpt));
+  
+  m_receivedBundles++;
+  m_receivedTrace(bundle, endpoint);
+  
+  // UDP没有会话握手，由上一跳区块得知对端的节点ID
+  Ptr<PreviousNodeBlock> previousNode =
+    DynamicCast<PreviousNodeBlock>(bundle->GetBlockByType(BlockType::PREVIOUS_NODE_BLOCK));
+  if (previousNode)
+    {
+      SetPeerNodeId(endpoint, previousNode->GetPreviousNode().ToString());
+    }
+  
+  // 通知Bundle回调
+  if (!m_bundleCallback.IsNull())
+    {
+      // 使用主要区块中的源节点EID
+      NodeID source = bundle->GetPrimaryBlock().GetSourceNodeEID();
+      m_bundleCallback(bundle, source);
+    }
+}
+
 void 
 UdpConvergenceLayer::HandleFragment(const uint8_t* data, uint32_t size, const Address& from)
 {
@@ -573,175 +1156,160 @@ UdpConvergenceLayer::HandleFragment(const uint8_t* data, uint32_t size, const Ad
   std::string endpoint = FormatEndpoint(address.GetIpv4(), address.GetPort());
   
   // 更新连接状态
-  {
-    std::lock_guard<std::mutex> lock(m_connectionsMutex);
-    auto it = m_connections.find(endpoint);
-    if (it == m_connections.end())
-      {
-        m_connections[endpoint] = Create<UdpConnection>(endpoint);
-      }
-    else
-      {
-        it->second->UpdateLastSeen();
-      }
-  }
+  TouchConnection(endpoint);
   
   // 检查数据类型
   uint8_t type = data[0];
   
-  if (type == 0xBB)
+  if (type == BUNDLE_MARKER)
     {
-      // 完整Bundle
+      // 完整Bundle，跳过标记字节
       NS_LOG_INFO ("收到完整Bundle");
-      
-      // 跳过标记字节
-      const uint8_t* bundleData = data + 1;
-      uint32_t bundleSize = size - 1;
-      
-      // 创建Buffer
-      Buffer buffer;
-      buffer.AddAtStart(bundleSize);
-      buffer.Begin().Write(bundleData, bundleSize);
-      
-      // 反序列化Bundle
-      auto bundleOpt = Bundle::FromCbor(buffer);
-      if (!bundleOpt)
-        {
-          NS_LOG_ERROR ("无法反序列化Bundle");
-          return;
-        }
-      
-      // 创建Bundle对象
-      Ptr<Bundle> bundle = Create<Bundle>(*bundleOpt);
-      
-      m_receivedBundles++;
-      m_receivedTrace(bundle, endpoint);
-      
-      // 通知Bundle回调
-      if (!m_bundleCallback.IsNull())
-        {
-          // 使用主要区块中的源节点EID
-          NodeID source = bundle->GetPrimaryBlock().GetSourceNodeEID();
-          m_bundleCallback(bundle, source);
-        }
+      DeliverBundle(data + 1, size - 1, endpoint);
     }
-  else if (type == 0x1B && size >= 8)
+  else if (type == FRAGMENT_MARKER && size >= FRAGMENT_HEADER_SIZE)
     {
       // 分片Bundle
       // 解析分片头
-      uint32_t bundleId = (data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4];
-      uint16_t fragmentId = (data[5] << 8) | data[6];
-      uint8_t numFragments = data[7];
+      PendingBundleKey key;
+      key.address = address.GetIpv4();
+      key.port = address.GetPort();
+      key.bundleId = GetU32(data + 1);
+      uint16_t fragmentId = GetU16(data + 5);
+      uint16_t numFragments = GetU16(data + 7);
+      uint32_t totalSize = GetU32(data + 9);
+      uint32_t offset = GetU32(data + 13);
       
       // 跳过头部
-      const uint8_t* fragmentData = data + 8;
-      uint32_t fragmentSize = size - 8;
+      const uint8_t* fragmentData = data + FRAGMENT_HEADER_SIZE;
+      uint32_t fragmentSize = size - FRAGMENT_HEADER_SIZE;
+      
+      NS_LOG_INFO ("收到Bundle分片: " << key.bundleId << ", fragmentId=" << fragmentId 
+                   << ", numFragments=" << numFragments);
       
-      NS_LOG_INFO ("收到Bundle分片: " << bundleId << ", fragmentId=" << fragmentId 
-                   << ", numFragments=" << static_cast<uint32_t>(numFragments));
+      if (fragmentId >= numFragments || offset > totalSize || fragmentSize > totalSize - offset)
+        {
+          NS_LOG_ERROR ("无效的分片: id=" << fragmentId << ", offset=" << offset
+                        << ", size=" << fragmentSize << ", total=" << totalSize);
+          return;
+        }
       
       // 查找或创建待接收Bundle
-      std::lock_guard<std::mutex> lock(m_pendingBundlesMutex);
+      std::unique_lock<OptionalMutex> lock(m_pendingBundlesMutex);
       
-      auto it = m_pendingBundles.find(bundleId);
+      auto it = m_pendingBundles.find(key);
       if (it == m_pendingBundles.end())
         {
-          // 创建新的待接收Bundle
-          PendingBundle pending;
-          pending.totalSize = 0; // 暂时未知总大小
-          pending.nextFragmentId = 0;
-          pending.receivedBytes = 0;
-          pending.expiryTime = Simulator::Now() + Seconds(60); // 1分钟超时
+          if (m_completedBundles.count(key))
+            {
+              NS_LOG_DEBUG ("已完成重组的迟到分片: " << fragmentId);
+              return;
+            }
+          if (!ReserveReassembly(totalSize))
+            {
+              NS_LOG_WARN ("Bundle大小 " << totalSize << " 超过重组内存上限，丢弃分片");
+              return;
+            }
           
-          // 预分配分片向量
-          pending.fragments.resize(numFragments);
+          // 按总大小预分配重组缓冲区与位图
+          it = m_pendingBundles.emplace(key, PendingBundle()).first;
+          PendingBundle& pending = it->second;
+          pending.data = AcquireReassemblyBuffer(totalSize);
+          pending.receivedMap.assign((numFragments + 63) / 64, 0);
+          pending.numFragments = numFragments;
+          pending.receivedFragments = 0;
+          pending.fragmentPayload = 0;
+          pending.nacksSent = 0;
+          pending.order = m_pendingOrder.insert(m_pendingOrder.end(), key);
+          m_pendingBytes += totalSize;
           
-          m_pendingBundles[bundleId] = pending;
-          it = m_pendingBundles.find(bundleId);
+          // 一段时间没有新分片时请求缺失的分片
+          pending.nackEvent = Simulator::Schedule(m_nackDelay,
+                                                  &UdpConvergenceLayer::CheckMissingFragments,
+                                                  this,
+                                                  key);
+        }
+      
+      PendingBundle& pending = it->second;
+      if (pending.numFragments != numFragments || pending.data.size() != totalSize)
+        {
+          NS_LOG_ERROR ("分片与已有的重组不一致: " << key.bundleId);
+          return;
         }
       
-      // 检查分片ID是否有效
-      if (fragmentId >= it->second.fragments.size())
+      // 位图按分片ID去重，因此偏移必须由分片ID决定：除末尾分片外大小都相同，
+      // 第i个分片位于i倍分片大小处，末尾分片到总大小为止。收齐所有ID即覆盖全部数据
+      bool last = fragmentId + 1u == numFragments;
+      uint32_t payload = 0;
+      if (!last)
         {
-          NS_LOG_ERROR ("无效的分片ID: " << fragmentId);
+          payload = fragmentSize;
+        }
+      else if (fragmentId > 0 && offset % fragmentId == 0)
+        {
+          payload = offset / fragmentId;
+        }
+      uint32_t expected = pending.fragmentPayload > 0 ? pending.fragmentPayload : payload;
+      bool consistent = (payload == 0 || payload == expected) &&
+                        (last ? offset + fragmentSize == totalSize : fragmentSize > 0) &&
+                        (fragmentId == 0 ? offset == 0 :
+                         expected > 0 && offset == static_cast<uint64_t>(fragmentId) * expected);
+      if (!consistent)
+        {
+          NS_LOG_ERROR ("分片偏移与分片ID不符: id=" << fragmentId << ", offset=" << offset
+                        << ", size=" << fragmentSize);
           return;
         }
+      pending.fragmentPayload = expected;
       
-      // 存储分片
-      Ptr<Packet> fragment = Create<Packet>(fragmentData, fragmentSize);
-      it->second.fragments[fragmentId] = fragment;
-      it->second.receivedBytes += fragmentSize;
+      pending.lastActivity = Simulator::Now();
       
-      // 检查是否收到所有分片
-      bool complete = true;
-      for (uint32_t i = 0; i < it->second.fragments.size(); i++)
+      // 重复的分片直接忽略
+      uint64_t bit = uint64_t(1) << (fragmentId % 64);
+      uint64_t& word = pending.receivedMap[fragmentId / 64];
+      if (word & bit)
         {
-          if (!it->second.fragments[i])
-            {
-              complete = false;
-              break;
-            }
+          NS_LOG_DEBUG ("重复的分片: " << fragmentId);
+          return;
         }
+      word |= bit;
+      pending.receivedFragments++;
+      
+      // 直接写入重组缓冲区
+      std::copy(fragmentData, fragmentData + fragmentSize, pending.data.begin() + offset);
       
-      if (complete)
+      if (pending.receivedFragments == pending.numFragments)
         {
           NS_LOG_INFO ("收到所有分片，重组Bundle");
           
-          // 计算总大小
-          uint32_t totalSize = 0;
-          for (const auto& frag : it->second.fragments)
-            {
-              totalSize += frag->GetSize();
-            }
-          
-          // 重组数据
-          std::vector<uint8_t> bundleData(totalSize);
-          uint32_t offset = 0;
-          
-          for (const auto& frag : it->second.fragments)
-            {
-              uint32_t fragSize = frag->GetSize();
-              uint8_t* buffer = new uint8_t[fragSize];
-              frag->CopyData(buffer, fragSize);
-              
-              std::copy(buffer, buffer + fragSize, bundleData.begin() + offset);
-              offset += fragSize;
-              
-              delete[] buffer;
-            }
-          
-          // 创建Buffer
-          Buffer buffer;
-          buffer.AddAtStart(totalSize);
-          buffer.Begin().Write(bundleData.data(), totalSize);
+          // 取出重组数据后再交付，回调中可能再次进入收敛层
+          Simulator::Cancel(pending.nackEvent);
+          std::vector<uint8_t> bundleData = std::move(pending.data);
+          pending.data.clear();
+          m_pendingBytes -= bundleData.size();
+          m_pendingOrder.erase(pending.order);
+          m_pendingBundles.erase(it);
           
-          // 反序列化Bundle
-          auto bundleOpt = Bundle::FromCbor(buffer);
-          if (!bundleOpt)
+          m_completedBundles.insert(key);
+          m_completedOrder.push(key);
+          if (m_completedOrder.size() > MAX_COMPLETED_BUNDLES)
             {
-              NS_LOG_ERROR ("无法反序列化重组的Bundle");
-              m_pendingBundles.erase(it);
-              return;
+              m_completedBundles.erase(m_completedOrder.front());
+              m_completedOrder.pop();
             }
+          lock.unlock();
           
-          // 创建Bundle对象
-          Ptr<Bundle> bundle = Create<Bundle>(*bundleOpt);
-          
-          m_receivedBundles++;
-          m_receivedTrace(bundle, endpoint);
+          DeliverBundle(bundleData.data(), bundleData.size(), endpoint);
           
-          // 通知Bundle回调
-          if (!m_bundleCallback.IsNull())
-            {
-              // 使用主要区块中的源节点EID
-              NodeID source = bundle->GetPrimaryBlock().GetSourceNodeEID();
-              m_bundleCallback(bundle, source);
-            }
-          
-          // 移除待接收Bundle
-          m_pendingBundles.erase(it);
+          // 解码时已复制出所需数据，缓冲区留给下一次重组
+          lock.lock();
+          ReleaseReassemblyBuffer(std::move(bundleData));
         }
     }
+  else if (type == NACK_MARKER)
+    {
+      HandleNack(data, size, address);
+    }
   else
     {
       NS_LOG_WARN ("未知数据类型: " << static_cast<uint32_t>(type));
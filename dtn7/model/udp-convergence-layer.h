@@ -2,15 +2,22 @@
 #define DTN7_UDP_CONVERGENCE_LAYER_H
 
 #include "convergence-layer.h"
+#include "optional-mutex.h"
 
 #include "ns3/socket.h"
 #include "ns3/ipv4-address.h"
+#include "ns3/inet-socket-address.h"
 #include "ns3/traced-callback.h"
 #include "ns3/node.h"
 #include "ns3/timer.h"
+#include "ns3/buffer.h"
+#include "ns3/data-rate.h"
 
+#include <deque>
 #include <queue>
+#include <list>
 #include <map>
+#include <set>
 #include <mutex>
 
 namespace ns3 {
@@ -49,21 +56,77 @@ public:
   std::string endpoint;  //!< 端点地址
   bool active;           //!< 活跃状态
   Time lastSeen;         //!< 最后活跃时间
+  std::string peerNodeId; //!< 对端节点ID，从收到的Bundle的上一跳区块得知，未知时为空
   std::queue<Ptr<Packet>> pendingPackets; //!< 等待发送的数据包队列
 };
 
 /**
- * \brief 正在传输中的bundle与其分片
+ * \brief 待重组Bundle的键，发送方地址、端口与其本地Bundle ID
+ */
+struct PendingBundleKey
+{
+  Ipv4Address address; //!< 发送方地址
+  uint16_t port;       //!< 发送方端口
+  uint32_t bundleId;   //!< 发送方分配的Bundle ID
+  
+  bool operator< (const PendingBundleKey& other) const
+  {
+    if (address != other.address)
+      {
+        return address < other.address;
+      }
+    if (port != other.port)
+      {
+        return port < other.port;
+      }
+    return bundleId < other.bundleId;
+  }
+};
+
+/**
+ * \brief 正在重组的bundle
+ *
+ * 分片直接写入按总大小预分配的连续缓冲区，位图与计数器记录已收到的分片，
+ * 因此每个分片的处理与完成判断都是O(1)。
  */
 struct PendingBundle
+{
+  std::vector<uint8_t> data;          //!< 预分配的重组缓冲区
+  std::vector<uint64_t> receivedMap;  //!< 已接收分片位图
+  uint32_t numFragments;              //!< 分片总数
+  uint32_t receivedFragments;         //!< 已接收的不同分片数
+  uint32_t fragmentPayload;           //!< 非末尾分片的数据大小，0表示尚未确定
+  Time lastActivity;                  //!< 最后收到分片的时间
+  Time lastNack;                      //!< 最后发送NACK的时间
+  uint32_t nacksSent;                 //!< 已发送的NACK数
+  EventId nackEvent;                  //!< 缺失分片检查事件
+  std::list<PendingBundleKey>::iterator order; //!< 在淘汰顺序中的位置
+};
+
+/**
+ * \brief 等待发送或保留以便按NACK重传的bundle
+ */
+struct OutgoingBundle
 {
   Ptr<Bundle> bundle;         //!< Bundle
-  std::vector<Ptr<Packet>> fragments; //!< 分片
-  uint32_t totalSize;         //!< 总大小
-  uint32_t nextFragmentId;    //!< 下一个分片ID
-  uint32_t receivedBytes;     //!< 已接收字节数
-  Time expiryTime;            //!< 过期时间
-  std::vector<uint8_t> data;  //!< 完整数据
+  Buffer encoded;             //!< 编码后的Bundle
+  std::string endpoint;       //!< 目标端点
+  Ipv4Address destAddress;    //!< 目标地址
+  uint16_t destPort;          //!< 目标端口
+  uint16_t numFragments;      //!< 分片数，0表示整个Bundle在一个数据报中发送
+  uint32_t fragmentPayload;   //!< 每个分片的数据大小
+  uint32_t unsent;            //!< 首轮发送中尚未发出的数据报数
+  EventId releaseEvent;       //!< 释放保留数据的事件
+};
+
+/**
+ * \brief 发送队列中的一个数据报
+ */
+struct QueuedDatagram
+{
+  uint32_t bundleId;          //!< 所属Bundle的本地ID
+  uint16_t fragmentId;        //!< 分片ID
+  bool retransmit;            //!< 是否为按NACK的重传
 };
 
 /**
@@ -106,6 +169,7 @@ public:
   // 从ConvergenceSender继承的方法
   bool Send (Ptr<Bundle> bundle, const std::string& endpoint) override;
   bool IsEndpointReachable (const std::string& endpoint) const override;
+  uint64_t GetMtu (const std::string& endpoint) const override;
   
   // 从ConvergenceLayer继承的方法
   std::string GetStats () const override;
@@ -130,11 +194,36 @@ private:
   Callback<void, Ptr<Bundle>, NodeID> m_bundleCallback; //!< Bundle接收回调
   
   std::map<std::string, Ptr<UdpConnection>> m_connections; //!< 连接映射
-  mutable std::mutex m_connectionsMutex;   //!< 连接映射互斥锁
+  mutable OptionalMutex m_connectionsMutex;   //!< 连接映射互斥锁
   
-  std::map<uint32_t, PendingBundle> m_pendingBundles; //!< 待接收Bundle映射
+  std::map<PendingBundleKey, PendingBundle> m_pendingBundles; //!< 待接收Bundle映射
+  std::list<PendingBundleKey> m_pendingOrder; //!< 待接收Bundle按创建先后排列，最旧的在前
+  std::set<PendingBundleKey> m_completedBundles; //!< 最近完成的重组，用于丢弃迟到的重复分片
+  std::queue<PendingBundleKey> m_completedOrder; //!< 最近完成的重组，按完成先后排列
+  uint64_t m_pendingBytes;                 //!< 重组缓冲区占用的总字节数
+  uint64_t m_reassemblyBudget;             //!< 重组缓冲区的内存上限
+  Time m_reassemblyTimeout;                //!< 无新分片时放弃重组的时间
+  uint32_t m_evictedBundles;               //!< 因内存上限或超时放弃的重组数
   uint32_t m_nextBundleId;                 //!< 下一个Bundle ID
-  mutable std::mutex m_pendingBundlesMutex; //!< 待接收Bundle映射互斥锁
+  mutable OptionalMutex m_pendingBundlesMutex; //!< 待接收Bundle映射互斥锁
+  std::vector<uint8_t> m_receiveBuffer;    //!< 复用的接收缓冲区
+  std::vector<std::vector<uint8_t>> m_freeReassemblyBuffers; //!< 回收的重组缓冲区，受m_pendingBundlesMutex保护
+  
+  std::map<uint32_t, OutgoingBundle> m_outgoing; //!< 正在发送或保留待重传的Bundle
+  std::deque<QueuedDatagram> m_sendQueue;  //!< 等待令牌桶放行的数据报
+  mutable OptionalMutex m_sendMutex;       //!< 发送队列互斥锁
+  mutable std::vector<uint8_t> m_sendBuffer; //!< 复用的数据报组装缓冲区，受m_sendMutex保护
+  DataRate m_maxSendRate;                  //!< 令牌桶速率，0表示不限速
+  uint32_t m_maxBurstSize;                 //!< 令牌桶容量（字节）
+  double m_tokens;                         //!< 当前可用令牌（字节）
+  Time m_lastRefill;                       //!< 上次补充令牌的时间
+  EventId m_sendEvent;                     //!< 下一次发送事件
+  Time m_nackDelay;                        //!< 无新分片多久后请求重传缺失分片
+  uint32_t m_maxNacks;                     //!< 每个Bundle最多发送的NACK数
+  Time m_retransmitHold;                   //!< 发送完成后保留数据以便重传的时间
+  uint64_t m_bundleMtu;                    //!< 向节点通告的MTU，0表示不限制
+  uint32_t m_sentNacks;                    //!< 已发送的NACK数
+  uint32_t m_retransmittedFragments;       //!< 按NACK重传的分片数
   
   Time m_cleanupInterval;                  //!< 清理间隔
   EventId m_cleanupEvent;                  //!< 清理事件
@@ -142,6 +231,7 @@ private:
   uint32_t m_sentBundles;                  //!< 已发送Bundle数
   uint32_t m_receivedBundles;              //!< 已接收Bundle数
   uint32_t m_failedSends;                  //!< 发送失败数
+  uint32_t m_knownBundles;                 //!< 节点已有而未解码即丢弃的Bundle数
   
   TracedCallback<Ptr<Bundle>, std::string> m_sentTrace; //!< 发送跟踪
   TracedCallback<Ptr<Bundle>, std::string> m_receivedTrace; //!< 接收跟踪
@@ -180,15 +270,96 @@ private:
    * \param bundle Bundle对象
    * \param destAddress 目标地址
    * \param destPort 目标端口
-   * \return 发送成功返回true
+   * \return 成功加入发送队列返回true
    */
   bool SendBundle(Ptr<Bundle> bundle, Ipv4Address destAddress, uint16_t destPort);
   
+  /**
+   * \brief 按令牌桶速率发送队列中的数据报
+   */
+  void SendPending();
+  
+  /**
+   * \brief 构造发送队列中的一个数据报，调用者持有m_sendMutex
+   * \param bundleId 本地Bundle ID
+   * \param outgoing 所属的Bundle
+   * \param fragmentId 分片ID
+   * \return 数据报
+   */
+  Ptr<Packet> BuildDatagram(uint32_t bundleId, const OutgoingBundle& outgoing, uint16_t fragmentId) const;
+  
+  /**
+   * \brief 释放为重传保留的Bundle
+   * \param bundleId 本地Bundle ID
+   */
+  void ReleaseOutgoing(uint32_t bundleId);
+  
+  /**
+   * \brief 处理对端的NACK，重传其中列出的分片
+   * \param data 数据
+   * \param size 数据大小
+   * \param address 对端地址
+   */
+  void HandleNack(const uint8_t* data, uint32_t size, const InetSocketAddress& address);
+  
+  /**
+   * \brief 在一段时间没有新分片后，向发送方请求缺失的分片
+   * \param key 待接收Bundle
+   */
+  void CheckMissingFragments(PendingBundleKey key);
+  
+  /**
+   * \brief 记录与端点的通信，新端点时上报连接建立
+   * \param endpoint 端点
+   */
+  void TouchConnection(const std::string& endpoint);
+  
+  /**
+   * \brief 记录端点对应的节点ID，ID变化时重新上报连接建立
+   * \param endpoint 端点
+   * \param nodeId 对端节点ID
+   */
+  void SetPeerNodeId(const std::string& endpoint, const std::string& nodeId);
+  
   /**
    * \brief 清理过期的连接和Bundle
    */
   void CleanupExpired();
   
+  /**
+   * \brief 移除一个待接收Bundle并释放其内存
+   * \param it 待接收Bundle
+   */
+  void RemovePending(std::map<PendingBundleKey, PendingBundle>::iterator it);
+  
+  /**
+   * \brief 按最旧优先淘汰待接收Bundle，直到能容纳新的重组
+   * \param size 新重组需要的字节数
+   * \return 能在内存上限内容纳时返回true
+   */
+  bool ReserveReassembly(uint64_t size);
+  
+  /**
+   * \brief 取一个重组缓冲区，优先复用回收的缓冲区，调用者持有m_pendingBundlesMutex
+   * \param size 缓冲区大小
+   * \return 大小为size的缓冲区
+   */
+  std::vector<uint8_t> AcquireReassemblyBuffer(size_t size);
+  
+  /**
+   * \brief 回收一个重组缓冲区，调用者持有m_pendingBundlesMutex
+   * \param buffer 不再使用的缓冲区
+   */
+  void ReleaseReassemblyBuffer(std::vector<uint8_t>&& buffer);
+  
+  /**
+   * \brief 交付一个完整接收的Bundle
+   * \param data 编码后的Bundle
+   * \param size 数据大小
+   * \param endpoint 来源端点
+   */
+  void DeliverBundle(const uint8_t* data, uint32_t size, const std::string& endpoint);
+  
   /**
    * \brief 处理接收到的分片
    * \param data 数据
@@ -11,6 +11,7 @@
 #include "ns3/wifi-module.h"
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "ns3/spatial-grid-index.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -22,6 +23,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <set>  // Use set instead of unordered_set for Address
+#include <optional>
 #include <cmath>  // 确保包含cmath以使用数学函数
 
 using namespace ns3;
@@ -37,6 +39,8 @@ uint32_t packetSize = 1024;   // 数据包大小(字节)
 bool enableDetailedLogging = true; // 启用详细日志记录，方便调试
 double communicationRange = 250.0; // 通信范围(m) - 新增参数，影响物理距离判断
 double routingUpdateInterval = 2.0; // 路由更新间隔(秒) - 新增参数，随移动速度调整
+bool enableAnimation = true; // 输出NetAnim动画, 参数扫描时关闭
+std::string resultFileName = ""; // 结果文件名, 为空时按移动速度命名
 
 // NDN兴趣包类型
 enum NdnPacketType {
@@ -351,6 +355,127 @@ struct FibEntry {
   FibEntry(std::string p) : prefix(p), lastUpdateTime(Seconds(0)) {}
 };
 
+// 新增: 名称组件前缀树 - 按"/"拆分名称, 逐个组件向下索引
+// 查找代价只与名称长度有关, 与表中条目数量无关
+template <typename T>
+class NameTrie
+{
+public:
+  // 拆分名称组件, 忽略空组件 ("/a//b/" -> {"a", "b"})
+  static std::vector<std::string> Split(const std::string &name)
+  {
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start < name.size())
+      {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos)
+          end = name.size();
+        if (end > start)
+          components.push_back(name.substr(start, end - start));
+        start = end + 1;
+      }
+    return components;
+  }
+  
+  // 精确查找名称对应的节点数据, 不存在时返回nullptr
+  T *Find(const std::string &name)
+  {
+    Node *node = &m_root;
+    for (const auto &component : Split(name))
+      {
+        auto it = node->children.find(component);
+        if (it == node->children.end())
+          return nullptr;
+        node = it->second.get();
+      }
+    return &node->data;
+  }
+  
+  // 获取从根到名称路径上每个节点的数据, 缺少的节点自动创建
+  std::vector<T *> GetPath(const std::string &name)
+  {
+    std::vector<T *> path;
+    Node *node = &m_root;
+    path.push_back(&node->data);
+    for (const auto &component : Split(name))
+      {
+        std::unique_ptr<Node> &child = node->children[component];
+        if (!child)
+          child = std::make_unique<Node>();
+        node = child.get();
+        path.push_back(&node->data);
+      }
+    return path;
+  }
+  
+  // 最长前缀匹配: 沿名称向下, 返回最深的满足match的节点数据
+  template <typename Match>
+  T *FindLongest(const std::string &name, Match match)
+  {
+    Node *node = &m_root;
+    T *best = match(node->data) ? &node->data : nullptr;
+    for (const auto &component : Split(name))
+      {
+        auto it = node->children.find(component);
+        if (it == node->children.end())
+          break;
+        node = it->second.get();
+        if (match(node->data))
+          best = &node->data;
+      }
+    return best;
+  }
+  
+  // 遍历名称本身及其下所有名称的节点数据
+  template <typename Visit>
+  void ForEach(const std::string &prefix, Visit visit)
+  {
+    Node *start = &m_root;
+    for (const auto &component : Split(prefix))
+      {
+        auto it = start->children.find(component);
+        if (it == start->children.end())
+          return;
+        start = it->second.get();
+      }
+    
+    std::vector<Node *> stack(1, start);
+    while (!stack.empty())
+      {
+        Node *node = stack.back();
+        stack.pop_back();
+        visit(node->data);
+        for (auto &child : node->children)
+          stack.push_back(child.second.get());
+      }
+  }
+
+private:
+  struct Node
+  {
+    T data;
+    std::unordered_map<std::string, std::unique_ptr<Node>> children;
+  };
+  
+  Node m_root;
+};
+
+// 新增: PIT名称索引的节点数据
+struct PitTrieData {
+  // 该名称下的PIT条目序号, 按插入顺序
+  std::vector<uint64_t> entries;
+  
+  // 该名称及其下所有名称的订阅者 <订阅者ID, PIT条目数>
+  std::unordered_map<uint32_t, uint32_t> subscribers;
+};
+
+// 新增: 订阅者路径索引项
+struct SubscriberPath {
+  size_t fibIndex;          // 记录该路径的FIB条目下标, 多个条目记录时取最早创建的
+  InetSocketAddress path;   // 到订阅者的下一跳
+};
+
 // 内容存储条目
 struct ContentStoreEntry {
   std::string contentName;
@@ -509,6 +634,15 @@ private:
   // 周期性清理过期PIT条目
   void CleanupExpiredPitEntries ();
   
+  // 新增: 插入PIT条目, 同时维护名称索引和过期队列
+  void InsertPitEntry(const PitEntry &entry);
+  
+  // 新增: 删除PIT条目, 同时维护名称索引
+  void ErasePitEntry(uint64_t serial);
+  
+  // 新增: 查找相同内容、Nonce和订阅者ID的PIT条目, 返回序号, 0表示不存在
+  uint64_t FindPitEntry(const std::string &contentName, uint32_t nonce, uint32_t subscriberId);
+  
   // 订阅者定期发送内容请求
   void ScheduleNextRequest ();
   
@@ -521,6 +655,12 @@ private:
   // 新增: 从NodeId获取IP地址
   Ipv4Address GetIpv4FromNodeId(uint32_t nodeId);
   
+  // 新增: 从IP地址获取NodeId (查表, 未命中时重建映射)
+  static bool GetNodeIdFromIpv4(Ipv4Address addr, uint32_t &nodeId);
+  
+  // 新增: 获取通信范围内的节点 (基于空间网格索引, 包含自身, 按ID升序)
+  std::vector<uint32_t> GetNodesInRange(double range);
+  
   // 新增: 获取节点当前位置
   Vector GetCurrentPosition();
   
@@ -572,12 +712,29 @@ private:
   // UDP socket
   Ptr<Socket> m_socket;
   
-  // PIT表
-  std::vector<PitEntry> m_pitTable;
+  // PIT表 <条目序号, 条目>, 序号按插入顺序递增
+  std::map<uint64_t, PitEntry> m_pitTable;
+  
+  // 新增: PIT名称索引
+  NameTrie<PitTrieData> m_pitIndex;
+  
+  // 新增: PIT过期队列 <过期时间, 条目序号>, 按过期时间升序
+  // 条目续期或删除后, 旧记录在出队时丢弃
+  std::priority_queue<std::pair<Time, uint64_t>, std::vector<std::pair<Time, uint64_t>>,
+                      std::greater<std::pair<Time, uint64_t>>> m_pitExpiry;
+  
+  // 新增: 下一个PIT条目序号
+  uint64_t m_nextPitSerial;
   
   // FIB表
   std::vector<FibEntry> m_fibTable;
   
+  // 新增: FIB名称索引 <名称, m_fibTable下标>
+  NameTrie<std::optional<size_t>> m_fibIndex;
+  
+  // 新增: 订阅者路径索引 <订阅者ID, 路径>
+  std::unordered_map<uint32_t, SubscriberPath> m_subscriberPaths;
+  
   // 内容存储
   std::vector<ContentStoreEntry> m_contentStore;
   
@@ -609,6 +766,12 @@ private:
   // 新增: 节点位置信息缓存 <节点ID, 位置信息>
   static std::map<uint32_t, NodeLocationInfo> s_nodeLocations;
   
+  // 新增: 节点位置的均匀网格索引 (网格边长为通信范围), 随位置更新刷新
+  static Ptr<dtn7::SpatialGridIndex> s_spatialIndex;
+  
+  // 新增: IP地址到节点ID的映射 <IP地址, 节点ID>
+  static std::unordered_map<uint32_t, uint32_t> s_addressToNode;
+  
   // 新增: 上次位置更新时保存的位置
   Vector m_lastPosition;
   
@@ -618,6 +781,8 @@ private:
 
 // 初始化静态成员
 std::map<uint32_t, NodeLocationInfo> NdnApp::s_nodeLocations;
+Ptr<dtn7::SpatialGridIndex> NdnApp::s_spatialIndex;
+std::unordered_map<uint32_t, uint32_t> NdnApp::s_addressToNode;
 uint32_t NdnApp::s_outOfRangeFailures = 0;
 
 // 静态成员初始化 - 总体统计
@@ -654,6 +819,7 @@ NdnApp::NdnApp ()
     m_lastBroadcastTime (Seconds(0)),
     m_notificationType (UNICAST_NOTIFICATION),
     m_socket (nullptr),
+    m_nextPitSerial (1),
     m_knownPublisherId (0),  // 初始化发布者ID为0
     m_lastPosition (Vector(0,0,0)),
     m_positionUpdateCount (0)
@@ -919,39 +1085,27 @@ NdnApp::SendInterest (std::string contentName)
           for (auto &hop : nextHops)
             {
               // 从IP地址查找节点ID
-              for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+              if (uint32_t i = 0; GetNodeIdFromIpv4(hop.GetIpv4(), i))
                 {
-                  Ptr<Node> node = NodeList::GetNode(i);
-                  if (node)
+                  // 找到节点ID，检查是否在通信范围内和稳定性
+                  if (IsInCommunicationRange(i))
                     {
-                      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                      if (ipv4 && ipv4->GetNInterfaces() > 1)
+                      // 高速移动环境下，考虑节点稳定性
+                      double stability = CalculateNodeStability(i);
+                      if (stability > 0.3 || nodeMobility < 5.0) // 低稳定性节点在高速移动时被忽略
                         {
-                          Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                          if (addr == hop.GetIpv4())
-                            {
-                              // 找到节点ID，检查是否在通信范围内和稳定性
-                              if (IsInCommunicationRange(i))
-                                {
-                                  // 高速移动环境下，考虑节点稳定性
-                                  double stability = CalculateNodeStability(i);
-                                  if (stability > 0.3 || nodeMobility < 5.0) // 低稳定性节点在高速移动时被忽略
-                                    {
-                                      // 找到可达的下一跳
-                                      dest = hop;
-                                      foundValidHop = true;
-                                      if (enableDetailedLogging)
-                                        NS_LOG_INFO ("使用FIB下一跳路由: " << contentName << " -> " << dest.GetIpv4() << ", 稳定性=" << stability);
-                                      else
-                                        NS_LOG_INFO ("Using FIB next hop for " << contentName);
-                                      break;
-                                    }
-                                  else
-                                    {
-                                      NS_LOG_INFO("下一跳节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
-                                    }
-                                }
-                            }
+                          // 找到可达的下一跳
+                          dest = hop;
+                          foundValidHop = true;
+                          if (enableDetailedLogging)
+                            NS_LOG_INFO ("使用FIB下一跳路由: " << contentName << " -> " << dest.GetIpv4() << ", 稳定性=" << stability);
+                          else
+                            NS_LOG_INFO ("Using FIB next hop for " << contentName);
+                          break;
+                        }
+                      else
+                        {
+                          NS_LOG_INFO("下一跳节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
                         }
                     }
                 }
@@ -1061,43 +1215,30 @@ NdnApp::SendData (std::string contentName, InetSocketAddress destination, uint32
   uint32_t targetNodeId = 0;
   
   // 从destination IP获取节点ID
-  for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+  if (uint32_t i = 0; GetNodeIdFromIpv4(destination.GetIpv4(), i))
     {
-      Ptr<Node> node = NodeList::GetNode(i);
-      if (node)
+      targetNodeId = i;
+      
+      // 考虑节点的未来位置
+      double predictionTime = 0.5; // 预测半秒后的位置
+      if (nodeMobility > 5.0)
         {
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-          if (ipv4 && ipv4->GetNInterfaces() > 1)
+          Vector futurePosition = PredictFuturePosition(i, predictionTime);
+          Vector myFuturePosition = PredictFuturePosition(GetNode()->GetId(), predictionTime);
+          
+          double futureDistance = CalculateDistance(myFuturePosition, futurePosition);
+          inRange = futureDistance <= communicationRange * 0.9; // 预留10%安全边界
+          
+          if (!inRange)
             {
-              Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-              if (addr == destination.GetIpv4())
-                {
-                  targetNodeId = i;
-                  
-                  // 考虑节点的未来位置
-                  double predictionTime = 0.5; // 预测半秒后的位置
-                  if (nodeMobility > 5.0)
-                    {
-                      Vector futurePosition = PredictFuturePosition(i, predictionTime);
-                      Vector myFuturePosition = PredictFuturePosition(GetNode()->GetId(), predictionTime);
-                      
-                      double futureDistance = CalculateDistance(myFuturePosition, futurePosition);
-                      inRange = futureDistance <= communicationRange * 0.9; // 预留10%安全边界
-                      
-                      if (!inRange)
-                        {
-                          NS_LOG_INFO("预测目标节点 " << targetNodeId << " 即将离开通信范围, 距离=" << futureDistance);
-                        }
-                    }
-                  else
-                    {
-                      // 低速移动时使用当前位置判断
-                      inRange = IsInCommunicationRange(i);
-                    }
-                  break;
-                }
+              NS_LOG_INFO("预测目标节点 " << targetNodeId << " 即将离开通信范围, 距离=" << futureDistance);
             }
         }
+      else
+        {
+          // 低速移动时使用当前位置判断
+          inRange = IsInCommunicationRange(i);
+        }
     }
   
   // 如果目标是广播地址，则向所有在通信范围内的节点发送
@@ -1137,40 +1278,27 @@ NdnApp::SendData (std::string contentName, InetSocketAddress destination, uint32
         {
           // 同样需要检查这个最佳路径是否在通信范围内
           bool bestPathInRange = false;
-          for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+          if (uint32_t i = 0; GetNodeIdFromIpv4(bestPath.GetIpv4(), i))
             {
-              Ptr<Node> node = NodeList::GetNode(i);
-              if (node)
+              // 考虑高速移动场景
+              if (nodeMobility > 5.0)
                 {
-                  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                  if (ipv4 && ipv4->GetNInterfaces() > 1)
+                  // 检查节点稳定性
+                  double stability = CalculateNodeStability(i);
+                  if (stability > 0.4) // 要求更高的稳定性
                     {
-                      Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                      if (addr == bestPath.GetIpv4())
-                        {
-                          // 考虑高速移动场景
-                          if (nodeMobility > 5.0)
-                            {
-                              // 检查节点稳定性
-                              double stability = CalculateNodeStability(i);
-                              if (stability > 0.4) // 要求更高的稳定性
-                                {
-                                  bestPathInRange = IsInCommunicationRange(i);
-                                }
-                              else
-                                {
-                                  NS_LOG_INFO("最佳路径节点 " << i << " 稳定性太低 (" << stability << "), 不使用");
-                                  bestPathInRange = false;
-                                }
-                            }
-                          else
-                            {
-                              bestPathInRange = IsInCommunicationRange(i);
-                            }
-                          break;
-                        }
+                      bestPathInRange = IsInCommunicationRange(i);
+                    }
+                  else
+                    {
+                      NS_LOG_INFO("最佳路径节点 " << i << " 稳定性太低 (" << stability << "), 不使用");
+                      bestPathInRange = false;
                     }
                 }
+              else
+                {
+                  bestPathInRange = IsInCommunicationRange(i);
+                }
             }
           
           if (bestPathInRange)
@@ -1185,7 +1313,7 @@ NdnApp::SendData (std::string contentName, InetSocketAddress destination, uint32
   if (destination.GetIpv4() == Ipv4Address("255.255.255.255"))
     {
       // 向所有在通信范围内的节点发送
-      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+      for (uint32_t i : GetNodesInRange(communicationRange))
         {
           if (i != GetNode()->GetId() && IsInCommunicationRange(i))
             {
@@ -1230,15 +1358,11 @@ NdnApp::SendData (std::string contentName, InetSocketAddress destination, uint32
 InetSocketAddress
 NdnApp::GetBestPathToSubscriber(uint32_t subscriberId)
 {
-  // 遍历FIB表寻找该订阅者的最佳路径
-  for (auto &entry : m_fibTable)
+  // 在订阅者路径索引中查找
+  auto it = m_subscriberPaths.find(subscriberId);
+  if (it != m_subscriberPaths.end())
     {
-      // 在订阅者路径映射中查找
-      auto it = entry.subscriberPaths.find(subscriberId);
-      if (it != entry.subscriberPaths.end())
-        {
-          return it->second; // 返回找到的路径
-        }
+      return it->second.path; // 返回找到的路径
     }
   
   // 未找到路径，返回默认值（使用显式构造函数）
@@ -1332,31 +1456,18 @@ NdnApp::SendUnicastNotification (uint32_t newBrokerId)
       bool publisherInRange = false;
       uint32_t publisherId = 0;
       
-      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+      if (uint32_t i = 0; GetNodeIdFromIpv4(publisherDest.GetIpv4(), i))
         {
-          Ptr<Node> node = NodeList::GetNode(i);
-          if (node)
+          publisherId = i;
+          publisherInRange = IsInCommunicationRange(i);
+          
+          // 高速场景检查稳定性
+          if (publisherInRange && nodeMobility > 5.0)
             {
-              Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-              if (ipv4 && ipv4->GetNInterfaces() > 1)
-                {
-                  Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                  if (addr == publisherDest.GetIpv4())
-                    {
-                      publisherId = i;
-                      publisherInRange = IsInCommunicationRange(i);
-                      
-                      // 高速场景检查稳定性
-                      if (publisherInRange && nodeMobility > 5.0)
-                        {
-                          double stability = CalculateNodeStability(i);
-                          publisherInRange = stability > 0.3;
-                          NS_LOG_INFO("发布者稳定性检查: ID=" << i << ", 稳定性=" << stability << 
-                                     ", 结果=" << (publisherInRange ? "可用" : "不可用"));
-                        }
-                      break;
-                    }
-                }
+              double stability = CalculateNodeStability(i);
+              publisherInRange = stability > 0.3;
+              NS_LOG_INFO("发布者稳定性检查: ID=" << i << ", 稳定性=" << stability << 
+                         ", 结果=" << (publisherInRange ? "可用" : "不可用"));
             }
         }
       
@@ -1374,9 +1485,9 @@ NdnApp::SendUnicastNotification (uint32_t newBrokerId)
     {
       // 找不到发布者，尝试找到任何对该内容感兴趣的发布者
       bool foundPublisher = false;
-      for (uint32_t i = 0; i < numNodes; ++i)
+      for (uint32_t i : GetNodesInRange(communicationRange))
         {
-          if (i != GetNode()->GetId() && i < NodeList::GetNNodes())
+          if (i != GetNode()->GetId() && i < numNodes)
             {
               Ptr<Node> node = NodeList::GetNode(i);
               if (node && node->GetNApplications() > 0)
@@ -1428,9 +1539,9 @@ NdnApp::SendUnicastNotification (uint32_t newBrokerId)
   
   // 向订阅者也发送单播通知
   bool foundSubscriber = false;
-  for (uint32_t i = 0; i < numNodes; ++i)
+  for (uint32_t i : GetNodesInRange(communicationRange))
     {
-      if (i != GetNode()->GetId() && i < NodeList::GetNNodes())
+      if (i != GetNode()->GetId() && i < numNodes)
         {
           Ptr<Node> node = NodeList::GetNode(i);
           if (node && node->GetNApplications() > 0)
@@ -1521,58 +1632,50 @@ NdnApp::SendInterestBasedNotification (uint32_t newBrokerId)
   // 记录每个订阅者ID对应的源地址 - 使用insert_or_assign而不是operator[]
   std::map<uint32_t, InetSocketAddress> subscriberSourceMap;
   
-  for (auto &pitEntry : m_pitTable)
+  // 通过名称索引取出对相关内容感兴趣的PIT条目, 按插入顺序处理
+  std::vector<uint64_t> pitSerials;
+  m_pitIndex.ForEach(m_contentPrefix, [&pitSerials] (PitTrieData &data) {
+    pitSerials.insert(pitSerials.end(), data.entries.begin(), data.entries.end());
+  });
+  std::sort(pitSerials.begin(), pitSerials.end());
+  
+  for (uint64_t serial : pitSerials)
     {
-      // 检查是否对相关内容感兴趣
-      if (pitEntry.contentName.find(m_contentPrefix) == 0)
+      PitEntry &pitEntry = m_pitTable.at(serial);
+      
+      // 新增: 确认这个PIT条目对应的节点在通信范围内和稳定
+      bool nodeUsable = false;
+      uint32_t nodeId = 0;
+      
+      // 从IP地址查找节点ID
+      if (uint32_t i = 0; GetNodeIdFromIpv4(pitEntry.sourceAddress.GetIpv4(), i))
         {
-          // 新增: 确认这个PIT条目对应的节点在通信范围内和稳定
-          bool nodeUsable = false;
-          uint32_t nodeId = 0;
+          nodeId = i;
+          nodeUsable = IsInCommunicationRange(i);
           
-          // 从IP地址查找节点ID
-          for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+          // 高速场景检查稳定性
+          if (nodeUsable && nodeMobility > 5.0)
             {
-              Ptr<Node> node = NodeList::GetNode(i);
-              if (node)
+              double stability = CalculateNodeStability(i);
+              nodeUsable = stability > 0.3;
+              if (!nodeUsable)
                 {
-                  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                  if (ipv4 && ipv4->GetNInterfaces() > 1)
-                    {
-                      Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                      if (addr == pitEntry.sourceAddress.GetIpv4())
-                        {
-                          nodeId = i;
-                          nodeUsable = IsInCommunicationRange(i);
-                          
-                          // 高速场景检查稳定性
-                          if (nodeUsable && nodeMobility > 5.0)
-                            {
-                              double stability = CalculateNodeStability(i);
-                              nodeUsable = stability > 0.3;
-                              if (!nodeUsable)
-                                {
-                                  NS_LOG_INFO("PIT条目节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
-                                }
-                            }
-                          break;
-                        }
-                    }
+                  NS_LOG_INFO("PIT条目节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
                 }
             }
+        }
+      
+      if (nodeUsable)
+        {
+          interestedNodes.push_back(pitEntry.sourceAddress);
+          subscriberIds.push_back(pitEntry.subscriberId);
           
-          if (nodeUsable)
-            {
-              interestedNodes.push_back(pitEntry.sourceAddress);
-              subscriberIds.push_back(pitEntry.subscriberId);
-              
-              // 记录订阅者路径 - 使用insert_or_assign而不是operator[]
-              subscriberSourceMap.insert_or_assign(pitEntry.subscriberId, pitEntry.sourceAddress);
-            }
-          else
-            {
-              NS_LOG_INFO("PIT条目节点 " << nodeId << " 不在通信范围内或稳定性太低，跳过");
-            }
+          // 记录订阅者路径 - 使用insert_or_assign而不是operator[]
+          subscriberSourceMap.insert_or_assign(pitEntry.subscriberId, pitEntry.sourceAddress);
+        }
+      else
+        {
+          NS_LOG_INFO("PIT条目节点 " << nodeId << " 不在通信范围内或稳定性太低，跳过");
         }
     }
   
@@ -1600,9 +1703,9 @@ NdnApp::SendInterestBasedNotification (uint32_t newBrokerId)
       NS_LOG_INFO ("PIT中没有找到感兴趣的节点或节点不在通信范围内，使用邻近通知代替");
       
       // 遍历所有节点，向距离较近且稳定的节点发送
-      for (uint32_t i = 0; i < numNodes && i < NodeList::GetNNodes(); ++i)
+      for (uint32_t i : GetNodesInRange(communicationRange))
         {
-          if (i != thisNode->GetId() && IsInCommunicationRange(i))
+          if (i != thisNode->GetId() && i < numNodes && IsInCommunicationRange(i))
             {
               Ptr<Node> node = NodeList::GetNode(i);
               if (node == nullptr)
@@ -1682,7 +1785,7 @@ NdnApp::SendBroadcastNotification (uint32_t newBrokerId, bool forceBroadcast)
       m_lastBroadcastTime = Simulator::Now();
       
       // 执行选择性广播 - 只向在通信范围内且相对稳定的节点广播
-      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+      for (uint32_t i : GetNodesInRange(communicationRange))
         {
           if (i != GetNode()->GetId() && IsInCommunicationRange(i))
             {
@@ -1723,35 +1826,16 @@ NdnApp::SendBroadcastNotification (uint32_t newBrokerId, bool forceBroadcast)
 uint32_t 
 NdnApp::EstimateSubscriberCount()
 {
-  // 安全检查
-  if (m_pitTable.empty())
-    {
-      NS_LOG_INFO("PIT表为空，估计订阅者数量为0");
-      return 0;
-    }
-  
-  // 使用std::set存储唯一的订阅者ID
-  std::set<uint32_t> uniqueSubscribers;
-  
-  try
-    {
-      for (auto &pitEntry : m_pitTable)
-        {
-          if (pitEntry.contentName.find(m_contentPrefix) == 0 && pitEntry.subscriberId > 0)
-            {
-              // 使用订阅者ID进行去重
-              uniqueSubscribers.insert(pitEntry.subscriberId);
-            }
-        }
-    }
-  catch (const std::exception& e)
+  // 名称索引的每个节点记录了其下所有PIT条目的订阅者
+  PitTrieData *data = m_pitIndex.Find(m_contentPrefix);
+  if (data == nullptr || data->subscribers.empty())
     {
-      NS_LOG_ERROR("估计订阅者数量时出错: " << e.what());
+      NS_LOG_INFO("PIT表中没有相关条目，估计订阅者数量为0");
       return 0;
     }
   
-  NS_LOG_INFO("估计到 " << uniqueSubscribers.size() << " 个订阅者");
-  return uniqueSubscribers.size();
+  NS_LOG_INFO("估计到 " << data->subscribers.size() << " 个订阅者");
+  return data->subscribers.size();
 }
 
 // 计算两点之间的距离
@@ -2064,31 +2148,18 @@ NdnApp::HandleInterest (Ptr<Packet> packet, Address from, NdnHeader &header)
   if (InetSocketAddress::IsMatchingType(from))
     {
       InetSocketAddress inetFrom = InetSocketAddress::ConvertFrom(from);
-      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+      if (uint32_t i = 0; GetNodeIdFromIpv4(inetFrom.GetIpv4(), i))
         {
-          Ptr<Node> node = NodeList::GetNode(i);
-          if (node)
+          senderId = i;
+          senderInRange = IsInCommunicationRange(i);
+          
+          // 高速移动场景检查稳定性
+          if (senderInRange && nodeMobility > 5.0)
             {
-              Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-              if (ipv4 && ipv4->GetNInterfaces() > 1)
+              double stability = CalculateNodeStability(i);
+              if (stability < 0.3)
                 {
-                  Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                  if (addr == inetFrom.GetIpv4())
-                    {
-                      senderId = i;
-                      senderInRange = IsInCommunicationRange(i);
-                      
-                      // 高速移动场景检查稳定性
-                      if (senderInRange && nodeMobility > 5.0)
-                        {
-                          double stability = CalculateNodeStability(i);
-                          if (stability < 0.3)
-                            {
-                              NS_LOG_INFO("发送方节点 " << i << " 稳定性太低 (" << stability << "), 处理兴趣包但不会回复");
-                            }
-                        }
-                      break;
-                    }
+                  NS_LOG_INFO("发送方节点 " << i << " 稳定性太低 (" << stability << "), 处理兴趣包但不会回复");
                 }
             }
         }
@@ -2189,41 +2260,28 @@ NdnApp::HandleInterest (Ptr<Packet> packet, Address from, NdnHeader &header)
               for (auto &nextHop : nextHops)
                 {
                   // 查找节点ID并检查是否在通信范围内
-                  for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+                  if (uint32_t i = 0; GetNodeIdFromIpv4(nextHop.GetIpv4(), i))
                     {
-                      Ptr<Node> node = NodeList::GetNode(i);
-                      if (node)
+                      bool nodeUsable = IsInCommunicationRange(i);
+                      
+                      // 高速移动场景检查稳定性
+                      if (nodeUsable && nodeMobility > 5.0)
                         {
-                          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                          if (ipv4 && ipv4->GetNInterfaces() > 1)
+                          double stability = CalculateNodeStability(i);
+                          nodeUsable = stability > 0.3;
+                          if (!nodeUsable)
                             {
-                              Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                              if (addr == nextHop.GetIpv4())
-                                {
-                                  bool nodeUsable = IsInCommunicationRange(i);
-                                  
-                                  // 高速移动场景检查稳定性
-                                  if (nodeUsable && nodeMobility > 5.0)
-                                    {
-                                      double stability = CalculateNodeStability(i);
-                                      nodeUsable = stability > 0.3;
-                                      if (!nodeUsable)
-                                        {
-                                          NS_LOG_INFO("下一跳节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
-                                        }
-                                    }
-                                  
-                                  if (nodeUsable)
-                                    {
-                                      m_socket->SendTo (interestPacket->Copy(), 0, nextHop);
-                                      if (enableDetailedLogging)
-                                        NS_LOG_INFO("转发兴趣包: " << contentName << " -> " << nextHop.GetIpv4() << 
-                                                  ", 订阅者ID=" << subscriberId << ", 发布者ID=" << publisherId);
-                                    }
-                                  break;
-                                }
+                              NS_LOG_INFO("下一跳节点 " << i << " 稳定性太低 (" << stability << "), 跳过");
                             }
                         }
+                      
+                      if (nodeUsable)
+                        {
+                          m_socket->SendTo (interestPacket->Copy(), 0, nextHop);
+                          if (enableDetailedLogging)
+                            NS_LOG_INFO("转发兴趣包: " << contentName << " -> " << nextHop.GetIpv4() << 
+                                      ", 订阅者ID=" << subscriberId << ", 发布者ID=" << publisherId);
+                        }
                     }
                 }
             }
@@ -2236,7 +2294,7 @@ NdnApp::HandleInterest (Ptr<Packet> packet, Address from, NdnHeader &header)
               interestPacket->AddHeader (header);
               
               // 向所有在通信范围内的节点发送
-              for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+              for (uint32_t i : GetNodesInRange(communicationRange))
                 {
                   if (i != GetNode()->GetId() && IsInCommunicationRange(i))
                     {
@@ -2294,42 +2352,29 @@ NdnApp::HandleData (Ptr<Packet> packet, Address from, NdnHeader &header)
           uint32_t subId = (i < outSubscriberIds.size()) ? outSubscriberIds[i] : 0;
           
           // 查找节点ID并检查是否在通信范围内
-          for (uint32_t j = 0; j < NodeList::GetNNodes(); j++)
+          if (uint32_t j = 0; GetNodeIdFromIpv4(sources[i].GetIpv4(), j))
             {
-              Ptr<Node> node = NodeList::GetNode(j);
-              if (node)
+              bool nodeUsable = IsInCommunicationRange(j);
+              
+              // 高速移动场景检查稳定性
+              if (nodeUsable && nodeMobility > 5.0)
                 {
-                  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                  if (ipv4 && ipv4->GetNInterfaces() > 1)
+                  double stability = CalculateNodeStability(j);
+                  if (stability < 0.3)
                     {
-                      Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                      if (addr == sources[i].GetIpv4())
-                        {
-                          bool nodeUsable = IsInCommunicationRange(j);
-                          
-                          // 高速移动场景检查稳定性
-                          if (nodeUsable && nodeMobility > 5.0)
-                            {
-                              double stability = CalculateNodeStability(j);
-                              if (stability < 0.3)
-                                {
-                                  NS_LOG_INFO("PIT来源节点 " << j << " 稳定性太低 (" << stability << "), 尝试发送但可能失败");
-                                }
-                            }
-                          
-                          if (nodeUsable)
-                            {
-                              // 传递订阅者ID以便优化路径选择
-                              SendData (contentName, sources[i], subId);
-                            }
-                          else
-                            {
-                              NS_LOG_INFO("PIT来源节点 " << j << " 不在通信范围内，跳过");
-                            }
-                          break;
-                        }
+                      NS_LOG_INFO("PIT来源节点 " << j << " 稳定性太低 (" << stability << "), 尝试发送但可能失败");
                     }
                 }
+              
+              if (nodeUsable)
+                {
+                  // 传递订阅者ID以便优化路径选择
+                  SendData (contentName, sources[i], subId);
+                }
+              else
+                {
+                  NS_LOG_INFO("PIT来源节点 " << j << " 不在通信范围内，跳过");
+                }
             }
         }
     }
@@ -2440,7 +2485,7 @@ NdnApp::HandleBrokerNotification (Ptr<Packet> packet, Address from, NdnHeader &h
                 {
                   NS_LOG_INFO("最近中继节点 " << relayNodeId << " 稳定性太低 (" << stability << "), 寻找替代");
                   // 尝试找到稳定性更高的节点
-                  for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+                  for (uint32_t i : GetNodesInRange(communicationRange))
                     {
                       if (i != GetNode()->GetId() && i != relayNodeId && IsInCommunicationRange(i))
                         {
@@ -2510,39 +2555,26 @@ NdnApp::HandleBrokerNotification (Ptr<Packet> packet, Address from, NdnHeader &h
                   if (InetSocketAddress::ConvertFrom(from).GetIpv4() != nextHop.GetIpv4()) // 避免发回给发送者
                     {
                       // 从IP地址查找节点ID并检查是否在通信范围内
-                      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+                      if (uint32_t i = 0; GetNodeIdFromIpv4(nextHop.GetIpv4(), i))
                         {
-                          Ptr<Node> node = NodeList::GetNode(i);
-                          if (node)
+                          bool nodeUsable = IsInCommunicationRange(i);
+                          
+                          // 高速移动场景检查稳定性
+                          if (nodeUsable && nodeMobility > 5.0)
                             {
-                              Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                              if (ipv4 && ipv4->GetNInterfaces() > 1)
+                              double stability = CalculateNodeStability(i);
+                              nodeUsable = stability > 0.3;
+                              if (!nodeUsable)
                                 {
-                                  Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                                  if (addr == nextHop.GetIpv4())
-                                    {
-                                      bool nodeUsable = IsInCommunicationRange(i);
-                                      
-                                      // 高速移动场景检查稳定性
-                                      if (nodeUsable && nodeMobility > 5.0)
-                                        {
-                                          double stability = CalculateNodeStability(i);
-                                          nodeUsable = stability > 0.3;
-                                          if (!nodeUsable)
-                                            {
-                                              NS_LOG_INFO("邻居节点 " << i << " 稳定性太低 (" << stability << "), 跳过转发");
-                                            }
-                                        }
-                                      
-                                      if (nodeUsable)
-                                        {
-                                          m_socket->SendTo (notificationPacket->Copy(), 0, nextHop);
-                                          NS_LOG_INFO("转发通知到邻居节点 " << i);
-                                        }
-                                      break;
-                                    }
+                                  NS_LOG_INFO("邻居节点 " << i << " 稳定性太低 (" << stability << "), 跳过转发");
                                 }
                             }
+                          
+                          if (nodeUsable)
+                            {
+                              m_socket->SendTo (notificationPacket->Copy(), 0, nextHop);
+                              NS_LOG_INFO("转发通知到邻居节点 " << i);
+                            }
                         }
                     }
                 }
@@ -2714,21 +2746,19 @@ NdnApp::AddToPit (std::string contentName, uint32_t nonce, uint32_t subscriberId
           InetSocketAddress fallbackSource = InetSocketAddress(fallbackAddr, 9);
           
           // 检查是否已存在相同内容和Nonce的条目
-          for (auto &entry : m_pitTable)
+          if (uint64_t serial = FindPitEntry(contentName, nonce, subscriberId))
             {
-              if (entry.contentName == contentName && entry.nonce == nonce && 
-                  entry.subscriberId == subscriberId)
-                {
-                  // 更新过期时间
-                  entry.expiryTime = Simulator::Now() + Seconds (4);
-                  return;
-                }
+              // 更新过期时间
+              PitEntry &entry = m_pitTable.at(serial);
+              entry.expiryTime = Simulator::Now() + Seconds (4);
+              m_pitExpiry.push(std::make_pair(entry.expiryTime, serial));
+              return;
             }
           
           // 使用带参数的构造函数创建新条目，使用备用地址
           PitEntry entry(contentName, nonce, subscriberId, publisherId, 
                          fallbackSource, Simulator::Now() + Seconds(4));
-          m_pitTable.push_back (entry);
+          InsertPitEntry (entry);
           NS_LOG_INFO("使用备用地址添加PIT条目: " << contentName);
         }
       else
@@ -2743,21 +2773,19 @@ NdnApp::AddToPit (std::string contentName, uint32_t nonce, uint32_t subscriberId
   InetSocketAddress inetSource = InetSocketAddress::ConvertFrom(source);
   
   // 检查是否已存在相同内容和Nonce的条目
-  for (auto &entry : m_pitTable)
+  if (uint64_t serial = FindPitEntry(contentName, nonce, subscriberId))
     {
-      if (entry.contentName == contentName && entry.nonce == nonce && 
-          entry.subscriberId == subscriberId)
-        {
-          // 更新过期时间
-          entry.expiryTime = Simulator::Now() + Seconds (4);
-          return;
-        }
+      // 更新过期时间
+      PitEntry &entry = m_pitTable.at(serial);
+      entry.expiryTime = Simulator::Now() + Seconds (4);
+      m_pitExpiry.push(std::make_pair(entry.expiryTime, serial));
+      return;
     }
   
   // 使用带参数的构造函数创建新条目
   PitEntry entry(contentName, nonce, subscriberId, publisherId, 
                  inetSource, Simulator::Now() + Seconds(4));
-  m_pitTable.push_back (entry);
+  InsertPitEntry (entry);
   NS_LOG_INFO("添加PIT条目: " << contentName << " 来源: " << inetSource.GetIpv4() << 
              ", 订阅者ID=" << subscriberId << ", 发布者ID=" << publisherId);
 }
@@ -2768,19 +2796,24 @@ NdnApp::FindAndRemovePitEntry (std::string contentName, std::vector<InetSocketAd
   bool found = false;
   
   // 找到所有匹配contentName的PIT条目
-  for (auto it = m_pitTable.begin(); it != m_pitTable.end(); )
+  PitTrieData *data = m_pitIndex.Find(contentName);
+  if (data == nullptr)
+    {
+      return false;
+    }
+  
+  // 复制序号列表, 删除条目会修改索引
+  std::vector<uint64_t> serials = data->entries;
+  for (uint64_t serial : serials)
     {
-      if (it->contentName == contentName && Simulator::Now() < it->expiryTime)
+      const PitEntry &entry = m_pitTable.at(serial);
+      if (Simulator::Now() < entry.expiryTime)
         {
-          outSources.push_back (it->sourceAddress);
-          outSubscriberIds.push_back (it->subscriberId);
-          it = m_pitTable.erase (it);
+          outSources.push_back (entry.sourceAddress);
+          outSubscriberIds.push_back (entry.subscriberId);
+          ErasePitEntry (serial);
           found = true;
         }
-      else
-        {
-          ++it;
-        }
     }
   
   return found;
@@ -2789,20 +2822,17 @@ NdnApp::FindAndRemovePitEntry (std::string contentName, std::vector<InetSocketAd
 bool
 NdnApp::FindFibEntry (std::string contentName, std::vector<InetSocketAddress> &outNextHops)
 {
-  // 查找最长前缀匹配
-  std::string bestPrefix = "";
-  
-  for (auto &entry : m_fibTable)
+  // 在名称索引中查找最长前缀匹配
+  std::optional<size_t> *index = m_fibIndex.FindLongest(contentName, [] (const std::optional<size_t> &i) {
+    return i.has_value();
+  });
+  if (index == nullptr)
     {
-      // 检查是否是前缀
-      if (contentName.find(entry.prefix) == 0 && entry.prefix.length() > bestPrefix.length())
-        {
-          bestPrefix = entry.prefix;
-          outNextHops = entry.nextHops;
-        }
+      return false;
     }
   
-  return !bestPrefix.empty();
+  outNextHops = m_fibTable[**index].nextHops;
+  return true;
 }
 
 void
@@ -2818,70 +2848,69 @@ NdnApp::UpdateFib (std::string prefix, Address nextHop, uint32_t subscriberId, d
   // 转换为InetSocketAddress
   InetSocketAddress inetNextHop = InetSocketAddress::ConvertFrom(nextHop);
   
-  // 查找已有条目
-  for (auto &entry : m_fibTable)
+  // 在名称索引中查找已有条目
+  std::optional<size_t> *index = m_fibIndex.Find(prefix);
+  if (index != nullptr && index->has_value())
     {
-      if (entry.prefix == prefix)
+      FibEntry &entry = m_fibTable[**index];
+      
+      // 检查是否已存在该nextHop
+      bool found = false;
+      for (auto &hop : entry.nextHops)
         {
-          // 检查是否已存在该nextHop
-          bool found = false;
-          for (auto &hop : entry.nextHops)
+          if (hop.GetIpv4() == inetNextHop.GetIpv4() && hop.GetPort() == inetNextHop.GetPort())
             {
-              if (hop.GetIpv4() == inetNextHop.GetIpv4() && hop.GetPort() == inetNextHop.GetPort())
-                {
-                  found = true;
-                  break;
-                }
+              found = true;
+              break;
             }
+        }
+      
+      if (!found)
+        {
+          // 添加新的nextHop
+          entry.nextHops.push_back (inetNextHop);
+        }
+      
+      // 如果有订阅者ID，更新订阅者路径
+      if (subscriberId > 0)
+        {
+          // 使用insert_or_assign代替operator[]
+          entry.subscriberPaths.insert_or_assign(subscriberId, inetNextHop);
           
-          if (!found)
+          // 更新订阅者路径索引 (保持与按FIB顺序查找相同的结果: 最早创建的条目优先)
+          auto path = m_subscriberPaths.find(subscriberId);
+          if (path == m_subscriberPaths.end())
             {
-              // 添加新的nextHop
-              entry.nextHops.push_back (inetNextHop);
+              m_subscriberPaths.emplace(subscriberId, SubscriberPath {**index, inetNextHop});
             }
-          
-          // 如果有订阅者ID，更新订阅者路径
-          if (subscriberId > 0)
+          else if (path->second.fibIndex >= **index)
             {
-              // 使用insert_or_assign代替operator[]
-              entry.subscriberPaths.insert_or_assign(subscriberId, inetNextHop);
-              NS_LOG_INFO("更新订阅者 " << subscriberId << " 的路径: " << inetNextHop.GetIpv4());
+              path->second = SubscriberPath {**index, inetNextHop};
             }
           
-          // 更新节点距离信息 - 如果提供了距离值
-          if (distance >= 0)
+          NS_LOG_INFO("更新订阅者 " << subscriberId << " 的路径: " << inetNextHop.GetIpv4());
+        }
+      
+      // 更新节点距离信息 - 如果提供了距离值
+      if (distance >= 0)
+        {
+          // 从IP地址查找节点ID
+          if (uint32_t i = 0; GetNodeIdFromIpv4(inetNextHop.GetIpv4(), i))
             {
-              // 从IP地址查找节点ID
-              for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
-                {
-                  Ptr<Node> node = NodeList::GetNode(i);
-                  if (node)
-                    {
-                      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-                      if (ipv4 && ipv4->GetNInterfaces() > 1)
-                        {
-                          Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                          if (addr == inetNextHop.GetIpv4())
-                            {
-                              entry.nodeDistances[i] = distance;
-                              
-                              // 新增: 更新节点稳定性评分
-                              entry.nodeStability[i] = CalculateNodeStability(i);
-                              
-                              NS_LOG_INFO("更新节点 " << i << " 的距离: " << distance 
-                                         << ", 稳定性: " << entry.nodeStability[i]);
-                              break;
-                            }
-                        }
-                    }
-                }
+              entry.nodeDistances[i] = distance;
+              
+              // 新增: 更新节点稳定性评分
+              entry.nodeStability[i] = CalculateNodeStability(i);
+              
+              NS_LOG_INFO("更新节点 " << i << " 的距离: " << distance 
+                         << ", 稳定性: " << entry.nodeStability[i]);
             }
-          
-          // 更新上次更新时间
-          entry.lastUpdateTime = Simulator::Now();
-          
-          return;
         }
+      
+      // 更新上次更新时间
+      entry.lastUpdateTime = Simulator::Now();
+      
+      return;
     }
   
   // 使用带参数的构造函数创建新条目
@@ -2894,6 +2923,9 @@ NdnApp::UpdateFib (std::string prefix, Address nextHop, uint32_t subscriberId, d
     {
       // 使用insert代替operator[]
       entry.subscriberPaths.insert(std::make_pair(subscriberId, inetNextHop));
+      
+      // 新条目排在所有已有条目之后, 只在订阅者尚无路径时记录
+      m_subscriberPaths.emplace(subscriberId, SubscriberPath {m_fibTable.size(), inetNextHop});
       NS_LOG_INFO("记录订阅者 " << subscriberId << " 的路径: " << inetNextHop.GetIpv4());
     }
   
@@ -2901,47 +2933,36 @@ NdnApp::UpdateFib (std::string prefix, Address nextHop, uint32_t subscriberId, d
   if (distance >= 0)
     {
       // 从IP地址查找节点ID
-      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+      if (uint32_t i = 0; GetNodeIdFromIpv4(inetNextHop.GetIpv4(), i))
         {
-          Ptr<Node> node = NodeList::GetNode(i);
-          if (node)
-            {
-              Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
-              if (ipv4 && ipv4->GetNInterfaces() > 1)
-                {
-                  Ipv4Address addr = ipv4->GetAddress(1, 0).GetLocal();
-                  if (addr == inetNextHop.GetIpv4())
-                    {
-                      entry.nodeDistances[i] = distance;
-                      
-                      // 新增: 更新节点稳定性评分
-                      entry.nodeStability[i] = CalculateNodeStability(i);
-                      
-                      NS_LOG_INFO("记录节点 " << i << " 的距离: " << distance 
-                                 << ", 稳定性: " << entry.nodeStability[i]);
-                      break;
-                    }
-                }
-            }
+          entry.nodeDistances[i] = distance;
+          
+          // 新增: 更新节点稳定性评分
+          entry.nodeStability[i] = CalculateNodeStability(i);
+          
+          NS_LOG_INFO("记录节点 " << i << " 的距离: " << distance 
+                     << ", 稳定性: " << entry.nodeStability[i]);
         }
     }
   
+  *m_fibIndex.GetPath(prefix).back() = m_fibTable.size();
   m_fibTable.push_back(entry);
 }
 
 void
 NdnApp::CleanupExpiredPitEntries ()
 {
-  // 移除过期PIT条目
-  for (auto it = m_pitTable.begin(); it != m_pitTable.end(); )
+  // 按过期时间顺序移除过期PIT条目, 只访问已过期的记录
+  while (!m_pitExpiry.empty() && m_pitExpiry.top().first < Simulator::Now())
     {
-      if (Simulator::Now() > it->expiryTime)
-        {
-          it = m_pitTable.erase (it);
-        }
-      else
+      std::pair<Time, uint64_t> expiry = m_pitExpiry.top();
+      m_pitExpiry.pop();
+      
+      // 条目已删除或已续期时, 该记录已失效
+      auto it = m_pitTable.find(expiry.second);
+      if (it != m_pitTable.end() && it->second.expiryTime == expiry.first)
         {
-          ++it;
+          ErasePitEntry (expiry.second);
         }
     }
   
@@ -2949,6 +2970,77 @@ NdnApp::CleanupExpiredPitEntries ()
   m_cleanupEvent = Simulator::Schedule (Seconds (10.0), &NdnApp::CleanupExpiredPitEntries, this);
 }
 
+// 新增: 插入PIT条目
+void
+NdnApp::InsertPitEntry(const PitEntry &entry)
+{
+  uint64_t serial = m_nextPitSerial++;
+  m_pitTable.emplace(serial, entry);
+  m_pitExpiry.push(std::make_pair(entry.expiryTime, serial));
+  
+  // 名称路径上的每个节点都记录该订阅者
+  std::vector<PitTrieData *> path = m_pitIndex.GetPath(entry.contentName);
+  path.back()->entries.push_back(serial);
+  if (entry.subscriberId > 0)
+    {
+      for (PitTrieData *data : path)
+        {
+          data->subscribers[entry.subscriberId]++;
+        }
+    }
+}
+
+// 新增: 删除PIT条目
+void
+NdnApp::ErasePitEntry(uint64_t serial)
+{
+  auto it = m_pitTable.find(serial);
+  if (it == m_pitTable.end())
+    {
+      return;
+    }
+  
+  std::vector<PitTrieData *> path = m_pitIndex.GetPath(it->second.contentName);
+  std::vector<uint64_t> &entries = path.back()->entries;
+  entries.erase(std::remove(entries.begin(), entries.end(), serial), entries.end());
+  
+  uint32_t subscriberId = it->second.subscriberId;
+  if (subscriberId > 0)
+    {
+      for (PitTrieData *data : path)
+        {
+          auto count = data->subscribers.find(subscriberId);
+          if (count != data->subscribers.end() && --count->second == 0)
+            {
+              data->subscribers.erase(count);
+            }
+        }
+    }
+  
+  m_pitTable.erase(it);
+}
+
+// 新增: 查找相同内容、Nonce和订阅者ID的PIT条目
+uint64_t
+NdnApp::FindPitEntry(const std::string &contentName, uint32_t nonce, uint32_t subscriberId)
+{
+  PitTrieData *data = m_pitIndex.Find(contentName);
+  if (data == nullptr)
+    {
+      return 0;
+    }
+  
+  for (uint64_t serial : data->entries)
+    {
+      const PitEntry &entry = m_pitTable.at(serial);
+      if (entry.nonce == nonce && entry.subscriberId == subscriberId)
+        {
+          return serial;
+        }
+    }
+  return 0;
+}
+
 // 新增: 更新节点位置信息
 void
 NdnApp::UpdateNodeLocation()
@@ -3000,6 +3092,13 @@ NdnApp::UpdateNodeLocation()
           // 更新到全局位置信息缓存
           s_nodeLocations[nodeId] = locationInfo;
           
+          // 同步刷新空间网格索引
+          if (!s_spatialIndex)
+            {
+              s_spatialIndex = Create<dtn7::SpatialGridIndex> (communicationRange);
+            }
+          s_spatialIndex->Update(nodeId, position);
+          
           // 更新上次位置和计数器
           m_lastPosition = position;
           m_positionUpdateCount++;
@@ -3025,8 +3124,8 @@ NdnApp::UpdateRoutingTopology()
   // 更新路由表中的节点距离信息
   Vector myPosition = GetCurrentPosition();
   
-  // 更新到所有已知节点的距离
-  for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+  // 更新到所有已知节点的距离 (可靠性只在1.2倍通信范围内为正)
+  for (uint32_t i : GetNodesInRange(communicationRange * 1.2))
     {
       if (i != GetNode()->GetId())
         {
@@ -3116,41 +3215,42 @@ NdnApp::UpdateRoutingTopology()
 uint32_t
 NdnApp::GetNearestNodeId(Vector position, std::vector<uint32_t> excludeIds)
 {
-  double minDistance = std::numeric_limits<double>::max();
   uint32_t nearestId = GetNode()->GetId(); // 默认为自己
+  if (!s_spatialIndex)
+    {
+      return nearestId;
+    }
+  
+  // 按网格由近及远搜索; 加权距离不小于实际距离, 因此可以提前结束
+  std::optional<uint32_t> nearest = s_spatialIndex->GetNearest(position,
+      [&] (uint32_t i, double distance) {
+        // 排除指定节点
+        if (std::find(excludeIds.begin(), excludeIds.end(), i) != excludeIds.end())
+          return std::numeric_limits<double>::infinity();
+        
+        auto it = s_nodeLocations.find(i);
+        if (it == s_nodeLocations.end())
+          return std::numeric_limits<double>::infinity();
+        
+        // 考虑速度因素 - 速度越高的节点距离权重越大
+        double speedWeight = 1.0 + (it->second.speed / 10.0);
+        double weightedDistance = distance * speedWeight;
+        
+        // 如果节点移动速度很高，增加距离权重
+        if (nodeMobility > 5.0)
+          {
+            // 计算稳定性
+            double stability = CalculateNodeStability(i);
+            // 稳定性低的节点距离权重增加
+            weightedDistance /= std::max(0.2, stability);
+          }
+        
+        return weightedDistance;
+      });
   
-  for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+  if (nearest)
     {
-      // 排除指定节点
-      if (std::find(excludeIds.begin(), excludeIds.end(), i) != excludeIds.end())
-        continue;
-      
-      // 获取节点位置
-      auto it = s_nodeLocations.find(i);
-      if (it != s_nodeLocations.end())
-        {
-          Vector nodePosition = it->second.position;
-          double distance = CalculateDistance(position, nodePosition);
-          
-          // 考虑速度因素 - 速度越高的节点距离权重越大
-          double speedWeight = 1.0 + (it->second.speed / 10.0);
-          double weightedDistance = distance * speedWeight;
-          
-          // 如果节点移动速度很高，增加距离权重
-          if (nodeMobility > 5.0)
-            {
-              // 计算稳定性
-              double stability = CalculateNodeStability(i);
-              // 稳定性低的节点距离权重增加
-              weightedDistance /= std::max(0.2, stability);
-            }
-          
-          if (weightedDistance < minDistance)
-            {
-              minDistance = weightedDistance;
-              nearestId = i;
-            }
-        }
+      nearestId = *nearest;
     }
   
   return nearestId;
@@ -3296,6 +3396,52 @@ NdnApp::GetIpv4FromNodeId(uint32_t nodeId)
   return Ipv4Address::GetAny();
 }
 
+// 新增: 从IP地址获取NodeId
+bool 
+NdnApp::GetNodeIdFromIpv4(Ipv4Address addr, uint32_t &nodeId)
+{
+  auto it = s_addressToNode.find(addr.Get());
+  if (it == s_addressToNode.end())
+    {
+      // 未命中时重建映射 (节点或地址可能在映射建立后才创建)
+      s_addressToNode.clear();
+      for (uint32_t i = 0; i < NodeList::GetNNodes(); i++)
+        {
+          Ptr<Node> node = NodeList::GetNode(i);
+          if (node)
+            {
+              Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+              if (ipv4 && ipv4->GetNInterfaces() > 1)
+                {
+                  // 与原先的线性查找一致, 同一地址取ID最小的节点
+                  s_addressToNode.emplace(ipv4->GetAddress(1, 0).GetLocal().Get(), i);
+                }
+            }
+        }
+      
+      it = s_addressToNode.find(addr.Get());
+      if (it == s_addressToNode.end())
+        {
+          return false;
+        }
+    }
+  
+  nodeId = it->second;
+  return true;
+}
+
+// 新增: 获取通信范围内的节点
+std::vector<uint32_t> 
+NdnApp::GetNodesInRange(double range)
+{
+  if (!s_spatialIndex)
+    {
+      return std::vector<uint32_t> ();
+    }
+  
+  return s_spatialIndex->GetInRange(GetCurrentPosition(), range);
+}
+
 // 新增: 获取节点当前位置
 Vector
 NdnApp::GetCurrentPosition()
@@ -3344,6 +3490,8 @@ int main (int argc, char *argv[])
   cmd.AddValue ("mobility", "Node mobility speed in m/s", nodeMobility);
   cmd.AddValue ("detailLog", "Enable detailed logging", enableDetailedLogging);
   cmd.AddValue ("commRange", "Communication range in meters", communicationRange);
+  cmd.AddValue ("animation", "Write NetAnim XML output", enableAnimation);
+  cmd.AddValue ("resultFile", "Result CSV file, ndn-results-mobility-<speed>.csv if empty", resultFileName);
   cmd.Parse (argc, argv);
   
   // 确保至少有50个节点
@@ -3529,8 +3677,12 @@ int main (int argc, char *argv[])
   FlowMonitorHelper flowmon;
   Ptr<FlowMonitor> monitor = flowmon.InstallAll ();
   
-  // 启用动画
-  AnimationInterface anim ("ndn-interest-simulation.xml");
+  // 启用动画 (批量运行时关闭, 避免写出大量XML)
+  std::unique_ptr<AnimationInterface> anim;
+  if (enableAnimation)
+    {
+      anim = std::make_unique<AnimationInterface> ("ndn-interest-simulation.xml");
+    }
   
   // 运行仿真
   NS_LOG_INFO ("Running simulation for " << simulationTime << " seconds with subscriber mobility speed " << nodeMobility << " m/s");
@@ -3604,7 +3756,8 @@ int main (int argc, char *argv[])
       NS_LOG_INFO ("  Out of Range Failures: " << NdnApp::s_outOfRangeFailures << " times");
       
       // 写入结果到CSV文件 - 包含移动速度信息
-      std::string filename = "ndn-results-mobility-" + std::to_string(int(nodeMobility)) + ".csv";
+      std::string filename = resultFileName.empty() ? "ndn-results-mobility-" + std::to_string(int(nodeMobility)) + ".csv"
+                                                    : resultFileName;
       std::ofstream resultFile;
       resultFile.open (filename.c_str());
       resultFile << "Metric,Value\n";